@@ -13,90 +13,166 @@
 
 #include <iostream>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <functional>
+#include <stdexcept>
 #include<queue>
 using namespace std;
 
-//include the iterator
+//include the iterator, the in-node search kernels and the node pool
 #include "btree_iterator.h"
+#include "btree_search.h"
+#include "btree_pool.h"
+#include "btree_serialize.h"
+#include "btree_parallel.h"
 
 // we do this to avoid compiler errors about non-template friends
 
-template<typename T> class btree;
-template<typename T> std::ostream &operator<<(std::ostream&, const btree<T>&);
+template<typename Params> class btree_base;
+template<typename T, typename Compare = std::less<T>, size_t Fanout = 0,
+         typename Alloc = std::allocator<T> > class btree;
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+std::ostream &operator<<(std::ostream&, const btree<T, Compare, Fanout, Alloc>&);
+
+// stands in for the value array of trees that only hold keys.
+struct btree_no_mapped{};
+
+// true when Compare declares is_transparent, i.e. can compare keys with other types.
+template<typename Compare, typename = void>
+struct btree_is_transparent : std::false_type{};
+template<typename Compare>
+struct btree_is_transparent<Compare, std::void_t<typename Compare::is_transparent> >
+	: std::true_type{};
+
+// type accepted by the lookup functions: any K for a transparent
+// comparator (deduced), otherwise the key type itself.
+template<bool Transparent> struct btree_key_arg{
+	template<typename K, typename Key> using type = Key;
+};
+template<> struct btree_key_arg<true>{
+	template<typename K, typename Key> using type = K;
+};
+
+// policy for btree: the element is its own key and nothing is mapped.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+struct btree_set_params{
+	typedef T key_type;
+	typedef T value_type;
+	typedef T init_type;
+	typedef btree_no_mapped mapped_storage;
+	typedef Compare key_compare;
+	typedef Alloc allocator_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+
+	static constexpr bool multi = false;
+	static constexpr bool has_mapped = false;
+	static constexpr size_t fanout = Fanout;
+
+	static const T& key(const T& value){ return value; }
+};
 
-template <typename T> 
-class btree {
+/**
+ * The node engine shared by btree and btree_map / btree_multimap
+ * (btree_map.h). Params names the key, the mapped value kept beside it
+ * (if any), the comparator, the allocator, whether equal keys may
+ * repeat and the node width (fanout, 0 when it is chosen at run time);
+ * everything else -- node layout, search, insert, erase, bulk load,
+ * copying and iteration -- is written once here.
+ */
+template <typename Params>
+class btree_base {
  public:
+	typedef typename Params::key_type key_type;
+	typedef typename Params::value_type value_type;
+	typedef typename Params::mapped_storage mapped_storage;
+	typedef typename Params::key_compare key_compare;
+	typedef typename Params::allocator_type allocator_type;
+	typedef typename Params::reference reference;
+	typedef typename Params::const_reference const_reference;
+	typedef typename Params::pointer pointer;
+	typedef typename Params::const_pointer const_pointer;
+
+	static constexpr bool multi = Params::multi;
+	static constexpr bool has_mapped = Params::has_mapped;
+	static constexpr size_t fanout = Params::fanout;
+
+	static_assert(fanout == 0 || fanout >= 3, "a fixed btree fanout must be at least 3");
+
   /** Iterator typedefs here **/
 
-	friend class btree_iterator<T>;
-	friend class const_btree_iterator<T>;
-	typedef btree_iterator<T> iterator;
-	typedef const_btree_iterator<T> const_iterator;
+	friend class btree_iterator<btree_base>;
+	friend class const_btree_iterator<btree_base>;
+	typedef btree_iterator<btree_base> iterator;
+	typedef const_btree_iterator<btree_base> const_iterator;
 	typedef std::reverse_iterator<iterator> reverse_iterator;
 	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
- 
+
+	template<typename K>
+	using key_arg = typename btree_key_arg<btree_is_transparent<key_compare>::value>::template type<K, key_type>;
+
   /**
-   * btree constructor: @param maxNodeElems the maximum number of elements
-   *        that can be stored in each B-Tree node
+   * @param maxNodeElems the maximum number of keys per node (at least 3);
+   *        ignored when Params fixes the fanout
+   * @param comp the ordering of the keys
+   * @param alloc the allocator the node pools take their chunks from
    */
-  btree(size_t maxNodeElems = 40);
-  
-  /** 
+  btree_base(size_t maxNodeElems, const key_compare& comp, const allocator_type& alloc);
+
+  /**
    * Copy constructor
-   * Creates a new B-Tree as a copy of original.
+   * Creates a new B-Tree as a copy of original, cloning it node for
+   * node in O(n) so the copy has the same shape.
    *
    * @param original a const lvalue reference to a B-Tree object
    */
-  btree(const btree<T>& original);
+  btree_base(const btree_base& original);
 
-  /** 
+  /**
    * Move constructor
    * Creates a new B-Tree by "stealing" from original.
    * @param original an rvalue reference to a B-Tree object
    */
-  btree(btree<T>&& original);
-    
-  /** 
+  btree_base(btree_base&& original);
+
+  /**
    * Copy assignment
-   * Replaces the contents of this object with a copy of rhs.
+   * Replaces the contents of this object with a copy of rhs. The copy is
+   * built before the old tree is released, so if copying an element
+   * throws this object is left unchanged.
    * @param rhs a const lvalue reference to a B-Tree object
    */
-  btree<T>& operator=(const btree<T>& rhs);
+  btree_base& operator=(const btree_base& rhs);
 
-  /** 
+  /**
    * Move assignment
    * Replaces the contents of this object with the "stolen"
    * contents of original.
    *
    * @param rhs a const reference to a B-Tree object
    */
-  btree<T>& operator=(btree<T>&& rhs);
-
-  /**
-   * Puts a breadth-first traversal of the B-Tree onto the output
-   * stream os. Elements supports the output operator.
-   * Elements are separated by space.
-   * @param os a reference to a C++ output stream
-   * @param tree a const reference to a B-Tree object
-   * @return a reference to os
-   */
-  friend std::ostream& operator<< <T> (std::ostream& os, const btree<T>& tree);
+  btree_base& operator=(btree_base&& rhs);
 
   /**
    * The following are iterator functions
-   * -- begin() 
-   * -- end() 
-   * -- rbegin() 
-   * -- rend() 
-   * -- cbegin() 
-   * -- cend() 
-   * -- crbegin() 
-   * -- crend() 
-   */ 
+   * -- begin()
+   * -- end()
+   * -- rbegin()
+   * -- rend()
+   * -- cbegin()
+   * -- cend()
+   * -- crbegin()
+   * -- crend()
+   */
 	iterator begin() const;
 	iterator end() 	const;
 	const_iterator cbegin() const;
@@ -105,489 +181,3128 @@ class btree {
 	reverse_iterator rend() const;
 	const_reverse_iterator crbegin() const;
 	const_reverse_iterator crend() const;
+
+  /**
+    * The lookups below take a key_type, or anything the comparator can
+    * order against the keys when it is transparent (declares
+    * is_transparent, like std::less<>), so e.g. std::string keys can be
+    * found by std::string_view without building a string.
+    */
+
   /**
-    * Returns an iterator to the matching element, or whatever 
-    * the non-const end() returns if the element could 
-    * not be found.  
+    * Returns an iterator to the matching element (the first of them when
+    * keys repeat), or whatever the non-const end() returns if the
+    * element could not be found.
     */
-  iterator find(const T& elem);
-    
+  template<typename K = key_type>
+  iterator find(const key_arg<K>& key);
+
   /**
-    * @param elem the client element we are trying to match.
+    * @param key the key we are trying to match.
     * @return an iterator to the matching element, or whatever the
     *         const end() returns if no such match was ever found.
     */
-  const_iterator find(const T& elem) const;
-      
+  template<typename K = key_type>
+  const_iterator find(const key_arg<K>& key) const;
+
+  /**
+    * @return an iterator to the first element not less than key, or end().
+    */
+  template<typename K = key_type>
+  iterator lower_bound(const key_arg<K>& key);
+  template<typename K = key_type>
+  const_iterator lower_bound(const key_arg<K>& key) const;
+
   /**
-    * @param elem the element to be inserted.
-    * @return a pair whose first field is an iterator positioned at
-    *         the matching element in the btree, and whose second field 
-    *         stores true if and only if the element needed to be added 
-    *         because no matching element was there prior to the insert call.
+    * @return an iterator to the first element greater than key, or end().
     */
-  std::pair<iterator, bool> insert(const T& elem);
+  template<typename K = key_type>
+  iterator upper_bound(const key_arg<K>& key);
+  template<typename K = key_type>
+  const_iterator upper_bound(const key_arg<K>& key) const;
+
+  /**
+    * @return the pair (lower_bound(key), upper_bound(key)).
+    */
+  template<typename K = key_type>
+  std::pair<iterator, iterator> equal_range(const key_arg<K>& key);
+  template<typename K = key_type>
+  std::pair<const_iterator, const_iterator> equal_range(const key_arg<K>& key) const;
+
+  /**
+    * @return the number of elements matching key (0 or 1 unless keys repeat).
+    */
+  template<typename K = key_type>
+  size_t count(const key_arg<K>& key) const;
+
+  /**
+    * Looks up keys[0, n) and stores find(keys[i]) in out[i]. Rather than
+    * paying each lookup's chain of cache misses in turn, several descents
+    * are interleaved, prefetching the next node of each while the others
+    * are searched. When the batch is sorted by the comparator, lookups
+    * also share path prefixes: each one climbs from where the previous
+    * one ended only as far as the two paths differ.
+    */
+  void find_batch(const key_type *keys, size_t n, iterator *out);
+  void find_batch(const key_type *keys, size_t n, const_iterator *out) const;
+
+  /**
+    * @return the number of elements in the tree.
+    */
+  size_t size() const;
+
+  /**
+    * @return whether the tree holds no elements.
+    */
+  bool empty() const;
+
+  /**
+    * The order statistics below run in O(log n) node visits: every
+    * internal node keeps the element count of each of its subtrees next
+    * to the child pointers, so a descent can skip whole subtrees by
+    * count, the way a search skips them by key.
+    */
+
+  /**
+    * @return the number of elements ordered before key, which is the
+    *         index lower_bound(key) is at.
+    */
+  template<typename K = key_type>
+  size_t rank(const key_arg<K>& key) const;
+
+  /**
+    * @return the element at index k of the sorted order.
+    * @throws std::out_of_range if k >= size()
+    */
+  const_reference select(size_t k) const;
+
+  /**
+    * @return an iterator to the element at index k of the sorted order,
+    *         or end() when k >= size().
+    */
+  iterator nth(size_t k) const;
+
+  /**
+    * @return the index of the element at pos, or size() for end().
+    */
+  size_t index_of(const_iterator pos) const;
+
+  /**
+    * Calls fn(const_reference) on every element whose key k has
+    * lo <= k < hi, in order. The tree is descended once to lo and the
+    * matching elements are then streamed straight out of the nodes, a
+    * leaf at a time, without building an iterator per element. If fn
+    * returns bool, returning false stops the scan early.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(const key_type& lo, const key_type& hi, Fn fn) const;
+
+  /**
+    * The parallel walks below run on up to threads threads (0 for one
+    * per hardware thread). The tree is cut at node boundaries into
+    * subtrees handed to a work-stealing pool (btree_parallel.h); a
+    * subtree holding many elements is cut again into its children, so
+    * a thread that runs out of work steals a large piece of another's.
+    * The callbacks run concurrently and in no particular order, and the
+    * tree must not be modified meanwhile.
+    */
+
+  /**
+    * Calls fn(const_reference) once for every element; what fn returns
+    * is ignored.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t parallel_for_each(Fn fn, size_t threads = 0) const;
+
+  /**
+    * parallel_for_each over the elements whose key k has lo <= k < hi.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t parallel_scan(const key_type& lo, const key_type& hi, Fn fn, size_t threads = 0) const;
+
+  /**
+    * Every thread folds the elements it visits into an accumulator of
+    * its own, starting from a copy of init, with acc = fold(acc, elem);
+    * the accumulators are then folded together with combine(acc, acc).
+    * init must be an identity of combine, and neither may depend on the
+    * order elements arrive in.
+    * @return the combined accumulator.
+    */
+  template<typename R, typename Fold, typename Combine>
+  R parallel_reduce(R init, Fold fold, Combine combine, size_t threads = 0) const;
+
+  /**
+    * parallel_reduce over the elements whose key k has lo <= k < hi.
+    */
+  template<typename R, typename Fold, typename Combine>
+  R parallel_reduce(const key_type& lo, const key_type& hi, R init, Fold fold, Combine combine, size_t threads = 0) const;
+
+  /**
+    * Replaces the contents of the tree with the elements of [first, last).
+    * Ordered input from a forward iterator (strictly increasing keys, or
+    * non-decreasing when keys repeat) is streamed straight into packed
+    * nodes in O(n); anything else is buffered and stable-sorted once,
+    * keeping the first of equal keys unless keys may repeat. Nodes are
+    * built bottom-up with evenly spread occupancy, so every level is
+    * filled in a single pass.
+    * @param fillFactor the fraction (0, 1] of each node to fill, leaving
+    *        room for later inserts; it never drops below half full.
+    */
+  template<typename InputIt>
+  void bulk_load(InputIt first, InputIt last, double fillFactor = 1.0);
+
+  /**
+    * The parallel operations below split their work over threads
+    * threads (0 for one per hardware thread; btree_parallel.h). Each one
+    * ends by building the new contents into fresh nodes with the same
+    * shape bulk_load gives them, and only then swaps them in. All the
+    * nodes are taken from the pools up front, so the threads fill
+    * disjoint nodes without sharing the pools.
+    */
+
+  /**
+    * bulk_load, in parallel: unsorted input is buffered and stable-sorted
+    * across the threads (keeping the first of equal keys unless keys may
+    * repeat), and every node is then filled in parallel.
+    */
+  template<typename InputIt>
+  void bulk_load_parallel(InputIt first, InputIt last, size_t threads = 0, double fillFactor = 1.0);
+
+  /**
+    * Moves every element of other into this tree, which becomes their
+    * union, and leaves other empty. Where keys are unique an element of
+    * other whose key is already here is dropped; where they may repeat
+    * all are kept, those of this tree first. Runs in O(n + m): both trees
+    * are cut into key ranges that are merged side by side, and the
+    * result is bulk built. If an exception is thrown this tree is
+    * unchanged, while elements of other may have been moved from.
+    */
+  void merge(btree_base&& other, size_t threads = 0);
+
+  /**
+    * Make this tree the union, intersection or difference (this minus
+    * other) of itself and other, in O(n + m) like merge. Elements are
+    * copied from other, which is left as it was. With repeated keys the
+    * counts follow std::set_union, std::set_intersection and
+    * std::set_difference. If an exception is thrown this tree is
+    * unchanged.
+    */
+  void set_union(const btree_base& other, size_t threads = 0);
+  void set_intersection(const btree_base& other, size_t threads = 0);
+  void set_difference(const btree_base& other, size_t threads = 0);
+
+  /**
+    * Writes a binary snapshot of the tree (btree_serialize.h) to os.
+    * Keys and mapped values must be trivially copyable; the comparator
+    * is not saved, so the snapshot must be loaded with the same ordering.
+    * @throws std::runtime_error if the stream fails, or if the nodes
+    *         are wider than btree_snapshot_max_width
+    */
+  void serialize(std::ostream& os) const;
+
+  /**
+    * @return the number of bytes serialize writes for the tree as it is now.
+    */
+  size_t serialized_size() const;
+
+  /**
+    * Writes the snapshot into out[0, capacity).
+    * @return the number of bytes written.
+    * @throws std::length_error if it needs more than capacity bytes
+    */
+  size_t serialize(std::byte *out, size_t capacity) const;
+
+  /**
+    * Replaces the contents of the tree with a snapshot read from is,
+    * rebuilding its nodes in the saved shape with one copy per node
+    * rather than inserting element by element. A tree whose width is
+    * chosen at run time takes the snapshot's width; one with a fixed
+    * fanout only loads snapshots of that fanout. The snapshot's shape
+    * is checked as it is read, and on any error the tree is left as it
+    * was.
+    * @throws std::runtime_error if the input is not a snapshot of a
+    *         tree of this type, or is truncated or malformed
+    */
+  void deserialize(std::istream& is);
+
+  /**
+    * As deserialize(std::istream&), reading the snapshot from data[0, size).
+    * @return the number of bytes the snapshot took up.
+    */
+  size_t deserialize(const std::byte *data, size_t size);
+
+#ifdef BTREE_HAS_SPAN
+  size_t serialize(std::span<std::byte> out) const{ return serialize(out.data(), out.size()); }
+  size_t deserialize(std::span<const std::byte> data){ return deserialize(data.data(), data.size()); }
+#endif
+
+  /**
+    * Removes every element and releases all nodes.
+    */
+  void clear();
+
+  /**
+    * Exchanges the contents (and node pools) of this tree and other.
+    */
+  void swap(btree_base& other) noexcept;
+
+  /**
+    * @return a copy of the allocator the node pools were built with.
+    */
+  allocator_type get_allocator() const;
+
+  /**
+    * @return a copy of the key comparator.
+    */
+  key_compare key_comp() const;
+
+  /**
+    * Removes the elements matching key, if any. Nodes that fall below
+    * half full borrow from a sibling or merge with it, and nodes that
+    * become empty are released.
+    * @return the number of elements removed.
+    */
+  size_t erase(const key_type& key);
+
+  /**
+    * Removes the element at pos, which must be dereferenceable.
+    * @return an iterator to the element that followed the erased one,
+    *         or end(). Other iterators into the tree are invalidated.
+    */
+  iterator erase(const_iterator pos);
+
+  /**
+    * Removes the elements in [first, last).
+    * @return an iterator to the element last referred to, or end().
+    */
+  iterator erase(const_iterator first, const_iterator last);
 
   /**
     * Destructor implentation to check that implementation does not leak memory!
     */
-  ~btree();
-  
+  ~btree_base();
+
 public:
-  // The Node class, it's constructors.
+  // The Node class. Keys, mapped values, child pointers, the parent link
+  // and the counts live in a single cache-line aligned block sized from
+  // capacity(): the header below is followed by room for capacity()
+  // keys, then (for maps only) capacity() mapped values and, for
+  // internal nodes only, capacity() + 1 child pointers and as many
+  // subtree element counts, count i belonging to child i. Searching a node
+  // reads only its key array, a lookup touches one allocation per level
+  // and leaves carry no child array. With a fixed fanout the capacity,
+  // and so every offset, is a compile-time constant.
   class Node{
 
 	  public:
-	  	  std::vector<T> *vNodeElement;
 	  	  Node *pNode_n;
-	  	  std::vector<Node*> *children;
 	  	  size_t maxNElems_b;
-	  	  size_t num_element =0;
+	  	  size_t num_element;
 	  	  size_t childno;
+	  	  bool leaf;
+
+	  	  static constexpr size_t cacheLine = 64;
 
-	  	  Node(const T& e_Value, size_t maxNElems_b_ =40, Node *pNode_ = nullptr){
+	  	  // constructs an empty node in block; all child slots of an internal node start out null.
+	  	  static Node* create(void *block, size_t maxNElems_b_, Node *pNode_, bool leaf_);
 
-	  		vNodeElement = new std::vector<T>;
-	  		vNodeElement->push_back(e_Value);
-	  		++num_element;
-	  		childno =0;
-	  		pNode_n = pNode_;
-	  		children = new std::vector<Node*>;
-	  		maxNElems_b = maxNElems_b_;
-	  		std::sort(vNodeElement->begin(), vNodeElement->end());
+	  	  // destroys the stored elements and the header; the block itself is the caller's.
+	  	  static void destroy(Node *node);
+
+	  	  size_t capacity() const{
+	  		  return fanout != 0 ? fanout : maxNElems_b;
 	  	  }
 
-	  	  Node( size_t maxNElems_b_ =40, Node *pNode_ = nullptr){
+	  	  key_type* elements(){
+	  		  return reinterpret_cast<key_type*>(reinterpret_cast<char*>(this) + elementOffset());
+	  	  }
+	  	  const key_type* elements() const{
+	  		  return reinterpret_cast<const key_type*>(reinterpret_cast<const char*>(this) + elementOffset());
+	  	  }
+	  	  mapped_storage* mappedValues(){
+	  		  return reinterpret_cast<mapped_storage*>(reinterpret_cast<char*>(this) + mappedOffset(capacity()));
+	  	  }
+	  	  const mapped_storage* mappedValues() const{
+	  		  return reinterpret_cast<const mapped_storage*>(reinterpret_cast<const char*>(this) + mappedOffset(capacity()));
+	  	  }
+	  	  Node** children(){
+	  		  return reinterpret_cast<Node**>(reinterpret_cast<char*>(this) + childOffset(capacity()));
+	  	  }
+	  	  Node* const* children() const{
+	  		  return reinterpret_cast<Node* const*>(reinterpret_cast<const char*>(this) + childOffset(capacity()));
+	  	  }
 
-	  		vNodeElement = new std::vector<T>;
-	  		num_element =0;
-	  		childno =0;
-	  		pNode_n = pNode_;
-	  		children = new std::vector<Node*>;
-	  		maxNElems_b = maxNElems_b_;
+	  	  key_type& element(size_t i){ return elements()[i]; }
+	  	  const key_type& element(size_t i) const{ return elements()[i]; }
+	  	  mapped_storage& mapped(size_t i){ return mappedValues()[i]; }
+	  	  const mapped_storage& mapped(size_t i) const{ return mappedValues()[i]; }
+	  	  Node*& child(size_t i){ return children()[i]; }
+	  	  Node* child(size_t i) const{ return children()[i]; }
+	  	  size_t* subtreeCounts(){
+	  		  return reinterpret_cast<size_t*>(reinterpret_cast<char*>(this) + countOffset(capacity()));
+	  	  }
+	  	  const size_t* subtreeCounts() const{
+	  		  return reinterpret_cast<const size_t*>(reinterpret_cast<const char*>(this) + countOffset(capacity()));
 	  	  }
+	  	  size_t& subtreeCount(size_t i){ return subtreeCounts()[i]; }
+	  	  size_t subtreeCount(size_t i) const{ return subtreeCounts()[i]; }
 
-	  	  ~Node(){
+	  	  bool hasChildren() const{ return !leaf; }
 
-	  		  delete vNodeElement;
-	  		  delete children;
+	  	  // layout of the block: [header | keys | mapped | children | counts], rounded up to a cache line.
+	  	  static_assert(alignof(key_type) <= cacheLine, "btree elements must fit the node pool's cache line alignment");
+	  	  static_assert(alignof(mapped_storage) <= cacheLine, "btree values must fit the node pool's cache line alignment");
+	  	  static size_t elementOffset(){
+	  		  return roundUp(sizeof(Node), alignof(key_type));
+	  	  }
+	  	  static size_t mappedOffset(size_t maxNElems_b_){
+	  		  return roundUp(elementOffset() + maxNElems_b_ * sizeof(key_type), alignof(mapped_storage));
+	  	  }
+	  	  static size_t slotsEnd(size_t maxNElems_b_){
+	  		  if (has_mapped){
+	  			  return mappedOffset(maxNElems_b_) + maxNElems_b_ * sizeof(mapped_storage);
+	  		  }
+	  		  return elementOffset() + maxNElems_b_ * sizeof(key_type);
+	  	  }
+	  	  static size_t childOffset(size_t maxNElems_b_){
+	  		  return roundUp(slotsEnd(maxNElems_b_), alignof(Node*));
+	  	  }
+	  	  static size_t countOffset(size_t maxNElems_b_){
+	  		  return roundUp(childOffset(maxNElems_b_) + (maxNElems_b_ + 1) * sizeof(Node*), alignof(size_t));
+	  	  }
+	  	  static size_t blockSize(size_t maxNElems_b_, bool leaf_){
+	  		  if (leaf_){
+	  			  return roundUp(slotsEnd(maxNElems_b_), cacheLine);
+	  		  }
+	  		  return roundUp(countOffset(maxNElems_b_) + (maxNElems_b_ + 1) * sizeof(size_t), cacheLine);
 	  	  }
 
-	  	  // = operator overloading for Node.
-	  	  Node& operator=(const Node &r_value_){
+	  private:
+	  	  Node(size_t maxNElems_b_, Node *pNode_, bool leaf_):
+	  		  pNode_n(pNode_), maxNElems_b(maxNElems_b_), num_element(0), childno(0), leaf(leaf_){}
+	  	  ~Node(){}
+	  	  Node(const Node&) = delete;
+	  	  Node& operator=(const Node&) = delete;
 
-	  		if (this != & r_value_){
-	  		vNodeElement = r_value_.vNodeElement;
-	  		num_element = r_value_.num_element;
-	  		pNode_n = r_value_.pNode_n;
-	  		children = r_value_.children;
-	  		maxNElems_b = r_value_.maxNElems_b;}
-	  		return *this;
+	  	  static size_t roundUp(size_t n, size_t a){
+	  		  return (n + a - 1) / a * a;
 	  	  }
   };
 
+  // what an iterator at slot i of node yields: the element itself, or a
+  // (key, value) pair of references for maps.
+  static reference elementAt(Node *node, size_t i){
+	  if constexpr (has_mapped){
+		  return reference(node->element(i), node->mapped(i));
+	  }
+	  else{
+		  return node->element(i);
+	  }
+  }
+  static const_reference elementAt(const Node *node, size_t i){
+	  if constexpr (has_mapped){
+		  return const_reference(node->element(i), node->mapped(i));
+	  }
+	  else{
+		  return node->element(i);
+	  }
+  }
+  static pointer addressAt(Node *node, size_t i){
+	  if constexpr (has_mapped){
+		  return pointer{elementAt(node, i)};
+	  }
+	  else{
+		  return &node->element(i);
+	  }
+  }
+  static const_pointer addressAt(const Node *node, size_t i){
+	  if constexpr (has_mapped){
+		  return const_pointer{elementAt(node, i)};
+	  }
+	  else{
+		  return &node->element(i);
+	  }
+  }
+
 public:
   Node *baseNode;
   Node *firstNode;
   Node *lastNode;
   size_t maxNodeElems_t;
   size_t btree_size;
-};
-
-//btree constructor.
-template<typename T>
-btree<T>::btree(size_t maxNodeElems_){
 
-	baseNode = nullptr;
-	firstNode = nullptr;
-	lastNode=nullptr;
-	maxNodeElems_t = maxNodeElems_;
-	btree_size =0;
-}
+protected:
+  // single descent shared by every unique insert: returns the match if
+  // key is present, otherwise builds the slot from key and mapped (only
+  // now, once it is known to be free) and inserts it.
+  template<typename KeyArg, typename... MappedArgs>
+  std::pair<iterator, bool> insertUnique(KeyArg &&key, MappedArgs&&... mapped);
+
+  // insertUnique for ascending runs: when key is not less than the
+  // element at hint, the descent starts from the lowest ancestor of
+  // hint's node whose subtree can hold key instead of from the root.
+  template<typename KeyArg, typename... MappedArgs>
+  std::pair<iterator, bool> insertUniqueAfter(const_iterator hint, KeyArg &&key, MappedArgs&&... mapped);
+
+  // insert for trees whose keys may repeat: the new slot goes after
+  // every element with an equal key.
+  template<typename KeyArg, typename... MappedArgs>
+  iterator insertMulti(KeyArg &&key, MappedArgs&&... mapped);
+
+  // the comparator, wrapped so the node searches can use it three-way.
+  btree_key_compare<key_compare, key_type> compare_t;
+
+private:
+  // the descent of insertUnique, from node down.
+  template<typename KeyArg, typename... MappedArgs>
+  std::pair<iterator, bool> insertUniqueFrom(Node *node, KeyArg &&key, MappedArgs&&... mapped);
+
+  // puts the slot at pos of leaf node (creating the root for an empty
+  // tree) and splits full nodes on the way back up.
+  iterator insertLeaf(Node *node, size_t pos, key_type &&value, mapped_storage &&mappedValue);
+
+  // inserts a slot at pos in a node with room, linking rightChild after it.
+  void insertAt(Node *node, size_t pos, key_type &&value, mapped_storage &&mappedValue, Node *rightChild);
+
+  // splits node around index k into node and a new right sibling.
+  Node* splitNode(Node *node, size_t k);
+
+  // returns a node holding key and its index in pos, or nullptr.
+  template<typename K>
+  Node* locate(const K& key, size_t &pos) const;
+
+  // returns the node holding the first element not less than key, or nullptr.
+  template<typename K>
+  Node* lowerBoundNode(const K& key, size_t &pos) const;
+
+  // lowerBoundNode from node down, with (candidate, candidatePos) the
+  // answer should node's subtree hold nothing not less than key; stop
+  // receives the node the descent ended in.
+  template<typename K>
+  Node* lowerBoundFrom(Node *node, Node *candidate, size_t candidatePos, const K& key,
+		  size_t &pos, Node *&stop) const;
+
+  // climbs from node, where the search for a key not greater than key
+  // ended, to the lowest ancestor whose subtree bounds key from above;
+  // (candidate, candidatePos) receives that upper bound, if there is one.
+  template<typename K>
+  Node* climbFor(Node *node, const K& key, Node *&candidate, size_t &candidatePos) const;
+
+  // shared by both find_batch overloads: emit(i, node, pos) receives the
+  // match for keys[i], node being nullptr when there is none.
+  template<typename Emit>
+  void findBatch(const key_type *keys, size_t n, Emit emit) const;
+
+  // pulls the key array of node towards the cache ahead of its search.
+  void prefetchNode(const Node *node) const;
+
+  // descents find_batch keeps in flight at once.
+  static constexpr size_t batchLanes = 8;
+
+  // returns the node holding the first element greater than key, or nullptr.
+  template<typename K>
+  Node* upperBoundNode(const K& key, size_t &pos) const;
+
+  // in-order walk of node's subtree for scan; lo only bounds the leftmost path.
+  // returns false once hi is reached or fn asked to stop.
+  template<typename Fn>
+  bool scanSubtree(const Node *node, const key_type *lo, const key_type& hi, Fn &fn, size_t &visited) const;
+
+  // a subtree of a parallel walk, with the bounds that still apply to it
+  // (nullptr once the whole subtree is inside the range).
+  struct WalkTask{
+	  const Node *node;
+	  const key_type *lo;
+	  const key_type *hi;
+  };
 
-//btree destructor
-template<typename T>
-btree<T>::~btree(){
+  // the walk behind the parallel members: visit(worker, elem) is called
+  // for the elements in [lo, hi) (unbounded on a side given nullptr)
+  // on workers threads. Returns the elements visited.
+  template<typename Visit>
+  size_t parallelWalk(const key_type *lo, const key_type *hi, size_t workers, Visit &visit) const;
 
-	delete baseNode;
-}
+  // the part of a walk that one thread does alone: all of node's subtree within the bounds.
+  template<typename Visit>
+  void walkSubtree(const Node *node, const key_type *lo, const key_type *hi, size_t worker,
+		  Visit &visit, size_t &visited) const;
 
-//btree iterator
-template<typename T>
-std::pair<typename btree<T>::iterator, bool> btree<T>::insert(const T &elem){
+  // removes the element at pos of node and restores the node fill invariants.
+  void eraseAt(Node *node, size_t pos);
 
-	if (baseNode == nullptr){
-		baseNode = new Node(elem);
-		firstNode = baseNode;
-		lastNode = baseNode;
-		baseNode->maxNElems_b = maxNodeElems_t;
-		btree_size=1;
-		return std::make_pair(iterator(baseNode, 0, this), true);
-	}
+  // removes element pos (and, for internal nodes, child pos + 1) from node.
+  void removeAt(Node *node, size_t pos);
 
-	auto findResult = find(elem);
+  // refills node after an erase left it below minElems().
+  void rebalance(Node *node);
 
-	if(&(*findResult.pNode)==nullptr){
-		// do nothing
-}
-	else{
-		return std::make_pair(findResult, false);
-	}
+  // moves one element through the parent from node's left/right sibling.
+  void borrowFromLeft(Node *node, Node *left);
+  void borrowFromRight(Node *node, Node *right);
 
-	if ((baseNode->num_element) < maxNodeElems_t){
+  // appends the separator and all of right to left, then frees right.
+  void mergeNodes(Node *left, Node *right);
 
-		baseNode->vNodeElement->push_back(elem);
-		++baseNode->num_element;
-		std::sort(baseNode->vNodeElement->begin(), baseNode->vNodeElement->end());
+  // the elements in node's subtree: its own plus its subtree counts.
+  static size_t subtreeSize(const Node *node);
 
-		return std::make_pair(iterator(baseNode, 0, this), true); //***** delete it
+  // adds delta (+1 or -1) to the subtree counts on the path above node.
+  static void countPath(Node *node, ptrdiff_t delta);
 
+  // the node and slot of the element at index k, or nullptr when k >= size().
+  Node* nodeAt(size_t k, size_t &pos) const;
 
-	}
+  // the index of the element at slot pos of node; size() for nullptr.
+  size_t indexOf(const Node *node, size_t pos) const;
 
-	Node *tempNode= baseNode;
-	while(true){
+  // moves (node, pos) n elements on (back, when n < 0); the iterators' += and -=.
+  void advance(Node *&node, size_t &pos, ptrdiff_t n) const;
 
-		if (tempNode->children->empty()){
+  // the most elements a node holds; a constant when the fanout is fixed.
+  size_t nodeWidth() const{ return fanout != 0 ? fanout : maxNodeElems_t; }
 
-			for (size_t i =0; i<=maxNodeElems_t; ++i){
+  // the fill every node other than the root is kept at after an erase.
+  size_t minElems() const{ return nodeWidth() / 2; }
 
-				Node *NewNode = new Node(maxNodeElems_t,tempNode);
-				NewNode->childno =i;
-				lastNode = NewNode;
-				tempNode->children->push_back(NewNode);
+  // slot primitives: each one applies to the key array and, when the
+  // tree maps values, to the value array alongside it. Counts are left
+  // to the caller.
 
-			}
+  // constructs slot i of node from key and mapped.
+  template<typename KeyArg, typename... MappedArgs>
+  static void emplaceSlot(Node *node, size_t i, KeyArg &&key, MappedArgs&&... mapped);
 
-			for(size_t i=0; i<=maxNodeElems_t; ++i){
+  // constructs slot i of node from an element, as stored by bulk_load.
+  template<typename V>
+  static void emplaceElement(Node *node, size_t i, V &&elem);
 
-				if(i == maxNodeElems_t){
-					tempNode->children->at(i)->vNodeElement->push_back(elem);
-					++tempNode->children->at(i)->num_element;
-					std::sort(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end());
-					auto ind = std::find(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end(), elem );
-					auto pos = std::distance(tempNode->children->at(i)->vNodeElement->begin(),ind);
-					return std::make_pair(iterator(tempNode->children->at(i), size_t(pos), this), true);
+  // copy or move constructs slot i of dst from slot j of src.
+  static void copySlot(Node *dst, size_t i, const Node *src, size_t j);
+  static void moveSlot(Node *dst, size_t i, Node *src, size_t j);
 
-				}
+  // move assigns slot j of src to slot i of dst.
+  static void assignSlot(Node *dst, size_t i, Node *src, size_t j);
 
-				if(elem < tempNode->vNodeElement->at(i)){
-					tempNode->children->at(i)->vNodeElement->push_back(elem);
-					++tempNode->children->at(i)->num_element;
-					std::sort(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end());
-					auto ind = std::find(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end(), elem );
-					auto pos = std::distance(tempNode->children->at(i)->vNodeElement->begin(),ind);
-					return std::make_pair(iterator(tempNode->children->at(i), size_t(pos), this), true);//******implement find as sorted i is changed.
-				}
+  // moves count slots of src from j on into fresh slots of dst from i on, destroying the originals.
+  static void relocateSlots(Node *dst, size_t i, Node *src, size_t j, size_t count);
 
-			}
+  // opens a slot at pos (shifting later ones right) and moves key and mapped into it.
+  static void insertSlot(Node *node, size_t pos, key_type &&key, mapped_storage &&mapped);
 
-		}
+  // closes slot pos, shifting later ones left and destroying the last.
+  static void eraseSlot(Node *node, size_t pos);
 
-		else{
+  static void destroySlot(Node *node, size_t i);
 
-			for(size_t i=0; i<=maxNodeElems_t; ++i){
+  // moves the mapped value out of slot i; sets have nothing to move.
+  static mapped_storage takeMapped(Node *node, size_t i);
 
-				if(i == maxNodeElems_t){
+  template<typename U>
+  static void arrayInsert(U *a, size_t n, size_t pos, U &&value);
+  template<typename U>
+  static void arrayErase(U *a, size_t n, size_t pos);
 
-					if (tempNode->children->at(i)->vNodeElement->size()<maxNodeElems_t){
-						tempNode->children->at(i)->vNodeElement->push_back(elem);
-						++tempNode->children->at(i)->num_element;
-						std::sort(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end());
-						auto ind = std::find(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end(), elem );
-						auto pos = std::distance(tempNode->children->at(i)->vNodeElement->begin(),ind);
-						return std::make_pair(iterator(tempNode->children->at(i), size_t(pos), this), true);//******implement find as sorted i is changed.
-					}
+  // takes a node block from the matching pool and constructs an empty node in it.
+  Node* newNode(Node *parent, bool leaf);
 
-					else{
-						tempNode = tempNode->children->at(i);
-						break;
-					}
-				}
+  // destroys node's elements and hands its block back to the pool.
+  void deleteNode(Node *node);
 
-				else{
-					if(elem < tempNode->vNodeElement->at(i)){
-						if (tempNode->children->at(i)->vNodeElement->size()<maxNodeElems_t){
-							tempNode->children->at(i)->vNodeElement->push_back(elem);
-							++tempNode->children->at(i)->num_element;
-							std::sort(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end());
-							auto ind = std::find(tempNode->children->at(i)->vNodeElement->begin(), tempNode->children->at(i)->vNodeElement->end(), elem );
-							auto pos = std::distance(tempNode->children->at(i)->vNodeElement->begin(),ind);
-							return std::make_pair(iterator(tempNode->children->at(i),size_t(pos), this), true);
-						}
-						else{
-							tempNode = tempNode->children->at(i);
-							break;
-						}
-					}
-					else{
-						continue;
-					}
-				}
-			}
-		}
-	}
-}
+  // releases node and every node below it.
+  void freeSubtree(Node *node);
 
-// btree iterators begin
-template<typename T> typename btree<T>::iterator
-btree<T>::begin() const {
-	return iterator(baseNode, 0, this);
-}
+  // destroys every element below node without returning any blocks.
+  static void destroyElements(Node *node);
 
-// btree iterators end
-template<typename T> typename btree<T>::iterator
-btree<T>::end() const {
-	return iterator(nullptr, 0, this);
-}
-// btree iterators cbegin
-template<typename T>
-typename btree<T>::const_iterator btree<T>::cbegin() const {
-	return const_iterator(begin());
-}
+  // drops the whole tree: elements are destroyed (when they need it) and
+  // the pools return their chunks, without visiting nodes one by one.
+  void releaseNodes();
 
-// btree iterators cend
-template<typename T>
-typename btree<T>::const_iterator btree<T>::cend() const {
-	return const_iterator(end());
-}
-// btree iterators rbegin
-template<typename T>
-typename btree<T>::reverse_iterator btree<T>::rbegin() const {
-	return reverse_iterator(end());
-}
-// btree iterators rend
-template<typename T>
-typename btree<T>::reverse_iterator btree<T>::rend() const {
-	return reverse_iterator(begin());
-}
-// btree iterators crbegin
-template<typename T>
-typename btree<T>::const_reverse_iterator btree<T>::crbegin() const {
-	return const_reverse_iterator(end());
-}
-// btree iterators crend
-template<typename T>
-typename btree<T>::const_reverse_iterator btree<T>::crend() const {
-	return const_reverse_iterator(begin());
-}
+  // copies src and everything below it node for node, keeping its shape.
+  Node* cloneSubtree(const Node *src, Node *parent, Node *&leftmost, Node *&rightmost);
 
-//************end other above type cend and all
+  // shape of one level of a bulk-loaded tree: items spread over groups
+  // (nodes), with one separator item between neighbouring groups.
+  struct BulkLevel{
+	  size_t items;
+	  size_t groups;
+  };
 
-//find the element in tree and return iterator
-template<typename T>
-typename btree<T>::iterator btree<T>::find(const T& elem){
+  // the node counts of every level of a bulk-built tree of n elements.
+  std::vector<BulkLevel> bulkLevels(size_t n, double fillFactor) const;
+
+  // node j of level: how many elements it holds and the index of its
+  // first child in the level below.
+  static void bulkNode(const BulkLevel &level, size_t j, size_t &count, size_t &firstChild);
+
+  template<typename InputIt>
+  void bulkLoad(InputIt first, InputIt last, double fillFactor, std::input_iterator_tag);
+  template<typename ForwardIt>
+  void bulkLoad(ForwardIt first, ForwardIt last, double fillFactor, std::forward_iterator_tag);
+
+  // builds a tree from n ordered elements and installs it.
+  template<typename ForwardIt>
+  void buildFromSorted(ForwardIt first, size_t n, double fillFactor);
+
+  // builds the tree holding source(0) .. source(n - 1), which are in
+  // order, and installs it. Every node is created first, then all are
+  // filled in parallel; source(p) may be called from any thread.
+  template<typename Source>
+  void buildParallel(Source source, size_t n, double fillFactor, size_t threads);
+
+  // what combine keeps: merge keeps every element of both trees, the
+  // others follow the std:: set algorithms of the same name.
+  enum CombineMode{
+	  combineMerge,
+	  combineUnion,
+	  combineIntersection,
+	  combineDifference
+  };
 
-	if (baseNode == nullptr){
-		return iterator(NULL, 0, this);
-	}
+  // rebuilds this tree as mode of itself and other, moving elements out
+  // of other when take is set.
+  void combine(btree_base &other, CombineMode mode, bool take, size_t threads);
+
+  // an element in the form bulk_load takes it, copied or moved out of slot i.
+  static typename Params::init_type copyElement(const Node *node, size_t i);
+  static typename Params::init_type moveElement(Node *node, size_t i);
+
+  // builds node j of level, consuming its subtree's elements in order.
+  template<typename ForwardIt>
+  Node* buildSubtree(const std::vector<BulkLevel> &levels, size_t level, size_t j,
+		  Node *parent, size_t childno, ForwardIt &it, Node *&leftmost, Node *&rightmost);
+
+  // snapshot writing and reading behind serialize and deserialize;
+  // Writer and Reader are the btree_serialize.h byte sinks and sources.
+  template<typename Writer>
+  void writeSnapshot(Writer &out) const;
+  template<typename Writer>
+  void writeSubtree(const Node *node, Writer &out) const;
+  template<typename Reader>
+  void readSnapshot(Reader &in);
+
+  // reads the block of the node at depth and, recursively, its subtrees;
+  // leafDepth is the depth of the first leaf read (0 until then), nodesLeft
+  // the blocks the header still promises and elems the elements read so far.
+  template<typename Reader>
+  Node* readSubtree(Reader &in, Node *parent, size_t childno, size_t depth, size_t &leafDepth,
+		  uint64_t &nodesLeft, uint64_t &elems);
+
+  // the nodes in node's subtree.
+  static size_t countNodes(const Node *node);
+
+  // node storage: leaves and internal nodes differ in size, so each has its own pool.
+  btree_node_pool<allocator_type> leafPool;
+  btree_node_pool<allocator_type> internalPool;
+};
 
-	Node *tempNode = baseNode;
-	while(true){
+/**
+ * An ordered set of unique elements of type T, ordered by Compare: either
+ * a strict weak "less" returning bool, or a three-way comparison returning
+ * a negative, zero or positive int. Fanout, when not 0, fixes the number
+ * of elements per node at compile time so node sizes and in-node searches
+ * are constants the compiler can fold and unroll.
+ */
+template <typename T, typename Compare, size_t Fanout, typename Alloc>
+class btree : public btree_base<btree_set_params<T, Compare, Fanout, Alloc> > {
 
-		size_t nodesize = tempNode->vNodeElement->size();
-		if (nodesize==0){
-			return iterator(NULL, 0, this);
-		}
-		for(size_t i =0; i<nodesize; i++ ){
-			if ( tempNode->vNodeElement->at(i) == elem){
-				return iterator(tempNode, i, this);
-			}
+	typedef btree_base<btree_set_params<T, Compare, Fanout, Alloc> > base_type;
+ public:
+	typedef typename base_type::iterator iterator;
+	typedef typename base_type::const_iterator const_iterator;
 
-			if (i == nodesize-1 && elem > tempNode->vNodeElement->at(i)){
+  /**
+   * btree constructor: @param maxNodeElems the maximum number of elements
+   *        that can be stored in each B-Tree node (at least 3; smaller
+   *        values are raised to 3 so a split always leaves both halves
+   *        non-empty); ignored when Fanout is not 0
+   * @param comp the ordering of the elements
+   * @param alloc the allocator the tree's node pools take their chunks from.
+   *        Nodes are carved out of those chunks, recycled through a free
+   *        list when erased, and all chunks are returned together when
+   *        the tree is cleared or destroyed.
+   */
+  btree(size_t maxNodeElems = 40, const Compare& comp = Compare(), const Alloc& alloc = Alloc());
 
-				if (tempNode->children->empty() || tempNode->children->at(i+1)->vNodeElement->empty()){
-					return iterator(NULL, 0, this);
-				}
-				else{
-					tempNode = tempNode->children->at(i+1);
-					break;
-				}
-			}
+  /**
+   * Range constructor: builds the tree from [first, last) with bulk_load.
+   * @param maxNodeElems as for the default constructor
+   * @param fillFactor as for bulk_load
+   */
+  template<typename InputIt,
+           typename = typename std::iterator_traits<InputIt>::iterator_category>
+  btree(InputIt first, InputIt last, size_t maxNodeElems = 40, double fillFactor = 1.0,
+		  const Compare& comp = Compare(), const Alloc& alloc = Alloc());
 
-			if (elem > tempNode->vNodeElement->at(i)){
+  /**
+   * Puts a breadth-first traversal of the B-Tree onto the output
+   * stream os. Elements supports the output operator.
+   * Elements are separated by space.
+   * @param os a reference to a C++ output stream
+   * @param tree a const reference to a B-Tree object
+   * @return a reference to os
+   */
+  friend std::ostream& operator<< <T, Compare, Fanout, Alloc> (std::ostream& os, const btree<T, Compare, Fanout, Alloc>& tree);
 
-				continue;
-			}
+  /**
+    * @param elem the element to be inserted.
+    * @return a pair whose first field is an iterator positioned at
+    *         the matching element in the btree, and whose second field
+    *         stores true if and only if the element needed to be added
+    *         because no matching element was there prior to the insert call.
+    */
+  std::pair<iterator, bool> insert(const T& elem);
 
-			else if (elem < tempNode->vNodeElement->at(i)){
+  /**
+    * Same as insert(const T&), but moves elem into the tree.
+    */
+  std::pair<iterator, bool> insert(T&& elem);
 
-				if (tempNode->children->empty() || tempNode->children->at(i)->vNodeElement->empty()){
-					return iterator(NULL, 0, this);
-				}
-				else{
-					tempNode = tempNode->children->at(i);
-					break;
-				}
-			}
-		}
+  /**
+    * Constructs an element from args and inserts it unless an equal
+    * element is already present.
+    * @return the same pair as insert.
+    */
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args);
 
+  /**
+    * Inserts the elements of [first, last) as insert does. When they come
+    * in ascending order each insert starts from where the previous one
+    * landed, climbing only as far as the path the two share, instead of
+    * descending from the root; out of order elements fall back to a full
+    * descent.
+    * @return the number of elements inserted.
+    */
+  template<typename InputIt>
+  size_t insert_sorted(InputIt first, InputIt last);
+};
+
+//Node construction inside a pool block: header, elements and children share it.
+template<typename Params>
+typename btree_base<Params>::Node* btree_base<Params>::Node::create(void *block, size_t maxNElems_b_, Node *pNode_, bool leaf_){
+
+	Node *node = ::new (block) Node(maxNElems_b_, pNode_, leaf_);
+	if (!leaf_){
+		Node **kids = node->children();
+		size_t *counts = node->subtreeCounts();
+		for (size_t i =0; i<=node->capacity(); ++i){
+			kids[i] = nullptr;
+			counts[i] = 0;
+		}
+	}
+	return node;
+}
+
+//Node destruction.
+template<typename Params>
+void btree_base<Params>::Node::destroy(Node *node){
+
+	for (size_t i =0; i<node->num_element; ++i){
+		destroySlot(node, i);
+	}
+	node->~Node();
+}
+
+//take a node from the pool
+template<typename Params>
+typename btree_base<Params>::Node* btree_base<Params>::newNode(Node *parent, bool leaf){
+
+	btree_node_pool<allocator_type> &pool = leaf ? leafPool : internalPool;
+	return Node::create(pool.allocate(), nodeWidth(), parent, leaf);
+}
+
+//give a node back to the pool
+template<typename Params>
+void btree_base<Params>::deleteNode(Node *node){
+
+	btree_node_pool<allocator_type> &pool = node->leaf ? leafPool : internalPool;
+	Node::destroy(node);
+	pool.deallocate(node);
+}
+
+//free a whole subtree.
+template<typename Params>
+void btree_base<Params>::freeSubtree(Node *node){
+
+	if (node == nullptr){
+		return;
+	}
+	if (node->hasChildren()){
+		for (size_t i =0; i<=node->num_element; ++i){
+			freeSubtree(node->child(i));
+		}
+	}
+	deleteNode(node);
+}
+
+//destroy the elements of a subtree, leaving its blocks to the pools.
+template<typename Params>
+void btree_base<Params>::destroyElements(Node *node){
+
+	if (node->hasChildren()){
+		for (size_t i =0; i<=node->num_element; ++i){
+			destroyElements(node->child(i));
+		}
+	}
+	Node::destroy(node);
+}
+
+//drop every node at once.
+template<typename Params>
+void btree_base<Params>::releaseNodes(){
+
+	bool trivial = std::is_trivially_destructible<key_type>::value &&
+			std::is_trivially_destructible<mapped_storage>::value;
+	if (!trivial && baseNode != nullptr){
+		destroyElements(baseNode);
+	}
+	leafPool.release();
+	internalPool.release();
+	baseNode = nullptr;
+	firstNode = nullptr;
+	lastNode = nullptr;
+	btree_size = 0;
+}
+
+//slot construction from a key and the mapped value's constructor arguments.
+template<typename Params>
+template<typename KeyArg, typename... MappedArgs>
+void btree_base<Params>::emplaceSlot(Node *node, size_t i, KeyArg &&key, MappedArgs&&... mapped){
+
+	::new (static_cast<void*>(node->elements() + i)) key_type(std::forward<KeyArg>(key));
+	if constexpr (has_mapped){
+		try{
+			::new (static_cast<void*>(node->mappedValues() + i)) mapped_storage(std::forward<MappedArgs>(mapped)...);
+		}
+		catch(...){
+			node->element(i).~key_type();
+			throw;
+		}
+	}
+}
+
+//slot construction from a whole element: a set element, or a (key, value) pair.
+template<typename Params>
+template<typename V>
+void btree_base<Params>::emplaceElement(Node *node, size_t i, V &&elem){
+
+	if constexpr (has_mapped){
+		emplaceSlot(node, i, std::forward<V>(elem).first, std::forward<V>(elem).second);
+	}
+	else{
+		emplaceSlot(node, i, std::forward<V>(elem));
+	}
+}
+
+//slot copy
+template<typename Params>
+void btree_base<Params>::copySlot(Node *dst, size_t i, const Node *src, size_t j){
+
+	if constexpr (has_mapped){
+		emplaceSlot(dst, i, src->element(j), src->mapped(j));
+	}
+	else{
+		emplaceSlot(dst, i, src->element(j));
+	}
+}
+
+//slot move construction
+template<typename Params>
+void btree_base<Params>::moveSlot(Node *dst, size_t i, Node *src, size_t j){
+
+	if constexpr (has_mapped){
+		emplaceSlot(dst, i, std::move(src->element(j)), std::move(src->mapped(j)));
+	}
+	else{
+		emplaceSlot(dst, i, std::move(src->element(j)));
+	}
+}
+
+//slot move assignment
+template<typename Params>
+void btree_base<Params>::assignSlot(Node *dst, size_t i, Node *src, size_t j){
+
+	dst->element(i) = std::move(src->element(j));
+	if constexpr (has_mapped){
+		dst->mapped(i) = std::move(src->mapped(j));
+	}
+}
+
+//slot relocation between nodes
+template<typename Params>
+void btree_base<Params>::relocateSlots(Node *dst, size_t i, Node *src, size_t j, size_t count){
+
+	for (size_t c = 0; c < count; ++c){
+		moveSlot(dst, i + c, src, j + c);
+		destroySlot(src, j + c);
+	}
+}
+
+//open a slot
+template<typename Params>
+void btree_base<Params>::insertSlot(Node *node, size_t pos, key_type &&key, mapped_storage &&mapped){
+
+	size_t n = node->num_element;
+	arrayInsert(node->elements(), n, pos, std::move(key));
+	if constexpr (has_mapped){
+		arrayInsert(node->mappedValues(), n, pos, std::move(mapped));
+	}
+}
+
+//close a slot
+template<typename Params>
+void btree_base<Params>::eraseSlot(Node *node, size_t pos){
+
+	size_t n = node->num_element;
+	arrayErase(node->elements(), n, pos);
+	if constexpr (has_mapped){
+		arrayErase(node->mappedValues(), n, pos);
+	}
+}
+
+//slot destruction
+template<typename Params>
+void btree_base<Params>::destroySlot(Node *node, size_t i){
+
+	node->element(i).~key_type();
+	if constexpr (has_mapped){
+		node->mapped(i).~mapped_storage();
+	}
+}
+
+//mapped value of a slot, moved out
+template<typename Params>
+typename btree_base<Params>::mapped_storage btree_base<Params>::takeMapped(Node *node, size_t i){
+
+	if constexpr (has_mapped){
+		return std::move(node->mapped(i));
+	}
+	else{
+		return mapped_storage();
+	}
+}
+
+//insert value at pos of the n live entries of a, constructing a[n].
+template<typename Params>
+template<typename U>
+void btree_base<Params>::arrayInsert(U *a, size_t n, size_t pos, U &&value){
+
+	if (pos == n){
+		::new (static_cast<void*>(a + n)) U(std::move(value));
+	}
+	else{
+		::new (static_cast<void*>(a + n)) U(std::move(a[n-1]));
+		std::move_backward(a + pos, a + n - 1, a + n);
+		a[pos] = std::move(value);
+	}
+}
+
+//remove a[pos] from the n live entries of a, destroying a[n-1].
+template<typename Params>
+template<typename U>
+void btree_base<Params>::arrayErase(U *a, size_t n, size_t pos){
+
+	std::move(a + pos + 1, a + n, a + pos);
+	a[n-1].~U();
+}
+
+//btree constructor.
+template<typename Params>
+btree_base<Params>::btree_base(size_t maxNodeElems_, const key_compare& comp, const allocator_type& alloc)
+	:baseNode(nullptr), firstNode(nullptr), lastNode(nullptr),
+	 maxNodeElems_t(fanout != 0 ? fanout : (maxNodeElems_ < 3 ? 3 : maxNodeElems_)), btree_size(0), compare_t{comp},
+	 leafPool(Node::blockSize(maxNodeElems_t, true), alloc),
+	 internalPool(Node::blockSize(maxNodeElems_t, false), alloc){
+}
+
+//clone a subtree node by node; on failure everything built so far is released.
+template<typename Params>
+typename btree_base<Params>::Node* btree_base<Params>::cloneSubtree(const Node *src, Node *parent, Node *&leftmost, Node *&rightmost){
+
+	Node *node = newNode(parent, src->leaf);
+	node->childno = src->childno;
+	if (src->leaf){
+		if (leftmost == nullptr){
+			leftmost = node;
+		}
+		rightmost = node;
+	}
+
+	try{
+		for (size_t i = 0; i < src->num_element; ++i){
+			if (!src->leaf){
+				node->child(i) = cloneSubtree(src->child(i), node, leftmost, rightmost);
+				node->subtreeCount(i) = src->subtreeCount(i);
+			}
+			copySlot(node, i, src, i);
+			++node->num_element;
+		}
+		if (!src->leaf){
+			node->child(src->num_element) = cloneSubtree(src->child(src->num_element), node, leftmost, rightmost);
+			node->subtreeCount(src->num_element) = src->subtreeCount(src->num_element);
+		}
+	}
+	catch(...){
+		freeSubtree(node);
+		throw;
+	}
+	return node;
+}
+
+//btree destructor
+template<typename Params>
+btree_base<Params>::~btree_base(){
+
+	releaseNodes();
+}
+
+//unique insert from the root.
+template<typename Params>
+template<typename KeyArg, typename... MappedArgs>
+std::pair<typename btree_base<Params>::iterator, bool> btree_base<Params>::insertUnique(KeyArg &&key, MappedArgs&&... mapped){
+
+	return insertUniqueFrom(baseNode, std::forward<KeyArg>(key), std::forward<MappedArgs>(mapped)...);
+}
+
+//unique insert starting near the previous one, when key comes after it.
+template<typename Params>
+template<typename KeyArg, typename... MappedArgs>
+std::pair<typename btree_base<Params>::iterator, bool> btree_base<Params>::insertUniqueAfter(const_iterator hint,
+		KeyArg &&key, MappedArgs&&... mapped){
+
+	Node *start = baseNode;
+	if (hint.pNode != nullptr && !compare_t(key, hint.pNode->element(hint.pindex))){
+		Node *candidate;
+		size_t candidatePos;
+		start = climbFor(hint.pNode, key, candidate, candidatePos);
+	}
+	return insertUniqueFrom(start, std::forward<KeyArg>(key), std::forward<MappedArgs>(mapped)...);
+}
+
+//descend once to the leaf, stopping early on a match, then insert there.
+template<typename Params>
+template<typename KeyArg, typename... MappedArgs>
+std::pair<typename btree_base<Params>::iterator, bool> btree_base<Params>::insertUniqueFrom(Node *tempNode,
+		KeyArg &&key, MappedArgs&&... mapped){
+
+	size_t pos = 0;
+	while(tempNode != nullptr){
+		bool match;
+		pos = btree_find_in_node<fanout>(tempNode->elements(), tempNode->num_element, key, compare_t, match);
+		if (match){
+			return std::make_pair(iterator(tempNode, pos, this), false);
+		}
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		tempNode = tempNode->child(pos);
+	}
+
+	key_type value(std::forward<KeyArg>(key));
+	mapped_storage mappedValue(std::forward<MappedArgs>(mapped)...);
+	return std::make_pair(insertLeaf(tempNode, pos, std::move(value), std::move(mappedValue)), true);
+}
+
+//descend to the leaf past every equal key and insert there.
+template<typename Params>
+template<typename KeyArg, typename... MappedArgs>
+typename btree_base<Params>::iterator btree_base<Params>::insertMulti(KeyArg &&key, MappedArgs&&... mapped){
+
+	Node *tempNode = baseNode;
+	size_t pos = 0;
+	while(tempNode != nullptr){
+		pos = btree_upper_bound<fanout>(tempNode->elements(), tempNode->num_element, key, compare_t);
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		tempNode = tempNode->child(pos);
+	}
+
+	key_type value(std::forward<KeyArg>(key));
+	mapped_storage mappedValue(std::forward<MappedArgs>(mapped)...);
+	return insertLeaf(tempNode, pos, std::move(value), std::move(mappedValue));
+}
+
+//insert into a leaf and split full nodes on the way back up.
+template<typename Params>
+typename btree_base<Params>::iterator btree_base<Params>::insertLeaf(Node *tempNode, size_t pos,
+		key_type &&value, mapped_storage &&mappedValue){
+
+	if (tempNode == nullptr){
+		baseNode = newNode(nullptr, true);
+		firstNode = baseNode;
+		lastNode = baseNode;
+		tempNode = baseNode;
+		pos = 0;
+	}
+
+	// the new element always stays in the leaf it is inserted into, since
+	// splits promote an existing element; remember where it landed.
+	Node *resultNode = nullptr;
+	size_t resultPos = 0;
+	Node *rightChild = nullptr;
+	const size_t width = nodeWidth();
+	while(tempNode->num_element == width){
+
+		// bias the split towards the insert position so that ascending
+		// or descending runs leave packed nodes behind.
+		size_t k = width / 2;
+		if (pos == 0){
+			k = 0;
+		}
+		else if (pos == width){
+			k = width - 1;
+		}
+
+		key_type median(std::move(tempNode->element(k)));
+		mapped_storage medianMapped(takeMapped(tempNode, k));
+		Node *sibling = splitNode(tempNode, k);
+		Node *target = tempNode;
+		size_t targetPos = pos;
+		if (pos > k){
+			target = sibling;
+			targetPos = pos - k - 1;
+		}
+		insertAt(target, targetPos, std::move(value), std::move(mappedValue), rightChild);
+		if (resultNode == nullptr){
+			resultNode = target;
+			resultPos = targetPos;
+		}
+
+		if (tempNode == lastNode){
+			lastNode = sibling;
+		}
+
+		Node *parent = tempNode->pNode_n;
+		if (parent == nullptr){
+			// the root was split: grow the tree by one level.
+			parent = newNode(nullptr, false);
+			parent->child(0) = tempNode;
+			tempNode->pNode_n = parent;
+			tempNode->childno = 0;
+			baseNode = parent;
+		}
+
+		pos = tempNode->childno;
+		value = std::move(median);
+		mappedValue = std::move(medianMapped);
+		rightChild = sibling;
+		tempNode = parent;
+	}
+	insertAt(tempNode, pos, std::move(value), std::move(mappedValue), rightChild);
+	if (resultNode == nullptr){
+		resultNode = tempNode;
+		resultPos = pos;
+	}
+	// nodes split on the way up were recounted by insertAt; above them
+	// every subtree just gained the one element.
+	countPath(tempNode, 1);
+	++btree_size;
+
+	return iterator(resultNode, resultPos, this);
+}
+
+//insert a slot at index pos of a node that has room; rightChild (internal nodes only) goes to its right.
+//child pos was just split into itself and rightChild, so both are recounted.
+template<typename Params>
+void btree_base<Params>::insertAt(Node *node, size_t pos, key_type &&value, mapped_storage &&mappedValue, Node *rightChild){
+
+	size_t n = node->num_element;
+	insertSlot(node, pos, std::move(value), std::move(mappedValue));
+	++node->num_element;
+
+	if (node->hasChildren()){
+		for (size_t i = n + 1; i > pos + 1; --i){
+			node->child(i) = node->child(i-1);
+			node->child(i)->childno = i;
+			node->subtreeCount(i) = node->subtreeCount(i-1);
+		}
+		node->child(pos+1) = rightChild;
+		rightChild->pNode_n = node;
+		rightChild->childno = pos + 1;
+		node->subtreeCount(pos) = subtreeSize(node->child(pos));
+		node->subtreeCount(pos+1) = subtreeSize(rightChild);
+	}
+}
+
+//move the elements after index k (and the children after k) into a new right sibling.
+//the element at k is destroyed; the caller has already moved it out as the median.
+template<typename Params>
+typename btree_base<Params>::Node* btree_base<Params>::splitNode(Node *node, size_t k){
+
+	size_t n = node->num_element;
+	Node *sibling = newNode(node->pNode_n, node->leaf);
+	relocateSlots(sibling, 0, node, k + 1, n - k - 1);
+	sibling->num_element = n - k - 1;
+	destroySlot(node, k);
+	node->num_element = k;
+
+	if (node->hasChildren()){
+		for (size_t i = k + 1; i <= n; ++i){
+			Node *c = node->child(i);
+			sibling->child(i - k - 1) = c;
+			sibling->subtreeCount(i - k - 1) = node->subtreeCount(i);
+			c->pNode_n = sibling;
+			c->childno = i - k - 1;
+			node->child(i) = nullptr;
+			node->subtreeCount(i) = 0;
+		}
+	}
+	return sibling;
+}
+
+//erase by key
+template<typename Params>
+size_t btree_base<Params>::erase(const key_type &key){
+
+	size_t removed = 0;
+	size_t pos;
+	Node *tempNode;
+	while ((tempNode = lowerBoundNode(key, pos)) != nullptr && !compare_t(key, tempNode->element(pos))){
+		eraseAt(tempNode, pos);
+		++removed;
+		if (!multi){
+			break;
+		}
+	}
+	return removed;
+}
+
+//erase at an iterator, returning its successor
+template<typename Params>
+typename btree_base<Params>::iterator btree_base<Params>::erase(const_iterator position){
+
+	// nodes may merge or rotate underneath us, so find the successor by
+	// key, stepping over the equal keys that came before position.
+	key_type key(position.pNode->element(position.pindex));
+	size_t rank = 0;
+	if (multi){
+		Node *prevNode = position.pNode;
+		size_t prevPos = position.pindex;
+		while (true){
+			btree_decrement(prevNode, prevPos, lastNode);
+			if (prevNode == nullptr || compare_t(prevNode->element(prevPos), key)){
+				break;
+			}
+			++rank;
+		}
+	}
+	eraseAt(position.pNode, position.pindex);
+	size_t pos;
+	Node *tempNode = lowerBoundNode(key, pos);
+	for (; rank > 0; --rank){
+		btree_increment(tempNode, pos);
+	}
+	return iterator(tempNode, pos, this);
+}
+
+//erase a range of elements
+template<typename Params>
+typename btree_base<Params>::iterator btree_base<Params>::erase(const_iterator first, const_iterator last){
+
+	// last is invalidated by the rebalancing, so count the range up front.
+	size_t count = size_t(std::distance(first, last));
+	iterator next(first.pNode, first.pindex, this);
+	for (; count > 0; --count){
+		next = erase(next);
+	}
+	return next;
+}
+
+//remove one element and fix up the nodes on the way to the root
+template<typename Params>
+void btree_base<Params>::eraseAt(Node *node, size_t pos){
+
+	if (node->hasChildren()){
+		// swap in the in-order predecessor, the last element of the rightmost
+		// leaf of the left subtree, and erase it from that leaf instead.
+		Node *leafNode = node->child(pos);
+		while (leafNode->hasChildren()){
+			leafNode = leafNode->child(leafNode->num_element);
+		}
+		assignSlot(node, pos, leafNode, leafNode->num_element - 1);
+		node = leafNode;
+		pos = leafNode->num_element - 1;
+	}
+	removeAt(node, pos);
+	countPath(node, -1);
+	--btree_size;
+	rebalance(node);
+}
+
+//shift the elements after pos one slot left
+template<typename Params>
+void btree_base<Params>::removeAt(Node *node, size_t pos){
+
+	size_t n = node->num_element;
+	eraseSlot(node, pos);
+	--node->num_element;
+
+	if (node->hasChildren()){
+		for (size_t i = pos + 1; i < n; ++i){
+			node->child(i) = node->child(i+1);
+			node->child(i)->childno = i;
+			node->subtreeCount(i) = node->subtreeCount(i+1);
+		}
+		node->child(n) = nullptr;
+		node->subtreeCount(n) = 0;
+	}
+}
+
+//borrow from or merge with a sibling until every node is full enough again
+template<typename Params>
+void btree_base<Params>::rebalance(Node *node){
+
+	while (node != baseNode && node->num_element < minElems()){
+
+		Node *parent = node->pNode_n;
+		size_t idx = node->childno;
+		Node *left = idx > 0 ? parent->child(idx-1) : nullptr;
+		Node *right = idx < parent->num_element ? parent->child(idx+1) : nullptr;
+
+		if (left != nullptr && left->num_element > minElems()){
+			borrowFromLeft(node, left);
+			return;
+		}
+		if (right != nullptr && right->num_element > minElems()){
+			borrowFromRight(node, right);
+			return;
+		}
+		if (left != nullptr){
+			mergeNodes(left, node);
+		}
+		else{
+			mergeNodes(node, right);
+		}
+		node = parent;
+	}
+
+	if (node == baseNode && node->num_element == 0){
+		if (node->hasChildren()){
+			// the root lost its last separator: drop a level.
+			baseNode = node->child(0);
+			baseNode->pNode_n = nullptr;
+			baseNode->childno = 0;
+		}
+		else{
+			baseNode = nullptr;
+			firstNode = nullptr;
+			lastNode = nullptr;
+		}
+		deleteNode(node);
+	}
+}
+
+//rotate the last element of left up into the parent and the separator down into node
+template<typename Params>
+void btree_base<Params>::borrowFromLeft(Node *node, Node *left){
+
+	Node *parent = node->pNode_n;
+	size_t sep = node->childno - 1;
+	size_t n = node->num_element;
+	size_t ln = left->num_element;
+
+	insertSlot(node, 0, std::move(parent->element(sep)), takeMapped(parent, sep));
+	assignSlot(parent, sep, left, ln-1);
+	destroySlot(left, ln-1);
+
+	// the separator and, for internal nodes, left's last subtree change sides.
+	size_t shifted = 1;
+	if (node->hasChildren()){
+		for (size_t i = n + 1; i > 0; --i){
+			node->child(i) = node->child(i-1);
+			node->child(i)->childno = i;
+			node->subtreeCount(i) = node->subtreeCount(i-1);
+		}
+		Node *moved = left->child(ln);
+		left->child(ln) = nullptr;
+		node->child(0) = moved;
+		moved->pNode_n = node;
+		moved->childno = 0;
+		node->subtreeCount(0) = left->subtreeCount(ln);
+		left->subtreeCount(ln) = 0;
+		shifted += node->subtreeCount(0);
+	}
+	--left->num_element;
+	++node->num_element;
+	parent->subtreeCount(sep) -= shifted;
+	parent->subtreeCount(sep + 1) += shifted;
+}
+
+//rotate the first element of right up into the parent and the separator down into node
+template<typename Params>
+void btree_base<Params>::borrowFromRight(Node *node, Node *right){
+
+	Node *parent = node->pNode_n;
+	size_t sep = node->childno;
+	size_t n = node->num_element;
+	size_t rn = right->num_element;
+
+	moveSlot(node, n, parent, sep);
+	assignSlot(parent, sep, right, 0);
+	eraseSlot(right, 0);
+
+	size_t shifted = 1;
+	if (node->hasChildren()){
+		Node *moved = right->child(0);
+		size_t movedCount = right->subtreeCount(0);
+		for (size_t i = 0; i < rn; ++i){
+			right->child(i) = right->child(i+1);
+			right->child(i)->childno = i;
+			right->subtreeCount(i) = right->subtreeCount(i+1);
+		}
+		right->child(rn) = nullptr;
+		right->subtreeCount(rn) = 0;
+		node->child(n+1) = moved;
+		moved->pNode_n = node;
+		moved->childno = n + 1;
+		node->subtreeCount(n+1) = movedCount;
+		shifted += movedCount;
+	}
+	--right->num_element;
+	++node->num_element;
+	parent->subtreeCount(sep) += shifted;
+	parent->subtreeCount(sep + 1) -= shifted;
+}
+
+//merge right and the separator between them into left and release right
+template<typename Params>
+void btree_base<Params>::mergeNodes(Node *left, Node *right){
+
+	Node *parent = left->pNode_n;
+	size_t sep = left->childno;
+	size_t ln = left->num_element;
+	size_t rn = right->num_element;
+
+	moveSlot(left, ln, parent, sep);
+	relocateSlots(left, ln + 1, right, 0, rn);
+	right->num_element = 0;
+
+	if (left->hasChildren()){
+		for (size_t i = 0; i <= rn; ++i){
+			Node *moved = right->child(i);
+			left->child(ln + 1 + i) = moved;
+			left->subtreeCount(ln + 1 + i) = right->subtreeCount(i);
+			moved->pNode_n = left;
+			moved->childno = ln + 1 + i;
+		}
+	}
+	left->num_element = ln + 1 + rn;
+
+	if (right == lastNode){
+		lastNode = left;
+	}
+	parent->subtreeCount(sep) += 1 + parent->subtreeCount(sep + 1);
+	removeAt(parent, sep);
+	deleteNode(right);
+}
+
+//clear the tree
+template<typename Params>
+void btree_base<Params>::clear(){
+
+	releaseNodes();
+}
+
+//swap two trees
+template<typename Params>
+void btree_base<Params>::swap(btree_base& other) noexcept{
+
+	std::swap(baseNode, other.baseNode);
+	std::swap(firstNode, other.firstNode);
+	std::swap(lastNode, other.lastNode);
+	std::swap(maxNodeElems_t, other.maxNodeElems_t);
+	std::swap(btree_size, other.btree_size);
+	std::swap(compare_t, other.compare_t);
+	leafPool.swap(other.leafPool);
+	internalPool.swap(other.internalPool);
+}
+
+//allocator access
+template<typename Params>
+typename btree_base<Params>::allocator_type btree_base<Params>::get_allocator() const{
+
+	return leafPool.get_allocator();
+}
+
+//comparator access
+template<typename Params>
+typename btree_base<Params>::key_compare btree_base<Params>::key_comp() const{
+
+	return compare_t.comp;
+}
+
+//bulk load
+template<typename Params>
+template<typename InputIt>
+void btree_base<Params>::bulk_load(InputIt first, InputIt last, double fillFactor){
+
+	bulkLoad(first, last, fillFactor, typename std::iterator_traits<InputIt>::iterator_category());
+}
+
+//single pass input: buffer, sort once and drop duplicates.
+template<typename Params>
+template<typename InputIt>
+void btree_base<Params>::bulkLoad(InputIt first, InputIt last, double fillFactor, std::input_iterator_tag){
+
+	typedef typename Params::init_type init_type;
+	std::vector<init_type> buffer(first, last);
+	const btree_key_compare<key_compare, key_type> &comp = compare_t;
+	std::stable_sort(buffer.begin(), buffer.end(), [&comp](const init_type& a, const init_type& b){
+		return comp(Params::key(a), Params::key(b));
+	});
+	if (!multi){
+		auto end = std::unique(buffer.begin(), buffer.end(), [&comp](const init_type& a, const init_type& b){
+			return !comp(Params::key(a), Params::key(b));
+		});
+		buffer.erase(end, buffer.end());
+	}
+	buildFromSorted(std::make_move_iterator(buffer.begin()), buffer.size(), fillFactor);
+}
+
+//multi pass input: build in place when it is already in order.
+template<typename Params>
+template<typename ForwardIt>
+void btree_base<Params>::bulkLoad(ForwardIt first, ForwardIt last, double fillFactor, std::forward_iterator_tag){
+
+	const btree_key_compare<key_compare, key_type> &comp = compare_t;
+	bool sorted = std::adjacent_find(first, last, [&comp](const auto& a, const auto& b){
+		return multi ? comp(Params::key(b), Params::key(a)) : !comp(Params::key(a), Params::key(b));
+	}) == last;
+	if (!sorted){
+		bulkLoad(first, last, fillFactor, std::input_iterator_tag());
+		return;
+	}
+	buildFromSorted(first, size_t(std::distance(first, last)), fillFactor);
+}
+
+//work out how many nodes each level needs, then build the tree in order.
+template<typename Params>
+template<typename ForwardIt>
+void btree_base<Params>::buildFromSorted(ForwardIt first, size_t n, double fillFactor){
+
+	if (n == 0){
+		clear();
+		return;
+	}
+
+	std::vector<BulkLevel> levels = bulkLevels(n, fillFactor);
+	ForwardIt it = first;
+	Node *leftmost = nullptr;
+	Node *rightmost = nullptr;
+	Node *root = buildSubtree(levels, levels.size() - 1, 0, nullptr, 0, it, leftmost, rightmost);
+
+	freeSubtree(baseNode);
+	baseNode = root;
+	firstNode = leftmost;
+	lastNode = rightmost;
+	btree_size = n;
+}
+
+//level 0 holds the leaves; every level above holds the separators left
+//between the groups of the level below, until one root remains.
+template<typename Params>
+std::vector<typename btree_base<Params>::BulkLevel> btree_base<Params>::bulkLevels(size_t n, double fillFactor) const{
+
+	const size_t width = nodeWidth();
+	size_t perNode = size_t(double(width) * fillFactor + 0.5);
+	if (perNode < minElems()){
+		perNode = minElems();
+	}
+	if (perNode > width){
+		perNode = width;
+	}
+
+	std::vector<BulkLevel> levels;
+	size_t items = n;
+	while (true){
+		if (items <= width){
+			levels.push_back(BulkLevel{items, 1});
+			break;
+		}
+		size_t groups = (items + perNode + 1) / (perNode + 1);
+		if (groups > (items + 1) / 2){
+			// one-element nodes cannot always tile the level; keep every node non-empty.
+			groups = (items + 1) / 2;
+		}
+		levels.push_back(BulkLevel{items, groups});
+		items = groups - 1;
+	}
+	return levels;
+}
+
+//spread the items of a level evenly: the first r groups take one extra.
+template<typename Params>
+void btree_base<Params>::bulkNode(const BulkLevel &level, size_t j, size_t &count, size_t &firstChild){
+
+	size_t spread = level.items - (level.groups - 1);
+	size_t q = spread / level.groups;
+	size_t r = spread % level.groups;
+	count = q + (j < r ? 1 : 0);
+	firstChild = j * (q + 1) + (j < r ? j : r);
+}
+
+//build node j of a level and, recursively, the nodes under it.
+template<typename Params>
+template<typename ForwardIt>
+typename btree_base<Params>::Node* btree_base<Params>::buildSubtree(const std::vector<BulkLevel> &levels, size_t level, size_t j,
+		Node *parent, size_t childno, ForwardIt &it, Node *&leftmost, Node *&rightmost){
+
+	size_t count, firstChild;
+	bulkNode(levels[level], j, count, firstChild);
+
+	Node *node = newNode(parent, level == 0);
+	node->childno = childno;
+	if (level == 0){
+		if (leftmost == nullptr){
+			leftmost = node;
+		}
+		rightmost = node;
+	}
+
+	try{
+		for (size_t i = 0; i <= count; ++i){
+			if (level != 0){
+				node->child(i) = buildSubtree(levels, level - 1, firstChild + i, node, i, it, leftmost, rightmost);
+				node->subtreeCount(i) = subtreeSize(node->child(i));
+			}
+			if (i < count){
+				emplaceElement(node, i, *it);
+				++it;
+				++node->num_element;
+			}
+		}
+	}
+	catch(...){
+		freeSubtree(node);
+		throw;
+	}
+	return node;
+}
+
+//parallel bulk load: build straight from sorted random access input,
+//otherwise sort a buffer across the threads first.
+template<typename Params>
+template<typename InputIt>
+void btree_base<Params>::bulk_load_parallel(InputIt first, InputIt last, size_t threads, double fillFactor){
+
+	typedef typename Params::init_type init_type;
+	const btree_key_compare<key_compare, key_type> &comp = compare_t;
+	if constexpr (std::is_base_of<std::random_access_iterator_tag,
+			typename std::iterator_traits<InputIt>::iterator_category>::value){
+		// check the order in pieces; each piece also checks the seam with the next.
+		size_t n = size_t(last - first);
+		size_t pieces = std::max<size_t>(1, std::min<size_t>(n / 4096, 64));
+		std::atomic<bool> sorted(true);
+		btree_parallel_for(pieces, threads, [&](size_t t){
+			size_t lo = t * n / pieces;
+			size_t hi = std::min(n, (t + 1) * n / pieces + 1);
+			for (size_t i = lo + 1; i < hi && sorted.load(std::memory_order_relaxed); ++i){
+				const key_type &a = Params::key(first[i - 1]);
+				const key_type &b = Params::key(first[i]);
+				if (multi ? comp(b, a) : !comp(a, b)){
+					sorted.store(false, std::memory_order_relaxed);
+				}
+			}
+		});
+		if (sorted.load()){
+			buildParallel([first](size_t p) -> decltype(auto){ return first[p]; }, n, fillFactor, threads);
+			return;
+		}
+	}
+
+	std::vector<init_type> buffer(first, last);
+	btree_parallel_sort(buffer.begin(), buffer.end(), [&comp](const init_type& a, const init_type& b){
+		return comp(Params::key(a), Params::key(b));
+	}, threads);
+	if (!multi){
+		auto end = std::unique(buffer.begin(), buffer.end(), [&comp](const init_type& a, const init_type& b){
+			return !comp(Params::key(a), Params::key(b));
+		});
+		buffer.erase(end, buffer.end());
+	}
+	init_type *elems = buffer.data();
+	buildParallel([elems](size_t p) -> init_type&&{ return std::move(elems[p]); }, buffer.size(), fillFactor, threads);
+}
+
+//size every subtree and find where its elements start in the input, then
+//fill all the nodes at once.
+template<typename Params>
+template<typename Source>
+void btree_base<Params>::buildParallel(Source source, size_t n, double fillFactor, size_t threads){
+
+	if (n == 0){
+		clear();
+		return;
+	}
+
+	std::vector<BulkLevel> levels = bulkLevels(n, fillFactor);
+	const size_t height = levels.size();
+
+	// sizes bottom-up, then the input index each subtree starts at, top-down.
+	std::vector<std::vector<size_t> > sizes(height), starts(height);
+	for (size_t l = 0; l < height; ++l){
+		sizes[l].resize(levels[l].groups);
+		starts[l].resize(levels[l].groups);
+		for (size_t j = 0; j < levels[l].groups; ++j){
+			size_t count, firstChild;
+			bulkNode(levels[l], j, count, firstChild);
+			size_t total = count;
+			if (l != 0){
+				for (size_t c = 0; c <= count; ++c){
+					total += sizes[l - 1][firstChild + c];
+				}
+			}
+			sizes[l][j] = total;
+		}
+	}
+	starts[height - 1][0] = 0;
+	for (size_t l = height - 1; l > 0; --l){
+		for (size_t j = 0; j < levels[l].groups; ++j){
+			size_t count, firstChild;
+			bulkNode(levels[l], j, count, firstChild);
+			size_t pos = starts[l][j];
+			for (size_t c = 0; c <= count; ++c){
+				starts[l - 1][firstChild + c] = pos;
+				pos += sizes[l - 1][firstChild + c] + 1;
+			}
+		}
+	}
+
+	// empty nodes for every slot of the shape, from this thread only.
+	std::vector<std::vector<Node*> > nodes(height);
+	auto discard = [this, &nodes]{
+		for (size_t l = 0; l < nodes.size(); ++l){
+			for (size_t j = 0; j < nodes[l].size(); ++j){
+				deleteNode(nodes[l][j]);
+			}
+		}
+	};
+	try{
+		for (size_t l = 0; l < height; ++l){
+			nodes[l].reserve(levels[l].groups);
+			for (size_t j = 0; j < levels[l].groups; ++j){
+				nodes[l].push_back(newNode(nullptr, l == 0));
+			}
+		}
+	}
+	catch(...){
+		discard();
+		throw;
+	}
+
+	// a node links its children (their parent fields are theirs to set
+	// only here) and constructs its own elements; no two tasks touch
+	// the same fields.
+	auto fill = [&](size_t l, size_t j){
+		Node *node = nodes[l][j];
+		size_t count, firstChild;
+		bulkNode(levels[l], j, count, firstChild);
+		size_t pos = starts[l][j];
+		for (size_t i = 0; i <= count; ++i){
+			if (l != 0){
+				Node *c = nodes[l - 1][firstChild + i];
+				node->child(i) = c;
+				node->subtreeCount(i) = sizes[l - 1][firstChild + i];
+				c->pNode_n = node;
+				c->childno = i;
+				pos += sizes[l - 1][firstChild + i];
+			}
+			if (i < count){
+				emplaceElement(node, i, source(pos));
+				++node->num_element;
+				++pos;
+			}
+		}
+	};
+
+	// tasks of about a thousand elements each, taken level by level.
+	const size_t perTask = std::max<size_t>(1, 1024 / nodeWidth());
+	std::vector<std::pair<size_t, size_t> > tasks;
+	for (size_t l = 0; l < height; ++l){
+		for (size_t j = 0; j < levels[l].groups; j += perTask){
+			tasks.push_back(std::make_pair(l, j));
+		}
+	}
+	try{
+		btree_parallel_for(tasks.size(), threads, [&](size_t t){
+			size_t l = tasks[t].first;
+			size_t end = std::min(levels[l].groups, tasks[t].second + perTask);
+			for (size_t j = tasks[t].second; j < end; ++j){
+				fill(l, j);
+			}
+		});
+	}
+	catch(...){
+		discard();
+		throw;
+	}
+
+	freeSubtree(baseNode);
+	baseNode = nodes[height - 1][0];
+	firstNode = nodes[0].front();
+	lastNode = nodes[0].back();
+	btree_size = n;
+}
+
+//element copy in bulk_load form
+template<typename Params>
+typename Params::init_type btree_base<Params>::copyElement(const Node *node, size_t i){
+
+	if constexpr (has_mapped){
+		return typename Params::init_type(node->element(i), node->mapped(i));
+	}
+	else{
+		return node->element(i);
+	}
+}
+
+//element move in bulk_load form
+template<typename Params>
+typename Params::init_type btree_base<Params>::moveElement(Node *node, size_t i){
+
+	if constexpr (has_mapped){
+		return typename Params::init_type(std::move(node->element(i)), std::move(node->mapped(i)));
+	}
+	else{
+		return std::move(node->element(i));
+	}
+}
+
+//merge, consuming other
+template<typename Params>
+void btree_base<Params>::merge(btree_base&& other, size_t threads){
+
+	if (this == &other){
+		return;
+	}
+	combine(other, multi ? combineMerge : combineUnion, true, threads);
+	other.clear();
+}
+
+//union
+template<typename Params>
+void btree_base<Params>::set_union(const btree_base& other, size_t threads){
+
+	if (this != &other){
+		combine(const_cast<btree_base&>(other), combineUnion, false, threads);
+	}
+}
+
+//intersection
+template<typename Params>
+void btree_base<Params>::set_intersection(const btree_base& other, size_t threads){
+
+	if (this != &other){
+		combine(const_cast<btree_base&>(other), combineIntersection, false, threads);
+	}
+}
+
+//difference
+template<typename Params>
+void btree_base<Params>::set_difference(const btree_base& other, size_t threads){
+
+	if (this == &other){
+		clear();
+		return;
+	}
+	combine(const_cast<btree_base&>(other), combineDifference, false, threads);
+}
+
+//cut both trees at the same keys, combine the pieces side by side, then
+//bulk build the result from the pieces in order.
+template<typename Params>
+void btree_base<Params>::combine(btree_base &other, CombineMode mode, bool take, size_t threads){
+
+	typedef typename Params::init_type init_type;
+	if (threads == 0){
+		threads = btree_default_threads();
+	}
+
+	// cut points are keys at even ranks of the larger tree; equal keys
+	// always fall in the same piece, since both trees are cut at the
+	// lower bound of the same key. Small inputs stay in one piece.
+	const btree_base &larger = btree_size >= other.btree_size ? *this : other;
+	size_t total = btree_size + other.btree_size;
+	size_t pieces = std::max<size_t>(1, std::min(threads * 4, total / 8192));
+	std::vector<Node*> ourCuts(pieces + 1, nullptr), theirCuts(pieces + 1, nullptr);
+	std::vector<size_t> ourPos(pieces + 1, 0), theirPos(pieces + 1, 0);
+	ourCuts[0] = firstNode;
+	theirCuts[0] = other.firstNode;
+	for (size_t t = 1; t < pieces; ++t){
+		size_t at;
+		const Node *cutNode = larger.nodeAt(t * larger.btree_size / pieces, at);
+		const key_type &cut = cutNode->element(at);
+		ourCuts[t] = lowerBoundNode(cut, ourPos[t]);
+		theirCuts[t] = other.lowerBoundNode(cut, theirPos[t]);
+	}
+
+	std::vector<std::vector<init_type> > parts(pieces);
+	btree_parallel_for(pieces, threads, [&](size_t t){
+		std::vector<init_type> &out = parts[t];
+		Node *a = ourCuts[t];
+		size_t ai = ourPos[t];
+		Node *b = theirCuts[t];
+		size_t bi = theirPos[t];
+		Node *aEnd = ourCuts[t + 1];
+		size_t aEndPos = ourPos[t + 1];
+		Node *bEnd = theirCuts[t + 1];
+		size_t bEndPos = theirPos[t + 1];
+		auto ours = [&]{
+			out.push_back(copyElement(a, ai));
+			btree_increment(a, ai);
+		};
+		auto theirs = [&]{
+			out.push_back(take ? moveElement(b, bi) : copyElement(b, bi));
+			btree_increment(b, bi);
+		};
+		while ((a != aEnd || ai != aEndPos) && (b != bEnd || bi != bEndPos)){
+			if (compare_t(a->element(ai), b->element(bi))){
+				if (mode == combineIntersection){
+					btree_increment(a, ai);
+				}
+				else{
+					ours();
+				}
+			}
+			else if (compare_t(b->element(bi), a->element(ai))){
+				if (mode == combineMerge || mode == combineUnion){
+					theirs();
+				}
+				else{
+					btree_increment(b, bi);
+				}
+			}
+			else if (mode == combineMerge){
+				ours();
+			}
+			else{
+				if (mode != combineDifference){
+					ours();
+				}
+				else{
+					btree_increment(a, ai);
+				}
+				btree_increment(b, bi);
+			}
+		}
+		if (mode != combineIntersection){
+			while (a != aEnd || ai != aEndPos){
+				ours();
+			}
+		}
+		if (mode == combineMerge || mode == combineUnion){
+			while (b != bEnd || bi != bEndPos){
+				theirs();
+			}
+		}
+	});
+
+	// the result is the pieces end to end; find an element's piece by its index.
+	std::vector<size_t> offsets(pieces + 1, 0);
+	for (size_t t = 0; t < pieces; ++t){
+		offsets[t + 1] = offsets[t] + parts[t].size();
+	}
+	buildParallel([&parts, &offsets](size_t p) -> init_type&&{
+		size_t t = size_t(std::upper_bound(offsets.begin(), offsets.end(), p) - offsets.begin()) - 1;
+		return std::move(parts[t][p - offsets[t]]);
+	}, offsets[pieces], 1.0, threads);
+}
+
+//binary snapshot to a stream
+template<typename Params>
+void btree_base<Params>::serialize(std::ostream& os) const{
+
+	btree_stream_writer out(os);
+	writeSnapshot(out);
+}
+
+//snapshot size
+template<typename Params>
+size_t btree_base<Params>::serialized_size() const{
+
+	size_t slotBytes = sizeof(key_type) + (has_mapped ? sizeof(mapped_storage) : 0);
+	size_t nodes = btree_size != 0 ? countNodes(baseNode) : 0;
+	return sizeof(btree_snapshot_header) + nodes * sizeof(btree_snapshot_node) + btree_size * slotBytes;
+}
+
+//binary snapshot to a buffer
+template<typename Params>
+size_t btree_base<Params>::serialize(std::byte *out, size_t capacity) const{
+
+	btree_buffer_writer writer(out, capacity);
+	writeSnapshot(writer);
+	return writer.written();
+}
+
+//load a snapshot from a stream
+template<typename Params>
+void btree_base<Params>::deserialize(std::istream& is){
+
+	btree_stream_reader in(is);
+	readSnapshot(in);
+}
+
+//load a snapshot from a buffer
+template<typename Params>
+size_t btree_base<Params>::deserialize(const std::byte *data, size_t size){
+
+	btree_buffer_reader in(data, size);
+	readSnapshot(in);
+	return in.consumed();
+}
+
+//count the nodes of a subtree
+template<typename Params>
+size_t btree_base<Params>::countNodes(const Node *node){
+
+	size_t nodes = 1;
+	if (node->hasChildren()){
+		for (size_t i =0; i<=node->num_element; ++i){
+			nodes += countNodes(node->child(i));
+		}
+	}
+	return nodes;
+}
+
+//header, then every node in pre-order
+template<typename Params>
+template<typename Writer>
+void btree_base<Params>::writeSnapshot(Writer &out) const{
+
+	static_assert(std::is_trivially_copyable<key_type>::value &&
+			std::is_trivially_copyable<mapped_storage>::value,
+			"btree snapshots store elements as raw bytes, so they must be trivially copyable");
+
+	if (nodeWidth() > btree_snapshot_max_width){
+		throw std::runtime_error("btree: node width too large for a snapshot");
+	}
+
+	btree_snapshot_header header = {};
+	std::memcpy(header.magic, btree_snapshot_magic, sizeof(header.magic));
+	header.formatVersion = btree_snapshot_version;
+	header.byteOrder = btree_snapshot_byte_order;
+	header.keySize = uint32_t(sizeof(key_type));
+	header.mappedSize = has_mapped ? uint32_t(sizeof(mapped_storage)) : 0;
+	header.multi = multi ? 1 : 0;
+	header.nodeWidth = nodeWidth();
+	header.size = btree_size;
+	header.nodeCount = btree_size != 0 ? countNodes(baseNode) : 0;
+	out.write(&header, sizeof(header));
+	if (header.nodeCount != 0){
+		writeSubtree(baseNode, out);
+	}
+}
+
+//one node block: kind and count, the keys, the mapped values, then the subtrees
+template<typename Params>
+template<typename Writer>
+void btree_base<Params>::writeSubtree(const Node *node, Writer &out) const{
+
+	btree_snapshot_node block = {node->leaf ? 1u : 0u, uint32_t(node->num_element)};
+	out.write(&block, sizeof(block));
+	out.write(node->elements(), node->num_element * sizeof(key_type));
+	if constexpr (has_mapped){
+		out.write(node->mappedValues(), node->num_element * sizeof(mapped_storage));
+	}
+	if (node->hasChildren()){
+		for (size_t i =0; i<=node->num_element; ++i){
+			writeSubtree(node->child(i), out);
+		}
+	}
+}
+
+//check the header, build the saved tree aside and swap it in once it is complete.
+template<typename Params>
+template<typename Reader>
+void btree_base<Params>::readSnapshot(Reader &in){
+
+	static_assert(std::is_trivially_copyable<key_type>::value &&
+			std::is_trivially_copyable<mapped_storage>::value,
+			"btree snapshots store elements as raw bytes, so they must be trivially copyable");
+
+	btree_snapshot_header header;
+	in.read(&header, sizeof(header));
+	if (std::memcmp(header.magic, btree_snapshot_magic, sizeof(header.magic)) != 0 ||
+			header.formatVersion != btree_snapshot_version){
+		throw std::runtime_error("btree: not a snapshot of a known format");
+	}
+	if (header.byteOrder != btree_snapshot_byte_order){
+		throw std::runtime_error("btree: snapshot was written with another byte order");
+	}
+	if (header.keySize != sizeof(key_type) ||
+			header.mappedSize != (has_mapped ? sizeof(mapped_storage) : 0) ||
+			(header.multi != 0 && !multi)){
+		throw std::runtime_error("btree: snapshot holds a different element type");
+	}
+	if (header.nodeWidth < 3 || header.nodeWidth > btree_snapshot_max_width || (fanout != 0 && header.nodeWidth != fanout)){
+		throw std::runtime_error("btree: snapshot has an unusable node width");
+	}
+	if ((header.size == 0) != (header.nodeCount == 0)){
+		throw std::runtime_error("btree: snapshot is malformed");
+	}
+
+	btree_base loaded(size_t(header.nodeWidth), compare_t.comp, get_allocator());
+	if (header.nodeCount != 0){
+		size_t leafDepth = 0;
+		uint64_t nodesLeft = header.nodeCount;
+		uint64_t elems = 0;
+		loaded.btree_size = size_t(header.size);
+		loaded.baseNode = loaded.readSubtree(in, nullptr, 0, 1, leafDepth, nodesLeft, elems);
+		if (nodesLeft != 0 || elems != header.size){
+			throw std::runtime_error("btree: snapshot is malformed");
+		}
+	}
+	swap(loaded);
+}
+
+//read one node block and the blocks of its subtrees; the first and last
+//leaves are the first and last leaf blocks read.
+template<typename Params>
+template<typename Reader>
+typename btree_base<Params>::Node* btree_base<Params>::readSubtree(Reader &in, Node *parent, size_t childno, size_t depth,
+		size_t &leafDepth, uint64_t &nodesLeft, uint64_t &elems){
+
+	// every level at least doubles the element count, so a deeper tree cannot be real.
+	static constexpr size_t maxDepth = 64;
+
+	btree_snapshot_node block;
+	in.read(&block, sizeof(block));
+	bool leaf = block.leaf != 0;
+	size_t n = block.num_element;
+	if (nodesLeft == 0 || block.leaf > 1 || n == 0 || n > nodeWidth() || n > btree_size - elems ||
+			depth > maxDepth || (leafDepth != 0 && (leaf ? depth != leafDepth : depth >= leafDepth))){
+		throw std::runtime_error("btree: snapshot is malformed");
+	}
+	--nodesLeft;
+	elems += n;
+
+	// the loaded tree is dropped whole if anything below throws, so
+	// nodes need no cleanup of their own here.
+	Node *node = newNode(parent, leaf);
+	node->childno = childno;
+	in.read(node->elements(), n * sizeof(key_type));
+	if constexpr (has_mapped){
+		in.read(node->mappedValues(), n * sizeof(mapped_storage));
+	}
+	node->num_element = n;
+
+	if (leaf){
+		leafDepth = depth;
+		if (firstNode == nullptr){
+			firstNode = node;
+		}
+		lastNode = node;
+		return node;
+	}
+	for (size_t i =0; i<=n; ++i){
+		node->child(i) = readSubtree(in, node, i, depth + 1, leafDepth, nodesLeft, elems);
+		node->subtreeCount(i) = subtreeSize(node->child(i));
+	}
+	return node;
+}
+
+// btree iterators begin
+template<typename Params> typename btree_base<Params>::iterator
+btree_base<Params>::begin() const {
+	return iterator(firstNode, 0, this);
+}
+
+// btree iterators end
+template<typename Params> typename btree_base<Params>::iterator
+btree_base<Params>::end() const {
+	return iterator(nullptr, 0, this);
+}
+// btree iterators cbegin
+template<typename Params>
+typename btree_base<Params>::const_iterator btree_base<Params>::cbegin() const {
+	return const_iterator(begin());
+}
+
+// btree iterators cend
+template<typename Params>
+typename btree_base<Params>::const_iterator btree_base<Params>::cend() const {
+	return const_iterator(end());
+}
+// btree iterators rbegin
+template<typename Params>
+typename btree_base<Params>::reverse_iterator btree_base<Params>::rbegin() const {
+	return reverse_iterator(end());
+}
+// btree iterators rend
+template<typename Params>
+typename btree_base<Params>::reverse_iterator btree_base<Params>::rend() const {
+	return reverse_iterator(begin());
+}
+// btree iterators crbegin
+template<typename Params>
+typename btree_base<Params>::const_reverse_iterator btree_base<Params>::crbegin() const {
+	return const_reverse_iterator(end());
+}
+// btree iterators crend
+template<typename Params>
+typename btree_base<Params>::const_reverse_iterator btree_base<Params>::crend() const {
+	return const_reverse_iterator(begin());
+}
+
+//************end other above type cend and all
+
+//descend from the root using the in-node search at every level
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::Node* btree_base<Params>::locate(const K& key, size_t &pos) const{
+
+	Node *tempNode = baseNode;
+	while(tempNode != nullptr && tempNode->num_element != 0){
+
+		bool match;
+		size_t i = btree_find_in_node<fanout>(tempNode->elements(), tempNode->num_element, key, compare_t, match);
+		if (match){
+			pos = i;
+			return tempNode;
+		}
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		tempNode = tempNode->child(i);
 	}
+	pos = 0;
+	return nullptr;
 }
 
-//find the element in tree and return const iterator
-template<typename T>
-typename btree<T>::const_iterator btree<T>::find(const T& elem) const{
+//descend to the first element not less than key; the deepest node where
+//the search stopped short of the end is the answer when the leaf runs out.
+//with repeated keys the descent cannot stop at a match, since an equal
+//key may still sit further left.
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::Node* btree_base<Params>::lowerBoundNode(const K& key, size_t &pos) const{
 
-	if (baseNode == nullptr){
-		return iterator(NULL, 0, this);
+	Node *stop;
+	return lowerBoundFrom(baseNode, nullptr, 0, key, pos, stop);
+}
+
+//lower bound descent from any node, seeded with the answer from above it.
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::Node* btree_base<Params>::lowerBoundFrom(Node *tempNode, Node *candidate, size_t candidatePos,
+		const K& key, size_t &pos, Node *&stop) const{
+
+	stop = tempNode;
+	while(tempNode != nullptr){
+
+		stop = tempNode;
+		size_t nodesize = tempNode->num_element;
+		size_t i;
+		if constexpr (multi){
+			i = btree_lower_bound<fanout>(tempNode->elements(), nodesize, key, compare_t);
+		}
+		else{
+			bool match;
+			i = btree_find_in_node<fanout>(tempNode->elements(), nodesize, key, compare_t, match);
+			if (match){
+				candidate = tempNode;
+				candidatePos = i;
+				break;
+			}
+		}
+		if (i < nodesize){
+			candidate = tempNode;
+			candidatePos = i;
+		}
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		tempNode = tempNode->child(i);
 	}
+	pos = candidatePos;
+	return candidate;
+}
+
+//descend to the first element greater than key, as lowerBoundNode does.
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::Node* btree_base<Params>::upperBoundNode(const K& key, size_t &pos) const{
+
+	Node *candidate = nullptr;
+	size_t candidatePos = 0;
 	Node *tempNode = baseNode;
-	while(true){
+	while(tempNode != nullptr){
 
-		size_t nodesize = tempNode->vNodeElement->size();
-		if (nodesize==0){
-			return iterator(NULL, 0, this);
+		size_t nodesize = tempNode->num_element;
+		size_t i = btree_upper_bound<fanout>(tempNode->elements(), nodesize, key, compare_t);
+		if (i < nodesize){
+			candidate = tempNode;
+			candidatePos = i;
 		}
-		for(size_t i =0; i<nodesize; i++ ){
-			if ( tempNode->vNodeElement->at(i) == elem){
-				return const_iterator(tempNode, i, this);
-			}
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		tempNode = tempNode->child(i);
+	}
+	pos = candidatePos;
+	return candidate;
+}
 
-			if (i == nodesize-1 && elem > tempNode->vNodeElement->at(i)){
-				if (tempNode->children->empty() || tempNode->children->at(i+1)->vNodeElement->empty()){
-					return const_iterator(NULL, 0, this);
-				}
-				else{
-					tempNode = tempNode->children->at(i+1);
-					break;
-				}
+//climb from where the last search ended while key is past the node's upper separator
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::Node* btree_base<Params>::climbFor(Node *node, const K& key, Node *&candidate,
+		size_t &candidatePos) const{
+
+	candidate = nullptr;
+	candidatePos = 0;
+	while (node->pNode_n != nullptr){
+		Node *parent = node->pNode_n;
+		if (node->childno < parent->num_element && compare_t(key, parent->element(node->childno))){
+			candidate = parent;
+			candidatePos = node->childno;
+			break;
+		}
+		node = parent;
+	}
+	return node;
+}
+
+//prefetch the header and key array of a node about to be searched
+template<typename Params>
+void btree_base<Params>::prefetchNode(const Node *node) const{
+
+	const char *block = reinterpret_cast<const char*>(node);
+	size_t bytes = std::min<size_t>(Node::elementOffset() + nodeWidth() * sizeof(key_type), 8 * Node::cacheLine);
+	for (size_t offset = 0; offset < bytes; offset += Node::cacheLine){
+		__builtin_prefetch(block + offset);
+	}
+}
+
+//batched lookups: interleaved descents, each lane a finger search when the batch is sorted
+template<typename Params>
+template<typename Emit>
+void btree_base<Params>::findBatch(const key_type *keys, size_t n, Emit emit) const{
+
+	if (baseNode == nullptr){
+		for (size_t i = 0; i < n; ++i){
+			emit(i, nullptr, 0);
+		}
+		return;
+	}
+
+	// each lane is one lookup in flight. Unsorted keys are handed out one
+	// at a time; a sorted batch is cut into one run per lane, and a lane
+	// starts each lookup of its run from where the previous one ended.
+	struct Lane{
+		Node *node;
+		Node *candidate;
+		size_t candidatePos;
+		size_t index;
+		size_t end;
+	};
+	const bool sorted = std::is_sorted(keys, keys + n, compare_t);
+	Lane lanes[batchLanes];
+	size_t active = 0;
+	size_t next = 0;
+	for (size_t l = 0; l < batchLanes && next < n; ++l){
+		size_t end = sorted ? (l + 1) * n / batchLanes : next + 1;
+		if (end > next){
+			lanes[active++] = Lane{baseNode, nullptr, 0, next, end};
+			next = end;
+		}
+	}
+	while (active > 0){
+		size_t l = 0;
+		while (l < active){
+			Lane &lane = lanes[l];
+			const key_type &key = keys[lane.index];
+			Node *node = lane.node;
+			size_t nodesize = node->num_element;
+			size_t i;
+			bool done = false;
+			if constexpr (multi){
+				i = btree_lower_bound<fanout>(node->elements(), nodesize, key, compare_t);
 			}
-			if (elem > tempNode->vNodeElement->at(i)){
+			else{
+				i = btree_find_in_node<fanout>(node->elements(), nodesize, key, compare_t, done);
+			}
+			if (i < nodesize){
+				lane.candidate = node;
+				lane.candidatePos = i;
+			}
+			if (!done && node->hasChildren()){
+				lane.node = node->child(i);
+				prefetchNode(lane.node);
+				++l;
 				continue;
 			}
 
-			else if (elem < tempNode->vNodeElement->at(i)){
-				if (tempNode->children->empty() || tempNode->children->at(i)->vNodeElement->empty()){
-					return const_iterator(NULL, 0, this);
-				}
-				else{
-					tempNode = tempNode->children->at(i);
-					break;
-				}
+			Node *found = lane.candidate;
+			if (found != nullptr && compare_t(key, found->element(lane.candidatePos))){
+				found = nullptr;
+			}
+			emit(lane.index, found, found != nullptr ? lane.candidatePos : 0);
+
+			if (sorted && ++lane.index < lane.end){
+				lane.node = climbFor(node, keys[lane.index], lane.candidate, lane.candidatePos);
+				++l;
+			}
+			else if (!sorted && next < n){
+				lane = Lane{baseNode, nullptr, 0, next, next + 1};
+				++next;
+				++l;
+			}
+			else{
+				lane = lanes[--active];
 			}
 		}
+	}
+}
+
+//batched find
+template<typename Params>
+void btree_base<Params>::find_batch(const key_type *keys, size_t n, iterator *out){
+
+	findBatch(keys, n, [this, out](size_t i, Node *node, size_t pos){
+		out[i] = iterator(node, pos, this);
+	});
+}
+
+//batched find (const)
+template<typename Params>
+void btree_base<Params>::find_batch(const key_type *keys, size_t n, const_iterator *out) const{
+
+	findBatch(keys, n, [this, out](size_t i, Node *node, size_t pos){
+		out[i] = const_iterator(node, pos, this);
+	});
+}
+
+//find the element in tree and return iterator
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::iterator btree_base<Params>::find(const key_arg<K>& key){
+
+	const btree_base &self = *this;
+	const_iterator it = self.template find<K>(key);
+	return iterator(it.pNode, it.pindex, this);
+}
 
+//find the element in tree and return const iterator
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::const_iterator btree_base<Params>::find(const key_arg<K>& key) const{
+
+	size_t pos;
+	Node *tempNode;
+	if (multi){
+		tempNode = lowerBoundNode(key, pos);
+		if (tempNode != nullptr && compare_t(key, tempNode->element(pos))){
+			tempNode = nullptr;
+			pos = 0;
+		}
+	}
+	else{
+		tempNode = locate(key, pos);
 	}
+	return const_iterator(tempNode, pos, this);
 }
 
-//<<operator overloading
-template<typename T>
-std::ostream& operator<<(std::ostream& output, const btree<T>& inputtree) {
+//lower bound
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::iterator btree_base<Params>::lower_bound(const key_arg<K>& key){
 
-	if (inputtree.baseNode == nullptr){
-		output<<"";
-		return output;
+	size_t pos;
+	Node *tempNode = lowerBoundNode(key, pos);
+	return iterator(tempNode, pos, this);
+}
+
+//lower bound (const)
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::const_iterator btree_base<Params>::lower_bound(const key_arg<K>& key) const{
+
+	size_t pos;
+	Node *tempNode = lowerBoundNode(key, pos);
+	return const_iterator(tempNode, pos, this);
+}
+
+//upper bound
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::iterator btree_base<Params>::upper_bound(const key_arg<K>& key){
+
+	size_t pos;
+	Node *tempNode = upperBoundNode(key, pos);
+	return iterator(tempNode, pos, this);
+}
+
+//upper bound (const)
+template<typename Params>
+template<typename K>
+typename btree_base<Params>::const_iterator btree_base<Params>::upper_bound(const key_arg<K>& key) const{
+
+	size_t pos;
+	Node *tempNode = upperBoundNode(key, pos);
+	return const_iterator(tempNode, pos, this);
+}
+
+//equal range
+template<typename Params>
+template<typename K>
+std::pair<typename btree_base<Params>::iterator, typename btree_base<Params>::iterator>
+btree_base<Params>::equal_range(const key_arg<K>& key){
+
+	const btree_base &self = *this;
+	std::pair<const_iterator, const_iterator> range = self.template equal_range<K>(key);
+	return std::make_pair(iterator(range.first.pNode, range.first.pindex, this),
+			iterator(range.second.pNode, range.second.pindex, this));
+}
+
+//equal range (const)
+template<typename Params>
+template<typename K>
+std::pair<typename btree_base<Params>::const_iterator, typename btree_base<Params>::const_iterator>
+btree_base<Params>::equal_range(const key_arg<K>& key) const{
+
+	const_iterator first = lower_bound<K>(key);
+	if (multi){
+		return std::make_pair(first, upper_bound<K>(key));
 	}
+	const_iterator last = first;
+	if (last.pNode != nullptr && !compare_t(key, last.pNode->element(last.pindex))){
+		++last;
+	}
+	return std::make_pair(first, last);
+}
 
-	typename btree<T>::Node* tempNode = inputtree.baseNode;
-	std::queue<typename btree<T>::Node*> nQueue;
-	nQueue.push(tempNode);
+//count
+template<typename Params>
+template<typename K>
+size_t btree_base<Params>::count(const key_arg<K>& key) const{
 
-	while(!nQueue.empty()){
+	size_t pos;
+	if (!multi){
+		return locate(key, pos) != nullptr ? 1 : 0;
+	}
+	size_t matches = 0;
+	Node *tempNode = lowerBoundNode(key, pos);
+	while (tempNode != nullptr && !compare_t(key, tempNode->element(pos))){
+		++matches;
+		btree_increment(tempNode, pos);
+	}
+	return matches;
+}
 
-		tempNode = nQueue.front();
-		nQueue.pop();
-		for(size_t i =0; i<tempNode->vNodeElement->size(); ++i){
+//element count
+template<typename Params>
+size_t btree_base<Params>::size() const{
+
+	return btree_size;
+}
+
+//emptiness
+template<typename Params>
+bool btree_base<Params>::empty() const{
 
-			output << tempNode->vNodeElement->at(i) << " ";
+	return btree_size == 0;
+}
+
+//rank: the lower bound descent, adding up everything it passes on the left
+template<typename Params>
+template<typename K>
+size_t btree_base<Params>::rank(const key_arg<K>& key) const{
+
+	size_t before = 0;
+	const Node *tempNode = baseNode;
+	while (tempNode != nullptr){
+		size_t n = tempNode->num_element;
+		size_t i = btree_lower_bound<fanout>(tempNode->elements(), n, key, compare_t);
+		before += i;
+		if (!tempNode->hasChildren()){
+			break;
+		}
+		const size_t *counts = tempNode->subtreeCounts();
+		for (size_t c = 0; c < i; ++c){
+			before += counts[c];
+		}
+		if (!multi && i < n && !compare_t(key, tempNode->element(i))){
+			// a unique key: everything below it on the left is smaller.
+			return before + counts[i];
 		}
+		tempNode = tempNode->child(i);
+	}
+	return before;
+}
 
-		for(size_t i =0; i<=tempNode->vNodeElement->size(); ++i){
-			if (tempNode->children->empty()){
-				continue;
+//select
+template<typename Params>
+typename btree_base<Params>::const_reference btree_base<Params>::select(size_t k) const{
+
+	size_t pos;
+	const Node *tempNode = nodeAt(k, pos);
+	if (tempNode == nullptr){
+		throw std::out_of_range("btree: select index out of range");
+	}
+	return elementAt(tempNode, pos);
+}
+
+//iterator at an index
+template<typename Params>
+typename btree_base<Params>::iterator btree_base<Params>::nth(size_t k) const{
+
+	size_t pos;
+	Node *tempNode = nodeAt(k, pos);
+	return iterator(tempNode, pos, this);
+}
+
+//index of an iterator
+template<typename Params>
+size_t btree_base<Params>::index_of(const_iterator pos) const{
+
+	return indexOf(pos.pNode, pos.pindex);
+}
+
+//size of a subtree from its root's counts
+template<typename Params>
+size_t btree_base<Params>::subtreeSize(const Node *node){
+
+	size_t total = node->num_element;
+	if (node->hasChildren()){
+		const size_t *counts = node->subtreeCounts();
+		for (size_t i = 0; i <= node->num_element; ++i){
+			total += counts[i];
+		}
+	}
+	return total;
+}
+
+//adjust the counts of every subtree holding node
+template<typename Params>
+void btree_base<Params>::countPath(Node *node, ptrdiff_t delta){
+
+	for (; node->pNode_n != nullptr; node = node->pNode_n){
+		node->pNode_n->subtreeCount(node->childno) += size_t(delta);
+	}
+}
+
+//descend by count to the element at index k
+template<typename Params>
+typename btree_base<Params>::Node* btree_base<Params>::nodeAt(size_t k, size_t &pos) const{
+
+	pos = 0;
+	if (k >= btree_size){
+		return nullptr;
+	}
+	Node *tempNode = baseNode;
+	while (tempNode->hasChildren()){
+		const size_t *counts = tempNode->subtreeCounts();
+		size_t i = 0;
+		// skip whole subtrees, and the element after each, until k falls inside one.
+		while (k >= counts[i]){
+			k -= counts[i];
+			if (k == 0){
+				pos = i;
+				return tempNode;
 			}
-			nQueue.push(tempNode->children->at(i));
+			--k;
+			++i;
 		}
+		tempNode = tempNode->child(i);
+	}
+	pos = k;
+	return tempNode;
+}
+
+//climb to the root counting everything to the left of (node, pos)
+template<typename Params>
+size_t btree_base<Params>::indexOf(const Node *node, size_t pos) const{
 
+	if (node == nullptr){
+		return btree_size;
+	}
+	size_t before = pos;
+	if (node->hasChildren()){
+		// the subtrees left of element pos are children 0..pos.
+		for (size_t i = 0; i <= pos; ++i){
+			before += node->subtreeCount(i);
+		}
+	}
+	for (; node->pNode_n != nullptr; node = node->pNode_n){
+		const Node *parent = node->pNode_n;
+		before += node->childno;
+		for (size_t i = 0; i < node->childno; ++i){
+			before += parent->subtreeCount(i);
+		}
 	}
+	return before;
+}
 
-	return output;
+//jump n elements; steps that stay inside a leaf need no descent
+template<typename Params>
+void btree_base<Params>::advance(Node *&node, size_t &pos, ptrdiff_t n) const{
+
+	if (node != nullptr && !node->hasChildren() && ptrdiff_t(pos) + n >= 0 && size_t(ptrdiff_t(pos) + n) < node->num_element){
+		pos = size_t(ptrdiff_t(pos) + n);
+		return;
+	}
+	size_t target = size_t(ptrdiff_t(indexOf(node, pos)) + n);
+	node = nodeAt(target, pos);
 }
-//copy constructor
-template<typename T>
-btree<T>::btree(const btree<T>& inputtree) :baseNode(nullptr), firstNode(nullptr), lastNode(nullptr), maxNodeElems_t(
-		inputtree.maxNodeElems_t), btree_size(0){
 
-	typename btree<T>::Node* tempNode = inputtree.baseNode;
-	std::queue<typename btree<T>::Node*> nQueue;
-	nQueue.push(tempNode);
+//range scan
+template<typename Params>
+template<typename Fn>
+size_t btree_base<Params>::scan(const key_type& lo, const key_type& hi, Fn fn) const{
 
-	while(!nQueue.empty()){
+	size_t visited = 0;
+	if (baseNode != nullptr && compare_t(lo, hi)){
+		scanSubtree(baseNode, &lo, hi, fn, visited);
+	}
+	return visited;
+}
 
-		tempNode = nQueue.front();
-		nQueue.pop();
-		for(size_t i =0; i<tempNode->vNodeElement->size(); ++i){
+//in-order walk below node; leaves are streamed as one contiguous run.
+template<typename Params>
+template<typename Fn>
+bool btree_base<Params>::scanSubtree(const Node *node, const key_type *lo, const key_type& hi, Fn &fn, size_t &visited) const{
+
+	const key_type *elems = node->elements();
+	size_t n = node->num_element;
+	size_t i = lo != nullptr ? btree_lower_bound<fanout>(elems, n, *lo, compare_t) : 0;
+
+	if (!node->hasChildren()){
+		size_t end = btree_lower_bound<fanout>(elems, n, hi, compare_t);
+		for (; i < end; ++i){
+			++visited;
+			if (!btree_scan_visit(fn, elementAt(node, i))){
+				return false;
+			}
+		}
+		return end == n;
+	}
 
-			insert(tempNode->vNodeElement->at(i));
+	for (; i <= n; ++i){
+		// only the first subtree can still hold elements below lo.
+		if (!scanSubtree(node->child(i), lo, hi, fn, visited)){
+			return false;
+		}
+		lo = nullptr;
+		if (i == n){
+			break;
+		}
+		if (!compare_t(elems[i], hi)){
+			return false;
 		}
+		++visited;
+		if (!btree_scan_visit(fn, elementAt(node, i))){
+			return false;
+		}
+	}
+	return true;
+}
 
-		for(size_t i =0; i<=tempNode->vNodeElement->size(); ++i){
-			if (tempNode->children->empty()){
-				continue;
+//parallel for each
+template<typename Params>
+template<typename Fn>
+size_t btree_base<Params>::parallel_for_each(Fn fn, size_t threads) const{
+
+	auto visit = [&fn](size_t, const_reference elem){
+		fn(elem);
+	};
+	return parallelWalk(nullptr, nullptr, threads != 0 ? threads : btree_default_threads(), visit);
+}
+
+//parallel range scan
+template<typename Params>
+template<typename Fn>
+size_t btree_base<Params>::parallel_scan(const key_type& lo, const key_type& hi, Fn fn, size_t threads) const{
+
+	if (!compare_t(lo, hi)){
+		return 0;
+	}
+	auto visit = [&fn](size_t, const_reference elem){
+		fn(elem);
+	};
+	return parallelWalk(&lo, &hi, threads != 0 ? threads : btree_default_threads(), visit);
+}
+
+//parallel reduce
+template<typename Params>
+template<typename R, typename Fold, typename Combine>
+R btree_base<Params>::parallel_reduce(R init, Fold fold, Combine combine, size_t threads) const{
+
+	if (threads == 0){
+		threads = btree_default_threads();
+	}
+	// one accumulator per worker, on its own cache lines.
+	struct alignas(64) Slot{
+		R acc;
+	};
+	std::vector<Slot> slots(threads, Slot{init});
+	auto visit = [&slots, &fold](size_t worker, const_reference elem){
+		slots[worker].acc = fold(std::move(slots[worker].acc), elem);
+	};
+	parallelWalk(nullptr, nullptr, threads, visit);
+	R result = std::move(slots[0].acc);
+	for (size_t w = 1; w < threads; ++w){
+		result = combine(std::move(result), std::move(slots[w].acc));
+	}
+	return result;
+}
+
+//parallel reduce over a range
+template<typename Params>
+template<typename R, typename Fold, typename Combine>
+R btree_base<Params>::parallel_reduce(const key_type& lo, const key_type& hi, R init, Fold fold, Combine combine,
+		size_t threads) const{
+
+	if (threads == 0){
+		threads = btree_default_threads();
+	}
+	struct alignas(64) Slot{
+		R acc;
+	};
+	std::vector<Slot> slots(threads, Slot{init});
+	auto visit = [&slots, &fold](size_t worker, const_reference elem){
+		slots[worker].acc = fold(std::move(slots[worker].acc), elem);
+	};
+	if (compare_t(lo, hi)){
+		parallelWalk(&lo, &hi, threads, visit);
+	}
+	R result = std::move(slots[0].acc);
+	for (size_t w = 1; w < threads; ++w){
+		result = combine(std::move(result), std::move(slots[w].acc));
+	}
+	return result;
+}
+
+//split the walk into subtree tasks: a task below the grain is walked by
+//the thread that took it, a larger one spawns its children as new tasks.
+template<typename Params>
+template<typename Visit>
+size_t btree_base<Params>::parallelWalk(const key_type *lo, const key_type *hi, size_t workers, Visit &visit) const{
+
+	if (baseNode == nullptr){
+		return 0;
+	}
+	// enough pieces for every worker to steal a few, none too small to be worth a task.
+	const size_t grain = std::max<size_t>(4096, btree_size / (workers * 16));
+	if (btree_size <= grain){
+		workers = 1;
+	}
+
+	struct alignas(64) Counter{
+		size_t visited;
+	};
+	std::vector<Counter> counters(workers, Counter{0});
+	std::vector<WalkTask> roots(1, WalkTask{baseNode, lo, hi});
+	btree_work_stealing(roots, workers, [&](const WalkTask &task, size_t worker, auto &spawn){
+		const Node *node = task.node;
+		const key_type *elems = node->elements();
+		size_t n = node->num_element;
+		size_t from = task.lo != nullptr ? btree_lower_bound<fanout>(elems, n, *task.lo, compare_t) : 0;
+		size_t to = task.hi != nullptr ? btree_lower_bound<fanout>(elems, n, *task.hi, compare_t) : n;
+		size_t &visited = counters[worker].visited;
+		if (node->hasChildren()){
+			// only the outermost children in range still need bounds.
+			for (size_t c = from; c <= to; ++c){
+				const key_type *clo = c == from ? task.lo : nullptr;
+				const key_type *chi = c == to ? task.hi : nullptr;
+				if (node->subtreeCount(c) > grain){
+					spawn(WalkTask{node->child(c), clo, chi});
+				}
+				else{
+					walkSubtree(node->child(c), clo, chi, worker, visit, visited);
+				}
 			}
-			nQueue.push(tempNode->children->at(i));
 		}
+		for (size_t i = from; i < to; ++i){
+			visit(worker, elementAt(node, i));
+		}
+		visited += to - from;
+	});
+
+	size_t total = 0;
+	for (size_t w = 0; w < workers; ++w){
+		total += counters[w].visited;
+	}
+	return total;
+}
+
+//one thread's share of a walk
+template<typename Params>
+template<typename Visit>
+void btree_base<Params>::walkSubtree(const Node *node, const key_type *lo, const key_type *hi, size_t worker,
+		Visit &visit, size_t &visited) const{
+
+	const key_type *elems = node->elements();
+	size_t n = node->num_element;
+	size_t from = lo != nullptr ? btree_lower_bound<fanout>(elems, n, *lo, compare_t) : 0;
+	size_t to = hi != nullptr ? btree_lower_bound<fanout>(elems, n, *hi, compare_t) : n;
+	for (size_t i = from; i <= to; ++i){
+		if (node->hasChildren()){
+			walkSubtree(node->child(i), i == from ? lo : nullptr, i == to ? hi : nullptr, worker, visit, visited);
+		}
+		if (i < to){
+			visit(worker, elementAt(node, i));
+		}
+	}
+	visited += to - from;
+}
 
+//copy constructor
+template<typename Params>
+btree_base<Params>::btree_base(const btree_base& inputtree) :baseNode(nullptr), firstNode(nullptr), lastNode(nullptr), maxNodeElems_t(
+		inputtree.maxNodeElems_t), btree_size(0), compare_t(inputtree.compare_t),
+		leafPool(Node::blockSize(maxNodeElems_t, true),
+				std::allocator_traits<allocator_type>::select_on_container_copy_construction(inputtree.get_allocator())),
+		internalPool(Node::blockSize(maxNodeElems_t, false), leafPool.get_allocator()){
+
+	if (inputtree.baseNode != nullptr){
+		baseNode = cloneSubtree(inputtree.baseNode, nullptr, firstNode, lastNode);
+		btree_size = inputtree.btree_size;
 	}
 }
 //move constructor
-template<typename T>
-btree<T>::btree(btree<T> && rhs) :baseNode(rhs.baseNode), firstNode(rhs.firstNode), lastNode(rhs.lastNode),
-	maxNodeElems_t(rhs.maxNodeElems_t), btree_size(rhs.btree_size) {
+template<typename Params>
+btree_base<Params>::btree_base(btree_base && rhs) :baseNode(rhs.baseNode), firstNode(rhs.firstNode), lastNode(rhs.lastNode),
+	maxNodeElems_t(rhs.maxNodeElems_t), btree_size(rhs.btree_size), compare_t(rhs.compare_t),
+	leafPool(std::move(rhs.leafPool)), internalPool(std::move(rhs.internalPool)) {
+
+	rhs.baseNode = nullptr;
+	rhs.firstNode = nullptr;
+	rhs.lastNode = nullptr;
+	rhs.btree_size = 0;
 }
 
 //operator = overloading
-template<typename T>
-btree<T>& btree<T>::operator=(const btree<T>& inputtree) {
+template<typename Params>
+btree_base<Params>& btree_base<Params>::operator=(const btree_base& inputtree) {
 	if(this != &inputtree ){
-		baseNode = nullptr;
-		firstNode = nullptr;
-		lastNode=nullptr;
-		maxNodeElems_t = inputtree.maxNodeElems_t;
-		btree_size =0;
-		typename btree<T>::Node* tempNode = inputtree.baseNode;
-		std::queue<typename btree<T>::Node*> nQueue;
-		nQueue.push(tempNode);
-
-		while(!nQueue.empty()){
-			tempNode = nQueue.front();
-			nQueue.pop();
-			for(size_t i =0; i<tempNode->vNodeElement->size(); ++i){
-				insert(tempNode->vNodeElement->at(i));
-			}
-			for(size_t i =0; i<=tempNode->vNodeElement->size(); ++i){
-				if (tempNode->children->empty()){
-					continue;
-				}
-				nQueue.push(tempNode->children->at(i));
-			}
+		if (maxNodeElems_t != inputtree.maxNodeElems_t){
+			// node sizes follow the width, so build in pools of the new size.
+			btree_base resized(inputtree.maxNodeElems_t, inputtree.compare_t.comp, get_allocator());
+			resized = inputtree;
+			swap(resized);
+			return *this;
+		}
+
+		// clone first so a throwing copy leaves this tree untouched.
+		Node *leftmost = nullptr;
+		Node *rightmost = nullptr;
+		Node *root = nullptr;
+		if (inputtree.baseNode != nullptr){
+			root = cloneSubtree(inputtree.baseNode, nullptr, leftmost, rightmost);
 		}
+
+		freeSubtree(baseNode);
+		baseNode = root;
+		firstNode = leftmost;
+		lastNode = rightmost;
+		btree_size = inputtree.btree_size;
+		compare_t = inputtree.compare_t;
 	}
 
 	return *this;
 }
 //move operator = overloading
-template<typename T> btree<T>&
-btree<T>::operator=(btree<T> && original) {
+template<typename Params> btree_base<Params>&
+btree_base<Params>::operator=(btree_base && original) {
 	if (this != &original) {
-		delete baseNode;
+		// original is left empty, with this tree's old (released) pools.
+		releaseNodes();
+		swap(original);
+	}
+	return *this;
+}
+
+//btree constructor.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree<T, Compare, Fanout, Alloc>::btree(size_t maxNodeElems_, const Compare& comp, const Alloc& alloc)
+	:base_type(maxNodeElems_, comp, alloc){
+}
+
+//btree range constructor.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+template<typename InputIt, typename>
+btree<T, Compare, Fanout, Alloc>::btree(InputIt first, InputIt last, size_t maxNodeElems_, double fillFactor,
+		const Compare& comp, const Alloc& alloc)
+	:btree(maxNodeElems_, comp, alloc){
+
+	this->bulk_load(first, last, fillFactor);
+}
+
+//btree insert
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+std::pair<typename btree<T, Compare, Fanout, Alloc>::iterator, bool> btree<T, Compare, Fanout, Alloc>::insert(const T &elem){
 
-		baseNode = nullptr;
-		firstNode = nullptr;
-		lastNode = nullptr;
-		baseNode = original.baseNode;
-		firstNode = original.firstNode;
-		lastNode = original.lastNode;
-		maxNodeElems_t = original.maxNodeElems_t;
-		btree_size = original.btree_size;
+	return this->insertUnique(elem);
+}
+
+//btree insert (move)
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+std::pair<typename btree<T, Compare, Fanout, Alloc>::iterator, bool> btree<T, Compare, Fanout, Alloc>::insert(T &&elem){
+
+	return this->insertUnique(std::move(elem));
+}
 
+//btree emplace
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+template<typename... Args>
+std::pair<typename btree<T, Compare, Fanout, Alloc>::iterator, bool> btree<T, Compare, Fanout, Alloc>::emplace(Args&&... args){
 
-		original.baseNode = new Node(maxNodeElems_t);
-		original.firstNode = baseNode;
-		original.lastNode = baseNode;
+	return this->insertUnique(T(std::forward<Args>(args)...));
+}
+
+//btree insert of an ascending run
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+template<typename InputIt>
+size_t btree<T, Compare, Fanout, Alloc>::insert_sorted(InputIt first, InputIt last){
+
+	size_t inserted = 0;
+	const_iterator hint = this->cend();
+	for (; first != last; ++first){
+		std::pair<iterator, bool> result = this->insertUniqueAfter(hint, *first);
+		hint = result.first;
+		inserted += result.second ? 1 : 0;
 	}
-	return *this;
+	return inserted;
+}
+
+//<<operator overloading
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+std::ostream& operator<<(std::ostream& output, const btree<T, Compare, Fanout, Alloc>& inputtree) {
+
+	if (inputtree.baseNode == nullptr){
+		output<<"";
+		return output;
+	}
+
+	typename btree<T, Compare, Fanout, Alloc>::Node* tempNode = inputtree.baseNode;
+	std::queue<typename btree<T, Compare, Fanout, Alloc>::Node*> nQueue;
+	nQueue.push(tempNode);
+
+	while(!nQueue.empty()){
+
+		tempNode = nQueue.front();
+		nQueue.pop();
+		for(size_t i =0; i<tempNode->num_element; ++i){
+
+			output << tempNode->element(i) << " ";
+		}
+
+		for(size_t i =0; i<=tempNode->num_element; ++i){
+			if (!tempNode->hasChildren()){
+				continue;
+			}
+			nQueue.push(tempNode->child(i));
+		}
+
+	}
+
+	return output;
 }
 #endif
 //**********************************
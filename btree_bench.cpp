@@ -0,0 +1,539 @@
+/**
+ * Benchmarks for btree and btree_map against std::set and std::map.
+ *
+ * Every container is run through the same workloads on the same keys:
+ * inserts in random, sorted and zipfian order, lookups that hit and that
+ * miss, short range scans, a full iteration, a copy and erasing every
+ * key.  Keys are 32 and 64 bit integers and 20 character strings; the
+ * btrees run at several node widths.  Each result is the best of a few
+ * runs and gives the time per operation, the bytes the container
+ * allocated per element (what the keys themselves own, such as a
+ * string's buffer, is not counted) and, where the kernel lets us open
+ * perf counters, the L1 data cache and last level cache misses per
+ * operation.  String keys also run through btree_string_set, whose
+ * prefix-compressed nodes hold the key bytes themselves, so its bytes
+ * per element include the keys, and integer keys through
+ * btree_packed_set.  Integer keys here are hashed, spread over the
+ * whole range, which is the worst case for its packed leaves.
+ *
+ * Build and run with, e.g.
+ *     g++ -std=c++17 -O2 -DNDEBUG -I. btree_bench.cpp -o btree_bench
+ *     ./btree_bench -n 1000000 -r 3 -w 16,32,64,128 [filter]
+ * where filter, when given, keeps only the results whose
+ * "container/key/workload" name contains it.
+ **/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "btree.h"
+#include "btree_map.h"
+#include "btree_string.h"
+#include "btree_packed.h"
+
+// bytes currently held through bench_allocator.
+static size_t bench_live_bytes = 0;
+
+// std::allocator that keeps count of the bytes it hands out.
+template<typename T>
+struct bench_allocator{
+	typedef T value_type;
+
+	bench_allocator() = default;
+	template<typename U>
+	bench_allocator(const bench_allocator<U>&){}
+
+	T* allocate(size_t n){
+		bench_live_bytes += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T *p, size_t n){
+		bench_live_bytes -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template<typename U>
+	bool operator==(const bench_allocator<U>&) const{ return true; }
+	template<typename U>
+	bool operator!=(const bench_allocator<U>&) const{ return false; }
+};
+
+// keeps the optimiser from dropping the work whose result it feeds.
+static volatile uint64_t bench_sink;
+
+//the hardware counters of this thread, when the kernel allows it
+class bench_counters{
+public:
+	bench_counters(): leader(-1), follower(-1){
+#ifdef __linux__
+		leader = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1);
+		if (leader >= 0){
+			follower = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+			if (follower < 0){
+				::close(leader);
+				leader = -1;
+			}
+		}
+#endif
+	}
+
+	~bench_counters(){
+#ifdef __linux__
+		if (leader >= 0){
+			::close(follower);
+			::close(leader);
+		}
+#endif
+	}
+
+	bench_counters(const bench_counters&) = delete;
+	bench_counters& operator=(const bench_counters&) = delete;
+
+	bool available() const{
+		return leader >= 0;
+	}
+
+	void start(){
+#ifdef __linux__
+		if (leader >= 0){
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	// stops counting and reads the L1D read misses and the LLC misses.
+	void stop(uint64_t &l1d, uint64_t &llc){
+		l1d = llc = 0;
+#ifdef __linux__
+		if (leader >= 0){
+			ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			uint64_t values[3];
+			if (::read(leader, values, sizeof(values)) == ssize_t(sizeof(values))){
+				l1d = values[1];
+				llc = values[2];
+			}
+		}
+#endif
+	}
+
+private:
+#ifdef __linux__
+	static int open(uint32_t type, uint64_t config, int group){
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = group < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+		return int(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+	}
+#endif
+
+	int leader;
+	int follower;
+};
+
+// one line of the report.
+struct bench_result{
+	double ns;
+	double bytes;
+	double l1d;
+	double llc;
+};
+
+// what a run was asked for on the command line.
+struct bench_options{
+	size_t n = 1000000;
+	size_t reps = 3;
+	std::vector<size_t> widths = {16, 32, 64, 128};
+	std::string filter;
+};
+
+static bench_options options;
+static bench_counters counters;
+
+//print one result
+static void report(const std::string& name, const bench_result& r){
+
+	std::cout << std::left << std::setw(44) << name << std::right << std::fixed
+		<< std::setprecision(1) << std::setw(10) << r.ns;
+	if (r.bytes >= 0){
+		std::cout << std::setw(12) << r.bytes;
+	}
+	else{
+		std::cout << std::setw(12) << "-";
+	}
+	if (counters.available()){
+		std::cout << std::setprecision(2) << std::setw(12) << r.l1d << std::setw(12) << r.llc;
+	}
+	std::cout << std::endl;
+}
+
+//times body once per rep (after setup, which is not timed) and keeps the fastest run
+template<typename Setup, typename Body>
+static bench_result measure(size_t ops, Setup setup, Body body){
+
+	bench_result best = {1e300, -1, 0, 0};
+	for (size_t rep = 0; rep < options.reps; ++rep){
+		setup();
+		uint64_t l1d, llc;
+		counters.start();
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		body();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		counters.stop(l1d, llc);
+		double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / double(ops);
+		if (ns < best.ns){
+			best.ns = ns;
+			best.l1d = double(l1d) / double(ops);
+			best.llc = double(llc) / double(ops);
+		}
+	}
+	return best;
+}
+
+//bijective 64 bit mixer, so distinct indices give distinct keys
+static uint64_t mix64(uint64_t x){
+
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+//bijective 32 bit mixer
+static uint32_t mix32(uint32_t x){
+
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+// the i-th key of each type; distinct for distinct i.
+template<typename K> struct bench_key;
+
+template<> struct bench_key<int>{
+	static const char* name(){ return "int"; }
+	static int make(uint64_t i){ return int(mix32(uint32_t(i))); }
+	static uint64_t touch(int k){ return uint64_t(k); }
+};
+
+template<> struct bench_key<uint64_t>{
+	static const char* name(){ return "uint64"; }
+	static uint64_t make(uint64_t i){ return mix64(i); }
+	static uint64_t touch(uint64_t k){ return k; }
+};
+
+template<> struct bench_key<std::string>{
+	static const char* name(){ return "string"; }
+	static std::string make(uint64_t i){
+		char buf[24];
+		std::snprintf(buf, sizeof(buf), "key:%016llx", static_cast<unsigned long long>(mix64(i)));
+		return std::string(buf);
+	}
+	static uint64_t touch(const std::string& k){ return k.size() + uint8_t(k[4]); }
+};
+
+//n draws from a zipfian distribution (theta 0.99) over [0, n), as YCSB does
+static std::vector<size_t> zipfian(size_t n, std::mt19937_64 &rng){
+
+	const double theta = 0.99;
+	double zetan = 0;
+	for (size_t i = 1; i <= n; ++i){
+		zetan += 1.0 / std::pow(double(i), theta);
+	}
+	double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+	double alpha = 1.0 / (1.0 - theta);
+	double eta = (1.0 - std::pow(2.0 / double(n), 1.0 - theta)) / (1.0 - zeta2 / zetan);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<size_t> draws(n);
+	for (size_t i = 0; i < n; ++i){
+		double u = uniform(rng);
+		double uz = u * zetan;
+		size_t rank;
+		if (uz < 1.0){
+			rank = 0;
+		}
+		else if (uz < zeta2){
+			rank = 1;
+		}
+		else{
+			rank = size_t(double(n) * std::pow(eta * u - eta + 1.0, alpha));
+		}
+		// scatter the popular ranks over the key space rather than at its start.
+		draws[i] = size_t(mix64(std::min(rank, n - 1)) % n);
+	}
+	return draws;
+}
+
+// the keys every container of one key type is run on.
+template<typename K>
+struct bench_keys{
+	std::vector<K> present;		// n distinct keys, in random order
+	std::vector<K> sorted;		// the same keys in order
+	std::vector<K> probes;		// the same keys, shuffled again
+	std::vector<K> missing;		// n keys that are never inserted
+	std::vector<K> skewed;		// n zipfian draws from present
+	size_t skewedDistinct;		// the distinct keys among them
+
+	explicit bench_keys(size_t n){
+		std::mt19937_64 rng(42);
+		present.reserve(n);
+		missing.reserve(n);
+		for (size_t i = 0; i < n; ++i){
+			present.push_back(bench_key<K>::make(i));
+			missing.push_back(bench_key<K>::make(n + i));
+		}
+		sorted = present;
+		std::sort(sorted.begin(), sorted.end());
+		probes = present;
+		std::shuffle(probes.begin(), probes.end(), rng);
+		std::vector<size_t> draws = zipfian(n, rng);
+		skewed.reserve(n);
+		for (size_t i = 0; i < n; ++i){
+			skewed.push_back(present[draws[i]]);
+		}
+		std::sort(draws.begin(), draws.end());
+		skewedDistinct = size_t(std::unique(draws.begin(), draws.end()) - draws.begin());
+	}
+};
+
+// set and map containers differ only in how an element is made and read.
+template<typename K, bool Map>
+struct bench_ops;
+
+template<typename K>
+struct bench_ops<K, false>{
+	template<typename C>
+	static void insert(C& c, const K& k){ c.insert(k); }
+	template<typename R>
+	static const K& key(const R& elem){ return elem; }
+};
+
+template<typename K>
+struct bench_ops<K, true>{
+	template<typename C>
+	static void insert(C& c, const K& k){ c.insert(typename C::value_type(k, 0)); }
+	template<typename R>
+	static const K& key(const R& elem){ return elem.first; }
+};
+
+//run every workload on the containers make() builds
+template<typename K, bool Map, typename Make>
+static void run(const std::string& container, const bench_keys<K>& keys, Make make){
+
+	typedef decltype(make()) C;
+	typedef bench_ops<K, Map> ops;
+	const size_t n = keys.present.size();
+	const std::string prefix = container + "/" + bench_key<K>::name() + "/";
+	std::unique_ptr<C> tree;
+
+	auto wanted = [&](const char *workload){
+		return options.filter.empty() || (prefix + workload).find(options.filter) != std::string::npos;
+	};
+	static const char *const workloads[] = {"insert_sequential", "insert_zipfian", "insert_random",
+		"find_hit", "find_miss", "scan_100", "iterate", "copy", "erase_random"};
+	if (std::none_of(std::begin(workloads), std::end(workloads), wanted)){
+		return;
+	}
+
+	// the inserts also build the tree the read-only workloads below use.
+	auto inserts = [&](const char *workload, const std::vector<K>& order, size_t distinct){
+		size_t before = 0;
+		bench_result r = measure(order.size(), [&]{
+			tree.reset();
+			before = bench_live_bytes;
+			tree.reset(new C(make()));
+		}, [&]{
+			for (size_t i = 0; i < order.size(); ++i){
+				ops::insert(*tree, order[i]);
+			}
+		});
+		r.bytes = double(bench_live_bytes - before) / double(distinct);
+		if (wanted(workload)){
+			report(prefix + workload, r);
+		}
+	};
+	if (wanted("insert_sequential")){
+		inserts("insert_sequential", keys.sorted, n);
+	}
+	if (wanted("insert_zipfian")){
+		inserts("insert_zipfian", keys.skewed, keys.skewedDistinct);
+	}
+	inserts("insert_random", keys.present, n);
+
+	auto noSetup = []{};
+	if (wanted("find_hit")){
+		report(prefix + "find_hit", measure(n, noSetup, [&]{
+			uint64_t found = 0;
+			for (size_t i = 0; i < n; ++i){
+				found += tree->find(keys.probes[i]) != tree->end();
+			}
+			bench_sink = found;
+		}));
+	}
+	if (wanted("find_miss")){
+		report(prefix + "find_miss", measure(n, noSetup, [&]{
+			uint64_t found = 0;
+			for (size_t i = 0; i < n; ++i){
+				found += tree->find(keys.missing[i]) != tree->end();
+			}
+			bench_sink = found;
+		}));
+	}
+	if (wanted("scan_100")){
+		const size_t scans = std::min<size_t>(n, 100000);
+		report(prefix + "scan_100", measure(scans, noSetup, [&]{
+			uint64_t sum = 0;
+			for (size_t i = 0; i < scans; ++i){
+				auto it = tree->lower_bound(keys.probes[i]);
+				for (size_t j = 0; j < 100 && it != tree->end(); ++j, ++it){
+					sum += bench_key<K>::touch(ops::key(*it));
+				}
+			}
+			bench_sink = sum;
+		}));
+	}
+	if (wanted("iterate")){
+		report(prefix + "iterate", measure(n, noSetup, [&]{
+			uint64_t sum = 0;
+			for (auto it = tree->begin(); it != tree->end(); ++it){
+				sum += bench_key<K>::touch(ops::key(*it));
+			}
+			bench_sink = sum;
+		}));
+	}
+	if (wanted("copy")){
+		std::unique_ptr<C> copy;
+		report(prefix + "copy", measure(n, [&]{ copy.reset(); }, [&]{
+			copy.reset(new C(*tree));
+		}));
+	}
+	if (wanted("erase_random")){
+		std::unique_ptr<C> victim;
+		report(prefix + "erase_random", measure(n, [&]{ victim.reset(new C(*tree)); }, [&]{
+			for (size_t i = 0; i < n; ++i){
+				victim->erase(keys.probes[i]);
+			}
+		}));
+	}
+}
+
+//every container on one key type
+template<typename K>
+static void runKeyType(){
+
+	bench_keys<K> keys(options.n);
+	typedef bench_allocator<K> set_alloc;
+	typedef bench_allocator<std::pair<const K, uint64_t> > map_alloc;
+
+	run<K, false>("std::set", keys, []{ return std::set<K, std::less<K>, set_alloc>(); });
+	for (size_t w : options.widths){
+		run<K, false>("btree/" + std::to_string(w), keys, [w]{
+			return btree<K, std::less<K>, 0, set_alloc>(w);
+		});
+	}
+	run<K, true>("std::map", keys, []{ return std::map<K, uint64_t, std::less<K>, map_alloc>(); });
+	for (size_t w : options.widths){
+		run<K, true>("btree_map/" + std::to_string(w), keys, [w]{
+			return btree_map<K, uint64_t, std::less<K>, 0, map_alloc>(w);
+		});
+	}
+	if constexpr (std::is_integral<K>::value){
+		run<K, false>("btree_packed_set", keys, []{
+			return btree_packed_set<K, 64, 512, set_alloc>();
+		});
+	}
+	if constexpr (std::is_same<K, std::string>::value){
+		run<K, false>("btree_string_set", keys, []{
+			return btree_string_set<64, bench_allocator<char> >();
+		});
+	}
+}
+
+//parse "a,b,c" into widths
+static std::vector<size_t> parseWidths(const std::string& list){
+
+	std::vector<size_t> widths;
+	std::stringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ',')){
+		size_t w = std::strtoul(item.c_str(), nullptr, 10);
+		if (w >= 3){
+			widths.push_back(w);
+		}
+	}
+	return widths;
+}
+
+int main(int argc, char **argv){
+
+	for (int i = 1; i < argc; ++i){
+		std::string arg = argv[i];
+		if (arg == "-n" && i + 1 < argc){
+			options.n = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "-r" && i + 1 < argc){
+			options.reps = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "-w" && i + 1 < argc){
+			options.widths = parseWidths(argv[++i]);
+		}
+		else if (arg == "-h" || arg == "--help"){
+			std::cout << "usage: " << argv[0] << " [-n elements] [-r reps] [-w width,...] [filter]" << std::endl;
+			return 0;
+		}
+		else{
+			options.filter = arg;
+		}
+	}
+
+	std::cout << options.n << " elements, best of " << options.reps << " runs";
+	if (!counters.available()){
+		std::cout << "; perf counters unavailable";
+	}
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(44) << "container/key/workload" << std::right
+		<< std::setw(10) << "ns/op" << std::setw(12) << "bytes/elem";
+	if (counters.available()){
+		std::cout << std::setw(12) << "l1d-miss/op" << std::setw(12) << "llc-miss/op";
+	}
+	std::cout << std::endl;
+
+	runKeyType<int>();
+	runKeyType<uint64_t>();
+	runKeyType<std::string>();
+	return 0;
+}
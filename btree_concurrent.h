@@ -0,0 +1,898 @@
+/**
+ * A btree that many threads may read and write at once, using optimistic
+ * lock coupling.  Every node carries a version word whose low bit is a
+ * write lock.  Readers never write shared memory: they note a node's
+ * version, read the node, and check the version is unchanged before
+ * trusting what they read (retrying from the root otherwise).  Writers
+ * descend the same way and lock only the nodes they modify: the leaf
+ * they change and, for a split, its parent.  Full nodes are split on the
+ * way down, so a split never has to climb back up the tree.
+ *
+ * Elements live in the leaves only (internal nodes hold copies as
+ * separators), so a lookup always ends in a leaf and a range scan is a
+ * walk over leaves.  Erase leaves under-full nodes in place rather than
+ * merging them, but a leaf it empties is unlinked from its parent, along
+ * with any internal nodes that are left without children, and a root
+ * left with a single child hands over to it.  So a tree that is emptied
+ * out shrinks back to one leaf.  Under-full internal nodes are never
+ * merged, though, so a tree that has shrunk a lot keeps the height it
+ * grew to.  An unlinked node is handed to the tree's epoch domain (btree_epoch.h)
+ * rather than freed: every operation pins the domain while it walks the
+ * tree, so a reader holding a stale pointer still reads a valid node and
+ * simply fails its version check, and the node is freed once no
+ * operation that could have reached it is still running.
+ *
+ * Since readers copy elements while a writer may be changing them, T
+ * must be trivially copyable.
+ **/
+
+#ifndef BTREE_CONCURRENT_H
+#define BTREE_CONCURRENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "btree_search.h"
+#include "btree_pool.h"
+#include "btree_epoch.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+#define BTREE_OLC_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define BTREE_OLC_TSAN
+#endif
+#endif
+
+#ifdef BTREE_OLC_TSAN
+extern "C" void AnnotateIgnoreReadsBegin(const char *file, int line);
+extern "C" void AnnotateIgnoreReadsEnd(const char *file, int line);
+#endif
+
+// backs off while a node is write locked.
+inline void btree_olc_pause(unsigned &spins){
+
+	if (++spins < 64){
+#if defined(__SSE2__)
+		_mm_pause();
+#endif
+	}
+	else{
+		spins = 0;
+		std::this_thread::yield();
+	}
+}
+
+/**
+ * Held while a thread reads node elements it has not locked.  Such reads
+ * may race a writer and are only trusted once the node's version
+ * validates, so under ThreadSanitizer they are left unchecked; writes
+ * always are, so two writers racing is still reported.  Otherwise it
+ * does nothing.
+ **/
+struct btree_olc_unchecked_reads{
+#ifdef BTREE_OLC_TSAN
+	btree_olc_unchecked_reads(){ AnnotateIgnoreReadsBegin(__FILE__, __LINE__); }
+	~btree_olc_unchecked_reads(){ AnnotateIgnoreReadsEnd(__FILE__, __LINE__); }
+#endif
+};
+
+/**
+ * A concurrent ordered set of unique elements of type T.  insert, erase,
+ * contains, scan and size may be called from any number of threads at
+ * once; clear may run alongside the readers (contains, find, scan), and
+ * construction and destruction need exclusive access.
+ * Compare works as for btree; Fanout is the number of elements per node.
+ */
+template<typename T, typename Compare = std::less<T>, size_t Fanout = 40,
+         typename Alloc = std::allocator<T> >
+class btree_concurrent{
+
+	static_assert(std::is_trivially_copyable<T>::value,
+			"btree_concurrent elements are read while they may be written, so they must be trivially copyable");
+	static_assert(std::is_default_constructible<T>::value, "btree_concurrent elements must be default constructible");
+	static_assert(Fanout >= 3, "btree_concurrent fanout must be at least 3");
+
+ public:
+	typedef T key_type;
+	typedef T value_type;
+	typedef Compare key_compare;
+	typedef Alloc allocator_type;
+
+  /**
+   * @param comp the ordering of the elements
+   * @param alloc the allocator the node pools take their chunks from
+   */
+  btree_concurrent(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  btree_concurrent(const btree_concurrent&) = delete;
+  btree_concurrent& operator=(const btree_concurrent&) = delete;
+
+  ~btree_concurrent();
+
+  /**
+    * Inserts elem unless an equal element is present.
+    * @return true if elem was inserted.
+    */
+  bool insert(const T& elem);
+
+  /**
+    * Removes the element equal to key, if any.
+    * @return true if an element was removed.
+    */
+  bool erase(const T& key);
+
+  /**
+    * @return true if an element equal to key is present.
+    */
+  bool contains(const T& key) const;
+
+  /**
+    * Looks key up and, if it is present, copies the stored element to out.
+    * @return true if key was found.
+    */
+  bool find(const T& key, T& out) const;
+
+  /**
+    * Calls fn(const T&) on every element k with lo <= k < hi, in order. If
+    * fn returns bool, returning false stops the scan early. Each leaf is
+    * read consistently, but writers may change the tree between leaves,
+    * so the scan is not a snapshot of the whole range. fn runs without
+    * any node locked.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(const T& lo, const T& hi, Fn fn) const;
+
+  /**
+    * @return the number of elements; exact once writers have finished.
+    */
+  size_t size() const;
+
+  /**
+    * Removes every element. Readers that overlap it see the old contents
+    * or the new, and the old nodes are freed once they are done. Must not
+    * overlap insert or erase.
+    */
+  void clear();
+
+  key_compare key_comp() const;
+
+ private:
+	// version word: bit 0 is the write lock, the rest counts completed writes.
+	struct Node{
+		std::atomic<uint64_t> version;
+		std::atomic<size_t> num_element;
+		bool leaf;
+		T elements[Fanout];
+
+		explicit Node(bool leaf_): version(0), num_element(0), leaf(leaf_), elements(){}
+
+		// waits for the node to be unlocked and returns its version.
+		uint64_t readLock() const;
+
+		// true if the node has not been written since version was read.
+		bool validate(uint64_t version_) const;
+
+		// locks the node if it is still at version; false means restart.
+		bool upgrade(uint64_t version_);
+
+		void writeUnlock();
+
+		// element count clamped to the array, safe to use on a racy read.
+		size_t count() const{
+			return std::min<size_t>(num_element.load(std::memory_order_relaxed), Fanout);
+		}
+	};
+
+	struct Inner : Node{
+		std::atomic<Node*> children[Fanout + 1];
+
+		Inner(): Node(false){
+			for (size_t i = 0; i < Fanout + 1; ++i){
+				children[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	// an internal node's child i holds the elements in (elements[i-1], elements[i]].
+	static Inner* asInner(Node *node){ return static_cast<Inner*>(node); }
+
+	Node* newLeaf();
+	Inner* newInner();
+
+	// root, after checking it has not changed since it was read; nullptr means restart.
+	Node* lockedRoot(uint64_t &version) const;
+
+	// index of the child of an internal node whose range holds the first
+	// element >= key (or > key when exclusive).
+	size_t childIndex(const Node *node, const T& key, bool exclusive) const;
+
+	// a tree only grows taller when a full root splits, which takes over
+	// 2^(height - 1) inserts, so no descent passes more internal nodes.
+	static constexpr size_t maxDepth = 64;
+
+	// the internal nodes a descent passed, root first, and the versions they were read at.
+	struct Path{
+		Inner *node[maxDepth];
+		uint64_t version[maxDepth];
+		size_t depth;
+	};
+
+	// optimistic descent to the leaf for key, returning it and the version
+	// it was read at, or nullptr to restart. When bound is given it receives
+	// the largest element the leaf may hold, unless the leaf is the last one;
+	// when path is given it receives the internal nodes above the leaf.
+	Node* descend(const T& key, bool exclusive, uint64_t &version, T *bound = nullptr, bool *bounded = nullptr,
+			Path *path = nullptr) const;
+
+	// optimistic search of the first n elements of a leaf for key: where it
+	// is or would go, whether it is there and, if so and copy is given, a
+	// copy of it. The answer only holds if the leaf's version validates after.
+	size_t findInLeaf(const Node *leaf, size_t n, const T& key, bool &match, T *copy = nullptr) const;
+
+	// splits the locked, full node; parent (locked, not full) or a new root takes the separator.
+	void split(Node *node, Inner *parent);
+
+	// inserts sep and the new right child of the node left of it into parent, which has room.
+	void insertChild(Inner *parent, const T& sep, Node *right);
+
+	// removes child, and a separator next to it, from the locked parent.
+	void unlinkChild(Inner *parent, Node *child);
+
+	// erases the only element of leaf, reached through path at version, by
+	// unlinking it along with the internal nodes above it that have no other
+	// child; false means restart.
+	bool unlinkLeaf(const Path &path, Node *leaf, uint64_t version);
+
+	// makes the only child of the locked root the new root, unlocks and retires
+	// the old one; repeats while the new root is an internal node with one child.
+	void collapseRoot(Inner *root);
+
+	// copies the elements of one leaf in [from, hi) for scan (from itself
+	// excluded when exclusive); more and next say where the following leaf
+	// starts. false means restart.
+	bool scanLeaf(const T& from, bool exclusive, const T& hi, T *out, size_t &copied,
+			bool &more, T &next) const;
+
+	// reclamation callbacks for btree_epoch: one node, or a whole detached tree.
+	static void releaseNode(void *tree, void *node);
+	static void releaseTree(void *tree, void *root);
+	void freeNode(Node *node);
+	void freeSubtree(Node *node);
+
+	std::atomic<Node*> baseNode;
+	std::atomic<size_t> btree_size;
+	btree_key_compare<Compare, T> compare_t;
+
+	// node storage, shared by every writer; splits are rare, so one mutex guards both pools.
+	std::mutex poolMutex;
+	btree_node_pool<Alloc> leafPool;
+	btree_node_pool<Alloc> internalPool;
+
+	// retired nodes; declared after the pools so it frees into them before they go.
+	mutable btree_epoch epochs;
+};
+
+//wait for the write lock to clear, then read the version
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+uint64_t btree_concurrent<T, Compare, Fanout, Alloc>::Node::readLock() const{
+
+	unsigned spins = 0;
+	uint64_t v = version.load(std::memory_order_acquire);
+	while (v & 1){
+		btree_olc_pause(spins);
+		v = version.load(std::memory_order_acquire);
+	}
+	return v;
+}
+
+//check nothing was written since the version was read
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::Node::validate(uint64_t version_) const{
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return version.load(std::memory_order_relaxed) == version_;
+}
+
+//take the write lock if the node is unchanged
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::Node::upgrade(uint64_t version_){
+
+	if (!version.compare_exchange_strong(version_, version_ + 1, std::memory_order_acquire)){
+		return false;
+	}
+	// keep the writes below from becoming visible before the lock bit.
+	std::atomic_thread_fence(std::memory_order_release);
+	return true;
+}
+
+//release the write lock, publishing a new version
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::Node::writeUnlock(){
+
+	version.fetch_add(1, std::memory_order_release);
+}
+
+//constructor: the tree always has a root, initially an empty leaf.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_concurrent<T, Compare, Fanout, Alloc>::btree_concurrent(const Compare& comp, const Alloc& alloc)
+	:baseNode(nullptr), btree_size(0), compare_t{comp},
+	 leafPool(sizeof(Node), alloc), internalPool(sizeof(Inner), alloc){
+
+	baseNode.store(newLeaf(), std::memory_order_relaxed);
+}
+
+//destructor: epochs frees the retired nodes, then the pools release the rest.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_concurrent<T, Compare, Fanout, Alloc>::~btree_concurrent(){
+}
+
+//new leaf from the pool
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_concurrent<T, Compare, Fanout, Alloc>::Node* btree_concurrent<T, Compare, Fanout, Alloc>::newLeaf(){
+
+	void *block;
+	{
+		std::lock_guard<std::mutex> guard(poolMutex);
+		block = leafPool.allocate();
+	}
+	return ::new (block) Node(true);
+}
+
+//new internal node from the pool
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_concurrent<T, Compare, Fanout, Alloc>::Inner* btree_concurrent<T, Compare, Fanout, Alloc>::newInner(){
+
+	void *block;
+	{
+		std::lock_guard<std::mutex> guard(poolMutex);
+		block = internalPool.allocate();
+	}
+	return ::new (block) Inner();
+}
+
+//clear: swap in an empty root and retire the old tree whole
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::clear(){
+
+	btree_epoch::guard pin(epochs);
+	Node *old = baseNode.exchange(newLeaf(), std::memory_order_acq_rel);
+	btree_size.store(0, std::memory_order_relaxed);
+	// a reader may be waiting on the old root; the bump sends it back to the new one.
+	old->version.fetch_add(2, std::memory_order_release);
+	epochs.retire(old, &releaseTree, this);
+}
+
+//epoch callback for a single node
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::releaseNode(void *tree, void *node){
+
+	static_cast<btree_concurrent*>(tree)->freeNode(static_cast<Node*>(node));
+}
+
+//epoch callback for a detached tree
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::releaseTree(void *tree, void *root){
+
+	static_cast<btree_concurrent*>(tree)->freeSubtree(static_cast<Node*>(root));
+}
+
+//give a node back to its pool
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::freeNode(Node *node){
+
+	std::lock_guard<std::mutex> guard(poolMutex);
+	if (node->leaf){
+		node->~Node();
+		leafPool.deallocate(node);
+	}
+	else{
+		asInner(node)->~Inner();
+		internalPool.deallocate(node);
+	}
+}
+
+//free a detached subtree
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::freeSubtree(Node *node){
+
+	if (!node->leaf){
+		Inner *inner = asInner(node);
+		for (size_t i = 0; i <= node->count(); ++i){
+			freeSubtree(inner->children[i].load(std::memory_order_relaxed));
+		}
+	}
+	freeNode(node);
+}
+
+//read the root and its version, making sure it is still the root
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_concurrent<T, Compare, Fanout, Alloc>::Node* btree_concurrent<T, Compare, Fanout, Alloc>::lockedRoot(uint64_t &version) const{
+
+	Node *root = baseNode.load(std::memory_order_acquire);
+	version = root->readLock();
+	if (root != baseNode.load(std::memory_order_acquire)){
+		return nullptr;
+	}
+	return root;
+}
+
+//child of an internal node to follow for key
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_concurrent<T, Compare, Fanout, Alloc>::childIndex(const Node *node, const T& key, bool exclusive) const{
+
+	btree_olc_unchecked_reads unchecked;
+	if (exclusive){
+		return btree_upper_bound<Fanout>(node->elements, node->count(), key, compare_t);
+	}
+	return btree_lower_bound<Fanout>(node->elements, node->count(), key, compare_t);
+}
+
+//optimistic descent: every pointer read is validated before it is followed,
+//and the node is validated again once the child's version is known, so a
+//split of the child in between is noticed.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_concurrent<T, Compare, Fanout, Alloc>::Node* btree_concurrent<T, Compare, Fanout, Alloc>::descend(const T& key,
+		bool exclusive, uint64_t &version, T *bound, bool *bounded, Path *path) const{
+
+	Node *node = lockedRoot(version);
+	if (node == nullptr){
+		return nullptr;
+	}
+	if (bounded != nullptr){
+		*bounded = false;
+	}
+	if (path != nullptr){
+		path->depth = 0;
+	}
+	while (!node->leaf){
+		size_t pos = childIndex(node, key, exclusive);
+		Node *child = asInner(node)->children[pos].load(std::memory_order_relaxed);
+		if (bound != nullptr && pos < node->count()){
+			btree_olc_unchecked_reads unchecked;
+			*bound = node->elements[pos];
+			*bounded = true;
+		}
+		if (!node->validate(version)){
+			return nullptr;
+		}
+		uint64_t childVersion = child->readLock();
+		if (!node->validate(version)){
+			return nullptr;
+		}
+		if (path != nullptr){
+			path->node[path->depth] = asInner(node);
+			path->version[path->depth++] = version;
+		}
+		node = child;
+		version = childVersion;
+	}
+	return node;
+}
+
+//search a leaf without locking it; the caller validates its version
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_concurrent<T, Compare, Fanout, Alloc>::findInLeaf(const Node *leaf, size_t n, const T& key, bool &match,
+		T *copy) const{
+
+	btree_olc_unchecked_reads unchecked;
+	size_t pos = btree_find_in_node<Fanout>(leaf->elements, n, key, compare_t, match);
+	if (match && copy != nullptr){
+		*copy = leaf->elements[pos];
+	}
+	return pos;
+}
+
+//contains
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::contains(const T& key) const{
+
+	T found;
+	return find(key, found);
+}
+
+//find: copy the element out, then check the leaf did not change meanwhile
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::find(const T& key, T& out) const{
+
+	btree_epoch::guard pin(epochs);
+	while (true){
+		uint64_t version;
+		Node *leaf = descend(key, false, version);
+		if (leaf == nullptr){
+			continue;
+		}
+		bool match;
+		T copy = T();
+		findInLeaf(leaf, leaf->count(), key, match, &copy);
+		if (!leaf->validate(version)){
+			continue;
+		}
+		if (match){
+			out = copy;
+		}
+		return match;
+	}
+}
+
+//insert: split full nodes on the way down, then lock just the leaf
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::insert(const T& elem){
+
+	btree_epoch::guard pin(epochs);
+	while (true){
+		uint64_t version;
+		Node *node = lockedRoot(version);
+		if (node == nullptr){
+			continue;
+		}
+		Inner *parent = nullptr;
+		uint64_t parentVersion = 0;
+
+		bool restart = false;
+		while (true){
+			if (node->count() == Fanout){
+				// lock parent then node; a node without parent must still be the root.
+				if (parent != nullptr && !parent->upgrade(parentVersion)){
+					restart = true;
+					break;
+				}
+				if (!node->upgrade(version)){
+					if (parent != nullptr){
+						parent->writeUnlock();
+					}
+					restart = true;
+					break;
+				}
+				if (parent == nullptr && node != baseNode.load(std::memory_order_acquire)){
+					node->writeUnlock();
+					restart = true;
+					break;
+				}
+				split(node, parent);
+				node->writeUnlock();
+				if (parent != nullptr){
+					parent->writeUnlock();
+				}
+				restart = true;
+				break;
+			}
+			if (node->leaf){
+				break;
+			}
+
+			size_t pos = childIndex(node, elem, false);
+			Node *child = asInner(node)->children[pos].load(std::memory_order_relaxed);
+			if (!node->validate(version)){
+				restart = true;
+				break;
+			}
+			uint64_t childVersion = child->readLock();
+			if (!node->validate(version)){
+				restart = true;
+				break;
+			}
+			parent = asInner(node);
+			parentVersion = version;
+			node = child;
+			version = childVersion;
+		}
+		if (restart){
+			continue;
+		}
+
+		// a leaf only changes range by splitting, which bumps its version,
+		// so once it is locked at the version it was reached with, elem
+		// belongs in it.
+		bool match;
+		size_t n = node->count();
+		size_t pos = findInLeaf(node, n, elem, match);
+		if (match){
+			if (!node->validate(version)){
+				continue;
+			}
+			return false;
+		}
+		if (!node->upgrade(version)){
+			continue;
+		}
+		std::copy_backward(node->elements + pos, node->elements + n, node->elements + n + 1);
+		node->elements[pos] = elem;
+		node->num_element.store(n + 1, std::memory_order_relaxed);
+		node->writeUnlock();
+		btree_size.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+}
+
+//erase: find the element optimistically, then lock the leaf to remove it.
+//A leaf losing its last element is unlinked instead (see unlinkLeaf).
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::erase(const T& key){
+
+	btree_epoch::guard pin(epochs);
+	while (true){
+		uint64_t version;
+		Path path;
+		Node *leaf = descend(key, false, version, nullptr, nullptr, &path);
+		if (leaf == nullptr){
+			continue;
+		}
+		bool match;
+		size_t n = leaf->count();
+		size_t pos = findInLeaf(leaf, n, key, match);
+		if (!match){
+			if (!leaf->validate(version)){
+				continue;
+			}
+			return false;
+		}
+		if (n == 1 && path.depth != 0){
+			if (!unlinkLeaf(path, leaf, version)){
+				continue;
+			}
+			btree_size.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		if (!leaf->upgrade(version)){
+			continue;
+		}
+		std::copy(leaf->elements + pos + 1, leaf->elements + n, leaf->elements + pos);
+		leaf->num_element.store(n - 1, std::memory_order_relaxed);
+		leaf->writeUnlock();
+		btree_size.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+}
+
+//split a full node in two around its middle
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::split(Node *node, Inner *parent){
+
+	size_t n = node->count();
+	size_t half = n / 2;
+	Node *right;
+	T sep;
+	if (node->leaf){
+		// the left leaf keeps half elements; its last one becomes the separator.
+		right = newLeaf();
+		std::copy(node->elements + half, node->elements + n, right->elements);
+		right->num_element.store(n - half, std::memory_order_relaxed);
+		node->num_element.store(half, std::memory_order_relaxed);
+		sep = node->elements[half - 1];
+	}
+	else{
+		// the middle separator moves up; the children on its right move over.
+		Inner *inner = asInner(node);
+		Inner *rightInner = newInner();
+		sep = node->elements[half];
+		std::copy(node->elements + half + 1, node->elements + n, rightInner->elements);
+		for (size_t i = half + 1; i <= n; ++i){
+			rightInner->children[i - half - 1].store(inner->children[i].load(std::memory_order_relaxed),
+					std::memory_order_relaxed);
+		}
+		rightInner->num_element.store(n - half - 1, std::memory_order_relaxed);
+		node->num_element.store(half, std::memory_order_relaxed);
+		right = rightInner;
+	}
+
+	if (parent != nullptr){
+		insertChild(parent, sep, right);
+		return;
+	}
+	// the root was split: grow the tree by one level.
+	Inner *root = newInner();
+	root->elements[0] = sep;
+	root->children[0].store(node, std::memory_order_relaxed);
+	root->children[1].store(right, std::memory_order_relaxed);
+	root->num_element.store(1, std::memory_order_relaxed);
+	baseNode.store(root, std::memory_order_release);
+}
+
+//open a slot in parent for a separator and the node to its right
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::insertChild(Inner *parent, const T& sep, Node *right){
+
+	size_t n = parent->count();
+	size_t pos = btree_lower_bound<Fanout>(parent->elements, n, sep, compare_t);
+	std::copy_backward(parent->elements + pos, parent->elements + n, parent->elements + n + 1);
+	for (size_t i = n + 1; i > pos + 1; --i){
+		parent->children[i].store(parent->children[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	parent->elements[pos] = sep;
+	parent->children[pos + 1].store(right, std::memory_order_relaxed);
+	parent->num_element.store(n + 1, std::memory_order_relaxed);
+}
+
+//drop child and the separator on one side of it from the locked parent:
+//the neighbour that takes over child's range absorbs it.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::unlinkChild(Inner *parent, Node *child){
+
+	size_t n = parent->count();
+	size_t c = 0;
+	while (parent->children[c].load(std::memory_order_relaxed) != child){
+		++c;
+	}
+	size_t sep = c < n ? c : c - 1;
+	std::copy(parent->elements + sep + 1, parent->elements + n, parent->elements + sep);
+	for (size_t i = c; i < n; ++i){
+		parent->children[i].store(parent->children[i + 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+	parent->children[n].store(nullptr, std::memory_order_relaxed);
+	parent->num_element.store(n - 1, std::memory_order_relaxed);
+}
+
+//an emptied leaf goes, and so does every internal node above it left with
+//no other child: they are cut from the lowest ancestor that has a separator
+//to spare. Without one the whole path is a chain, and the leaf, now empty,
+//becomes the root. The path is locked top down, as for a split, at the
+//versions the descent read, so the counts it saw still hold and path.node[0]
+//is still the root (replacing it bumps its version).
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::unlinkLeaf(const Path &path, Node *leaf, uint64_t version){
+
+	size_t top = path.depth;
+	while (top > 0 && path.node[top - 1]->count() == 0){
+		--top;
+	}
+	// top > 0: path.node[top - 1] keeps its other children and loses path.node[top] (or leaf).
+	size_t first = top > 0 ? top - 1 : 0;
+	size_t locked = first;
+	while (locked < path.depth && path.node[locked]->upgrade(path.version[locked])){
+		++locked;
+	}
+	if (locked < path.depth || !leaf->upgrade(version)){
+		while (locked > first){
+			path.node[--locked]->writeUnlock();
+		}
+		return false;
+	}
+
+	leaf->num_element.store(0, std::memory_order_relaxed);
+	if (top == 0){
+		baseNode.store(leaf, std::memory_order_release);
+	}
+	else{
+		unlinkChild(path.node[top - 1], top < path.depth ? static_cast<Node*>(path.node[top]) : leaf);
+	}
+	// the nodes cut loose are unlocked with new versions, so stale readers restart.
+	for (size_t i = top; i < path.depth; ++i){
+		path.node[i]->writeUnlock();
+		epochs.retire(path.node[i], &releaseNode, this);
+	}
+	if (top == 0){
+		leaf->writeUnlock();
+		return true;
+	}
+	leaf->writeUnlock();
+	epochs.retire(leaf, &releaseNode, this);
+	// only a writer holding the root's lock can replace it, so this is stable.
+	Inner *parent = path.node[top - 1];
+	if (parent->count() == 0 && parent == baseNode.load(std::memory_order_relaxed)){
+		collapseRoot(parent);
+	}
+	else{
+		parent->writeUnlock();
+	}
+	return true;
+}
+
+//shrink the tree by a level. The new root is published before the old one
+//is unlocked, so anyone who reaches the old root later fails lockedRoot's
+//check, and anyone who read it earlier fails validation, as for clear.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_concurrent<T, Compare, Fanout, Alloc>::collapseRoot(Inner *root){
+
+	while (true){
+		Node *child = root->children[0].load(std::memory_order_relaxed);
+		baseNode.store(child, std::memory_order_release);
+		root->writeUnlock();
+		epochs.retire(root, &releaseNode, this);
+		if (child->leaf){
+			return;
+		}
+		uint64_t version = child->readLock();
+		if (child->count() != 0 || !child->upgrade(version)){
+			return;
+		}
+		// a concurrent erase may have collapsed it already.
+		if (child != baseNode.load(std::memory_order_relaxed)){
+			child->writeUnlock();
+			return;
+		}
+		root = asInner(child);
+	}
+}
+
+//range scan, one consistently read leaf at a time
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+template<typename Fn>
+size_t btree_concurrent<T, Compare, Fanout, Alloc>::scan(const T& lo, const T& hi, Fn fn) const{
+
+	size_t visited = 0;
+	if (!compare_t(lo, hi)){
+		return visited;
+	}
+	T buffer[Fanout];
+	T from = lo;
+	bool exclusive = false;
+	while (true){
+		size_t copied;
+		bool more;
+		T next;
+		if (!scanLeaf(from, exclusive, hi, buffer, copied, more, next)){
+			continue;
+		}
+		for (size_t i = 0; i < copied; ++i){
+			++visited;
+			if (!btree_scan_visit(fn, buffer[i])){
+				return visited;
+			}
+		}
+		if (!more){
+			return visited;
+		}
+		// every element of the leaves further right is greater than next.
+		from = next;
+		exclusive = true;
+	}
+}
+
+//copy one leaf's share of a scan
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_concurrent<T, Compare, Fanout, Alloc>::scanLeaf(const T& from, bool exclusive, const T& hi, T *out,
+		size_t &copied, bool &more, T &next) const{
+
+	// pinned per leaf, so fn never runs with the domain pinned.
+	btree_epoch::guard pin(epochs);
+	uint64_t version;
+	bool bounded;
+	Node *leaf = descend(from, exclusive, version, &next, &bounded);
+	if (leaf == nullptr){
+		return false;
+	}
+	size_t n = leaf->count();
+	size_t i;
+	{
+		btree_olc_unchecked_reads unchecked;
+		i = exclusive ? btree_upper_bound<Fanout>(leaf->elements, n, from, compare_t)
+				: btree_lower_bound<Fanout>(leaf->elements, n, from, compare_t);
+		copied = 0;
+		for (; i < n && compare_t(leaf->elements[i], hi); ++i){
+			out[copied++] = leaf->elements[i];
+		}
+	}
+	if (!leaf->validate(version)){
+		return false;
+	}
+	more = i == n && bounded && compare_t(next, hi);
+	return true;
+}
+
+//size
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_concurrent<T, Compare, Fanout, Alloc>::size() const{
+
+	return btree_size.load(std::memory_order_relaxed);
+}
+
+//comparator access
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_concurrent<T, Compare, Fanout, Alloc>::key_compare btree_concurrent<T, Compare, Fanout, Alloc>::key_comp() const{
+
+	return compare_t.comp;
+}
+
+#endif
+//**********************************
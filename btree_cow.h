@@ -0,0 +1,989 @@
+/**
+ * A btree with cheap immutable snapshots, by copy-on-write.
+ *
+ * Nodes are reference counted and may be shared between trees.  Taking a
+ * snapshot just shares the root, so it costs O(1) whatever the size of
+ * the tree.  A writer that is about to modify a node checks its count:
+ * a node only the writer can reach is changed in place; a shared one is
+ * first copied, and the parent's pointer is switched to the copy.  Since
+ * the parent is reached (and so made private) first, an update copies at
+ * most the path from the root to the nodes it changes, and every other
+ * node stays shared.  Without outstanding snapshots nothing is shared and
+ * updates work in place as usual.
+ *
+ * A node reachable from a snapshot is never written again, so snapshots
+ * can be read from other threads while the writer goes on, without any
+ * locking.  Snapshots can be copied and dropped on any thread; the last
+ * reference to a node frees it.
+ *
+ * Elements live in the leaves (internal nodes hold copies as separators).
+ * Nodes have no parent links, since a shared node has many parents, so
+ * iterators step between leaves by searching again from the root.
+ **/
+
+#ifndef BTREE_COW_H
+#define BTREE_COW_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "btree_search.h"
+#include "btree_pool.h"
+
+template<typename T, typename Compare = std::less<T>, size_t Fanout = 32,
+         typename Alloc = std::allocator<T> > class btree_cow_snapshot;
+template<typename T, typename Compare = std::less<T>, size_t Fanout = 32,
+         typename Alloc = std::allocator<T> > class btree_cow;
+template<typename Tree> class btree_cow_iterator;
+
+/**
+ * An immutable ordered set of unique elements of type T: a point-in-time
+ * view of a btree_cow, taken with btree_cow::snapshot(). Copying one is
+ * O(1). A snapshot stays valid, and unchanged, after the tree it was
+ * taken from changes or is destroyed.
+ */
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+class btree_cow_snapshot{
+
+	static_assert(Fanout >= 3, "btree_cow fanout must be at least 3");
+	static_assert(std::is_default_constructible<T>::value, "btree_cow elements must be default constructible");
+
+ public:
+	typedef T key_type;
+	typedef T value_type;
+	typedef Compare key_compare;
+	typedef Alloc allocator_type;
+	typedef const T& reference;
+	typedef const T& const_reference;
+	typedef const T* pointer;
+	typedef const T* const_pointer;
+
+	friend class btree_cow_iterator<btree_cow_snapshot>;
+	friend class btree_cow<T, Compare, Fanout, Alloc>;
+	typedef btree_cow_iterator<btree_cow_snapshot> const_iterator;
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+
+  /**
+   * Shares original's nodes; O(1).
+   */
+  btree_cow_snapshot(const btree_cow_snapshot& original);
+  btree_cow_snapshot(btree_cow_snapshot&& original) noexcept;
+  btree_cow_snapshot& operator=(const btree_cow_snapshot& rhs);
+  btree_cow_snapshot& operator=(btree_cow_snapshot&& rhs) noexcept;
+
+  /**
+   * Drops this view's reference to the root, freeing the nodes nothing
+   * else shares.
+   */
+  ~btree_cow_snapshot();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	const_reverse_iterator rbegin() const;
+	const_reverse_iterator rend() const;
+	const_reverse_iterator crbegin() const;
+	const_reverse_iterator crend() const;
+
+  /**
+    * @return an iterator to the matching element, or end().
+    */
+  const_iterator find(const T& key) const;
+
+  /**
+    * @return an iterator to the first element not less than key, or end().
+    */
+  const_iterator lower_bound(const T& key) const;
+
+  /**
+    * @return an iterator to the first element greater than key, or end().
+    */
+  const_iterator upper_bound(const T& key) const;
+
+  /**
+    * @return the pair (lower_bound(key), upper_bound(key)).
+    */
+  std::pair<const_iterator, const_iterator> equal_range(const T& key) const;
+
+  /**
+    * @return 1 if key is present, otherwise 0.
+    */
+  size_t count(const T& key) const;
+
+  bool contains(const T& key) const;
+
+  /**
+    * Calls fn(const T&) on every element k with lo <= k < hi, in order,
+    * streaming each leaf's run straight out of the node. If fn returns
+    * bool, returning false stops the scan early.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(const T& lo, const T& hi, Fn fn) const;
+
+  size_t size() const;
+  bool empty() const;
+  key_compare key_comp() const;
+
+ protected:
+	// an empty tree, for btree_cow.
+	btree_cow_snapshot(const Compare& comp, const Alloc& alloc);
+
+	// refs counts the parents and trees pointing at the node.
+	struct Node{
+		std::atomic<size_t> refs;
+		size_t num_element;
+		bool leaf;
+		T elements[Fanout];
+
+		explicit Node(bool leaf_): refs(1), num_element(0), leaf(leaf_), elements(){}
+	};
+
+	// child i holds the elements in (elements[i-1], elements[i]].
+	struct Inner : Node{
+		Node *children[Fanout + 1];
+
+		Inner(): Node(false), children(){}
+	};
+
+	// node storage shared by a tree and all its snapshots; nodes may be
+	// freed by whichever of them drops the last reference, on any thread.
+	struct Store{
+		std::mutex poolMutex;
+		btree_node_pool<Alloc> leafPool;
+		btree_node_pool<Alloc> internalPool;
+
+		explicit Store(const Alloc& alloc): leafPool(sizeof(Node), alloc), internalPool(sizeof(Inner), alloc){}
+	};
+
+	static Inner* asInner(Node *node){ return static_cast<Inner*>(node); }
+	static const Inner* asInner(const Node *node){ return static_cast<const Inner*>(node); }
+
+	Node* newLeaf();
+	Inner* newInner();
+
+	static void retain(Node *node);
+
+	// drops a reference to node; the last one frees it and drops its references to its children.
+	void release(Node *node);
+
+	// returns node's block to the pool, leaving its children alone.
+	void freeNode(Node *node);
+
+	// the first element not less than key (greater than key when upper):
+	// its leaf and index, or nullptr at the end.
+	const Node* seek(const T& key, bool upper, size_t &pos) const;
+
+	// the last element less than key, or nullptr.
+	const Node* seekBefore(const T& key, size_t &pos) const;
+
+	static const Node* leftmostLeaf(const Node *node);
+	static const Node* rightmostLeaf(const Node *node);
+
+	std::shared_ptr<Store> store;
+	Node *baseNode;
+	size_t btree_size;
+	btree_key_compare<Compare, T> compare_t;
+};
+
+/**
+ * An ordered set of unique elements of type T whose snapshot() is O(1).
+ * It has the read interface of btree_cow_snapshot plus the updates. A
+ * btree_cow is written by one thread at a time; its snapshots are
+ * independent objects any thread may use. Copying a btree_cow is O(1)
+ * as well and gives a second writable tree; the two share nodes until
+ * either is changed.
+ */
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+class btree_cow : public btree_cow_snapshot<T, Compare, Fanout, Alloc>{
+
+	typedef btree_cow_snapshot<T, Compare, Fanout, Alloc> base_type;
+	typedef typename base_type::Node Node;
+	typedef typename base_type::Inner Inner;
+
+ public:
+	typedef base_type snapshot_type;
+	typedef typename base_type::const_iterator const_iterator;
+	typedef typename base_type::iterator iterator;
+
+  /**
+   * @param comp the ordering of the elements
+   * @param alloc the allocator the node pools take their chunks from
+   */
+  btree_cow(const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  /**
+    * @return an immutable view of the tree as it is now; O(1).
+    */
+  snapshot_type snapshot() const;
+
+  /**
+    * Inserts elem unless an equal element is present, copying the shared
+    * nodes on its path. Iterators into this tree (not its snapshots)
+    * are invalidated.
+    * @return true if elem was inserted.
+    */
+  bool insert(const T& elem);
+
+  /**
+    * Removes the element equal to key, if any, copying the shared nodes
+    * it changes. Nodes that fall below half full borrow from a sibling
+    * or merge with it.
+    * @return the number of elements removed.
+    */
+  size_t erase(const T& key);
+
+  /**
+    * Removes every element; snapshots keep theirs.
+    */
+  void clear();
+
+ private:
+	// the node at slot, copied first if it is shared so that it may be
+	// modified; slot is switched to the copy.
+	Node* own(Node *&slot);
+
+	// inserts key (known to be absent) below slot. Returns true if the
+	// node split, with sep and right the separator and new right sibling
+	// for the parent.
+	bool insertInto(Node *&slot, const T& key, T &sep, Node *&right);
+
+	// opens a slot at pos of an internal node with room for sep, with right after it.
+	static void insertChild(Inner *node, size_t pos, const T& sep, Node *right);
+
+	// removes key (known to be present) below slot.
+	void eraseFrom(Node *&slot, const T& key);
+
+	// refills child i of parent after an erase left it under half full.
+	void rebalance(Inner *parent, size_t i);
+
+	static constexpr size_t minElems = Fanout / 2;
+};
+
+/**
+ * Bidirectional iterator over a btree_cow or one of its snapshots: a
+ * leaf and an index in it; (nullptr, 0) is end(). Stepping off a leaf
+ * searches from the root for the neighbouring element.
+ */
+template<typename Tree> class btree_cow_iterator{
+
+	typedef typename Tree::Node Node;
+
+public:
+	const Node *pNode;
+	size_t pindex;
+	const Tree *pbtree;
+
+	btree_cow_iterator(const Node *pNode_ = nullptr, size_t pindex_ = 0, const Tree *pbtree_ = nullptr):
+		pNode(pNode_), pindex(pindex_), pbtree(pbtree_){}
+
+	typedef ptrdiff_t difference_type;
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
+
+	bool operator==(const btree_cow_iterator& rhs) const;
+	bool operator!=(const btree_cow_iterator& rhs) const;
+	reference operator*() const;
+	pointer operator->() const;
+	btree_cow_iterator& operator++();
+	btree_cow_iterator operator++(int);
+	btree_cow_iterator& operator--();
+	btree_cow_iterator operator--(int);
+};
+
+//== operator overloading
+template<typename Tree>
+bool btree_cow_iterator<Tree>::operator==(const btree_cow_iterator& rhs) const{
+	return pNode == rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree;
+}
+
+//!= operator overloading
+template<typename Tree>
+bool btree_cow_iterator<Tree>::operator!=(const btree_cow_iterator& rhs) const{
+	return !operator==(rhs);
+}
+
+//* operator overloading
+template<typename Tree>
+typename btree_cow_iterator<Tree>::reference btree_cow_iterator<Tree>::operator*() const{
+	return pNode->elements[pindex];
+}
+
+//-> operator overloading
+template<typename Tree>
+typename btree_cow_iterator<Tree>::pointer btree_cow_iterator<Tree>::operator->() const{
+	return &pNode->elements[pindex];
+}
+
+//++ operator overloading: past a leaf's last element, search for the first greater one
+template<typename Tree>
+btree_cow_iterator<Tree>& btree_cow_iterator<Tree>::operator++(){
+
+	if (++pindex < pNode->num_element){
+		return *this;
+	}
+	pNode = pbtree->seek(pNode->elements[pindex - 1], true, pindex);
+	return *this;
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_cow_iterator<Tree> btree_cow_iterator<Tree>::operator++(int){
+	btree_cow_iterator temp_return = *this;
+	operator++();
+	return temp_return;
+}
+
+//-- operator overloading: before a leaf's first element, search for the last smaller one
+template<typename Tree>
+btree_cow_iterator<Tree>& btree_cow_iterator<Tree>::operator--(){
+
+	if (pNode == nullptr){
+		pNode = Tree::rightmostLeaf(pbtree->baseNode);
+		pindex = pNode->num_element - 1;
+		return *this;
+	}
+	if (pindex > 0){
+		--pindex;
+		return *this;
+	}
+	pNode = pbtree->seekBefore(pNode->elements[0], pindex);
+	return *this;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_cow_iterator<Tree> btree_cow_iterator<Tree>::operator--(int){
+	btree_cow_iterator e_iter = *this;
+	operator--();
+	return e_iter;
+}
+
+//empty tree: a single empty leaf
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>::btree_cow_snapshot(const Compare& comp, const Alloc& alloc)
+	:store(std::make_shared<Store>(alloc)), baseNode(nullptr), btree_size(0), compare_t{comp}{
+
+	baseNode = newLeaf();
+}
+
+//copy constructor: share the root
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>::btree_cow_snapshot(const btree_cow_snapshot& original)
+	:store(original.store), baseNode(original.baseNode), btree_size(original.btree_size), compare_t(original.compare_t){
+
+	retain(baseNode);
+}
+
+//move constructor
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>::btree_cow_snapshot(btree_cow_snapshot&& original) noexcept
+	:store(original.store), baseNode(original.baseNode), btree_size(original.btree_size), compare_t(original.compare_t){
+
+	// the source keeps a reference to a root so that it stays usable.
+	retain(baseNode);
+}
+
+//operator = overloading
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>& btree_cow_snapshot<T, Compare, Fanout, Alloc>::operator=(const btree_cow_snapshot& rhs){
+
+	if (this != &rhs){
+		retain(rhs.baseNode);
+		release(baseNode);
+		store = rhs.store;
+		baseNode = rhs.baseNode;
+		btree_size = rhs.btree_size;
+		compare_t = rhs.compare_t;
+	}
+	return *this;
+}
+
+//move operator = overloading
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>& btree_cow_snapshot<T, Compare, Fanout, Alloc>::operator=(btree_cow_snapshot&& rhs) noexcept{
+
+	if (this != &rhs){
+		std::swap(store, rhs.store);
+		std::swap(baseNode, rhs.baseNode);
+		std::swap(btree_size, rhs.btree_size);
+		std::swap(compare_t, rhs.compare_t);
+	}
+	return *this;
+}
+
+//destructor
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>::~btree_cow_snapshot(){
+
+	release(baseNode);
+}
+
+//new leaf from the shared pool
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Node* btree_cow_snapshot<T, Compare, Fanout, Alloc>::newLeaf(){
+
+	void *block;
+	{
+		std::lock_guard<std::mutex> guard(store->poolMutex);
+		block = store->leafPool.allocate();
+	}
+	return ::new (block) Node(true);
+}
+
+//new internal node from the shared pool
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Inner* btree_cow_snapshot<T, Compare, Fanout, Alloc>::newInner(){
+
+	void *block;
+	{
+		std::lock_guard<std::mutex> guard(store->poolMutex);
+		block = store->internalPool.allocate();
+	}
+	return ::new (block) Inner();
+}
+
+//one more owner
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow_snapshot<T, Compare, Fanout, Alloc>::retain(Node *node){
+
+	node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+//one owner fewer; the last one frees the node and lets go of its children
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow_snapshot<T, Compare, Fanout, Alloc>::release(Node *node){
+
+	// acquire too, so the last owner sees every write the others made
+	// before letting go.
+	if (node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1){
+		return;
+	}
+	if (!node->leaf){
+		Inner *inner = asInner(node);
+		for (size_t i = 0; i <= node->num_element; ++i){
+			release(inner->children[i]);
+		}
+	}
+	freeNode(node);
+}
+
+//give a node's block back
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow_snapshot<T, Compare, Fanout, Alloc>::freeNode(Node *node){
+
+	bool leaf = node->leaf;
+	if (leaf){
+		node->~Node();
+	}
+	else{
+		asInner(node)->~Inner();
+	}
+	std::lock_guard<std::mutex> guard(store->poolMutex);
+	(leaf ? store->leafPool : store->internalPool).deallocate(node);
+}
+
+//descend to the first element >= key (> key when upper), remembering the
+//nearest subtree to the right in case key's leaf holds nothing after it.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+const typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Node* btree_cow_snapshot<T, Compare, Fanout, Alloc>::seek(const T& key,
+		bool upper, size_t &pos) const{
+
+	const Node *node = baseNode;
+	const Node *next = nullptr;
+	while (!node->leaf){
+		size_t n = node->num_element;
+		size_t c = upper ? btree_upper_bound<Fanout>(node->elements, n, key, compare_t)
+				: btree_lower_bound<Fanout>(node->elements, n, key, compare_t);
+		if (c < n){
+			next = asInner(node)->children[c + 1];
+		}
+		node = asInner(node)->children[c];
+	}
+	size_t n = node->num_element;
+	pos = upper ? btree_upper_bound<Fanout>(node->elements, n, key, compare_t)
+			: btree_lower_bound<Fanout>(node->elements, n, key, compare_t);
+	if (pos < n){
+		return node;
+	}
+	pos = 0;
+	return next != nullptr ? leftmostLeaf(next) : nullptr;
+}
+
+//descend to the last element < key, remembering the nearest subtree to the left
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+const typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Node* btree_cow_snapshot<T, Compare, Fanout, Alloc>::seekBefore(const T& key,
+		size_t &pos) const{
+
+	const Node *node = baseNode;
+	const Node *prev = nullptr;
+	while (!node->leaf){
+		size_t c = btree_lower_bound<Fanout>(node->elements, node->num_element, key, compare_t);
+		if (c > 0){
+			prev = asInner(node)->children[c - 1];
+		}
+		node = asInner(node)->children[c];
+	}
+	pos = btree_lower_bound<Fanout>(node->elements, node->num_element, key, compare_t);
+	if (pos > 0){
+		--pos;
+		return node;
+	}
+	if (prev == nullptr){
+		return nullptr;
+	}
+	node = rightmostLeaf(prev);
+	pos = node->num_element - 1;
+	return node;
+}
+
+//first leaf of a subtree
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+const typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Node* btree_cow_snapshot<T, Compare, Fanout, Alloc>::leftmostLeaf(const Node *node){
+
+	while (!node->leaf){
+		node = asInner(node)->children[0];
+	}
+	return node;
+}
+
+//last leaf of a subtree
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+const typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::Node* btree_cow_snapshot<T, Compare, Fanout, Alloc>::rightmostLeaf(const Node *node){
+
+	while (!node->leaf){
+		node = asInner(node)->children[node->num_element];
+	}
+	return node;
+}
+
+// btree_cow_snapshot iterators
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::begin() const{
+
+	const Node *leaf = leftmostLeaf(baseNode);
+	return leaf->num_element != 0 ? const_iterator(leaf, 0, this) : end();
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::end() const{
+	return const_iterator(nullptr, 0, this);
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::cbegin() const{
+	return begin();
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::cend() const{
+	return end();
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_reverse_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::rbegin() const{
+	return const_reverse_iterator(end());
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_reverse_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::rend() const{
+	return const_reverse_iterator(begin());
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_reverse_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::crbegin() const{
+	return rbegin();
+}
+
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_reverse_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::crend() const{
+	return rend();
+}
+
+//find
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::find(const T& key) const{
+
+	const_iterator it = lower_bound(key);
+	if (it.pNode != nullptr && !compare_t(key, *it)){
+		return it;
+	}
+	return end();
+}
+
+//lower bound
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::lower_bound(const T& key) const{
+
+	size_t pos;
+	const Node *leaf = seek(key, false, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//upper bound
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator btree_cow_snapshot<T, Compare, Fanout, Alloc>::upper_bound(const T& key) const{
+
+	size_t pos;
+	const Node *leaf = seek(key, true, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//equal range
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+std::pair<typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator, typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::const_iterator>
+btree_cow_snapshot<T, Compare, Fanout, Alloc>::equal_range(const T& key) const{
+
+	const_iterator first = lower_bound(key);
+	const_iterator last = first;
+	if (last.pNode != nullptr && !compare_t(key, *last)){
+		++last;
+	}
+	return std::make_pair(first, last);
+}
+
+//count
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_cow_snapshot<T, Compare, Fanout, Alloc>::count(const T& key) const{
+
+	return contains(key) ? 1 : 0;
+}
+
+//contains: one descent, no iterator
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_cow_snapshot<T, Compare, Fanout, Alloc>::contains(const T& key) const{
+
+	const Node *node = baseNode;
+	while (!node->leaf){
+		node = asInner(node)->children[btree_lower_bound<Fanout>(node->elements, node->num_element, key, compare_t)];
+	}
+	bool match;
+	btree_find_in_node<Fanout>(node->elements, node->num_element, key, compare_t, match);
+	return match;
+}
+
+//range scan, a leaf's run at a time
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+template<typename Fn>
+size_t btree_cow_snapshot<T, Compare, Fanout, Alloc>::scan(const T& lo, const T& hi, Fn fn) const{
+
+	size_t visited = 0;
+	if (!compare_t(lo, hi)){
+		return visited;
+	}
+	size_t i;
+	const Node *leaf = seek(lo, false, i);
+	while (leaf != nullptr){
+		size_t n = leaf->num_element;
+		size_t end = btree_lower_bound<Fanout>(leaf->elements, n, hi, compare_t);
+		for (; i < end; ++i){
+			++visited;
+			if (!btree_scan_visit(fn, leaf->elements[i])){
+				return visited;
+			}
+		}
+		if (end < n){
+			break;
+		}
+		leaf = seek(leaf->elements[n - 1], true, i);
+	}
+	return visited;
+}
+
+//size
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_cow_snapshot<T, Compare, Fanout, Alloc>::size() const{
+	return btree_size;
+}
+
+//empty
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_cow_snapshot<T, Compare, Fanout, Alloc>::empty() const{
+	return btree_size == 0;
+}
+
+//comparator access
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow_snapshot<T, Compare, Fanout, Alloc>::key_compare btree_cow_snapshot<T, Compare, Fanout, Alloc>::key_comp() const{
+	return compare_t.comp;
+}
+
+//btree_cow constructor.
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+btree_cow<T, Compare, Fanout, Alloc>::btree_cow(const Compare& comp, const Alloc& alloc)
+	:base_type(comp, alloc){
+}
+
+//snapshot: share the root
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow<T, Compare, Fanout, Alloc>::snapshot_type btree_cow<T, Compare, Fanout, Alloc>::snapshot() const{
+
+	return snapshot_type(*this);
+}
+
+//make a node private to this tree before modifying it
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+typename btree_cow<T, Compare, Fanout, Alloc>::Node* btree_cow<T, Compare, Fanout, Alloc>::own(Node *&slot){
+
+	Node *node = slot;
+	// with a count of 1 nothing else can reach the node, nor start to.
+	if (node->refs.load(std::memory_order_acquire) == 1){
+		return node;
+	}
+	Node *copy = node->leaf ? this->newLeaf() : this->newInner();
+	try{
+		std::copy(node->elements, node->elements + node->num_element, copy->elements);
+	}
+	catch(...){
+		this->freeNode(copy);
+		throw;
+	}
+	copy->num_element = node->num_element;
+	if (!node->leaf){
+		Inner *from = base_type::asInner(node);
+		Inner *to = base_type::asInner(copy);
+		for (size_t i = 0; i <= node->num_element; ++i){
+			to->children[i] = from->children[i];
+			base_type::retain(to->children[i]);
+		}
+	}
+	this->release(node);
+	slot = copy;
+	return copy;
+}
+
+//insert
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_cow<T, Compare, Fanout, Alloc>::insert(const T& elem){
+
+	// a duplicate changes nothing, so look before copying any path.
+	if (this->contains(elem)){
+		return false;
+	}
+	T sep;
+	Node *right;
+	if (insertInto(this->baseNode, elem, sep, right)){
+		// the root split: grow the tree by one level.
+		Inner *root = this->newInner();
+		root->elements[0] = std::move(sep);
+		root->children[0] = this->baseNode;
+		root->children[1] = right;
+		root->num_element = 1;
+		this->baseNode = root;
+	}
+	++this->btree_size;
+	return true;
+}
+
+//recursive insert: full nodes split after the child below reports its split
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+bool btree_cow<T, Compare, Fanout, Alloc>::insertInto(Node *&slot, const T& key, T &sep, Node *&right){
+
+	Node *node = own(slot);
+	size_t n = node->num_element;
+
+	if (node->leaf){
+		Node *target = node;
+		bool split = n == Fanout;
+		if (split){
+			size_t half = n / 2;
+			right = this->newLeaf();
+			std::move(node->elements + half, node->elements + n, right->elements);
+			right->num_element = n - half;
+			node->num_element = half;
+			sep = node->elements[half - 1];
+			if (this->compare_t(sep, key)){
+				target = right;
+			}
+		}
+		size_t m = target->num_element;
+		size_t pos = btree_lower_bound<Fanout>(target->elements, m, key, this->compare_t);
+		std::move_backward(target->elements + pos, target->elements + m, target->elements + m + 1);
+		target->elements[pos] = key;
+		target->num_element = m + 1;
+		return split;
+	}
+
+	Inner *inner = base_type::asInner(node);
+	size_t c = btree_lower_bound<Fanout>(node->elements, n, key, this->compare_t);
+	T childSep;
+	Node *childRight;
+	if (!insertInto(inner->children[c], key, childSep, childRight)){
+		return false;
+	}
+	if (n < Fanout){
+		insertChild(inner, c, childSep, childRight);
+		return false;
+	}
+
+	// the middle separator moves up; the keys and children after it move to a new node.
+	size_t mid = n / 2;
+	Inner *sibling = this->newInner();
+	std::move(node->elements + mid + 1, node->elements + n, sibling->elements);
+	std::copy(inner->children + mid + 1, inner->children + n + 1, sibling->children);
+	sibling->num_element = n - mid - 1;
+	node->num_element = mid;
+	sep = std::move(node->elements[mid]);
+	if (c <= mid){
+		insertChild(inner, c, childSep, childRight);
+	}
+	else{
+		insertChild(sibling, c - mid - 1, childSep, childRight);
+	}
+	right = sibling;
+	return true;
+}
+
+//open a separator slot in an internal node
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow<T, Compare, Fanout, Alloc>::insertChild(Inner *node, size_t pos, const T& sep, Node *right){
+
+	size_t n = node->num_element;
+	std::move_backward(node->elements + pos, node->elements + n, node->elements + n + 1);
+	std::copy_backward(node->children + pos + 1, node->children + n + 1, node->children + n + 2);
+	node->elements[pos] = sep;
+	node->children[pos + 1] = right;
+	node->num_element = n + 1;
+}
+
+//erase
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+size_t btree_cow<T, Compare, Fanout, Alloc>::erase(const T& key){
+
+	if (!this->contains(key)){
+		return 0;
+	}
+	eraseFrom(this->baseNode, key);
+	--this->btree_size;
+
+	Node *root = this->baseNode;
+	if (!root->leaf && root->num_element == 0){
+		// the root's last separator went into a merge: its only child takes over.
+		this->baseNode = base_type::asInner(root)->children[0];
+		this->freeNode(root);
+	}
+	return 1;
+}
+
+//recursive erase: each node on the path is made private, then fixed up on the way back
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow<T, Compare, Fanout, Alloc>::eraseFrom(Node *&slot, const T& key){
+
+	Node *node = own(slot);
+	size_t n = node->num_element;
+	size_t pos = btree_lower_bound<Fanout>(node->elements, n, key, this->compare_t);
+
+	if (node->leaf){
+		std::move(node->elements + pos + 1, node->elements + n, node->elements + pos);
+		node->num_element = n - 1;
+		return;
+	}
+
+	Inner *inner = base_type::asInner(node);
+	eraseFrom(inner->children[pos], key);
+	if (inner->children[pos]->num_element < minElems){
+		rebalance(inner, pos);
+	}
+}
+
+//borrow from a sibling that can spare an element, else merge with one
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow<T, Compare, Fanout, Alloc>::rebalance(Inner *parent, size_t i){
+
+	Node *child = parent->children[i];
+	size_t n = child->num_element;
+
+	if (i > 0 && parent->children[i - 1]->num_element > minElems){
+		Node *left = own(parent->children[i - 1]);
+		size_t ln = left->num_element;
+		std::move_backward(child->elements, child->elements + n, child->elements + n + 1);
+		if (child->leaf){
+			child->elements[0] = std::move(left->elements[ln - 1]);
+			parent->elements[i - 1] = left->elements[ln - 2];
+		}
+		else{
+			Inner *c = base_type::asInner(child);
+			Inner *l = base_type::asInner(left);
+			std::copy_backward(c->children, c->children + n + 1, c->children + n + 2);
+			child->elements[0] = std::move(parent->elements[i - 1]);
+			c->children[0] = l->children[ln];
+			parent->elements[i - 1] = std::move(left->elements[ln - 1]);
+		}
+		child->num_element = n + 1;
+		left->num_element = ln - 1;
+		return;
+	}
+
+	if (i < parent->num_element && parent->children[i + 1]->num_element > minElems){
+		Node *right = own(parent->children[i + 1]);
+		size_t rn = right->num_element;
+		if (child->leaf){
+			child->elements[n] = std::move(right->elements[0]);
+			parent->elements[i] = child->elements[n];
+			std::move(right->elements + 1, right->elements + rn, right->elements);
+		}
+		else{
+			Inner *c = base_type::asInner(child);
+			Inner *r = base_type::asInner(right);
+			child->elements[n] = std::move(parent->elements[i]);
+			c->children[n + 1] = r->children[0];
+			parent->elements[i] = std::move(right->elements[0]);
+			std::move(right->elements + 1, right->elements + rn, right->elements);
+			std::copy(r->children + 1, r->children + rn + 1, r->children);
+		}
+		child->num_element = n + 1;
+		right->num_element = rn - 1;
+		return;
+	}
+
+	// neither sibling can spare one: merge the pair (child and its right
+	// neighbour, or its left neighbour and child) into the left node.
+	size_t k = i > 0 ? i - 1 : i;
+	Node *left = own(parent->children[k]);
+	Node *right = own(parent->children[k + 1]);
+	size_t ln = left->num_element;
+	size_t rn = right->num_element;
+	if (left->leaf){
+		std::move(right->elements, right->elements + rn, left->elements + ln);
+		left->num_element = ln + rn;
+	}
+	else{
+		Inner *l = base_type::asInner(left);
+		Inner *r = base_type::asInner(right);
+		left->elements[ln] = std::move(parent->elements[k]);
+		std::move(right->elements, right->elements + rn, left->elements + ln + 1);
+		std::copy(r->children, r->children + rn + 1, l->children + ln + 1);
+		left->num_element = ln + rn + 1;
+	}
+	// right's children, if any, now belong to left: free the shell only.
+	this->freeNode(right);
+
+	size_t pn = parent->num_element;
+	std::move(parent->elements + k + 1, parent->elements + pn, parent->elements + k);
+	std::copy(parent->children + k + 2, parent->children + pn + 1, parent->children + k + 1);
+	parent->num_element = pn - 1;
+}
+
+//clear: start over with an empty root; snapshots keep their references
+template<typename T, typename Compare, size_t Fanout, typename Alloc>
+void btree_cow<T, Compare, Fanout, Alloc>::clear(){
+
+	Node *root = this->newLeaf();
+	this->release(this->baseNode);
+	this->baseNode = root;
+	this->btree_size = 0;
+}
+
+#endif
+//**********************************
@@ -0,0 +1,912 @@
+/**
+ * A btree that lives in a file.  Nodes are fixed-size pages: page 0 holds
+ * the tree's metadata and every other page is a node, addressed by its
+ * page number.  Elements live in the leaves (internal pages hold copies
+ * as separators) and the leaves are linked in both directions, so the
+ * iterators and range scans walk the leaves in order.
+ *
+ * A tree opened read-write reads and writes its pages through a bounded
+ * btree_page_cache; modified pages reach the file when they are evicted
+ * or on flush(), which also records the metadata and syncs the file.  A
+ * tree opened with btree_open_mapped maps an existing file read-only and
+ * serves lookups straight from the mapping, with nothing to load first.
+ *
+ * The file stores T's bytes as they are in memory, so T must be
+ * trivially copyable and files only move between machines of the same
+ * byte order.  The tree is not safe for concurrent use, and a crash
+ * between flushes can leave the file inconsistent.
+ **/
+
+#ifndef BTREE_DISK_H
+#define BTREE_DISK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "btree_iterator.h"
+#include "btree_search.h"
+#include "btree_page_cache.h"
+
+// how btree_disk opens its file.
+enum btree_open_mode{
+	btree_open_readwrite,	// created if absent; pages go through the page cache
+	btree_open_mapped		// must exist; mapped read-only, so lookups only
+};
+
+template<typename Tree> class btree_disk_iterator;
+
+/**
+ * An ordered set of unique elements of type T stored in a file of
+ * PageSize byte pages, with the lookup, range and iterator interface of
+ * btree. Iterators yield elements by value, since a page may be evicted
+ * while an iterator still refers to it.
+ */
+template<typename T, typename Compare = std::less<T>, size_t PageSize = 4096>
+class btree_disk{
+
+	static_assert(std::is_trivially_copyable<T>::value, "btree_disk stores elements as raw bytes, so they must be trivially copyable");
+	static_assert(alignof(T) <= 8, "btree_disk elements must not need more than 8 byte alignment");
+	static_assert(PageSize >= 256 && PageSize % 8 == 0, "btree_disk pages must be at least 256 bytes, in whole words");
+
+ public:
+	typedef T key_type;
+	typedef T value_type;
+	typedef Compare key_compare;
+	typedef T reference;
+	typedef T const_reference;
+	typedef btree_arrow_proxy<T> pointer;
+	typedef btree_arrow_proxy<T> const_pointer;
+
+	friend class btree_disk_iterator<btree_disk>;
+	typedef btree_disk_iterator<btree_disk> const_iterator;
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+
+  /**
+   * Opens the tree stored at path.
+   * @param mode btree_open_readwrite creates the file if it does not
+   *        exist; btree_open_mapped maps an existing one read-only
+   * @param cachePages the number of pages the read-write cache holds
+   * @param comp the ordering of the elements; it must match the one the
+   *        file was written with
+   * @throws std::system_error if the file cannot be opened or mapped,
+   *         std::runtime_error if it is not a tree of this type
+   */
+  btree_disk(const std::string& path, btree_open_mode mode = btree_open_readwrite,
+		  size_t cachePages = 1024, const Compare& comp = Compare());
+
+  btree_disk(const btree_disk&) = delete;
+  btree_disk& operator=(const btree_disk&) = delete;
+
+  /**
+   * Flushes a read-write tree (ignoring errors; call flush() to see them)
+   * and closes the file.
+   */
+  ~btree_disk();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	const_reverse_iterator rbegin() const;
+	const_reverse_iterator rend() const;
+	const_reverse_iterator crbegin() const;
+	const_reverse_iterator crend() const;
+
+  /**
+    * @return an iterator to the matching element, or end().
+    */
+  const_iterator find(const T& key) const;
+
+  /**
+    * @return an iterator to the first element not less than key, or end().
+    */
+  const_iterator lower_bound(const T& key) const;
+
+  /**
+    * @return an iterator to the first element greater than key, or end().
+    */
+  const_iterator upper_bound(const T& key) const;
+
+  /**
+    * @return the pair (lower_bound(key), upper_bound(key)).
+    */
+  std::pair<const_iterator, const_iterator> equal_range(const T& key) const;
+
+  /**
+    * @return 1 if key is present, otherwise 0.
+    */
+  size_t count(const T& key) const;
+
+  /**
+    * Calls fn(const T&) on every element k with lo <= k < hi, in order,
+    * a leaf at a time. If fn returns bool, returning false stops the scan.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(const T& lo, const T& hi, Fn fn) const;
+
+  /**
+    * Inserts elem unless an equal element is present.
+    * @return the iterator at the element equal to elem, and whether elem
+    *         was inserted.
+    * @throws std::logic_error if the tree was opened read-only
+    */
+  std::pair<iterator, bool> insert(const T& elem);
+
+  /**
+    * Removes the element equal to key, if any. Pages are not merged, so
+    * the file does not shrink.
+    * @return the number of elements removed.
+    */
+  size_t erase(const T& key);
+
+  /**
+    * Removes the element at pos, which must be dereferenceable.
+    * @return an iterator to the element that followed it, or end().
+    */
+  iterator erase(const_iterator pos);
+
+  /**
+    * Removes the elements in [first, last).
+    * @return an iterator to the element last referred to, or end().
+    */
+  iterator erase(const_iterator first, const_iterator last);
+
+  /**
+    * Writes every modified page and the metadata to the file and syncs
+    * it. Does nothing for a mapped tree.
+    */
+  void flush();
+
+  size_t size() const;
+  bool empty() const;
+  bool read_only() const;
+  key_compare key_comp() const;
+
+ private:
+	// leading bytes of every node page. prev and next link the leaves in order.
+	struct PageHeader{
+		uint32_t leaf;
+		uint32_t num_element;
+		uint64_t next;
+		uint64_t prev;
+	};
+
+	// page 0. Page number 0 doubles as "no page".
+	struct Meta{
+		char magic[8];
+		uint32_t formatVersion;
+		uint32_t pageSize;
+		uint32_t elementSize;
+		uint32_t reserved;
+		uint64_t root;
+		uint64_t pageCount;
+		uint64_t btree_size;
+		uint64_t firstLeaf;
+		uint64_t lastLeaf;
+	};
+
+	static constexpr uint32_t currentFormat = 1;
+
+	// page layout: [header | elements | children (internal pages only)].
+	static constexpr size_t elementOffset = (sizeof(PageHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+	static constexpr size_t leafCapacity = (PageSize - elementOffset) / sizeof(T);
+	static constexpr size_t innerCapacity = (PageSize - elementOffset - 2 * sizeof(uint64_t)) / (sizeof(T) + sizeof(uint64_t));
+	static constexpr size_t childOffset = (elementOffset + innerCapacity * sizeof(T) + 7) / 8 * 8;
+
+	static_assert(leafCapacity >= 3 && innerCapacity >= 3, "btree_disk pages must hold at least 3 elements");
+	static_assert(childOffset + (innerCapacity + 1) * sizeof(uint64_t) <= PageSize, "btree_disk page layout overflow");
+
+	static PageHeader* header(char *page){ return reinterpret_cast<PageHeader*>(page); }
+	static const PageHeader* header(const char *page){ return reinterpret_cast<const PageHeader*>(page); }
+	static T* elements(char *page){ return reinterpret_cast<T*>(page + elementOffset); }
+	static const T* elements(const char *page){ return reinterpret_cast<const T*>(page + elementOffset); }
+	static uint64_t* children(char *page){ return reinterpret_cast<uint64_t*>(page + childOffset); }
+	static const uint64_t* children(const char *page){ return reinterpret_cast<const uint64_t*>(page + childOffset); }
+
+	void openMapped(const std::string& path);
+	void openReadWrite(const std::string& path, size_t cachePages);
+	void checkMeta(const std::string& path) const;
+	void writeMeta();
+	void closeFile();
+	void requireWritable() const;
+
+	// a page's bytes; valid until the next page access.
+	const char* readPage(uint64_t id) const;
+	char* writePage(uint64_t id);
+
+	// appends a zeroed page of the given kind to the file.
+	char* newPage(uint64_t &id, bool leaf);
+
+	// the leaf whose range holds key; path receives the internal pages on the way.
+	uint64_t descend(const T& key, std::vector<uint64_t> *path) const;
+
+	// moves (page, index) forward past the end of its leaf (and any empty leaves).
+	void normalize(uint64_t &page, size_t &index) const;
+
+	// the element before (page, index); (0, 0) steps to the last element.
+	void retreat(uint64_t &page, size_t &index) const;
+
+	T elementAt(uint64_t page, size_t index) const;
+
+	// puts sep and the page right of left into the parent at the end of
+	// path, splitting up the path as far as needed.
+	void insertChild(std::vector<uint64_t> &path, uint64_t left, const T& sep, uint64_t right);
+
+	int fd;
+	btree_open_mode mode;
+	char *mapBase;
+	size_t mapBytes;
+	Meta meta;
+	std::unique_ptr<btree_page_cache> cache;
+	btree_key_compare<Compare, T> compare_t;
+};
+
+/**
+ * Bidirectional iterator over a btree_disk, a position (page, index)
+ * in the leaf chain; (0, 0) is end().
+ */
+template<typename Tree> class btree_disk_iterator{
+
+public:
+	uint64_t pPage;
+	size_t pindex;
+	const Tree *pbtree;
+
+	btree_disk_iterator(uint64_t pPage_ = 0, size_t pindex_ = 0, const Tree *pbtree_ = nullptr):
+		pPage(pPage_), pindex(pindex_), pbtree(pbtree_){}
+
+	typedef ptrdiff_t difference_type;
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
+
+	bool operator==(const btree_disk_iterator& rhs) const;
+	bool operator!=(const btree_disk_iterator& rhs) const;
+	reference operator*() const;
+	pointer operator->() const;
+	btree_disk_iterator& operator++();
+	btree_disk_iterator operator++(int);
+	btree_disk_iterator& operator--();
+	btree_disk_iterator operator--(int);
+};
+
+//== operator overloading
+template<typename Tree>
+bool btree_disk_iterator<Tree>::operator==(const btree_disk_iterator& rhs) const{
+	return pPage == rhs.pPage && pindex == rhs.pindex && pbtree == rhs.pbtree;
+}
+
+//!= operator overloading
+template<typename Tree>
+bool btree_disk_iterator<Tree>::operator!=(const btree_disk_iterator& rhs) const{
+	return !operator==(rhs);
+}
+
+//* operator overloading
+template<typename Tree>
+typename btree_disk_iterator<Tree>::reference btree_disk_iterator<Tree>::operator*() const{
+	return pbtree->elementAt(pPage, pindex);
+}
+
+//-> operator overloading
+template<typename Tree>
+typename btree_disk_iterator<Tree>::pointer btree_disk_iterator<Tree>::operator->() const{
+	return pointer{operator*()};
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_disk_iterator<Tree>& btree_disk_iterator<Tree>::operator++(){
+
+	++pindex;
+	pbtree->normalize(pPage, pindex);
+	return *this;
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_disk_iterator<Tree> btree_disk_iterator<Tree>::operator++(int){
+	btree_disk_iterator temp_return = *this;
+	operator++();
+	return temp_return;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_disk_iterator<Tree>& btree_disk_iterator<Tree>::operator--(){
+
+	pbtree->retreat(pPage, pindex);
+	return *this;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_disk_iterator<Tree> btree_disk_iterator<Tree>::operator--(int){
+	btree_disk_iterator e_iter = *this;
+	operator--();
+	return e_iter;
+}
+
+//open the file in the requested mode; nothing is left open on failure.
+template<typename T, typename Compare, size_t PageSize>
+btree_disk<T, Compare, PageSize>::btree_disk(const std::string& path, btree_open_mode mode_, size_t cachePages,
+		const Compare& comp)
+	:fd(-1), mode(mode_), mapBase(nullptr), mapBytes(0), meta(), compare_t{comp}{
+
+	try{
+		if (mode == btree_open_mapped){
+			openMapped(path);
+		}
+		else{
+			openReadWrite(path, cachePages);
+		}
+	}
+	catch(...){
+		closeFile();
+		throw;
+	}
+}
+
+//destructor
+template<typename T, typename Compare, size_t PageSize>
+btree_disk<T, Compare, PageSize>::~btree_disk(){
+
+	try{
+		flush();
+	}
+	catch(...){
+	}
+	closeFile();
+}
+
+//map an existing file read-only
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::openMapped(const std::string& path){
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: cannot open " + path);
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: cannot stat " + path);
+	}
+	if (size_t(st.st_size) < PageSize){
+		throw std::runtime_error("btree_disk: " + path + " is not a btree file");
+	}
+	void *mapping = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: cannot map " + path);
+	}
+	mapBase = static_cast<char*>(mapping);
+	mapBytes = size_t(st.st_size);
+	// lookups jump between pages; readahead would mostly fetch pages never used.
+	::madvise(mapBase, mapBytes, MADV_RANDOM);
+
+	std::memcpy(&meta, mapBase, sizeof(Meta));
+	checkMeta(path);
+	if (meta.pageCount * PageSize > mapBytes){
+		throw std::runtime_error("btree_disk: " + path + " is truncated");
+	}
+}
+
+//open or create a file for reading and writing through the page cache
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::openReadWrite(const std::string& path, size_t cachePages){
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: cannot open " + path);
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: cannot stat " + path);
+	}
+	cache.reset(new btree_page_cache(fd, PageSize, cachePages));
+
+	if (st.st_size == 0){
+		// a new tree: the metadata page and one empty leaf as the root.
+		std::memcpy(meta.magic, "BTREEDSK", sizeof(meta.magic));
+		meta.formatVersion = currentFormat;
+		meta.pageSize = uint32_t(PageSize);
+		meta.elementSize = uint32_t(sizeof(T));
+		meta.pageCount = 1;
+		uint64_t root;
+		newPage(root, true);
+		meta.root = root;
+		meta.firstLeaf = root;
+		meta.lastLeaf = root;
+		flush();
+		return;
+	}
+	char buffer[sizeof(Meta)];
+	btree_read_at(fd, buffer, sizeof(Meta), 0);
+	std::memcpy(&meta, buffer, sizeof(Meta));
+	checkMeta(path);
+}
+
+//reject files written by another kind of tree
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::checkMeta(const std::string& path) const{
+
+	if (std::memcmp(meta.magic, "BTREEDSK", sizeof(meta.magic)) != 0 || meta.formatVersion != currentFormat){
+		throw std::runtime_error("btree_disk: " + path + " is not a btree file");
+	}
+	if (meta.pageSize != PageSize || meta.elementSize != sizeof(T)){
+		throw std::runtime_error("btree_disk: " + path + " holds a different page or element size");
+	}
+}
+
+//write page 0
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::writeMeta(){
+
+	std::vector<char> page(PageSize, 0);
+	std::memcpy(page.data(), &meta, sizeof(Meta));
+	btree_write_at(fd, page.data(), PageSize, 0);
+}
+
+//release the mapping and the file
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::closeFile(){
+
+	if (mapBase != nullptr){
+		::munmap(mapBase, mapBytes);
+		mapBase = nullptr;
+	}
+	cache.reset();
+	if (fd >= 0){
+		::close(fd);
+		fd = -1;
+	}
+}
+
+//flush
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::flush(){
+
+	if (mode == btree_open_mapped || !cache){
+		return;
+	}
+	cache->flush();
+	writeMeta();
+	if (::fsync(fd) != 0){
+		throw std::system_error(errno, std::generic_category(), "btree_disk: fsync failed");
+	}
+}
+
+//writes need a read-write tree
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::requireWritable() const{
+
+	if (mode == btree_open_mapped){
+		throw std::logic_error("btree_disk: the tree was opened read-only");
+	}
+}
+
+//page contents from the mapping or the cache. Page 0 is the metadata, so
+//a link to it or past the last page can only come from a corrupt file.
+template<typename T, typename Compare, size_t PageSize>
+const char* btree_disk<T, Compare, PageSize>::readPage(uint64_t id) const{
+
+	if (id == 0 || id >= meta.pageCount){
+		throw std::runtime_error("btree_disk: page " + std::to_string(id) + " is out of range; the file is corrupt");
+	}
+	if (mapBase != nullptr){
+		return mapBase + id * PageSize;
+	}
+	return cache->read(id);
+}
+
+//page contents to modify
+template<typename T, typename Compare, size_t PageSize>
+char* btree_disk<T, Compare, PageSize>::writePage(uint64_t id){
+
+	return cache->write(id);
+}
+
+//append a page
+template<typename T, typename Compare, size_t PageSize>
+char* btree_disk<T, Compare, PageSize>::newPage(uint64_t &id, bool leaf){
+
+	id = meta.pageCount++;
+	char *page = cache->create(id);
+	header(page)->leaf = leaf ? 1 : 0;
+	return page;
+}
+
+//descend by lower bound: child i holds the elements in (elements[i-1], elements[i]]
+template<typename T, typename Compare, size_t PageSize>
+uint64_t btree_disk<T, Compare, PageSize>::descend(const T& key, std::vector<uint64_t> *path) const{
+
+	uint64_t id = meta.root;
+	while (true){
+		const char *page = readPage(id);
+		if (header(page)->leaf){
+			return id;
+		}
+		size_t i = btree_lower_bound<innerCapacity>(elements(page), header(page)->num_element, key, compare_t);
+		if (path != nullptr){
+			path->push_back(id);
+		}
+		id = children(page)[i];
+	}
+}
+
+//skip to the next leaf once a leaf is used up
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::normalize(uint64_t &page, size_t &index) const{
+
+	while (page != 0){
+		const char *p = readPage(page);
+		if (index < header(p)->num_element){
+			return;
+		}
+		page = header(p)->next;
+		index = 0;
+	}
+	index = 0;
+}
+
+//step back, across leaves when needed
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::retreat(uint64_t &page, size_t &index) const{
+
+	if (page == 0){
+		page = meta.lastLeaf;
+		index = header(readPage(page))->num_element;
+	}
+	while (index == 0){
+		page = header(readPage(page))->prev;
+		if (page == 0){
+			return;
+		}
+		index = header(readPage(page))->num_element;
+	}
+	--index;
+}
+
+//copy an element out of its page
+template<typename T, typename Compare, size_t PageSize>
+T btree_disk<T, Compare, PageSize>::elementAt(uint64_t page, size_t index) const{
+
+	return elements(readPage(page))[index];
+}
+
+// btree_disk iterators
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::begin() const{
+
+	uint64_t page = meta.firstLeaf;
+	size_t index = 0;
+	normalize(page, index);
+	return const_iterator(page, index, this);
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::end() const{
+	return const_iterator(0, 0, this);
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::cbegin() const{
+	return begin();
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::cend() const{
+	return end();
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_reverse_iterator btree_disk<T, Compare, PageSize>::rbegin() const{
+	return const_reverse_iterator(end());
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_reverse_iterator btree_disk<T, Compare, PageSize>::rend() const{
+	return const_reverse_iterator(begin());
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_reverse_iterator btree_disk<T, Compare, PageSize>::crbegin() const{
+	return rbegin();
+}
+
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_reverse_iterator btree_disk<T, Compare, PageSize>::crend() const{
+	return rend();
+}
+
+//find
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::find(const T& key) const{
+
+	uint64_t leaf = descend(key, nullptr);
+	const char *page = readPage(leaf);
+	bool match;
+	size_t pos = btree_find_in_node<leafCapacity>(elements(page), header(page)->num_element, key, compare_t, match);
+	return match ? const_iterator(leaf, pos, this) : end();
+}
+
+//lower bound
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::lower_bound(const T& key) const{
+
+	uint64_t leaf = descend(key, nullptr);
+	const char *page = readPage(leaf);
+	size_t pos = btree_lower_bound<leafCapacity>(elements(page), header(page)->num_element, key, compare_t);
+	normalize(leaf, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//upper bound
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::const_iterator btree_disk<T, Compare, PageSize>::upper_bound(const T& key) const{
+
+	uint64_t leaf = descend(key, nullptr);
+	const char *page = readPage(leaf);
+	size_t pos = btree_upper_bound<leafCapacity>(elements(page), header(page)->num_element, key, compare_t);
+	normalize(leaf, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//equal range
+template<typename T, typename Compare, size_t PageSize>
+std::pair<typename btree_disk<T, Compare, PageSize>::const_iterator, typename btree_disk<T, Compare, PageSize>::const_iterator>
+btree_disk<T, Compare, PageSize>::equal_range(const T& key) const{
+
+	const_iterator first = lower_bound(key);
+	const_iterator last = first;
+	if (last.pPage != 0 && !compare_t(key, *last)){
+		++last;
+	}
+	return std::make_pair(first, last);
+}
+
+//count
+template<typename T, typename Compare, size_t PageSize>
+size_t btree_disk<T, Compare, PageSize>::count(const T& key) const{
+
+	return find(key) != end() ? 1 : 0;
+}
+
+//range scan: each leaf's share is copied out before fn sees it, so fn
+//may use the tree without invalidating the page being read.
+template<typename T, typename Compare, size_t PageSize>
+template<typename Fn>
+size_t btree_disk<T, Compare, PageSize>::scan(const T& lo, const T& hi, Fn fn) const{
+
+	size_t visited = 0;
+	if (!compare_t(lo, hi)){
+		return visited;
+	}
+	uint64_t leaf = descend(lo, nullptr);
+	const char *page = readPage(leaf);
+	size_t i = btree_lower_bound<leafCapacity>(elements(page), header(page)->num_element, lo, compare_t);
+	std::vector<T> buffer;
+	buffer.reserve(leafCapacity);
+	while (leaf != 0){
+		page = readPage(leaf);
+		const T *elems = elements(page);
+		size_t n = header(page)->num_element;
+		buffer.clear();
+		for (; i < n && compare_t(elems[i], hi); ++i){
+			buffer.push_back(elems[i]);
+		}
+		bool reachedHi = i < n;
+		leaf = header(page)->next;
+		i = 0;
+		for (size_t j = 0; j < buffer.size(); ++j){
+			++visited;
+			if (!btree_scan_visit(fn, buffer[j])){
+				return visited;
+			}
+		}
+		if (reachedHi){
+			break;
+		}
+	}
+	return visited;
+}
+
+//insert into the leaf, splitting it and its ancestors when full
+template<typename T, typename Compare, size_t PageSize>
+std::pair<typename btree_disk<T, Compare, PageSize>::iterator, bool> btree_disk<T, Compare, PageSize>::insert(const T& elem){
+
+	requireWritable();
+	std::vector<uint64_t> path;
+	uint64_t leaf = descend(elem, &path);
+	const char *page = readPage(leaf);
+	size_t n = header(page)->num_element;
+	bool match;
+	size_t pos = btree_find_in_node<leafCapacity>(elements(page), n, elem, compare_t, match);
+	if (match){
+		return std::make_pair(iterator(leaf, pos, this), false);
+	}
+
+	++meta.btree_size;
+	if (n < leafCapacity){
+		char *wp = writePage(leaf);
+		T *elems = elements(wp);
+		std::copy_backward(elems + pos, elems + n, elems + n + 1);
+		elems[pos] = elem;
+		header(wp)->num_element = uint32_t(n + 1);
+		return std::make_pair(iterator(leaf, pos, this), true);
+	}
+
+	// the full leaf and the new element are split evenly over the leaf and a new right sibling.
+	std::vector<T> merged(elements(page), elements(page) + n);
+	merged.insert(merged.begin() + pos, elem);
+	uint64_t oldNext = header(page)->next;
+	size_t half = merged.size() / 2;
+
+	uint64_t right;
+	char *rp = newPage(right, true);
+	std::copy(merged.begin() + half, merged.end(), elements(rp));
+	header(rp)->num_element = uint32_t(merged.size() - half);
+	header(rp)->next = oldNext;
+	header(rp)->prev = leaf;
+
+	char *lp = writePage(leaf);
+	std::copy(merged.begin(), merged.begin() + half, elements(lp));
+	header(lp)->num_element = uint32_t(half);
+	header(lp)->next = right;
+
+	if (oldNext != 0){
+		header(writePage(oldNext))->prev = right;
+	}
+	else{
+		meta.lastLeaf = right;
+	}
+	insertChild(path, leaf, merged[half - 1], right);
+	if (pos < half){
+		return std::make_pair(iterator(leaf, pos, this), true);
+	}
+	return std::make_pair(iterator(right, pos - half, this), true);
+}
+
+//add a separator to the parent, splitting internal pages on the way up
+template<typename T, typename Compare, size_t PageSize>
+void btree_disk<T, Compare, PageSize>::insertChild(std::vector<uint64_t> &path, uint64_t left, const T& separator, uint64_t right){
+
+	T sep = separator;
+	while (!path.empty()){
+		uint64_t parent = path.back();
+		path.pop_back();
+		const char *page = readPage(parent);
+		size_t n = header(page)->num_element;
+		size_t pos = btree_lower_bound<innerCapacity>(elements(page), n, sep, compare_t);
+
+		if (n < innerCapacity){
+			char *wp = writePage(parent);
+			T *elems = elements(wp);
+			uint64_t *kids = children(wp);
+			std::copy_backward(elems + pos, elems + n, elems + n + 1);
+			std::copy_backward(kids + pos + 1, kids + n + 1, kids + n + 2);
+			elems[pos] = sep;
+			kids[pos + 1] = right;
+			header(wp)->num_element = uint32_t(n + 1);
+			return;
+		}
+
+		// the middle separator moves up; the keys and children after it move to a new page.
+		std::vector<T> keys(elements(page), elements(page) + n);
+		std::vector<uint64_t> kids(children(page), children(page) + n + 1);
+		keys.insert(keys.begin() + pos, sep);
+		kids.insert(kids.begin() + pos + 1, right);
+		size_t mid = keys.size() / 2;
+
+		uint64_t sibling;
+		char *sp = newPage(sibling, false);
+		std::copy(keys.begin() + mid + 1, keys.end(), elements(sp));
+		std::copy(kids.begin() + mid + 1, kids.end(), children(sp));
+		header(sp)->num_element = uint32_t(keys.size() - mid - 1);
+
+		char *wp = writePage(parent);
+		std::copy(keys.begin(), keys.begin() + mid, elements(wp));
+		std::copy(kids.begin(), kids.begin() + mid + 1, children(wp));
+		header(wp)->num_element = uint32_t(mid);
+
+		left = parent;
+		sep = keys[mid];
+		right = sibling;
+	}
+
+	// the root was split: grow the tree by one level.
+	uint64_t root;
+	char *page = newPage(root, false);
+	elements(page)[0] = sep;
+	children(page)[0] = left;
+	children(page)[1] = right;
+	header(page)->num_element = 1;
+	meta.root = root;
+}
+
+//erase by key
+template<typename T, typename Compare, size_t PageSize>
+size_t btree_disk<T, Compare, PageSize>::erase(const T& key){
+
+	requireWritable();
+	const_iterator pos = find(key);
+	if (pos == end()){
+		return 0;
+	}
+	erase(pos);
+	return 1;
+}
+
+//erase at an iterator; leaves are never merged, so the successor is just the next slot
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::iterator btree_disk<T, Compare, PageSize>::erase(const_iterator position){
+
+	requireWritable();
+	uint64_t leaf = position.pPage;
+	size_t index = position.pindex;
+	char *page = writePage(leaf);
+	T *elems = elements(page);
+	size_t n = header(page)->num_element;
+	std::copy(elems + index + 1, elems + n, elems + index);
+	header(page)->num_element = uint32_t(n - 1);
+	--meta.btree_size;
+	normalize(leaf, index);
+	return iterator(leaf, index, this);
+}
+
+//erase a range of elements
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::iterator btree_disk<T, Compare, PageSize>::erase(const_iterator first, const_iterator last){
+
+	size_t count = size_t(std::distance(first, last));
+	iterator next = first;
+	for (; count > 0; --count){
+		next = erase(next);
+	}
+	return next;
+}
+
+//size
+template<typename T, typename Compare, size_t PageSize>
+size_t btree_disk<T, Compare, PageSize>::size() const{
+	return size_t(meta.btree_size);
+}
+
+//empty
+template<typename T, typename Compare, size_t PageSize>
+bool btree_disk<T, Compare, PageSize>::empty() const{
+	return meta.btree_size == 0;
+}
+
+//read only
+template<typename T, typename Compare, size_t PageSize>
+bool btree_disk<T, Compare, PageSize>::read_only() const{
+	return mode == btree_open_mapped;
+}
+
+//comparator access
+template<typename T, typename Compare, size_t PageSize>
+typename btree_disk<T, Compare, PageSize>::key_compare btree_disk<T, Compare, PageSize>::key_comp() const{
+	return compare_t.comp;
+}
+
+#endif
+//**********************************
@@ -0,0 +1,324 @@
+/**
+ * Epoch-based reclamation for trees whose nodes are read without locks.
+ *
+ * A thread pins the domain (with a btree_epoch::guard) for as long as it
+ * may hold pointers into the tree.  A node unlinked from the tree is not
+ * freed at once but retired, stamped with the domain's current epoch.
+ * The epoch only moves on once every pinned thread has seen the current
+ * one, so two steps after a node was retired every thread that might
+ * have reached it has unpinned, and it is freed.
+ *
+ * Each thread has its own record in the domain: its pin state and its
+ * own list of retired nodes, so retiring takes no lock and touches no
+ * shared cache line.  A thread tries to drain its list every retireBatch
+ * retires, and unpins count too while the list is not empty.  A drain scans
+ * the list only once its oldest entry can be freed.  What a scan leaves
+ * behind spans at most two epochs, so every entry is scanned a bounded
+ * number of times.  A straggler that stalls the epoch thus costs nothing
+ * per retire, however long the list grows.  A thread that exits gives its
+ * record back.  The next thread to arrive reuses it, and until then any
+ * drain adopts the nodes left on it.  Whatever is left when the domain is
+ * destroyed is freed then.
+ **/
+
+#ifndef BTREE_EPOCH_H
+#define BTREE_EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <unordered_set>
+#include <algorithm>
+
+class btree_epoch{
+
+	struct Record;
+
+public:
+	btree_epoch();
+
+	btree_epoch(const btree_epoch&) = delete;
+	btree_epoch& operator=(const btree_epoch&) = delete;
+
+	// frees everything still retired; no thread may be pinned any more.
+	~btree_epoch();
+
+	// pins the calling thread for its lifetime. Guards nest.
+	class guard{
+	public:
+		explicit guard(btree_epoch& domain);
+		~guard();
+
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+	private:
+		btree_epoch *domain;
+		Record *record;
+	};
+
+	// hands ptr to release(context, ptr) once no thread can still reach it.
+	// The caller is pinned and has already unlinked ptr.
+	void retire(void *ptr, void (*release)(void*, void*), void *context);
+
+	// a thread tries to drain its retired nodes every this many retires.
+	static constexpr size_t retireBatch = 64;
+
+private:
+	struct Retired{
+		void *ptr;
+		void (*release)(void*, void*);
+		void *context;
+		uint64_t epoch;
+	};
+
+	// one per thread using the domain; a finished thread's record is reused.
+	// state is 0 while the thread is not pinned, else (epoch << 1) | 1.
+	// Whoever sets inUse owns the rest, so an idle record's list can be adopted.
+	struct alignas(64) Record{
+		std::atomic<uint64_t> state;
+		std::atomic<bool> inUse;
+		Record *next;
+		size_t depth;
+		size_t countdown;	// retires, or unpins holding retired nodes, left until the next drain
+		uint64_t oldest;	// epoch of the oldest entry in retired
+		std::vector<Retired> retired;
+
+		Record(): state(0), inUse(true), next(nullptr), depth(0), countdown(retireBatch), oldest(0){}
+	};
+
+	// the records a thread holds, one per domain; handed back when it exits.
+	struct ThreadRecords{
+		struct Slot{
+			uint64_t domain;
+			Record *record;
+		};
+		std::vector<Slot> slots;
+		~ThreadRecords();
+	};
+
+	// ids of the domains still alive, so an exiting thread knows which
+	// of its records it can still hand back.
+	struct Registry{
+		std::mutex lock;
+		std::unordered_set<uint64_t> live;
+	};
+
+	// never destroyed: threads may exit after static destructors have run.
+	static Registry& registry(){
+		static Registry *r = new Registry();
+		return *r;
+	}
+
+	// the calling thread's record, found in its ThreadRecords.
+	Record* localRecord();
+
+	// takes a free record, or adds one.
+	Record* claim();
+
+	// moves the epoch on if every pinned thread is in the current one.
+	void tryAdvance();
+
+	// advances if it can, adopts idle records' lists and frees what is old enough.
+	void drain(Record *record);
+
+	// frees the entries of record retired two or more epochs ago.
+	void collect(Record *record);
+
+	static uint64_t nextDomainId(){
+		static std::atomic<uint64_t> ids(1);
+		return ids.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint64_t> epoch;
+	std::atomic<Record*> records;
+	uint64_t domainId;
+};
+
+//constructor
+inline btree_epoch::btree_epoch(): epoch(1), records(nullptr), domainId(nextDomainId()){
+
+	Registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.live.insert(domainId);
+}
+
+//destructor: nothing is pinned any more, so everything retired can go.
+inline btree_epoch::~btree_epoch(){
+
+	{
+		Registry &r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		r.live.erase(domainId);
+	}
+	Record *record = records.load(std::memory_order_acquire);
+	while (record != nullptr){
+		for (size_t i = 0; i < record->retired.size(); ++i){
+			const Retired &r = record->retired[i];
+			r.release(r.context, r.ptr);
+		}
+		Record *next = record->next;
+		delete record;
+		record = next;
+	}
+}
+
+//pin: publish the epoch this thread entered in before reading any node
+inline btree_epoch::guard::guard(btree_epoch& domain_): domain(&domain_), record(domain_.localRecord()){
+
+	if (record->depth++ == 0){
+		uint64_t e = domain->epoch.load(std::memory_order_relaxed);
+		record->state.store((e << 1) | 1, std::memory_order_relaxed);
+		// order the pin before every node read that follows.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+//unpin; a thread still holding retired nodes counts its unpins towards a
+//drain, so a writer that stops retiring still frees what it retired.
+inline btree_epoch::guard::~guard(){
+
+	if (--record->depth == 0){
+		record->state.store(0, std::memory_order_release);
+		if (!record->retired.empty() && --record->countdown == 0){
+			domain->drain(record);
+		}
+	}
+}
+
+//retire
+inline void btree_epoch::retire(void *ptr, void (*release)(void*, void*), void *context){
+
+	Record *record = localRecord();
+	uint64_t e = epoch.load(std::memory_order_acquire);
+	if (record->retired.empty()){
+		record->oldest = e;
+	}
+	record->retired.push_back(Retired{ptr, release, context, e});
+	if (--record->countdown == 0){
+		drain(record);
+	}
+}
+
+//hand the records back: the domains still alive may give them to other
+//threads, and adopt what is left on them.
+inline btree_epoch::ThreadRecords::~ThreadRecords(){
+
+	Registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	for (size_t i = 0; i < slots.size(); ++i){
+		if (r.live.count(slots[i].domain) != 0){
+			slots[i].record->inUse.store(false, std::memory_order_release);
+		}
+	}
+}
+
+//the calling thread's record, claimed on first use
+inline btree_epoch::Record* btree_epoch::localRecord(){
+
+	static thread_local ThreadRecords mine;
+
+	for (size_t i = 0; i < mine.slots.size(); ++i){
+		if (mine.slots[i].domain == domainId){
+			return mine.slots[i].record;
+		}
+	}
+	Record *record = claim();
+	// forget the domains that are gone while the slot is added.
+	Registry &r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	size_t kept = 0;
+	for (size_t i = 0; i < mine.slots.size(); ++i){
+		if (r.live.count(mine.slots[i].domain) != 0){
+			mine.slots[kept++] = mine.slots[i];
+		}
+	}
+	mine.slots.resize(kept);
+	mine.slots.push_back(ThreadRecords::Slot{domainId, record});
+	return record;
+}
+
+//take a record a finished thread handed back, with whatever it still holds
+//retired, or add a new one. Records are kept until the domain goes.
+inline btree_epoch::Record* btree_epoch::claim(){
+
+	for (Record *r = records.load(std::memory_order_acquire); r != nullptr; r = r->next){
+		bool idle = false;
+		if (!r->inUse.load(std::memory_order_relaxed) &&
+				r->inUse.compare_exchange_strong(idle, true, std::memory_order_acquire, std::memory_order_relaxed)){
+			return r;
+		}
+	}
+	Record *record = new Record();
+	Record *head = records.load(std::memory_order_relaxed);
+	do{
+		record->next = head;
+	} while (!records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+	return record;
+}
+
+//advance the epoch unless a thread is still pinned in an older one
+inline void btree_epoch::tryAdvance(){
+
+	uint64_t e = epoch.load(std::memory_order_acquire);
+	// pairs with the fence in guard: a pin this scan misses is ordered
+	// after it, so that thread cannot reach anything unlinked before it.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for (Record *r = records.load(std::memory_order_acquire); r != nullptr; r = r->next){
+		uint64_t state = r->state.load(std::memory_order_acquire);
+		if ((state & 1) != 0 && (state >> 1) != e){
+			return;
+		}
+	}
+	epoch.compare_exchange_strong(e, e + 1, std::memory_order_acq_rel);
+}
+
+//advance, adopt, and collect if the oldest entry has become free
+inline void btree_epoch::drain(Record *record){
+
+	tryAdvance();
+	for (Record *r = records.load(std::memory_order_acquire); r != nullptr; r = r->next){
+		bool idle = false;
+		if (r == record || r->inUse.load(std::memory_order_relaxed) ||
+				!r->inUse.compare_exchange_strong(idle, true, std::memory_order_acquire, std::memory_order_relaxed)){
+			continue;
+		}
+		if (!r->retired.empty()){
+			if (record->retired.empty() || r->oldest < record->oldest){
+				record->oldest = r->oldest;
+			}
+			record->retired.insert(record->retired.end(), r->retired.begin(), r->retired.end());
+			r->retired.clear();
+		}
+		r->inUse.store(false, std::memory_order_release);
+	}
+	if (!record->retired.empty() && record->oldest + 2 <= epoch.load(std::memory_order_acquire)){
+		collect(record);
+	}
+	record->countdown = retireBatch;
+}
+
+//free what no pinned thread can reach
+inline void btree_epoch::collect(Record *record){
+
+	uint64_t e = epoch.load(std::memory_order_acquire);
+	std::vector<Retired> &list = record->retired;
+	std::vector<Retired>::iterator keep = std::partition(list.begin(), list.end(), [e](const Retired& r){
+		return r.epoch + 2 > e;
+	});
+	for (std::vector<Retired>::iterator it = keep; it != list.end(); ++it){
+		it->release(it->context, it->ptr);
+	}
+	list.erase(keep, list.end());
+	uint64_t oldest = e;
+	for (std::vector<Retired>::iterator it = list.begin(); it != list.end(); ++it){
+		oldest = std::min(oldest, it->epoch);
+	}
+	record->oldest = oldest;
+}
+
+#endif
+//**********************************
@@ -10,43 +10,125 @@
 #include <iterator>
 #include <stddef.h>
 #include<iostream>
-#include<stack>
 using namespace std;
 
 
 // iterator related interface stuff here; would be nice if you called your
 // iterator class btree_iterator (and possibly const_btree_iterator)
 
-template<typename T> class btree;
-template<typename T> class btree_iterator;
-template<typename T> class const_btree_iterator;
+// both iterators are parameterised on the tree type they walk.
+template<typename Tree> class btree_iterator;
+template<typename Tree> class const_btree_iterator;
 
-template<typename T> class btree_iterator{
+// operator-> result for trees whose reference is a proxy (a pair of
+// references into the key and value arrays) rather than a real object.
+template<typename Ref> struct btree_arrow_proxy{
+	Ref ref;
+	const Ref* operator->() const{ return &ref; }
+};
+
+// In-order stepping shared by both iterators. Within a leaf a step is just
+// an index change; otherwise it descends to the nearest leaf of the next
+// subtree or climbs through pNode_n/childno to the first ancestor that
+// still has elements on that side. Every node is entered and left once
+// per full scan, so each step costs O(1) amortized.
+
+// moves (node, index) to the next element, or to (nullptr, 0) past the end.
+template<typename NodePtr>
+void btree_increment(NodePtr &node, size_t &index){
+
+	if (node == nullptr){
+		return;
+	}
+	if (!node->hasChildren()){
+		if (++index < node->num_element){
+			return;
+		}
+		NodePtr climb = node;
+		while (climb->pNode_n != nullptr && climb->childno == climb->pNode_n->num_element){
+			climb = climb->pNode_n;
+		}
+		if (climb->pNode_n == nullptr){
+			node = nullptr;
+			index = 0;
+			return;
+		}
+		index = climb->childno;
+		node = climb->pNode_n;
+		return;
+	}
+	NodePtr descend = node->child(index + 1);
+	while (descend->hasChildren()){
+		descend = descend->child(0);
+	}
+	node = descend;
+	index = 0;
+}
+
+// moves (node, index) to the previous element; from the end it moves to
+// the last element (in lastNode), and from the first element to the end.
+template<typename NodePtr>
+void btree_decrement(NodePtr &node, size_t &index, NodePtr lastNode){
 
-	friend class const_btree_iterator<T>;
+	if (node == nullptr){
+		if (lastNode != nullptr){
+			node = lastNode;
+			index = lastNode->num_element - 1;
+		}
+		return;
+	}
+	if (!node->hasChildren()){
+		if (index > 0){
+			--index;
+			return;
+		}
+		NodePtr climb = node;
+		while (climb->pNode_n != nullptr && climb->childno == 0){
+			climb = climb->pNode_n;
+		}
+		if (climb->pNode_n == nullptr){
+			node = nullptr;
+			index = 0;
+			return;
+		}
+		index = climb->childno - 1;
+		node = climb->pNode_n;
+		return;
+	}
+	NodePtr descend = node->child(index);
+	while (descend->hasChildren()){
+		descend = descend->child(descend->num_element);
+	}
+	node = descend;
+	index = descend->num_element - 1;
+}
+
+template<typename Tree> class btree_iterator{
+
+	friend class const_btree_iterator<Tree>;
 public:
-	typename btree<T>::Node *pNode;
+	typename Tree::Node *pNode;
 	size_t pindex;
-	const btree<T> *pbtree;
+	const Tree *pbtree;
 
 public:
 	//constructor
-	btree_iterator(typename btree<T>::Node *pNode_ = nullptr, size_t pindex_=0, const btree<T> *pbtree_ = nullptr):
+	btree_iterator(typename Tree::Node *pNode_ = nullptr, size_t pindex_=0, const Tree *pbtree_ = nullptr):
 		pNode(pNode_),pindex( pindex_), pbtree(pbtree_){}
 
 	// typedefs
 	typedef ptrdiff_t difference_type;
 	typedef bidirectional_iterator_tag	iterator_category;
-	typedef T value_type;
-	typedef T& reference;
-	typedef T* pointer;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::reference reference;
+	typedef typename Tree::pointer pointer;
 
 	//operator overloading
 	btree_iterator& operator=(const btree_iterator&);
 	bool operator==(const btree_iterator&) const;
-	bool operator==(const const_btree_iterator<T>& rhs) const;
+	bool operator==(const const_btree_iterator<Tree>& rhs) const;
 	bool operator!=(const btree_iterator&) const;
-	bool operator!=(const const_btree_iterator<T>& rhs) const;
+	bool operator!=(const const_btree_iterator<Tree>& rhs) const;
 	reference operator*()const;
 	pointer operator->()const;
 	btree_iterator& operator++();
@@ -54,39 +136,48 @@ public:
 	btree_iterator& operator--();
 	btree_iterator operator --(int);
 
+	// jumps of n elements, through the tree's subtree counts in O(log n)
+	// rather than n steps. The category stays bidirectional, so
+	// std::advance and std::distance still step one element at a time.
+	btree_iterator& operator+=(difference_type n);
+	btree_iterator& operator-=(difference_type n);
+	btree_iterator operator+(difference_type n) const;
+	btree_iterator operator-(difference_type n) const;
+	difference_type operator-(const btree_iterator& rhs) const;
+
 };
 
 /// const iterator class
-template<typename T> class const_btree_iterator{
+template<typename Tree> class const_btree_iterator{
 
 public:
-	typename btree<T>::Node *pNode;
+	typename Tree::Node *pNode;
 	size_t pindex;
-	const btree<T> *pbtree;
+	const Tree *pbtree;
 
 public:
 	//constructor
-	const_btree_iterator(typename btree<T>::Node *pNode_ = nullptr, size_t pindex_=0, const btree<T> *pbtree_ = nullptr):
+	const_btree_iterator(typename Tree::Node *pNode_ = nullptr, size_t pindex_=0, const Tree *pbtree_ = nullptr):
 		pNode(pNode_),pindex( pindex_), pbtree(pbtree_){}
 
-	friend class btree_iterator<T>;
+	friend class btree_iterator<Tree>;
 
-	const_btree_iterator(const btree_iterator<T>& rhs):
+	const_btree_iterator(const btree_iterator<Tree>& rhs):
 		pNode(rhs.pNode),pindex( rhs.pindex), pbtree(rhs.pbtree){}
 
 	//typedefs
 	typedef ptrdiff_t difference_type;
 	typedef bidirectional_iterator_tag	iterator_category;
-	typedef T value_type;
-	typedef T& reference;
-	typedef T* pointer;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
 
 	//operator overloading
 	const_btree_iterator& operator=(const const_btree_iterator&);
 	bool operator==(const const_btree_iterator& rhs) const;
-	bool operator==(const btree_iterator<T>& rhs) const;
+	bool operator==(const btree_iterator<Tree>& rhs) const;
 	bool operator!=(const const_btree_iterator&) const;
-	bool operator!=(const btree_iterator<T>& other) const;
+	bool operator!=(const btree_iterator<Tree>& other) const;
 	reference operator*()const;
 	pointer operator->()const;
 	const_btree_iterator& operator++();
@@ -94,13 +185,20 @@ public:
 	const_btree_iterator& operator--();
 	const_btree_iterator operator--(int);
 
+	// jumps of n elements, as for btree_iterator.
+	const_btree_iterator& operator+=(difference_type n);
+	const_btree_iterator& operator-=(difference_type n);
+	const_btree_iterator operator+(difference_type n) const;
+	const_btree_iterator operator-(difference_type n) const;
+	difference_type operator-(const const_btree_iterator& rhs) const;
+
 };
 
 // non constant members
 
 // = operator overloading.
-template<typename T>
-btree_iterator<T>& btree_iterator<T>::operator =(const btree_iterator &rhs){
+template<typename Tree>
+btree_iterator<Tree>& btree_iterator<Tree>::operator =(const btree_iterator &rhs){
 
 	if (this==&rhs){
 		return *this;
@@ -115,8 +213,8 @@ btree_iterator<T>& btree_iterator<T>::operator =(const btree_iterator &rhs){
 	return *this;
 }
 //== operator overloading
-template<typename T>
-bool btree_iterator<T>::operator ==(const btree_iterator &rhs) const{
+template<typename Tree>
+bool btree_iterator<Tree>::operator ==(const btree_iterator &rhs) const{
 
 	if(pNode==rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree){
 		return true;
@@ -124,214 +222,117 @@ bool btree_iterator<T>::operator ==(const btree_iterator &rhs) const{
 	return false;
 }
 //== operator overloading
-template<typename T>
-bool btree_iterator<T>::operator ==(const const_btree_iterator<T>& rhs) const {
+template<typename Tree>
+bool btree_iterator<Tree>::operator ==(const const_btree_iterator<Tree>& rhs) const {
 	if(pNode==rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree){
 		return true;
 	}
 	return false;
 }
 //* operator overloading
-template<typename T>
-typename btree_iterator<T>::reference btree_iterator<T>::operator*()const {
-	return pNode->vNodeElement->at(pindex);
+template<typename Tree>
+typename btree_iterator<Tree>::reference btree_iterator<Tree>::operator*()const {
+	return Tree::elementAt(pNode, pindex);
 }
 
 //-> operator overloading
-template<typename T>
-typename btree_iterator<T>::pointer btree_iterator<T>::operator->()const {
+template<typename Tree>
+typename btree_iterator<Tree>::pointer btree_iterator<Tree>::operator->()const {
 
-	return &(pNode->vNodeElement->at(pindex));
+	return Tree::addressAt(pNode, pindex);
 }
 
 //!= operator overloading
-template<typename T>
-bool btree_iterator<T>::operator !=(const btree_iterator &rhs) const{
+template<typename Tree>
+bool btree_iterator<Tree>::operator !=(const btree_iterator &rhs) const{
 	return !operator==(rhs);
 }
 
 //!= operator overloading
-template<typename T>
-bool btree_iterator<T>::operator !=(const const_btree_iterator<T> &rhs) const{
+template<typename Tree>
+bool btree_iterator<Tree>::operator !=(const const_btree_iterator<Tree> &rhs) const{
 	return !operator==(rhs);
 }
 
 //++ operator overloading
-template<typename T>
-btree_iterator<T>& btree_iterator<T>::operator++(){
-
-	if(pNode == nullptr){
-		this->pNode= nullptr;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
-
-	if(pNode->vNodeElement->size()==0){
-		this->pNode= pbtree->baseNode;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
-	if(pNode->vNodeElement->size()-pindex >=2){
-		this->pNode=pNode;
-		this->pbtree= pbtree;
-		this->pindex= pindex+1;
-		return *this;
-	}
-
-	if(pNode->children->empty()){
-		this->pNode=nullptr;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
+template<typename Tree>
+btree_iterator<Tree>& btree_iterator<Tree>::operator++(){
 
-	if(pNode==pbtree->baseNode){
-		for (size_t i =0; i<=pNode->vNodeElement->size(); ++i){
-
-			if(pNode->children->at(i)->vNodeElement->size() ==0){
-				if(i == pNode->vNodeElement->size()){
-					this->pNode=nullptr;
-					this->pbtree= pbtree;
-					this->pindex= 0;
-					return *this;
-				}
-				continue;
-			}
-			this->pNode=pNode->children->at(i);
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-		}
-	}
-
-	typename btree<T>::Node * tempNode = pNode;
-	typename btree<T>::Node * tParNode = tempNode->pNode_n;
-	size_t pSize = tParNode->vNodeElement->size();
-	size_t childNIndex = tempNode->childno;
-
-	for(size_t i = childNIndex+1; i<= pSize; ++i ){
-
-		if (tParNode->children->at(i)->vNodeElement->empty()){
-			continue;
-		}
-		else{
-			this->pNode=tParNode->children->at(i);
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-		}
-	}
-
-	for(size_t i = 0; i<= pSize; ++i ){
-
-		if (tParNode->children->at(i)->children->empty()){
-			continue;
-		}
-		typename btree<T>::Node * chNode = tParNode->children->at(i);
-			for(size_t j = 0; j<=chNode->vNodeElement->size(); ++j){
-				if (chNode->children->at(j)->vNodeElement->empty()){
-					continue;
-				}
-				else{
-					this->pNode=chNode->children->at(i);
-					this->pbtree= pbtree;
-					this->pindex= 0;
-					return *this;
-				}
-			}
-
-			this->pNode=nullptr;
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-
-	}
-	this->pNode=nullptr;
-	this->pbtree= pbtree;
-	this->pindex= 0;
+	btree_increment(pNode, pindex);
 	return *this;
 }
 
 //++ operator overloading
-template<typename T>
-btree_iterator<T> btree_iterator<T>::operator ++(int){
+template<typename Tree>
+btree_iterator<Tree> btree_iterator<Tree>::operator ++(int){
 	btree_iterator temp_return = *this;
 	operator ++();
 	return temp_return;
 }
 
 //-- operator overloading
-template<typename T>
-btree_iterator<T>& btree_iterator<T>::operator --(){
-
-
-	if(pNode==nullptr){
-		pNode= pbtree->lastNode;
-		pindex= pbtree->lastNode->vNodeElement->size()-1;
-		return *this;
-	}
+template<typename Tree>
+btree_iterator<Tree>& btree_iterator<Tree>::operator --(){
 
-	if(pNode==pbtree->baseNode && pindex ==0){
-		pNode= nullptr;
-		pindex= 0;
-		return *this;
-	}
-
-	if(pNode==pbtree->baseNode && pindex !=0){
-		pindex= pindex-1;
-		return *this;
-	}
+	btree_decrement(pNode, pindex, pbtree->lastNode);
+	return *this;
+}
+//-- operator overloading
+template<typename Tree>
+btree_iterator<Tree> btree_iterator<Tree>::operator --(int){
 
-	typename btree<T>::Node* tempNode = pbtree->baseNode;
-	std::stack<typename btree<T>::Node*> nstack;
-	nstack.push(tempNode);
+	btree_iterator e_iter = *this;
+		operator --();
+		return e_iter;
+}
 
-	while(true){
+//+= operator overloading
+template<typename Tree>
+btree_iterator<Tree>& btree_iterator<Tree>::operator +=(difference_type n){
 
-		tempNode = nstack.top();
-		nstack.pop();
+	pbtree->advance(pNode, pindex, n);
+	return *this;
+}
 
-		if (tempNode == pNode && pindex!=0){
+//-= operator overloading
+template<typename Tree>
+btree_iterator<Tree>& btree_iterator<Tree>::operator -=(difference_type n){
 
-			pindex= pindex-1;
-			return *this;
-		}
+	pbtree->advance(pNode, pindex, -n);
+	return *this;
+}
 
-		if (tempNode == pNode && pindex==0){
+//+ operator overloading
+template<typename Tree>
+btree_iterator<Tree> btree_iterator<Tree>::operator +(difference_type n) const{
 
-			pNode= nstack.top();
-			pindex = pNode->vNodeElement->size()-1;
-			nstack.pop();
-			return *this;
-		}
+	btree_iterator moved = *this;
+	moved += n;
+	return moved;
+}
 
-		for(size_t i =0; i<=tempNode->vNodeElement->size(); ++i){
-			if (tempNode->children->empty()){
-				continue;
-			}
-			nstack.push(tempNode->children->at(i));
-		}
-	}
+//- operator overloading
+template<typename Tree>
+btree_iterator<Tree> btree_iterator<Tree>::operator -(difference_type n) const{
 
-	return *this;
+	btree_iterator moved = *this;
+	moved -= n;
+	return moved;
 }
-//-- operator overloading
-template<typename T>
-btree_iterator<T> btree_iterator<T>::operator --(int){
 
-	btree_iterator e_iter = *this;
-		operator --();
-		return e_iter;
+//distance between iterators
+template<typename Tree>
+typename btree_iterator<Tree>::difference_type btree_iterator<Tree>::operator -(const btree_iterator &rhs) const{
+
+	return difference_type(pbtree->indexOf(pNode, pindex)) - difference_type(pbtree->indexOf(rhs.pNode, rhs.pindex));
 }
 
 
 //---constant member functions
 
 //== operator overloading (const)
-template<typename T>
-const_btree_iterator<T>& const_btree_iterator<T>::operator =(const const_btree_iterator &rhs){
+template<typename Tree>
+const_btree_iterator<Tree>& const_btree_iterator<Tree>::operator =(const const_btree_iterator &rhs){
 
 	if (this==&rhs){
 		return *this;
@@ -346,8 +347,8 @@ const_btree_iterator<T>& const_btree_iterator<T>::operator =(const const_btree_i
 	return *this;
 }
 //== operator overloading (const)
-template<typename T>
-bool const_btree_iterator<T>::operator ==(const const_btree_iterator &rhs) const{
+template<typename Tree>
+bool const_btree_iterator<Tree>::operator ==(const const_btree_iterator &rhs) const{
 
 	if(pNode==rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree){
 		return true;
@@ -356,8 +357,8 @@ bool const_btree_iterator<T>::operator ==(const const_btree_iterator &rhs) const
 }
 
 //== operator overloading (const)
-template<typename T>
-bool const_btree_iterator<T>::operator ==(const btree_iterator<T>& rhs) const {
+template<typename Tree>
+bool const_btree_iterator<Tree>::operator ==(const btree_iterator<Tree>& rhs) const {
 	if(pNode==rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree){
 		return true;
 	}
@@ -365,203 +366,102 @@ bool const_btree_iterator<T>::operator ==(const btree_iterator<T>& rhs) const {
 }
 
 //== operator overloading (const)
-template<typename T>
-typename const_btree_iterator<T>::reference const_btree_iterator<T>::operator*()const {
-	return pNode->vNodeElement->at(pindex);
+template<typename Tree>
+typename const_btree_iterator<Tree>::reference const_btree_iterator<Tree>::operator*()const {
+	return Tree::elementAt(static_cast<const typename Tree::Node*>(pNode), pindex);
 }
 
 //-> operator overloading (const)
-template<typename T>
-typename const_btree_iterator<T>::pointer const_btree_iterator<T>::operator->()const {
+template<typename Tree>
+typename const_btree_iterator<Tree>::pointer const_btree_iterator<Tree>::operator->()const {
 
-	return &(pNode->vNodeElement->at(pindex));
+	return Tree::addressAt(static_cast<const typename Tree::Node*>(pNode), pindex);
 }
 
 //!= operator overloading (const)
-template<typename T>
-bool const_btree_iterator<T>::operator !=(const const_btree_iterator &rhs) const{
+template<typename Tree>
+bool const_btree_iterator<Tree>::operator !=(const const_btree_iterator &rhs) const{
 	return !operator==(rhs);
 }
 
 //!= operator overloading (const)
-template<typename T>
-bool const_btree_iterator<T>::operator !=(const btree_iterator<T> &rhs) const{
+template<typename Tree>
+bool const_btree_iterator<Tree>::operator !=(const btree_iterator<Tree> &rhs) const{
 	return !operator==(rhs);
 }
 
 //++ operator overloading (const)
-template<typename T>
-const_btree_iterator<T>& const_btree_iterator<T>::operator++(){
-
-	if(pNode == nullptr){
-		this->pNode= nullptr;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
-
-	if(pNode->vNodeElement->size()==0){
-		this->pNode= pbtree->baseNode;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
-	if(pNode->vNodeElement->size()-pindex >=2){
-		this->pNode=pNode;
-		this->pbtree= pbtree;
-		this->pindex= pindex+1;
-		return *this;
-	}
-
-	if(pNode->children->empty()){
-		this->pNode=nullptr;
-		this->pbtree= pbtree;
-		this->pindex= 0;
-		return *this;
-	}
-
-	if(pNode==pbtree->baseNode){
-		for (size_t i =0; i<=pNode->vNodeElement->size(); ++i){
-
-			if(pNode->children->at(i)->vNodeElement->size() ==0){
-				if(i == pNode->vNodeElement->size()){
-					this->pNode=nullptr;
-					this->pbtree= pbtree;
-					this->pindex= 0;
-					return *this;
-				}
-				continue;
-			}
-			this->pNode=pNode->children->at(i);
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-		}
-	}
-
-	typename btree<T>::Node * tempNode = pNode;
-	typename btree<T>::Node * tParNode = tempNode->pNode_n;
-	size_t pSize = tParNode->vNodeElement->size();
-	size_t childNIndex = tempNode->childno;
-
-	for(size_t i = childNIndex+1; i<= pSize; ++i ){
-
-		if (tParNode->children->at(i)->vNodeElement->empty()){
-			continue;
-		}
-		else{
-			this->pNode=tParNode->children->at(i);
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-		}
-	}
-
-	for(size_t i = 0; i<= pSize; ++i ){
-
-		if (tParNode->children->at(i)->children->empty()){
-			continue;
-		}
-		typename btree<T>::Node * chNode = tParNode->children->at(i);
-
-			for(size_t j = 0; j<=chNode->vNodeElement->size(); ++j){
+template<typename Tree>
+const_btree_iterator<Tree>& const_btree_iterator<Tree>::operator++(){
 
-				if (chNode->children->at(j)->vNodeElement->empty()){
-					continue;
-				}
-				else{
-					this->pNode=chNode->children->at(i);
-					this->pbtree= pbtree;
-					this->pindex= 0;
-					return *this;
-
-				}
-
-			}
-
-			this->pNode=nullptr;
-			this->pbtree= pbtree;
-			this->pindex= 0;
-			return *this;
-
-	}
-	this->pNode=nullptr;
-	this->pbtree= pbtree;
-	this->pindex= 0;
+	btree_increment(pNode, pindex);
 	return *this;
 }
 
 //++ operator overloading (const)
-template<typename T>
-const_btree_iterator<T> const_btree_iterator<T>::operator ++(int){
+template<typename Tree>
+const_btree_iterator<Tree> const_btree_iterator<Tree>::operator ++(int){
 	const_btree_iterator temp_return = *this;
 	operator ++();
 	return temp_return;
 }
 
 //-- operator overloading (const)
-template<typename T>
-const_btree_iterator<T>& const_btree_iterator<T>::operator --(){
-
-
-	if(pNode==nullptr){
-		pNode= pbtree->lastNode;
-		pindex= pbtree->lastNode->vNodeElement->size()-1;
-		return *this;
-	}
+template<typename Tree>
+const_btree_iterator<Tree>& const_btree_iterator<Tree>::operator --(){
 
-	if(pNode==pbtree->baseNode && pindex ==0){
-		pNode= nullptr;
-		pindex= 0;
-		return *this;
-	}
+	btree_decrement(pNode, pindex, pbtree->lastNode);
+	return *this;
+}
 
-	if(pNode==pbtree->baseNode && pindex !=0){
-		pindex= pindex-1;
-		return *this;
-	}
+//-- operator overloading (const)
+template<typename Tree>
+const_btree_iterator<Tree> const_btree_iterator<Tree>::operator --(int){
 
-	typename btree<T>::Node* tempNode = pbtree->baseNode;
-	std::stack<typename btree<T>::Node*> nstack;
-	nstack.push(tempNode);
+	const_btree_iterator e_iter = *this;
+		operator --();
+		return e_iter;
+}
 
-	while(true){
+//+= operator overloading (const)
+template<typename Tree>
+const_btree_iterator<Tree>& const_btree_iterator<Tree>::operator +=(difference_type n){
 
-		tempNode = nstack.top();
-		nstack.pop();
+	pbtree->advance(pNode, pindex, n);
+	return *this;
+}
 
-		if (tempNode == pNode && pindex!=0){
+//-= operator overloading (const)
+template<typename Tree>
+const_btree_iterator<Tree>& const_btree_iterator<Tree>::operator -=(difference_type n){
 
-			pindex= pindex-1;
-			return *this;
-		}
+	pbtree->advance(pNode, pindex, -n);
+	return *this;
+}
 
-		if (tempNode == pNode && pindex==0){
+//+ operator overloading (const)
+template<typename Tree>
+const_btree_iterator<Tree> const_btree_iterator<Tree>::operator +(difference_type n) const{
 
-			pNode= nstack.top();
-			pindex = pNode->vNodeElement->size()-1;
-			nstack.pop();
-			return *this;
-		}
+	const_btree_iterator moved = *this;
+	moved += n;
+	return moved;
+}
 
-		for(size_t i =0; i<=tempNode->vNodeElement->size(); ++i){
-			if (tempNode->children->empty()){
-				continue;
-			}
-			nstack.push(tempNode->children->at(i));
-		}
-	}
+//- operator overloading (const)
+template<typename Tree>
+const_btree_iterator<Tree> const_btree_iterator<Tree>::operator -(difference_type n) const{
 
-	return *this;
+	const_btree_iterator moved = *this;
+	moved -= n;
+	return moved;
 }
 
-//-- operator overloading (const)
-template<typename T>
-const_btree_iterator<T> const_btree_iterator<T>::operator --(int){
+//distance between iterators (const)
+template<typename Tree>
+typename const_btree_iterator<Tree>::difference_type const_btree_iterator<Tree>::operator -(const const_btree_iterator &rhs) const{
 
-	const_btree_iterator e_iter = *this;
-		operator --();
-		return e_iter;
+	return difference_type(pbtree->indexOf(pNode, pindex)) - difference_type(pbtree->indexOf(rhs.pNode, rhs.pindex));
 }
 #endif
 //**********************************
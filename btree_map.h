@@ -0,0 +1,335 @@
+/**
+ * Ordered key/value containers on the btree node engine.  Each node keeps
+ * its keys and its mapped values in two separate arrays, so the in-node
+ * search only streams keys and a value is touched once its slot is known.
+ * Since no pair is stored, iterators yield a std::pair<const K&, V&> of
+ * references (bind it with auto&& or const auto&); it->second works
+ * through btree_arrow_proxy.
+ **/
+
+#ifndef BTREE_MAP_H
+#define BTREE_MAP_H
+
+#include <stdexcept>
+#include "btree.h"
+
+// policy for btree_map / btree_multimap: keys searched, values carried alongside.
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc, bool Multi>
+struct btree_map_params{
+	typedef K key_type;
+	typedef std::pair<const K, V> value_type;
+	typedef std::pair<K, V> init_type;
+	typedef V mapped_storage;
+	typedef Compare key_compare;
+	typedef Alloc allocator_type;
+	typedef std::pair<const K&, V&> reference;
+	typedef std::pair<const K&, const V&> const_reference;
+	typedef btree_arrow_proxy<reference> pointer;
+	typedef btree_arrow_proxy<const_reference> const_pointer;
+
+	static constexpr bool multi = Multi;
+	static constexpr bool has_mapped = true;
+	static constexpr size_t fanout = Fanout;
+
+	template<typename P>
+	static const K& key(const P& value){ return value.first; }
+};
+
+/**
+ * An ordered map from unique keys K to values V. Compare and Fanout work
+ * as for btree.
+ */
+template<typename K, typename V, typename Compare = std::less<K>, size_t Fanout = 0,
+         typename Alloc = std::allocator<std::pair<const K, V> > >
+class btree_map : public btree_base<btree_map_params<K, V, Compare, Fanout, Alloc, false> > {
+
+	typedef btree_base<btree_map_params<K, V, Compare, Fanout, Alloc, false> > base_type;
+ public:
+	typedef V mapped_type;
+	typedef typename base_type::key_type key_type;
+	typedef typename base_type::value_type value_type;
+	typedef typename base_type::iterator iterator;
+	typedef typename base_type::const_iterator const_iterator;
+
+  /**
+   * @param maxNodeElems the maximum number of entries per node (at least 3);
+   *        ignored when Fanout is not 0
+   * @param comp the key ordering; a transparent one (e.g. std::less<>)
+   *        enables lookups by any type it can compare with K
+   * @param alloc the allocator the node pools take their chunks from
+   */
+  btree_map(size_t maxNodeElems = 40, const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  /**
+   * Range constructor: builds the map from the (key, value) pairs of
+   * [first, last) with bulk_load; the first of equal keys is kept.
+   */
+  template<typename InputIt,
+           typename = typename std::iterator_traits<InputIt>::iterator_category>
+  btree_map(InputIt first, InputIt last, size_t maxNodeElems = 40, double fillFactor = 1.0,
+		  const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  /**
+    * Inserts elem unless its key is already present.
+    * @return the iterator at the entry for the key, and whether elem was inserted.
+    */
+  std::pair<iterator, bool> insert(const value_type& elem);
+  std::pair<iterator, bool> insert(value_type&& elem);
+
+  /**
+    * Builds a (key, value) pair from args and inserts it like insert.
+    */
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args);
+
+  /**
+    * Inserts key with a value constructed from args if key is absent;
+    * otherwise neither key nor args are touched.
+    */
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args);
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args);
+
+  /**
+    * Inserts (key, obj), or assigns obj to the value of an existing key.
+    * @return the iterator at the entry, and true if it was inserted.
+    */
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& obj);
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(key_type&& key, M&& obj);
+
+  /**
+    * @return the value for key, inserting a value-initialised one first
+    *         if key is absent.
+    */
+  mapped_type& operator[](const key_type& key);
+  mapped_type& operator[](key_type&& key);
+
+  /**
+    * @return the value for key.
+    * @throws std::out_of_range if key is absent.
+    */
+  template<typename K2 = key_type>
+  mapped_type& at(const typename base_type::template key_arg<K2>& key);
+  template<typename K2 = key_type>
+  const mapped_type& at(const typename base_type::template key_arg<K2>& key) const;
+};
+
+/**
+ * An ordered map from keys K to values V in which keys may repeat;
+ * entries with equal keys stay in insertion order.
+ */
+template<typename K, typename V, typename Compare = std::less<K>, size_t Fanout = 0,
+         typename Alloc = std::allocator<std::pair<const K, V> > >
+class btree_multimap : public btree_base<btree_map_params<K, V, Compare, Fanout, Alloc, true> > {
+
+	typedef btree_base<btree_map_params<K, V, Compare, Fanout, Alloc, true> > base_type;
+ public:
+	typedef V mapped_type;
+	typedef typename base_type::key_type key_type;
+	typedef typename base_type::value_type value_type;
+	typedef typename base_type::iterator iterator;
+	typedef typename base_type::const_iterator const_iterator;
+
+  /**
+   * @param maxNodeElems, comp, alloc as for btree_map
+   */
+  btree_multimap(size_t maxNodeElems = 40, const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  /**
+   * Range constructor: builds the multimap from [first, last) with bulk_load.
+   */
+  template<typename InputIt,
+           typename = typename std::iterator_traits<InputIt>::iterator_category>
+  btree_multimap(InputIt first, InputIt last, size_t maxNodeElems = 40, double fillFactor = 1.0,
+		  const Compare& comp = Compare(), const Alloc& alloc = Alloc());
+
+  /**
+    * Inserts elem after every entry with an equal key.
+    * @return an iterator at the new entry.
+    */
+  iterator insert(const value_type& elem);
+  iterator insert(value_type&& elem);
+
+  /**
+    * Builds a (key, value) pair from args and inserts it like insert.
+    */
+  template<typename... Args>
+  iterator emplace(Args&&... args);
+};
+
+//btree_map constructor.
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+btree_map<K, V, Compare, Fanout, Alloc>::btree_map(size_t maxNodeElems_, const Compare& comp, const Alloc& alloc)
+	:base_type(maxNodeElems_, comp, alloc){
+}
+
+//btree_map range constructor.
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename InputIt, typename>
+btree_map<K, V, Compare, Fanout, Alloc>::btree_map(InputIt first, InputIt last, size_t maxNodeElems_, double fillFactor,
+		const Compare& comp, const Alloc& alloc)
+	:base_type(maxNodeElems_, comp, alloc){
+
+	this->bulk_load(first, last, fillFactor);
+}
+
+//btree_map insert
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::insert(const value_type& elem){
+
+	return this->insertUnique(elem.first, elem.second);
+}
+
+//btree_map insert (move)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::insert(value_type&& elem){
+
+	return this->insertUnique(elem.first, std::move(elem.second));
+}
+
+//btree_map emplace
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename... Args>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::emplace(Args&&... args){
+
+	std::pair<K, V> elem(std::forward<Args>(args)...);
+	return this->insertUnique(std::move(elem.first), std::move(elem.second));
+}
+
+//btree_map try_emplace
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename... Args>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::try_emplace(const key_type& key, Args&&... args){
+
+	return this->insertUnique(key, std::forward<Args>(args)...);
+}
+
+//btree_map try_emplace (move)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename... Args>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::try_emplace(key_type&& key, Args&&... args){
+
+	return this->insertUnique(std::move(key), std::forward<Args>(args)...);
+}
+
+//btree_map insert_or_assign
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename M>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::insert_or_assign(const key_type& key, M&& obj){
+
+	// obj is only consumed by one of the two branches.
+	std::pair<iterator, bool> result = this->insertUnique(key, std::forward<M>(obj));
+	if (!result.second){
+		result.first->second = std::forward<M>(obj);
+	}
+	return result;
+}
+
+//btree_map insert_or_assign (move)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename M>
+std::pair<typename btree_map<K, V, Compare, Fanout, Alloc>::iterator, bool>
+btree_map<K, V, Compare, Fanout, Alloc>::insert_or_assign(key_type&& key, M&& obj){
+
+	std::pair<iterator, bool> result = this->insertUnique(std::move(key), std::forward<M>(obj));
+	if (!result.second){
+		result.first->second = std::forward<M>(obj);
+	}
+	return result;
+}
+
+//btree_map subscript
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+typename btree_map<K, V, Compare, Fanout, Alloc>::mapped_type&
+btree_map<K, V, Compare, Fanout, Alloc>::operator[](const key_type& key){
+
+	return this->insertUnique(key).first->second;
+}
+
+//btree_map subscript (move)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+typename btree_map<K, V, Compare, Fanout, Alloc>::mapped_type&
+btree_map<K, V, Compare, Fanout, Alloc>::operator[](key_type&& key){
+
+	return this->insertUnique(std::move(key)).first->second;
+}
+
+//btree_map checked access
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename K2>
+typename btree_map<K, V, Compare, Fanout, Alloc>::mapped_type&
+btree_map<K, V, Compare, Fanout, Alloc>::at(const typename base_type::template key_arg<K2>& key){
+
+	iterator it = this->template find<K2>(key);
+	if (it == this->end()){
+		throw std::out_of_range("btree_map::at: key not found");
+	}
+	return it->second;
+}
+
+//btree_map checked access (const)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename K2>
+const typename btree_map<K, V, Compare, Fanout, Alloc>::mapped_type&
+btree_map<K, V, Compare, Fanout, Alloc>::at(const typename base_type::template key_arg<K2>& key) const{
+
+	const_iterator it = this->template find<K2>(key);
+	if (it == this->cend()){
+		throw std::out_of_range("btree_map::at: key not found");
+	}
+	return it->second;
+}
+
+//btree_multimap constructor.
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+btree_multimap<K, V, Compare, Fanout, Alloc>::btree_multimap(size_t maxNodeElems_, const Compare& comp, const Alloc& alloc)
+	:base_type(maxNodeElems_, comp, alloc){
+}
+
+//btree_multimap range constructor.
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename InputIt, typename>
+btree_multimap<K, V, Compare, Fanout, Alloc>::btree_multimap(InputIt first, InputIt last, size_t maxNodeElems_, double fillFactor,
+		const Compare& comp, const Alloc& alloc)
+	:base_type(maxNodeElems_, comp, alloc){
+
+	this->bulk_load(first, last, fillFactor);
+}
+
+//btree_multimap insert
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+typename btree_multimap<K, V, Compare, Fanout, Alloc>::iterator
+btree_multimap<K, V, Compare, Fanout, Alloc>::insert(const value_type& elem){
+
+	return this->insertMulti(elem.first, elem.second);
+}
+
+//btree_multimap insert (move)
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+typename btree_multimap<K, V, Compare, Fanout, Alloc>::iterator
+btree_multimap<K, V, Compare, Fanout, Alloc>::insert(value_type&& elem){
+
+	return this->insertMulti(elem.first, std::move(elem.second));
+}
+
+//btree_multimap emplace
+template<typename K, typename V, typename Compare, size_t Fanout, typename Alloc>
+template<typename... Args>
+typename btree_multimap<K, V, Compare, Fanout, Alloc>::iterator
+btree_multimap<K, V, Compare, Fanout, Alloc>::emplace(Args&&... args){
+
+	std::pair<K, V> elem(std::forward<Args>(args)...);
+	return this->insertMulti(std::move(elem.first), std::move(elem.second));
+}
+
+#endif
+//**********************************
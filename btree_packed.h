@@ -0,0 +1,1246 @@
+/**
+ * An ordered set of integers with compressed leaves.
+ *
+ * Keys that are close together, such as increasing ids, need far fewer
+ * bits than their type holds once the distance to a nearby key is all
+ * that is stored.  Each leaf here keeps its smallest key, the base, in
+ * full and every key as its distance from the base (frame of reference),
+ * packed at the fewest bits that hold the leaf's largest distance.  How
+ * many keys a leaf takes follows from that width: a fixed leaf block
+ * holds many more keys when they are dense.
+ *
+ * The packed deltas are spread over four interleaved lanes, key i going
+ * to lane i % 4, so a row of four keys sits at the same bit position of
+ * four neighbouring words.  A scan unpacks a whole row with one vector
+ * shift and mask (AVX2, or SSE2 in two halves; plain code elsewhere),
+ * while any single key is still found in O(1) from its index, so a leaf
+ * is searched by bisection on the packed keys without unpacking it.
+ *
+ * Appending past the last key of a leaf writes its delta in place; any
+ * other change to a leaf unpacks it and packs it again, so the set suits
+ * keys that mostly arrive in order.  Internal nodes hold plain keys.
+ * Iterators yield keys by value.
+ **/
+
+#ifndef BTREE_PACKED_H
+#define BTREE_PACKED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "btree_search.h"
+#include "btree_pool.h"
+
+template<typename T, size_t Fanout = 64, size_t LeafBytes = 512,
+         typename Alloc = std::allocator<T> > class btree_packed_set;
+template<typename Tree> class btree_packed_iterator;
+
+/**
+ * An ordered set of unique integers of type T. Internal nodes have up to
+ * Fanout keys; a leaf is a LeafBytes block whose keys are bit-packed.
+ */
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+class btree_packed_set{
+
+	static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "btree_packed_set keys must be integers");
+	static_assert(sizeof(T) <= 8, "btree_packed_set keys are at most 64 bits");
+	static_assert(Fanout >= 4, "btree_packed_set fanout must be at least 4");
+
+ public:
+	typedef T key_type;
+	typedef T value_type;
+	typedef std::less<T> key_compare;
+	typedef Alloc allocator_type;
+	typedef T reference;
+	typedef T const_reference;
+	typedef const T* pointer;
+	typedef const T* const_pointer;
+
+	friend class btree_packed_iterator<btree_packed_set>;
+	typedef btree_packed_iterator<btree_packed_set> const_iterator;
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+
+  /**
+   * @param alloc the allocator the node pools take their chunks from
+   */
+  explicit btree_packed_set(const Alloc& alloc = Alloc());
+
+  /**
+   * Builds the set from the keys in [first, last); sorted input packs best.
+   */
+  template<typename InputIt>
+  btree_packed_set(InputIt first, InputIt last, const Alloc& alloc = Alloc());
+
+  btree_packed_set(const btree_packed_set& original);
+  btree_packed_set(btree_packed_set&& original) noexcept;
+  btree_packed_set& operator=(const btree_packed_set& rhs);
+  btree_packed_set& operator=(btree_packed_set&& rhs) noexcept;
+  ~btree_packed_set();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	const_reverse_iterator rbegin() const;
+	const_reverse_iterator rend() const;
+	const_reverse_iterator crbegin() const;
+	const_reverse_iterator crend() const;
+
+  /**
+    * Inserts key unless it is present. A key past the end of its leaf
+    * that fits the leaf's width is written in place; otherwise the leaf
+    * is packed again, and split when its keys no longer fit. Iterators
+    * are invalidated.
+    * @return true if key was inserted.
+    */
+  bool insert(T key);
+
+  /**
+    * Removes key, if present. A leaf left under a third full merges with
+    * a sibling when their keys fit in one leaf. Iterators are invalidated.
+    * @return the number of elements removed.
+    */
+  size_t erase(T key);
+
+  /**
+    * Removes every element and frees every node.
+    */
+  void clear();
+
+  /**
+    * @return an iterator to the matching element, or end().
+    */
+  const_iterator find(T key) const;
+
+  /**
+    * @return an iterator to the first element not less than key, or end().
+    */
+  const_iterator lower_bound(T key) const;
+
+  /**
+    * @return an iterator to the first element greater than key, or end().
+    */
+  const_iterator upper_bound(T key) const;
+
+  /**
+    * @return the pair (lower_bound(key), upper_bound(key)).
+    */
+  std::pair<const_iterator, const_iterator> equal_range(T key) const;
+
+  /**
+    * @return 1 if key is present, otherwise 0.
+    */
+  size_t count(T key) const;
+
+  bool contains(T key) const;
+
+  /**
+    * Calls fn(T) on every element k with lo <= k < hi, in order, each
+    * leaf being unpacked a block of rows at a time. If fn returns bool,
+    * returning false stops the scan early.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(T lo, T hi, Fn fn) const;
+
+  size_t size() const;
+  bool empty() const;
+  key_compare key_comp() const;
+  void swap(btree_packed_set& other) noexcept;
+
+ private:
+	typedef typename std::make_unsigned<T>::type U;
+
+	// keys per row: one per lane.
+	static constexpr size_t lanes = 4;
+
+	struct Leaf;
+
+	struct Node{
+		uint32_t num_element;
+		bool leaf;
+
+		explicit Node(bool leaf_): num_element(0), leaf(leaf_){}
+	};
+
+	// a leaf holds base + delta for each of its keys, delta taking width
+	// bits (0 when the leaf holds a single key). Leaves are linked in key order.
+	struct LeafHeader : Node{
+		Leaf *prev;
+		Leaf *next;
+		T base;
+		uint32_t width;
+
+		LeafHeader(): Node(true), prev(nullptr), next(nullptr), base(), width(0){}
+	};
+
+	// the words left in a LeafBytes block, whole rows of lanes of them.
+	static constexpr size_t leafWords = (LeafBytes - sizeof(LeafHeader)) / (8 * lanes) * lanes;
+	static_assert(leafWords >= 2 * lanes, "btree_packed_set leaves are too small");
+
+	// delta i is at bit (i / lanes) * width of lane i % lanes; word j of
+	// a lane is words[j * lanes + lane]. Bits past the last delta are 0.
+	struct Leaf : LeafHeader{
+		uint64_t words[leafWords];
+
+		Leaf(): LeafHeader(), words(){}
+	};
+
+	// child i holds the keys k with elements[i-1] <= k < elements[i].
+	struct Inner : Node{
+		T elements[Fanout];
+		Node *children[Fanout + 1];
+
+		Inner(): Node(false), elements(), children(){}
+	};
+
+	static Leaf* asLeaf(Node *node){ return static_cast<Leaf*>(node); }
+	static const Leaf* asLeaf(const Node *node){ return static_cast<const Leaf*>(node); }
+	static Inner* asInner(Node *node){ return static_cast<Inner*>(node); }
+	static const Inner* asInner(const Node *node){ return static_cast<const Inner*>(node); }
+
+	// the distance from base up to key, key >= base.
+	static uint64_t deltaOf(T key, T base){ return uint64_t(U(U(key) - U(base))); }
+
+	// the bits needed to hold delta.
+	static uint32_t bitsFor(uint64_t delta);
+
+	static uint64_t maskOf(uint32_t width){ return width >= 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1; }
+
+	// how many keys a leaf holds at width bits each.
+	static size_t capacityFor(uint32_t width);
+
+	static uint64_t deltaAt(const Leaf *leaf, size_t i);
+	static void putDelta(Leaf *leaf, size_t i, uint64_t delta);
+	static T keyAt(const Leaf *leaf, size_t i){ return T(U(U(leaf->base) + U(deltaAt(leaf, i)))); }
+
+	// unpacks the deltas of rows [first, last) into out, lanes per row.
+	static void unpackRows(const Leaf *leaf, size_t first, size_t last, uint64_t *out);
+
+	// unpacks every key of leaf into out.
+	static void decode(const Leaf *leaf, T *out);
+
+	// packs the sorted keys[0, n) into leaf; they must fit.
+	static void encode(Leaf *leaf, const T *keys, size_t n);
+
+	// whether the sorted keys[0, n) fit in one leaf.
+	static bool fits(const T *keys, size_t n);
+
+	// the first key of leaf not less than key (greater than key when
+	// upper), by bisection on the packed deltas.
+	static size_t searchLeaf(const Leaf *leaf, T key, bool upper);
+
+	const Leaf* findLeaf(T key) const;
+
+	// the first key not less than key (greater than key when upper): its leaf and index, or nullptr at the end.
+	const Leaf* seek(T key, bool upper, size_t &pos) const;
+
+	Leaf* newLeaf();
+	Inner* newInner();
+	void freeNode(Node *node);
+	void freeSubtree(Node *node);
+
+	// copies a subtree, appending its leaves to the chain after prevLeaf.
+	Node* cloneSubtree(const Node *src, Leaf *&prevLeaf);
+
+	// inserts separator sep at pos of an internal node with room for it, with right after it.
+	static void insertChild(Inner *node, size_t pos, T sep, Node *right);
+
+	// removes separator pos of an internal node and the child after it.
+	static void removeChild(Inner *node, size_t pos);
+
+	// what insertInto did with the key: keyDeferred means a leaf had to
+	// split before the key could go in, and the insert starts over.
+	enum KeyState{ keyPresent, keyAdded, keyDeferred };
+
+	// inserts key below node. Returns true if node split, with sep and
+	// right the separator and new right sibling for the parent.
+	bool insertInto(Node *node, T key, KeyState &state, T &sep, Node *&right);
+
+	// splits leaf, whose keys with the new one are scratch[0, total).
+	bool splitLeaf(Leaf *leaf, size_t pos, size_t total, KeyState &state, T &sep, Node *&right);
+
+	// removes key from below node; returns whether it was there.
+	bool eraseFrom(Node *node, T key);
+
+	// merges leaf child i of parent into a sibling if it is under a third
+	// full and their keys fit in one leaf.
+	void mergeLeaf(Inner *parent, size_t i);
+
+	// refills internal child i of parent after an erase left it under half full.
+	void rebalance(Inner *parent, size_t i);
+
+	static constexpr size_t minElems = Fanout / 2;
+
+	btree_node_pool<Alloc> leafPool;
+	btree_node_pool<Alloc> internalPool;
+	Node *baseNode;
+	Leaf *firstNode;
+	Leaf *lastNode;
+	size_t btree_size;
+	btree_key_compare<key_compare, T> compare_t;
+	// a leaf's keys, unpacked while it is rebuilt.
+	std::vector<T, Alloc> scratch;
+};
+
+/**
+ * Bidirectional iterator over a btree_packed_set: a leaf and an index in
+ * it; (nullptr, 0) is end(). *it unpacks the key, by value.
+ */
+template<typename Tree> class btree_packed_iterator{
+
+	typedef typename Tree::Leaf Leaf;
+
+public:
+	const Leaf *pNode;
+	size_t pindex;
+	const Tree *pbtree;
+
+	btree_packed_iterator(const Leaf *pNode_ = nullptr, size_t pindex_ = 0, const Tree *pbtree_ = nullptr):
+		pNode(pNode_), pindex(pindex_), pbtree(pbtree_){}
+
+	typedef ptrdiff_t difference_type;
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
+
+	bool operator==(const btree_packed_iterator& rhs) const;
+	bool operator!=(const btree_packed_iterator& rhs) const;
+	reference operator*() const;
+	btree_packed_iterator& operator++();
+	btree_packed_iterator operator++(int);
+	btree_packed_iterator& operator--();
+	btree_packed_iterator operator--(int);
+};
+
+//== operator overloading
+template<typename Tree>
+bool btree_packed_iterator<Tree>::operator==(const btree_packed_iterator& rhs) const{
+	return pNode == rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree;
+}
+
+//!= operator overloading
+template<typename Tree>
+bool btree_packed_iterator<Tree>::operator!=(const btree_packed_iterator& rhs) const{
+	return !operator==(rhs);
+}
+
+//* operator overloading
+template<typename Tree>
+typename btree_packed_iterator<Tree>::reference btree_packed_iterator<Tree>::operator*() const{
+	return Tree::keyAt(pNode, pindex);
+}
+
+//++ operator overloading: past a leaf's last key, on to the next leaf
+template<typename Tree>
+btree_packed_iterator<Tree>& btree_packed_iterator<Tree>::operator++(){
+
+	if (++pindex == pNode->num_element){
+		pNode = pNode->next;
+		pindex = 0;
+	}
+	return *this;
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_packed_iterator<Tree> btree_packed_iterator<Tree>::operator++(int){
+	btree_packed_iterator temp_return = *this;
+	operator++();
+	return temp_return;
+}
+
+//-- operator overloading: before a leaf's first key, back to the previous leaf
+template<typename Tree>
+btree_packed_iterator<Tree>& btree_packed_iterator<Tree>::operator--(){
+
+	if (pNode == nullptr){
+		pNode = pbtree->lastNode;
+		pindex = pNode->num_element - 1;
+	}
+	else if (pindex > 0){
+		--pindex;
+	}
+	else{
+		pNode = pNode->prev;
+		pindex = pNode->num_element - 1;
+	}
+	return *this;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_packed_iterator<Tree> btree_packed_iterator<Tree>::operator--(int){
+	btree_packed_iterator e_iter = *this;
+	operator--();
+	return e_iter;
+}
+
+//constructor: an empty set has no nodes at all
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::btree_packed_set(const Alloc& alloc)
+	:leafPool(sizeof(Leaf), alloc), internalPool(sizeof(Inner), alloc), baseNode(nullptr),
+	 firstNode(nullptr), lastNode(nullptr), btree_size(0), compare_t(), scratch(alloc){
+}
+
+//range constructor
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+template<typename InputIt>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::btree_packed_set(InputIt first, InputIt last, const Alloc& alloc)
+	:btree_packed_set(alloc){
+
+	for (; first != last; ++first){
+		insert(*first);
+	}
+}
+
+//copy constructor
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::btree_packed_set(const btree_packed_set& original)
+	:leafPool(sizeof(Leaf), original.scratch.get_allocator()), internalPool(sizeof(Inner), original.scratch.get_allocator()),
+	 baseNode(nullptr), firstNode(nullptr), lastNode(nullptr), btree_size(0), compare_t(original.compare_t),
+	 scratch(original.scratch.get_allocator()){
+
+	if (original.baseNode != nullptr){
+		Leaf *prevLeaf = nullptr;
+		baseNode = cloneSubtree(original.baseNode, prevLeaf);
+		lastNode = prevLeaf;
+		btree_size = original.btree_size;
+	}
+}
+
+//move constructor
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::btree_packed_set(btree_packed_set&& original) noexcept
+	:leafPool(std::move(original.leafPool)), internalPool(std::move(original.internalPool)),
+	 baseNode(original.baseNode), firstNode(original.firstNode), lastNode(original.lastNode),
+	 btree_size(original.btree_size), compare_t(original.compare_t), scratch(original.scratch.get_allocator()){
+
+	original.baseNode = nullptr;
+	original.firstNode = nullptr;
+	original.lastNode = nullptr;
+	original.btree_size = 0;
+}
+
+//operator = overloading
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>& btree_packed_set<T, Fanout, LeafBytes, Alloc>::operator=(const btree_packed_set& rhs){
+
+	if (this != &rhs){
+		btree_packed_set copy(rhs);
+		swap(copy);
+	}
+	return *this;
+}
+
+//move operator = overloading
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>& btree_packed_set<T, Fanout, LeafBytes, Alloc>::operator=(btree_packed_set&& rhs) noexcept{
+
+	if (this != &rhs){
+		swap(rhs);
+	}
+	return *this;
+}
+
+//destructor
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::~btree_packed_set(){
+
+	if (baseNode != nullptr){
+		freeSubtree(baseNode);
+	}
+}
+
+//swap
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::swap(btree_packed_set& other) noexcept{
+
+	leafPool.swap(other.leafPool);
+	internalPool.swap(other.internalPool);
+	std::swap(baseNode, other.baseNode);
+	std::swap(firstNode, other.firstNode);
+	std::swap(lastNode, other.lastNode);
+	std::swap(btree_size, other.btree_size);
+	std::swap(compare_t, other.compare_t);
+	scratch.swap(other.scratch);
+}
+
+//bit width of a delta
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+uint32_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::bitsFor(uint64_t delta){
+
+	uint32_t bits = 0;
+	while (delta != 0){
+		++bits;
+		delta >>= 1;
+	}
+	return bits;
+}
+
+//leaf capacity: whole rows of width bits in each lane
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::capacityFor(uint32_t width){
+
+	if (width == 0){
+		return 1;
+	}
+	return lanes * ((leafWords / lanes) * 64 / width);
+}
+
+//one delta, straight from its lane
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+uint64_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::deltaAt(const Leaf *leaf, size_t i){
+
+	uint32_t width = leaf->width;
+	if (width == 0){
+		return 0;
+	}
+	size_t bit = (i / lanes) * width;
+	size_t shift = bit % 64;
+	const uint64_t *lane = leaf->words + (bit / 64) * lanes + i % lanes;
+	uint64_t value = lane[0] >> shift;
+	if (shift + width > 64){
+		value |= lane[lanes] << (64 - shift);
+	}
+	return value & maskOf(width);
+}
+
+//write one delta over whatever was in its bits
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::putDelta(Leaf *leaf, size_t i, uint64_t delta){
+
+	uint32_t width = leaf->width;
+	if (width == 0){
+		return;
+	}
+	uint64_t mask = maskOf(width);
+	size_t bit = (i / lanes) * width;
+	size_t shift = bit % 64;
+	uint64_t *lane = leaf->words + (bit / 64) * lanes + i % lanes;
+	lane[0] = (lane[0] & ~(mask << shift)) | (delta << shift);
+	if (shift + width > 64){
+		size_t spill = 64 - shift;
+		lane[lanes] = (lane[lanes] & ~(mask >> spill)) | (delta >> spill);
+	}
+}
+
+//unpack rows: the four lanes of a row share their bit position, so one
+//vector shift (and a second for a row that straddles two words) and a
+//mask give four deltas at once.
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::unpackRows(const Leaf *leaf, size_t first, size_t last, uint64_t *out){
+
+	uint32_t width = leaf->width;
+	if (width == 0){
+		std::fill(out, out + (last - first) * lanes, uint64_t(0));
+		return;
+	}
+	const uint64_t *words = leaf->words;
+#if defined(__AVX2__)
+	const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(maskOf(width)));
+	for (size_t r = first; r < last; ++r){
+		size_t bit = r * width;
+		size_t shift = bit % 64;
+		const uint64_t *row = words + (bit / 64) * lanes;
+		__m256i v = _mm256_srl_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row)), _mm_cvtsi32_si128(int(shift)));
+		if (shift + width > 64){
+			__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + lanes));
+			v = _mm256_or_si256(v, _mm256_sll_epi64(hi, _mm_cvtsi32_si128(int(64 - shift))));
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + (r - first) * lanes), _mm256_and_si256(v, mask));
+	}
+#elif defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi64x(static_cast<long long>(maskOf(width)));
+	for (size_t r = first; r < last; ++r){
+		size_t bit = r * width;
+		size_t shift = bit % 64;
+		const uint64_t *row = words + (bit / 64) * lanes;
+		__m128i count = _mm_cvtsi32_si128(int(shift));
+		__m128i a = _mm_srl_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)), count);
+		__m128i b = _mm_srl_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 2)), count);
+		if (shift + width > 64){
+			__m128i back = _mm_cvtsi32_si128(int(64 - shift));
+			a = _mm_or_si128(a, _mm_sll_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + lanes)), back));
+			b = _mm_or_si128(b, _mm_sll_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + lanes + 2)), back));
+		}
+		uint64_t *dst = out + (r - first) * lanes;
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_and_si128(a, mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2), _mm_and_si128(b, mask));
+	}
+#else
+	const uint64_t mask = maskOf(width);
+	for (size_t r = first; r < last; ++r){
+		size_t bit = r * width;
+		size_t shift = bit % 64;
+		const uint64_t *row = words + (bit / 64) * lanes;
+		for (size_t l = 0; l < lanes; ++l){
+			uint64_t v = row[l] >> shift;
+			if (shift + width > 64){
+				v |= row[lanes + l] << (64 - shift);
+			}
+			out[(r - first) * lanes + l] = v & mask;
+		}
+	}
+#endif
+}
+
+//unpack a whole leaf, a block of rows at a time
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::decode(const Leaf *leaf, T *out){
+
+	static constexpr size_t blockRows = 64;
+	uint64_t deltas[blockRows * lanes];
+	size_t n = leaf->num_element;
+	size_t rows = (n + lanes - 1) / lanes;
+	for (size_t r = 0; r < rows; r += blockRows){
+		size_t last = std::min(rows, r + blockRows);
+		unpackRows(leaf, r, last, deltas);
+		size_t first = r * lanes;
+		size_t count = std::min(n, last * lanes) - first;
+		for (size_t j = 0; j < count; ++j){
+			out[first + j] = T(U(U(leaf->base) + U(deltas[j])));
+		}
+	}
+}
+
+//pack sorted keys at the width their span needs
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::encode(Leaf *leaf, const T *keys, size_t n){
+
+	std::fill(leaf->words, leaf->words + leafWords, uint64_t(0));
+	leaf->num_element = uint32_t(n);
+	if (n == 0){
+		leaf->base = T();
+		leaf->width = 0;
+		return;
+	}
+	leaf->base = keys[0];
+	leaf->width = bitsFor(deltaOf(keys[n - 1], keys[0]));
+	for (size_t i = 1; i < n; ++i){
+		putDelta(leaf, i, deltaOf(keys[i], keys[0]));
+	}
+}
+
+//fit test
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::fits(const T *keys, size_t n){
+	return n <= 1 || n <= capacityFor(bitsFor(deltaOf(keys[n - 1], keys[0])));
+}
+
+//in-leaf search: key is turned into a delta once, then the packed deltas
+//are bisected without branches, each probe unpacking one of them.
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::searchLeaf(const Leaf *leaf, T key, bool upper){
+
+	size_t n = leaf->num_element;
+	if (n == 0 || key < leaf->base){
+		return 0;
+	}
+	uint64_t delta = deltaOf(key, leaf->base);
+	if (delta > maskOf(leaf->width)){
+		return n;
+	}
+	size_t base = 0;
+	while (n > 1){
+		size_t half = n / 2;
+		uint64_t probe = deltaAt(leaf, base + half);
+		base = (upper ? probe <= delta : probe < delta) ? base + half : base;
+		n -= half;
+	}
+	uint64_t probe = deltaAt(leaf, base);
+	return base + (upper ? probe <= delta : probe < delta);
+}
+
+//descend to the leaf for key
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+const typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::Leaf* btree_packed_set<T, Fanout, LeafBytes, Alloc>::findLeaf(T key) const{
+
+	const Node *node = baseNode;
+	while (!node->leaf){
+		const Inner *inner = asInner(node);
+		node = inner->children[btree_upper_bound<Fanout>(inner->elements, node->num_element, key, compare_t)];
+	}
+	return asLeaf(node);
+}
+
+//seek: past the end of its leaf, key's bound is the next leaf's first key
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+const typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::Leaf* btree_packed_set<T, Fanout, LeafBytes, Alloc>::seek(T key,
+		bool upper, size_t &pos) const{
+
+	pos = 0;
+	if (baseNode == nullptr){
+		return nullptr;
+	}
+	const Leaf *leaf = findLeaf(key);
+	pos = searchLeaf(leaf, key, upper);
+	if (pos < leaf->num_element){
+		return leaf;
+	}
+	pos = 0;
+	return leaf->next;
+}
+
+//new leaf from the pool
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::Leaf* btree_packed_set<T, Fanout, LeafBytes, Alloc>::newLeaf(){
+	return ::new (leafPool.allocate()) Leaf();
+}
+
+//new internal node from the pool
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::Inner* btree_packed_set<T, Fanout, LeafBytes, Alloc>::newInner(){
+	return ::new (internalPool.allocate()) Inner();
+}
+
+//give a node's block back
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::freeNode(Node *node){
+
+	if (node->leaf){
+		asLeaf(node)->~Leaf();
+		leafPool.deallocate(node);
+	}
+	else{
+		asInner(node)->~Inner();
+		internalPool.deallocate(node);
+	}
+}
+
+//free a subtree; a partly copied one may have null children
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::freeSubtree(Node *node){
+
+	if (!node->leaf){
+		Inner *inner = asInner(node);
+		for (size_t i = 0; i <= node->num_element; ++i){
+			if (inner->children[i] != nullptr){
+				freeSubtree(inner->children[i]);
+			}
+		}
+	}
+	freeNode(node);
+}
+
+//copy a subtree, relinking the leaves in order
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::Node* btree_packed_set<T, Fanout, LeafBytes, Alloc>::cloneSubtree(const Node *src,
+		Leaf *&prevLeaf){
+
+	if (src->leaf){
+		Leaf *leaf = newLeaf();
+		const Leaf *from = asLeaf(src);
+		leaf->num_element = from->num_element;
+		leaf->base = from->base;
+		leaf->width = from->width;
+		std::copy(from->words, from->words + leafWords, leaf->words);
+		leaf->prev = prevLeaf;
+		if (prevLeaf != nullptr){
+			prevLeaf->next = leaf;
+		}
+		else{
+			firstNode = leaf;
+		}
+		prevLeaf = leaf;
+		return leaf;
+	}
+
+	Inner *inner = newInner();
+	const Inner *from = asInner(src);
+	inner->num_element = from->num_element;
+	std::copy(from->elements, from->elements + from->num_element, inner->elements);
+	try{
+		for (size_t i = 0; i <= from->num_element; ++i){
+			inner->children[i] = cloneSubtree(from->children[i], prevLeaf);
+		}
+	}
+	catch(...){
+		freeSubtree(inner);
+		throw;
+	}
+	return inner;
+}
+
+//open a separator and child slot
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::insertChild(Inner *node, size_t pos, T sep, Node *right){
+
+	size_t n = node->num_element;
+	std::copy_backward(node->elements + pos, node->elements + n, node->elements + n + 1);
+	std::copy_backward(node->children + pos + 1, node->children + n + 1, node->children + n + 2);
+	node->elements[pos] = sep;
+	node->children[pos + 1] = right;
+	node->num_element = uint32_t(n + 1);
+}
+
+//close a separator and child slot
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::removeChild(Inner *node, size_t pos){
+
+	size_t n = node->num_element;
+	std::copy(node->elements + pos + 1, node->elements + n, node->elements + pos);
+	std::copy(node->children + pos + 2, node->children + n + 1, node->children + pos + 1);
+	node->children[n] = nullptr;
+	node->num_element = uint32_t(n - 1);
+}
+
+// btree_packed_set iterators
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::begin() const{
+	return firstNode != nullptr && firstNode->num_element != 0 ? const_iterator(firstNode, 0, this) : end();
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::end() const{
+	return const_iterator(nullptr, 0, this);
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::cbegin() const{
+	return begin();
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::cend() const{
+	return end();
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_reverse_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::rbegin() const{
+	return const_reverse_iterator(end());
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_reverse_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::rend() const{
+	return const_reverse_iterator(begin());
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_reverse_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::crbegin() const{
+	return rbegin();
+}
+
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_reverse_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::crend() const{
+	return rend();
+}
+
+//insert; a deferred key goes in on the second pass, its leaf now split
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::insert(T key){
+
+	if (baseNode == nullptr){
+		Leaf *leaf = newLeaf();
+		encode(leaf, &key, 1);
+		baseNode = firstNode = lastNode = leaf;
+		btree_size = 1;
+		return true;
+	}
+	KeyState state;
+	do{
+		T sep;
+		Node *right = nullptr;
+		if (insertInto(baseNode, key, state, sep, right)){
+			// the root split: grow a level.
+			Inner *root = newInner();
+			root->children[0] = baseNode;
+			insertChild(root, 0, sep, right);
+			baseNode = root;
+		}
+	} while (state == keyDeferred);
+	if (state == keyAdded){
+		++btree_size;
+	}
+	return state == keyAdded;
+}
+
+//insert below a node
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::insertInto(Node *node, T key, KeyState &state, T &sep, Node *&right){
+
+	size_t n = node->num_element;
+	if (node->leaf){
+		Leaf *leaf = asLeaf(node);
+		size_t pos = searchLeaf(leaf, key, false);
+		if (pos < n && keyAt(leaf, pos) == key){
+			state = keyPresent;
+			return false;
+		}
+		state = keyAdded;
+		// past the last key and within the width: write it in place.
+		if (pos == n && n != 0 && n < capacityFor(leaf->width) && deltaOf(key, leaf->base) <= maskOf(leaf->width)){
+			putDelta(leaf, n, deltaOf(key, leaf->base));
+			leaf->num_element = uint32_t(n + 1);
+			return false;
+		}
+		scratch.resize(n + 1);
+		decode(leaf, scratch.data());
+		std::copy_backward(scratch.begin() + pos, scratch.begin() + n, scratch.begin() + n + 1);
+		scratch[pos] = key;
+		if (fits(scratch.data(), n + 1)){
+			encode(leaf, scratch.data(), n + 1);
+			return false;
+		}
+		return splitLeaf(leaf, pos, n + 1, state, sep, right);
+	}
+
+	Inner *inner = asInner(node);
+	size_t c = btree_upper_bound<Fanout>(inner->elements, n, key, compare_t);
+	T childSep;
+	Node *childRight = nullptr;
+	if (!insertInto(inner->children[c], key, state, childSep, childRight)){
+		return false;
+	}
+	if (n < Fanout){
+		insertChild(inner, c, childSep, childRight);
+		return false;
+	}
+
+	// full: the middle separator of the Fanout + 1 moves up.
+	T keys[Fanout + 1];
+	Node *children[Fanout + 2];
+	std::copy(inner->elements, inner->elements + c, keys);
+	keys[c] = childSep;
+	std::copy(inner->elements + c, inner->elements + n, keys + c + 1);
+	std::copy(inner->children, inner->children + c + 1, children);
+	children[c + 1] = childRight;
+	std::copy(inner->children + c + 1, inner->children + n + 1, children + c + 2);
+	Inner *sibling = newInner();
+	size_t mid = (n + 1) / 2;
+	std::copy(keys + mid + 1, keys + n + 1, sibling->elements);
+	std::copy(children + mid + 1, children + n + 2, sibling->children);
+	sibling->num_element = uint32_t(n - mid);
+	std::copy(keys, keys + mid, inner->elements);
+	std::copy(children, children + mid + 1, inner->children);
+	std::fill(inner->children + mid + 1, inner->children + Fanout + 1, nullptr);
+	inner->num_element = uint32_t(mid);
+	sep = keys[mid];
+	right = sibling;
+	return true;
+}
+
+//split a leaf that cannot take the new key. Halves are tried first, or
+//everything but the new key when appending to the last leaf, as
+//increasing keys do; then cuts either side of the new key, which can
+//matter when it is far from the rest. If neither side can take it, the
+//old keys are cut at its place and the insert is retried: it then lands
+//at an end of a leaf, where a cut beside it always works.
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::splitLeaf(Leaf *leaf, size_t pos, size_t total, KeyState &state,
+		T &sep, Node *&right){
+
+	const T *keys = scratch.data();
+	auto cutFits = [&](size_t m){
+		return m > 0 && m < total && fits(keys, m) && fits(keys + m, total - m);
+	};
+	size_t m = pos == total - 1 && leaf->next == nullptr ? total - 1 : total / 2;
+	if (!cutFits(m)){
+		if (cutFits(pos)){
+			m = pos;
+		}
+		else if (cutFits(pos + 1)){
+			m = pos + 1;
+		}
+		else{
+			scratch.erase(scratch.begin() + pos);
+			keys = scratch.data();
+			--total;
+			m = pos;
+			state = keyDeferred;
+		}
+	}
+	Leaf *sibling = newLeaf();
+	encode(sibling, keys + m, total - m);
+	encode(leaf, keys, m);
+	sibling->prev = leaf;
+	sibling->next = leaf->next;
+	if (leaf->next != nullptr){
+		leaf->next->prev = sibling;
+	}
+	else{
+		lastNode = sibling;
+	}
+	leaf->next = sibling;
+	sep = keys[m];
+	right = sibling;
+	return true;
+}
+
+//erase
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::erase(T key){
+
+	if (baseNode == nullptr || !eraseFrom(baseNode, key)){
+		return 0;
+	}
+	--btree_size;
+	if (!baseNode->leaf && baseNode->num_element == 0){
+		// the root's children merged: drop a level.
+		Node *root = baseNode;
+		baseNode = asInner(root)->children[0];
+		freeNode(root);
+	}
+	else if (baseNode->leaf && baseNode->num_element == 0){
+		freeNode(baseNode);
+		baseNode = firstNode = lastNode = nullptr;
+	}
+	return 1;
+}
+
+//erase below a node, then tidy the child it went through
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::eraseFrom(Node *node, T key){
+
+	size_t n = node->num_element;
+	if (node->leaf){
+		Leaf *leaf = asLeaf(node);
+		size_t pos = searchLeaf(leaf, key, false);
+		if (pos == n || keyAt(leaf, pos) != key){
+			return false;
+		}
+		if (pos == n - 1 && pos != 0){
+			// the last key: clear its bits, the rest stay where they are.
+			putDelta(leaf, pos, 0);
+			leaf->num_element = uint32_t(pos);
+			return true;
+		}
+		scratch.resize(n);
+		decode(leaf, scratch.data());
+		scratch.erase(scratch.begin() + pos);
+		encode(leaf, scratch.data(), n - 1);
+		return true;
+	}
+	Inner *inner = asInner(node);
+	size_t c = btree_upper_bound<Fanout>(inner->elements, n, key, compare_t);
+	Node *child = inner->children[c];
+	if (!eraseFrom(child, key)){
+		return false;
+	}
+	if (child->leaf){
+		mergeLeaf(inner, c);
+	}
+	else if (child->num_element < minElems){
+		rebalance(inner, c);
+	}
+	return true;
+}
+
+//merge a sparse leaf with a sibling whose keys fit alongside its own; an
+//empty one always merges, since the sibling's keys fit on their own.
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::mergeLeaf(Inner *parent, size_t i){
+
+	Leaf *leaf = asLeaf(parent->children[i]);
+	size_t n = leaf->num_element;
+	if (n != 0 && 3 * n >= capacityFor(leaf->width)){
+		return;
+	}
+	for (size_t l = i > 0 ? i - 1 : i; l <= i && l < parent->num_element; ++l){
+		Leaf *left = asLeaf(parent->children[l]);
+		Leaf *right = asLeaf(parent->children[l + 1]);
+		size_t nl = left->num_element;
+		size_t total = nl + right->num_element;
+		scratch.resize(total);
+		decode(left, scratch.data());
+		decode(right, scratch.data() + nl);
+		if (!fits(scratch.data(), total)){
+			continue;
+		}
+		encode(left, scratch.data(), total);
+		left->next = right->next;
+		if (right->next != nullptr){
+			right->next->prev = left;
+		}
+		else{
+			lastNode = left;
+		}
+		removeChild(parent, l);
+		freeNode(right);
+		return;
+	}
+}
+
+//rebalance internal child i with a sibling: merge the two if their keys
+//fit in one node, else share the keys out evenly.
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::rebalance(Inner *parent, size_t i){
+
+	size_t l = i > 0 ? i - 1 : i;
+	Inner *left = asInner(parent->children[l]);
+	Inner *right = asInner(parent->children[l + 1]);
+	size_t nl = left->num_element;
+	size_t nr = right->num_element;
+
+	// the parent's separator comes down between the two.
+	T keys[2 * Fanout + 1];
+	Node *children[2 * Fanout + 2];
+	std::copy(left->elements, left->elements + nl, keys);
+	keys[nl] = parent->elements[l];
+	std::copy(right->elements, right->elements + nr, keys + nl + 1);
+	std::copy(left->children, left->children + nl + 1, children);
+	std::copy(right->children, right->children + nr + 1, children + nl + 1);
+	size_t total = nl + nr + 1;
+	if (total <= Fanout){
+		std::copy(keys, keys + total, left->elements);
+		std::copy(children, children + total + 1, left->children);
+		left->num_element = uint32_t(total);
+		removeChild(parent, l);
+		freeNode(right);
+		return;
+	}
+	size_t mid = total / 2;
+	std::copy(keys, keys + mid, left->elements);
+	std::copy(children, children + mid + 1, left->children);
+	std::fill(left->children + mid + 1, left->children + Fanout + 1, nullptr);
+	left->num_element = uint32_t(mid);
+	std::copy(keys + mid + 1, keys + total, right->elements);
+	std::copy(children + mid + 1, children + total + 1, right->children);
+	std::fill(right->children + (total - mid), right->children + Fanout + 1, nullptr);
+	right->num_element = uint32_t(total - mid - 1);
+	parent->elements[l] = keys[mid];
+}
+
+//clear
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+void btree_packed_set<T, Fanout, LeafBytes, Alloc>::clear(){
+
+	if (baseNode != nullptr){
+		freeSubtree(baseNode);
+	}
+	baseNode = nullptr;
+	firstNode = nullptr;
+	lastNode = nullptr;
+	btree_size = 0;
+}
+
+//find
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::find(T key) const{
+
+	if (baseNode == nullptr){
+		return end();
+	}
+	const Leaf *leaf = findLeaf(key);
+	size_t pos = searchLeaf(leaf, key, false);
+	if (pos < leaf->num_element && keyAt(leaf, pos) == key){
+		return const_iterator(leaf, pos, this);
+	}
+	return end();
+}
+
+//lower bound
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::lower_bound(T key) const{
+
+	size_t pos;
+	const Leaf *leaf = seek(key, false, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//upper bound
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator btree_packed_set<T, Fanout, LeafBytes, Alloc>::upper_bound(T key) const{
+
+	size_t pos;
+	const Leaf *leaf = seek(key, true, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//equal range
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+std::pair<typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator,
+		typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::const_iterator>
+btree_packed_set<T, Fanout, LeafBytes, Alloc>::equal_range(T key) const{
+
+	const_iterator first = lower_bound(key);
+	const_iterator last = first;
+	if (last.pNode != nullptr && *last == key){
+		++last;
+	}
+	return std::make_pair(first, last);
+}
+
+//count
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::count(T key) const{
+	return contains(key) ? 1 : 0;
+}
+
+//contains
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::contains(T key) const{
+	return find(key) != end();
+}
+
+//range scan along the leaf chain, unpacking blocks of rows
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+template<typename Fn>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::scan(T lo, T hi, Fn fn) const{
+
+	size_t visited = 0;
+	if (!(lo < hi)){
+		return visited;
+	}
+	static constexpr size_t blockRows = 64;
+	uint64_t deltas[blockRows * lanes];
+	size_t i;
+	const Leaf *leaf = seek(lo, false, i);
+	while (leaf != nullptr){
+		size_t n = leaf->num_element;
+		size_t end = searchLeaf(leaf, hi, false);
+		while (i < end){
+			size_t row = i / lanes;
+			size_t last = std::min((end + lanes - 1) / lanes, row + blockRows);
+			unpackRows(leaf, row, last, deltas);
+			size_t stop = std::min(end, last * lanes);
+			for (; i < stop; ++i){
+				++visited;
+				if (!btree_scan_visit(fn, T(U(U(leaf->base) + U(deltas[i - row * lanes]))))){
+					return visited;
+				}
+			}
+		}
+		if (end < n){
+			break;
+		}
+		leaf = leaf->next;
+		i = 0;
+	}
+	return visited;
+}
+
+//size
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+size_t btree_packed_set<T, Fanout, LeafBytes, Alloc>::size() const{
+	return btree_size;
+}
+
+//empty
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+bool btree_packed_set<T, Fanout, LeafBytes, Alloc>::empty() const{
+	return btree_size == 0;
+}
+
+//comparator access
+template<typename T, size_t Fanout, size_t LeafBytes, typename Alloc>
+typename btree_packed_set<T, Fanout, LeafBytes, Alloc>::key_compare btree_packed_set<T, Fanout, LeafBytes, Alloc>::key_comp() const{
+	return key_compare();
+}
+
+#endif
+//**********************************
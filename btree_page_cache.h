@@ -0,0 +1,188 @@
+/**
+ * Bounded buffer pool for the pages of an on-disk btree.  The cache owns
+ * a fixed number of page-sized frames; a page is read from the file the
+ * first time it is asked for and stays resident until the clock hand
+ * finds it unreferenced, at which point a dirty page is written back
+ * before its frame is reused.  Writes go to the file only on eviction or
+ * flush, so a page that is modified many times is written once.
+ *
+ * A page pointer handed out stays valid until the next call into the
+ * cache, which may evict it; callers copy out what they need to keep.
+ **/
+
+#ifndef BTREE_PAGE_CACHE_H
+#define BTREE_PAGE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <system_error>
+
+#include <unistd.h>
+
+// reads exactly n bytes at offset, zero filling past the end of the file.
+inline void btree_read_at(int fd, char *buf, size_t n, uint64_t offset){
+
+	size_t done = 0;
+	while (done < n){
+		ssize_t got = ::pread(fd, buf + done, n - done, off_t(offset + done));
+		if (got < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), "btree: page read failed");
+		}
+		if (got == 0){
+			std::memset(buf + done, 0, n - done);
+			return;
+		}
+		done += size_t(got);
+	}
+}
+
+// writes exactly n bytes at offset.
+inline void btree_write_at(int fd, const char *buf, size_t n, uint64_t offset){
+
+	size_t done = 0;
+	while (done < n){
+		ssize_t put = ::pwrite(fd, buf + done, n - done, off_t(offset + done));
+		if (put < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), "btree: page write failed");
+		}
+		done += size_t(put);
+	}
+}
+
+class btree_page_cache{
+
+public:
+	// @param fd the open file the pages live in; the cache does not own it
+	// @param pageSize bytes per page; page i starts at offset i * pageSize
+	// @param frames the most pages held in memory at once (at least 4)
+	btree_page_cache(int fd, size_t pageSize, size_t frames):
+		fd(fd), pageSize(pageSize), frameCount(frames < 4 ? 4 : frames),
+		memory(new char[frameCount * pageSize]), frameInfo(frameCount), hand(0){
+
+		table.reserve(frameCount);
+	}
+
+	btree_page_cache(const btree_page_cache&) = delete;
+	btree_page_cache& operator=(const btree_page_cache&) = delete;
+
+	// the contents of page, read from the file if it is not resident.
+	const char* read(uint64_t page){
+		return frameData(frameFor(page, true));
+	}
+
+	// as read, and the page will be written back.
+	char* write(uint64_t page){
+		size_t frame = frameFor(page, true);
+		frameInfo[frame].dirty = true;
+		return frameData(frame);
+	}
+
+	// a zeroed frame for a page that does not exist in the file yet.
+	char* create(uint64_t page){
+		size_t frame = frameFor(page, false);
+		std::memset(frameData(frame), 0, pageSize);
+		frameInfo[frame].dirty = true;
+		return frameData(frame);
+	}
+
+	// writes every dirty page back to the file; pages stay resident.
+	void flush(){
+		for (size_t frame = 0; frame < frameCount; ++frame){
+			if (frameInfo[frame].used && frameInfo[frame].dirty){
+				writeBack(frame);
+			}
+		}
+	}
+
+	size_t frames() const{
+		return frameCount;
+	}
+
+	// pages read from the file since the cache was created.
+	size_t misses() const{
+		return missCount;
+	}
+
+private:
+	struct Frame{
+		uint64_t page = 0;
+		bool used = false;
+		bool dirty = false;
+		bool referenced = false;
+	};
+
+	char* frameData(size_t frame){
+		return memory.get() + frame * pageSize;
+	}
+
+	// the frame holding page, loading it into a victim frame if needed.
+	size_t frameFor(uint64_t page, bool load){
+		std::unordered_map<uint64_t, size_t>::iterator it = table.find(page);
+		if (it != table.end()){
+			frameInfo[it->second].referenced = true;
+			return it->second;
+		}
+		size_t frame = victim();
+		if (load){
+			btree_read_at(fd, frameData(frame), pageSize, page * pageSize);
+			++missCount;
+		}
+		frameInfo[frame].page = page;
+		frameInfo[frame].used = true;
+		frameInfo[frame].dirty = false;
+		frameInfo[frame].referenced = true;
+		table[page] = frame;
+		return frame;
+	}
+
+	// clock: sweep past referenced frames, clearing their bit, and take the
+	// first free or unreferenced one, writing it back if it is dirty.
+	size_t victim(){
+		while (true){
+			size_t frame = hand;
+			hand = (hand + 1) % frameCount;
+			Frame &info = frameInfo[frame];
+			if (!info.used){
+				return frame;
+			}
+			if (info.referenced){
+				info.referenced = false;
+				continue;
+			}
+			if (info.dirty){
+				writeBack(frame);
+			}
+			table.erase(info.page);
+			info = Frame();
+			return frame;
+		}
+	}
+
+	void writeBack(size_t frame){
+		btree_write_at(fd, frameData(frame), pageSize, frameInfo[frame].page * pageSize);
+		frameInfo[frame].dirty = false;
+	}
+
+	int fd;
+	size_t pageSize;
+	size_t frameCount;
+	std::unique_ptr<char[]> memory;
+	std::vector<Frame> frameInfo;
+	std::unordered_map<uint64_t, size_t> table;
+	size_t hand;
+	size_t missCount = 0;
+};
+
+#endif
+//**********************************
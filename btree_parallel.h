@@ -0,0 +1,229 @@
+/**
+ * Threading helpers for the parallel btree operations (bulk_load_parallel,
+ * merge, the set operations and the parallel walks).  Work is cut into
+ * tasks and run on plain std::threads, the calling thread taking a
+ * share; nothing outside the C++ standard library is needed.
+ **/
+
+#ifndef BTREE_PARALLEL_H
+#define BTREE_PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// the threads a parallel operation uses when it is asked for 0.
+inline size_t btree_default_threads(){
+
+	size_t n = std::thread::hardware_concurrency();
+	return n != 0 ? n : 1;
+}
+
+// calls fn(i) for every i in [0, tasks), spread over up to threads
+// threads (0 picks btree_default_threads()), the caller being one of
+// them. Tasks are handed out in order as threads come free. If any call
+// throws, the remaining tasks are skipped and the first exception is
+// rethrown once every thread has stopped.
+template<typename Fn>
+void btree_parallel_for(size_t tasks, size_t threads, Fn fn){
+
+	if (threads == 0){
+		threads = btree_default_threads();
+	}
+	threads = std::min(threads, tasks);
+	if (threads <= 1){
+		for (size_t i = 0; i < tasks; ++i){
+			fn(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+	auto work = [&]{
+		size_t i;
+		while (!failed.load(std::memory_order_relaxed) && (i = next.fetch_add(1, std::memory_order_relaxed)) < tasks){
+			try{
+				fn(i);
+			}
+			catch(...){
+				std::lock_guard<std::mutex> guard(errorMutex);
+				if (!error){
+					error = std::current_exception();
+				}
+				failed.store(true, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	try{
+		for (size_t t = 1; t < threads; ++t){
+			pool.emplace_back(work);
+		}
+	}
+	catch(...){
+		// could not start them all; the ones that did start still help.
+	}
+	work();
+	for (size_t t = 0; t < pool.size(); ++t){
+		pool[t].join();
+	}
+	if (error){
+		std::rethrow_exception(error);
+	}
+}
+
+// fork-join run of tasks that may spawn more tasks, on a work-stealing
+// pool of threads workers (0 picks btree_default_threads()), the caller
+// being worker 0. Each worker owns a deque: it pushes the tasks it
+// spawns on the back and takes its next task from there too, keeping
+// its work local, and when its deque runs dry it steals from the front
+// of another's, where the oldest (and for a tree walk the largest) task
+// waits. run(task, worker, spawn) runs one task; worker is the index of
+// the thread running it and spawn(Task) hands a new task to the pool.
+// Returns once every task has run. If one throws, tasks not yet started
+// are dropped and the first exception is rethrown.
+template<typename Task, typename Run>
+void btree_work_stealing(const std::vector<Task> &initial, size_t workers, Run run){
+
+	if (workers == 0){
+		workers = btree_default_threads();
+	}
+
+	// a deque per worker, each on its own cache lines.
+	struct alignas(64) Queue{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	std::unique_ptr<Queue[]> queues(new Queue[workers]);
+	for (size_t i = 0; i < initial.size(); ++i){
+		queues[i % workers].tasks.push_back(initial[i]);
+	}
+
+	// tasks queued or running; a task's spawns are counted before it is
+	// retired, so this only reaches 0 once all the work is done.
+	std::atomic<size_t> pending(initial.size());
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	auto take = [&](size_t w, Task &task){
+		{
+			std::lock_guard<std::mutex> guard(queues[w].mutex);
+			if (!queues[w].tasks.empty()){
+				task = queues[w].tasks.back();
+				queues[w].tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t k = 1; k < workers; ++k){
+			Queue &victim = queues[(w + k) % workers];
+			std::lock_guard<std::mutex> guard(victim.mutex);
+			if (!victim.tasks.empty()){
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto work = [&](size_t w){
+		auto spawn = [&queues, &pending, w](const Task &task){
+			pending.fetch_add(1, std::memory_order_relaxed);
+			std::lock_guard<std::mutex> guard(queues[w].mutex);
+			queues[w].tasks.push_back(task);
+		};
+		Task task;
+		while (!failed.load(std::memory_order_relaxed)){
+			if (!take(w, task)){
+				if (pending.load(std::memory_order_acquire) == 0){
+					return;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+			try{
+				run(task, w, spawn);
+			}
+			catch(...){
+				std::lock_guard<std::mutex> guard(errorMutex);
+				if (!error){
+					error = std::current_exception();
+				}
+				failed.store(true, std::memory_order_relaxed);
+			}
+			pending.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(workers - 1);
+	try{
+		for (size_t w = 1; w < workers; ++w){
+			pool.emplace_back(work, w);
+		}
+	}
+	catch(...){
+		// could not start them all; the queues of the missing ones get stolen from.
+	}
+	work(0);
+	for (size_t t = 0; t < pool.size(); ++t){
+		pool[t].join();
+	}
+	if (error){
+		std::rethrow_exception(error);
+	}
+}
+
+// stable sort of [first, last) by less: one run per thread is sorted,
+// then neighbouring runs are merged pairwise, the merges of each round
+// running side by side.
+template<typename RandomIt, typename Less>
+void btree_parallel_sort(RandomIt first, RandomIt last, Less less, size_t threads){
+
+	if (threads == 0){
+		threads = btree_default_threads();
+	}
+	size_t n = size_t(last - first);
+	// below a few thousand elements a thread costs more than it saves.
+	static constexpr size_t minRun = 4096;
+	size_t runs = std::min(threads, std::max<size_t>(1, n / minRun));
+	if (runs <= 1){
+		std::stable_sort(first, last, less);
+		return;
+	}
+
+	std::vector<size_t> bounds(runs + 1);
+	for (size_t r = 0; r <= runs; ++r){
+		bounds[r] = r * n / runs;
+	}
+	btree_parallel_for(runs, threads, [&](size_t r){
+		std::stable_sort(first + bounds[r], first + bounds[r + 1], less);
+	});
+	for (size_t width = 1; width < runs; width *= 2){
+		size_t merges = (runs + 2 * width - 1) / (2 * width);
+		btree_parallel_for(merges, threads, [&](size_t m){
+			size_t lo = 2 * width * m;
+			size_t mid = std::min(lo + width, runs);
+			size_t hi = std::min(lo + 2 * width, runs);
+			if (mid < hi){
+				std::inplace_merge(first + bounds[lo], first + bounds[mid], first + bounds[hi], less);
+			}
+		});
+	}
+}
+
+#endif
+//**********************************
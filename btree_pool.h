@@ -0,0 +1,162 @@
+/**
+ * Slab allocator for btree nodes.  Every node of a given kind (leaf or
+ * internal) in a tree has the same size, so the tree keeps one pool per
+ * kind: blocks are carved out of large chunks obtained from the tree's
+ * allocator, freed blocks go onto an intrusive free list and are handed
+ * out again before a new chunk is requested, and all chunks are returned
+ * at once when the pool is released.
+ **/
+
+#ifndef BTREE_POOL_H
+#define BTREE_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// unit of allocation for chunks: one cache line, so every block is line aligned.
+struct alignas(64) btree_cache_line{
+	unsigned char bytes[64];
+};
+
+template<typename Alloc>
+class btree_node_pool{
+
+public:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<btree_cache_line> line_allocator;
+	typedef std::allocator_traits<line_allocator> line_traits;
+
+	// the first chunk holds this many blocks; each later chunk doubles,
+	// up to maxChunkBytes, so small trees stay small.
+	static constexpr size_t firstChunkBlocks = 4;
+	static constexpr size_t maxChunkBytes = 64 * 1024;
+
+	// @param blockBytes size of every block, a multiple of the cache line
+	btree_node_pool(size_t blockBytes = sizeof(btree_cache_line), const Alloc& alloc = Alloc()):
+		lineAlloc(alloc), chunks(nullptr), freeList(nullptr), blockLines(linesFor(blockBytes)),
+		nextChunkBlocks(firstChunkBlocks), reservedLines(0){}
+
+	btree_node_pool(btree_node_pool&& rhs) noexcept:
+		lineAlloc(std::move(rhs.lineAlloc)), chunks(rhs.chunks), freeList(rhs.freeList),
+		blockLines(rhs.blockLines), nextChunkBlocks(rhs.nextChunkBlocks), reservedLines(rhs.reservedLines){
+
+		rhs.chunks = nullptr;
+		rhs.freeList = nullptr;
+		rhs.nextChunkBlocks = firstChunkBlocks;
+		rhs.reservedLines = 0;
+	}
+
+	btree_node_pool& operator=(btree_node_pool&& rhs) noexcept{
+		if (this != &rhs){
+			release();
+			swap(rhs);
+		}
+		return *this;
+	}
+
+	btree_node_pool(const btree_node_pool&) = delete;
+	btree_node_pool& operator=(const btree_node_pool&) = delete;
+
+	~btree_node_pool(){
+		release();
+	}
+
+	void swap(btree_node_pool& rhs) noexcept{
+		using std::swap;
+		swap(lineAlloc, rhs.lineAlloc);
+		swap(chunks, rhs.chunks);
+		swap(freeList, rhs.freeList);
+		swap(blockLines, rhs.blockLines);
+		swap(nextChunkBlocks, rhs.nextChunkBlocks);
+		swap(reservedLines, rhs.reservedLines);
+	}
+
+	// hands out one block, recycling a freed block when there is one.
+	void* allocate(){
+		if (freeList == nullptr){
+			grow();
+		}
+		FreeBlock *block = freeList;
+		freeList = block->next;
+		return block;
+	}
+
+	// puts block back on the free list; the memory stays with the pool.
+	void deallocate(void *block){
+		FreeBlock *freed = static_cast<FreeBlock*>(block);
+		freed->next = freeList;
+		freeList = freed;
+	}
+
+	// returns every chunk to the allocator in O(chunks); all blocks become invalid.
+	void release(){
+		while (chunks != nullptr){
+			Chunk *next = chunks->next;
+			size_t lines = chunks->lines;
+			line_traits::deallocate(lineAlloc, reinterpret_cast<btree_cache_line*>(chunks), lines);
+			chunks = next;
+		}
+		freeList = nullptr;
+		nextChunkBlocks = firstChunkBlocks;
+		reservedLines = 0;
+	}
+
+	size_t blockSize() const{
+		return blockLines * sizeof(btree_cache_line);
+	}
+
+	// bytes currently obtained from the allocator, including chunk headers.
+	size_t reservedBytes() const{
+		return reservedLines * sizeof(btree_cache_line);
+	}
+
+	Alloc get_allocator() const{
+		return Alloc(lineAlloc);
+	}
+
+private:
+	struct FreeBlock{
+		FreeBlock *next;
+	};
+
+	// lives in the first cache line of every chunk.
+	struct Chunk{
+		Chunk *next;
+		size_t lines;
+	};
+
+	static size_t linesFor(size_t bytes){
+		return (bytes + sizeof(btree_cache_line) - 1) / sizeof(btree_cache_line);
+	}
+
+	// allocates a chunk and threads its blocks onto the free list.
+	void grow(){
+		size_t blocks = nextChunkBlocks;
+		size_t lines = 1 + blocks * blockLines;
+		btree_cache_line *memory = line_traits::allocate(lineAlloc, lines);
+
+		Chunk *chunk = ::new (static_cast<void*>(memory)) Chunk;
+		chunk->next = chunks;
+		chunk->lines = lines;
+		chunks = chunk;
+		reservedLines += lines;
+
+		for (size_t i = blocks; i > 0; --i){
+			deallocate(memory + 1 + (i - 1) * blockLines);
+		}
+
+		if ((2 * blocks * blockLines + 1) * sizeof(btree_cache_line) <= maxChunkBytes){
+			nextChunkBlocks = 2 * blocks;
+		}
+	}
+
+	line_allocator lineAlloc;
+	Chunk *chunks;
+	FreeBlock *freeList;
+	size_t blockLines;
+	size_t nextChunkBlocks;
+	size_t reservedLines;
+};
+
+#endif
+//**********************************
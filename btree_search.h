@@ -0,0 +1,357 @@
+/**
+ * In-node search used by the btree to locate a key inside one node.
+ * Every kernel answers the same question: how many of the n sorted
+ * elements are strictly less than key (i.e. the lower bound index).
+ *
+ * General element types use a branchless binary search.  Arithmetic
+ * types with a matching vector unit narrow the range the same way and
+ * then count the remaining window with SIMD compares, which keeps the
+ * whole search free of data-dependent branches.  The tree calls the
+ * btree_lower_bound / btree_upper_bound / btree_find_in_node entry points
+ * at the bottom with its comparator; the vector kernels are only used
+ * when that comparator is plain < on the stored type.  When the node
+ * width MaxN is a compile-time constant the narrowing runs a fixed
+ * number of steps, which the compiler can unroll completely.
+ *
+ * At the end, btree_scan_visit fixes how every container's scan() calls
+ * its visitor.
+ **/
+
+#ifndef BTREE_SEARCH_H
+#define BTREE_SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <functional>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// kernel selected for an element type.
+enum btree_search_kernel{
+	btree_kernel_scalar,
+	btree_kernel_int32,
+	btree_kernel_int64,
+	btree_kernel_float,
+	btree_kernel_double
+};
+
+// compile time trait picking the kernel for T.
+template<typename T> struct btree_search_traits{
+
+	static constexpr int kernel =
+		(std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) == 4) ? btree_kernel_int32 :
+		(std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) == 8) ? btree_kernel_int64 :
+		(std::is_same<T, float>::value) ? btree_kernel_float :
+		(std::is_same<T, double>::value) ? btree_kernel_double :
+		btree_kernel_scalar;
+};
+
+// counts the elements of a[0, n) that are less than key, one vector at a time.
+template<typename T>
+inline size_t btree_count_less_int32(const T *a, size_t n, T key){
+
+	size_t i = 0, count = 0;
+#if defined(__AVX2__)
+	const __m256i k = _mm256_set1_epi32(int32_t(key));
+	for (; i + 8 <= n; i += 8){
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+		__m256i lt = _mm256_cmpgt_epi32(k, v);
+		count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+	}
+#elif defined(__SSE2__)
+	const __m128i k = _mm_set1_epi32(int32_t(key));
+	for (; i + 4 <= n; i += 4){
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i lt = _mm_cmpgt_epi32(k, v);
+		count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+	}
+#endif
+	for (; i < n; ++i){
+		count += a[i] < key;
+	}
+	return count;
+}
+
+template<typename T>
+inline size_t btree_count_less_int64(const T *a, size_t n, T key){
+
+	size_t i = 0, count = 0;
+#if defined(__AVX2__)
+	const __m256i k = _mm256_set1_epi64x(int64_t(key));
+	for (; i + 4 <= n; i += 4){
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+		__m256i lt = _mm256_cmpgt_epi64(k, v);
+		count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+	}
+#elif defined(__SSE4_2__)
+	const __m128i k = _mm_set1_epi64x(int64_t(key));
+	for (; i + 2 <= n; i += 2){
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i lt = _mm_cmpgt_epi64(k, v);
+		count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(lt)));
+	}
+#endif
+	for (; i < n; ++i){
+		count += a[i] < key;
+	}
+	return count;
+}
+
+inline size_t btree_count_less(const float *a, size_t n, float key){
+
+	size_t i = 0, count = 0;
+#if defined(__AVX2__)
+	const __m256 k = _mm256_set1_ps(key);
+	for (; i + 8 <= n; i += 8){
+		__m256 lt = _mm256_cmp_ps(_mm256_loadu_ps(a + i), k, _CMP_LT_OQ);
+		count += __builtin_popcount(_mm256_movemask_ps(lt));
+	}
+#elif defined(__SSE2__)
+	const __m128 k = _mm_set1_ps(key);
+	for (; i + 4 <= n; i += 4){
+		__m128 lt = _mm_cmplt_ps(_mm_loadu_ps(a + i), k);
+		count += __builtin_popcount(_mm_movemask_ps(lt));
+	}
+#endif
+	for (; i < n; ++i){
+		count += a[i] < key;
+	}
+	return count;
+}
+
+inline size_t btree_count_less(const double *a, size_t n, double key){
+
+	size_t i = 0, count = 0;
+#if defined(__AVX2__)
+	const __m256d k = _mm256_set1_pd(key);
+	for (; i + 4 <= n; i += 4){
+		__m256d lt = _mm256_cmp_pd(_mm256_loadu_pd(a + i), k, _CMP_LT_OQ);
+		count += __builtin_popcount(_mm256_movemask_pd(lt));
+	}
+#elif defined(__SSE2__)
+	const __m128d k = _mm_set1_pd(key);
+	for (; i + 2 <= n; i += 2){
+		__m128d lt = _mm_cmplt_pd(_mm_loadu_pd(a + i), k);
+		count += __builtin_popcount(_mm_movemask_pd(lt));
+	}
+#endif
+	for (; i < n; ++i){
+		count += a[i] < key;
+	}
+	return count;
+}
+
+// halving steps that take any n <= maxN down to 1 (n becomes ceil(n / 2) each step).
+constexpr size_t btree_search_steps(size_t maxN){
+	return maxN <= 1 ? 0 : 1 + btree_search_steps((maxN + 1) / 2);
+}
+
+// branchless narrowing of [base, base + n) to one candidate, probing with
+// less(element). With MaxN known the step count bounds the loop, so it
+// can be unrolled, and it still stops as soon as n is 1.
+template<size_t MaxN, typename T, typename Less>
+inline const T* btree_narrow(const T *base, size_t n, Less less){
+
+	if constexpr (MaxN != 0){
+		for (size_t step = 0; step < btree_search_steps(MaxN) && n > 1; ++step){
+			size_t half = n / 2;
+			base = less(base[half]) ? base + half : base;
+			n -= half;
+		}
+	}
+	else{
+		while (n > 1){
+			size_t half = n / 2;
+			base = less(base[half]) ? base + half : base;
+			n -= half;
+		}
+	}
+	return base;
+}
+
+// in-node search, specialised on the kernel chosen by btree_search_traits.
+template<typename T, int Kernel = btree_search_traits<T>::kernel>
+struct btree_node_search{
+
+	// branchless binary search: returns the first index whose element is not less than key.
+	template<size_t MaxN = 0>
+	static size_t lowerBound(const T *elems, size_t n, const T& key){
+
+		if (n == 0){
+			return 0;
+		}
+		const T *base = btree_narrow<MaxN>(elems, n, [&key](const T& e){ return e < key; });
+		return size_t(base - elems) + (*base < key);
+	}
+};
+
+// dispatch from a kernel to its counting routine.
+template<typename T> inline size_t btree_count_less(const T *a, size_t n, T key,
+		std::integral_constant<int, btree_kernel_int32>){
+	return btree_count_less_int32(a, n, key);
+}
+template<typename T> inline size_t btree_count_less(const T *a, size_t n, T key,
+		std::integral_constant<int, btree_kernel_int64>){
+	return btree_count_less_int64(a, n, key);
+}
+template<typename T> inline size_t btree_count_less(const T *a, size_t n, T key,
+		std::integral_constant<int, btree_kernel_float>){
+	return btree_count_less(a, n, key);
+}
+template<typename T> inline size_t btree_count_less(const T *a, size_t n, T key,
+		std::integral_constant<int, btree_kernel_double>){
+	return btree_count_less(a, n, key);
+}
+
+// vector kernels: narrow to a window of a few vectors, then count it.
+template<typename T, int Kernel>
+struct btree_node_search_simd{
+
+	// elements left once the binary narrowing stops: two cache lines.
+	static constexpr size_t window = 128 / sizeof(T);
+
+	// a node that fits in the window is counted straight away.
+	template<size_t MaxN = 0>
+	static size_t lowerBound(const T *elems, size_t n, const T& key){
+
+		size_t base = 0;
+		if constexpr (MaxN == 0 || MaxN > window){
+			while (n > window){
+				size_t half = n / 2;
+				base = (elems[base + half] < key) ? base + half : base;
+				n -= half;
+			}
+		}
+		return base + btree_count_less(elems + base, n, key, std::integral_constant<int, Kernel>());
+	}
+};
+
+template<typename T> struct btree_node_search<T, btree_kernel_int32> : btree_node_search_simd<T, btree_kernel_int32>{};
+template<typename T> struct btree_node_search<T, btree_kernel_int64> : btree_node_search_simd<T, btree_kernel_int64>{};
+template<typename T> struct btree_node_search<T, btree_kernel_float> : btree_node_search_simd<T, btree_kernel_float>{};
+template<typename T> struct btree_node_search<T, btree_kernel_double> : btree_node_search_simd<T, btree_kernel_double>{};
+
+// The tree's view of a user comparator.  A comparator returning bool is
+// a strict weak "less"; one returning anything else (int, like
+// std::string::compare) is read as three-way, negative meaning "ordered
+// before", and lets a node search learn order and equality from a single
+// call per probed key.
+template<typename Compare, typename Key>
+struct btree_key_compare{
+
+	Compare comp;
+
+	static constexpr bool three_way = !std::is_same<
+		decltype(std::declval<const Compare&>()(std::declval<const Key&>(), std::declval<const Key&>())), bool>::value;
+
+	template<typename A, typename B>
+	bool operator()(const A& a, const B& b) const{
+		if constexpr (three_way){
+			return comp(a, b) < 0;
+		}
+		else{
+			return comp(a, b);
+		}
+	}
+
+	template<typename A, typename B>
+	int compare(const A& a, const B& b) const{
+		if constexpr (three_way){
+			// one call per probe: the sign says both order and equality.
+			auto c = comp(a, b);
+			return (c > 0) - (c < 0);
+		}
+		else{
+			return comp(a, b) ? -1 : (comp(b, a) ? 1 : 0);
+		}
+	}
+};
+
+// comparators the kernels above may stand in for: they compare with <.
+template<typename T, typename Compare> struct btree_natural_order : std::false_type{};
+template<typename T> struct btree_natural_order<T, std::less<T> > : std::true_type{};
+template<typename T> struct btree_natural_order<T, std::less<void> > : std::true_type{};
+template<typename T, typename Compare, typename Key>
+struct btree_natural_order<T, btree_key_compare<Compare, Key> > : btree_natural_order<T, Compare>{};
+
+// first index whose element is not ordered before key under comp.
+template<size_t MaxN = 0, typename T, typename Compare, typename K>
+inline size_t btree_lower_bound(const T *elems, size_t n, const K& key, const Compare& comp){
+
+	if constexpr (btree_natural_order<T, Compare>::value && std::is_same<K, T>::value){
+		return btree_node_search<T>::template lowerBound<MaxN>(elems, n, key);
+	}
+	else{
+		if (n == 0){
+			return 0;
+		}
+		const T *base = btree_narrow<MaxN>(elems, n, [&](const T& e){ return comp(e, key); });
+		return size_t(base - elems) + comp(*base, key);
+	}
+}
+
+// first index whose element key is ordered before under comp.
+template<size_t MaxN = 0, typename T, typename Compare, typename K>
+inline size_t btree_upper_bound(const T *elems, size_t n, const K& key, const Compare& comp){
+
+	if (n == 0){
+		return 0;
+	}
+	const T *base = btree_narrow<MaxN>(elems, n, [&](const T& e){ return !comp(key, e); });
+	return size_t(base - elems) + !comp(key, *base);
+}
+
+// lower bound of key in a node of unique keys, setting match when the
+// element there is equal to key. A three-way comparator answers both
+// questions with the probes of the search itself (any probe that came
+// out equal must be the lower bound); only a miss on every probe but
+// the last costs one more call.
+template<size_t MaxN = 0, typename T, typename Compare, typename K>
+inline size_t btree_find_in_node(const T *elems, size_t n, const K& key, const Compare& comp, bool &match){
+
+	if constexpr (Compare::three_way){
+		match = false;
+		if (n == 0){
+			return 0;
+		}
+		bool seen = false;
+		const T *base = btree_narrow<MaxN>(elems, n, [&](const T& e){
+			int c = comp.compare(e, key);
+			seen |= (c == 0);
+			return c < 0;
+		});
+		int c = comp.compare(*base, key);
+		size_t pos = size_t(base - elems) + (c < 0);
+		match = seen || c == 0;
+		if (!match && c < 0 && pos < n){
+			match = comp.compare(elems[pos], key) == 0;
+		}
+		return pos;
+	}
+	else{
+		size_t pos = btree_lower_bound<MaxN>(elems, n, key, comp);
+		match = pos < n && !comp(key, elems[pos]);
+		return pos;
+	}
+}
+
+// calls a scan's visitor on elem. fn may return bool, false meaning stop,
+// or return nothing and see every element in range.
+// @return whether the scan should go on.
+template<typename Fn, typename E>
+inline bool btree_scan_visit(Fn &fn, const E& elem){
+
+	if constexpr (std::is_same<decltype(fn(elem)), bool>::value){
+		return fn(elem);
+	}
+	else{
+		fn(elem);
+		return true;
+	}
+}
+
+#endif
+//**********************************
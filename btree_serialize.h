@@ -0,0 +1,141 @@
+/**
+ * Binary snapshot format for btree, btree_map and btree_multimap.
+ *
+ * A snapshot is a header followed by the tree's nodes in pre-order
+ * (a node, then each of its subtrees from left to right).  Each node is
+ * a block of its own: a small header giving its kind and element count,
+ * then that many keys and, for maps, that many mapped values, each as
+ * one contiguous array of raw bytes.  The tree's shape is saved exactly,
+ * so loading copies every node's arrays back in with memcpy and relinks
+ * parents and children as the blocks arrive, with no comparisons and no
+ * per-element insertion.
+ *
+ * Elements are stored as their in-memory bytes, so snapshots are for
+ * trivially copyable keys and values and move only between builds with
+ * the same layout and byte order, both of which the header records.
+ **/
+
+#ifndef BTREE_SERIALIZE_H
+#define BTREE_SERIALIZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#define BTREE_HAS_SPAN 1
+#endif
+#endif
+
+// the start of every snapshot.
+struct btree_snapshot_header{
+	char magic[8];
+	uint32_t formatVersion;
+	uint32_t byteOrder;		// btree_snapshot_byte_order as written by the saving machine
+	uint32_t keySize;
+	uint32_t mappedSize;	// 0 for sets
+	uint32_t multi;
+	uint32_t reserved;
+	uint64_t nodeWidth;		// elements per node of the saved tree
+	uint64_t size;			// elements in the tree
+	uint64_t nodeCount;		// node blocks that follow
+};
+
+// the start of every node block.
+struct btree_snapshot_node{
+	uint32_t leaf;
+	uint32_t num_element;
+};
+
+static constexpr char btree_snapshot_magic[8] = {'B', 'T', 'R', 'E', 'E', 'S', 'N', 'P'};
+static constexpr uint32_t btree_snapshot_version = 1;
+static constexpr uint32_t btree_snapshot_byte_order = 0x01020304;
+
+// the widest node a snapshot may hold. Node blocks are sized from the
+// width before their contents are read, so it is bounded to keep a
+// damaged header from asking for gigabytes.
+static constexpr uint64_t btree_snapshot_max_width = 1 << 16;
+
+// snapshot output to a stream.
+class btree_stream_writer{
+public:
+	explicit btree_stream_writer(std::ostream &os): os(os){}
+
+	void write(const void *data, size_t n){
+		if (!os.write(static_cast<const char*>(data), std::streamsize(n))){
+			throw std::runtime_error("btree: snapshot write failed");
+		}
+	}
+
+private:
+	std::ostream &os;
+};
+
+// snapshot output to a caller's buffer.
+class btree_buffer_writer{
+public:
+	btree_buffer_writer(std::byte *out, size_t capacity): out(out), capacity(capacity), used(0){}
+
+	void write(const void *data, size_t n){
+		if (n > capacity - used){
+			throw std::length_error("btree: snapshot buffer too small");
+		}
+		std::memcpy(out + used, data, n);
+		used += n;
+	}
+
+	size_t written() const{
+		return used;
+	}
+
+private:
+	std::byte *out;
+	size_t capacity;
+	size_t used;
+};
+
+// snapshot input from a stream.
+class btree_stream_reader{
+public:
+	explicit btree_stream_reader(std::istream &is): is(is){}
+
+	void read(void *data, size_t n){
+		if (!is.read(static_cast<char*>(data), std::streamsize(n))){
+			throw std::runtime_error("btree: snapshot is truncated");
+		}
+	}
+
+private:
+	std::istream &is;
+};
+
+// snapshot input from memory.
+class btree_buffer_reader{
+public:
+	btree_buffer_reader(const std::byte *data, size_t size): data(data), size(size), used(0){}
+
+	void read(void *out, size_t n){
+		if (n > size - used){
+			throw std::runtime_error("btree: snapshot is truncated");
+		}
+		std::memcpy(out, data + used, n);
+		used += n;
+	}
+
+	size_t consumed() const{
+		return used;
+	}
+
+private:
+	const std::byte *data;
+	size_t size;
+	size_t used;
+};
+
+#endif
+//**********************************
@@ -0,0 +1,1378 @@
+/**
+ * An ordered set of strings with prefix-compressed nodes.
+ *
+ * btree<std::string> keeps a whole std::string per slot, each with its
+ * own heap buffer once it outgrows the small string buffer, so nodes are
+ * large and every comparison follows a pointer.  Here a node keeps its
+ * keys in one contiguous byte area instead: first the prefix all of its
+ * keys share, stored once, then each key's remaining suffix, back to
+ * back in key order.  Fixed-width offset slots locate the suffixes, and
+ * next to them every key has a small "head", the first four bytes of its
+ * suffix as a big-endian integer, so that most comparisons in a node
+ * search are a single integer compare and only ties touch the bytes.
+ *
+ * Elements live in the leaves, which are linked for iteration; internal
+ * nodes hold separators, cut to the shortest string that still divides
+ * their two children, so they compress even better.  Keys order as
+ * std::string does, by unsigned bytes; any string_view may be looked up.
+ *
+ * An iterator decodes its key into a string of its own, so *it is a
+ * const std::string& that stays valid until the iterator moves.  For the
+ * same reason std::reverse_iterator, which dereferences a temporary copy,
+ * cannot be used on it; the set has a reverse iterator of its own.
+ **/
+
+#ifndef BTREE_STRING_H
+#define BTREE_STRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+#include "btree_search.h"
+#include "btree_pool.h"
+
+template<size_t Fanout = 64, typename Alloc = std::allocator<char> > class btree_string_set;
+template<typename Tree> class btree_string_iterator;
+template<typename Tree> class btree_string_reverse_iterator;
+
+/**
+ * An ordered set of unique strings, held in prefix-compressed nodes of
+ * up to Fanout keys.
+ */
+template<size_t Fanout, typename Alloc>
+class btree_string_set{
+
+	static_assert(Fanout >= 4, "btree_string_set fanout must be at least 4");
+
+ public:
+	typedef std::string key_type;
+	typedef std::string value_type;
+	typedef std::less<std::string> key_compare;
+	typedef Alloc allocator_type;
+	typedef const std::string& reference;
+	typedef const std::string& const_reference;
+	typedef const std::string* pointer;
+	typedef const std::string* const_pointer;
+
+	friend class btree_string_iterator<btree_string_set>;
+	friend class btree_string_reverse_iterator<btree_string_set>;
+	typedef btree_string_iterator<btree_string_set> const_iterator;
+	typedef const_iterator iterator;
+	typedef btree_string_reverse_iterator<btree_string_set> const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+
+  /**
+   * @param alloc the allocator nodes and their byte areas come from
+   */
+  explicit btree_string_set(const Alloc& alloc = Alloc());
+
+  /**
+   * Builds the set from the strings in [first, last).
+   */
+  template<typename InputIt>
+  btree_string_set(InputIt first, InputIt last, const Alloc& alloc = Alloc());
+
+  /**
+   * Copies original node by node; the byte areas are copied whole.
+   */
+  btree_string_set(const btree_string_set& original);
+  btree_string_set(btree_string_set&& original) noexcept;
+  btree_string_set& operator=(const btree_string_set& rhs);
+  btree_string_set& operator=(btree_string_set&& rhs) noexcept;
+  ~btree_string_set();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+	const_reverse_iterator rbegin() const;
+	const_reverse_iterator rend() const;
+	const_reverse_iterator crbegin() const;
+	const_reverse_iterator crend() const;
+
+  /**
+    * Inserts key unless it is present. Iterators are invalidated.
+    * @return true if key was inserted.
+    */
+  bool insert(std::string_view key);
+
+  /**
+    * Removes key, if present. Nodes that fall below half full take keys
+    * from a sibling or merge with it. Iterators are invalidated.
+    * @return the number of elements removed.
+    */
+  size_t erase(std::string_view key);
+
+  /**
+    * Removes every element and frees every node.
+    */
+  void clear();
+
+  /**
+    * @return an iterator to the matching element, or end().
+    */
+  const_iterator find(std::string_view key) const;
+
+  /**
+    * @return an iterator to the first element not less than key, or end().
+    */
+  const_iterator lower_bound(std::string_view key) const;
+
+  /**
+    * @return an iterator to the first element greater than key, or end().
+    */
+  const_iterator upper_bound(std::string_view key) const;
+
+  /**
+    * @return the pair (lower_bound(key), upper_bound(key)).
+    */
+  std::pair<const_iterator, const_iterator> equal_range(std::string_view key) const;
+
+  /**
+    * @return 1 if key is present, otherwise 0.
+    */
+  size_t count(std::string_view key) const;
+
+  bool contains(std::string_view key) const;
+
+  /**
+    * Calls fn(const std::string&) on every element k with lo <= k < hi,
+    * in order, decoding each leaf's run into one reused buffer. If fn
+    * returns bool, returning false stops the scan early.
+    * @return the number of elements passed to fn.
+    */
+  template<typename Fn>
+  size_t scan(std::string_view lo, std::string_view hi, Fn fn) const;
+
+  size_t size() const;
+  bool empty() const;
+  key_compare key_comp() const;
+  void swap(btree_string_set& other) noexcept;
+
+ private:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<char> byte_allocator;
+	typedef std::allocator_traits<byte_allocator> byte_traits;
+
+	// the keys of a node share the prefix bytes[0, offsets[0]); key i goes
+	// on with the suffix bytes[offsets[i], offsets[i + 1]), and heads[i]
+	// holds that suffix's first four bytes, big endian and zero padded,
+	// so heads order as the suffixes do. capacity is the size of bytes.
+	struct Node{
+		uint32_t num_element;
+		uint32_t capacity;
+		bool leaf;
+		char *bytes;
+		uint32_t offsets[Fanout + 1];
+		uint32_t heads[Fanout];
+
+		explicit Node(bool leaf_): num_element(0), capacity(0), leaf(leaf_), bytes(nullptr), offsets(), heads(){}
+	};
+
+	// leaves are linked in key order.
+	struct Leaf : Node{
+		Leaf *prev;
+		Leaf *next;
+
+		Leaf(): Node(true), prev(nullptr), next(nullptr){}
+	};
+
+	// child i holds the keys k with separator i-1 <= k < separator i.
+	struct Inner : Node{
+		Node *children[Fanout + 1];
+
+		Inner(): Node(false), children(){}
+	};
+
+	static Leaf* asLeaf(Node *node){ return static_cast<Leaf*>(node); }
+	static const Leaf* asLeaf(const Node *node){ return static_cast<const Leaf*>(node); }
+	static Inner* asInner(Node *node){ return static_cast<Inner*>(node); }
+	static const Inner* asInner(const Node *node){ return static_cast<const Inner*>(node); }
+
+	static std::string_view prefixOf(const Node *node);
+	static std::string_view suffixOf(const Node *node, size_t i);
+
+	// the head of a suffix: its first four bytes as a big-endian integer.
+	static uint32_t headOf(std::string_view suffix);
+
+	// memcmp that also takes the null pointers of empty views.
+	static int compareBytes(const char *a, const char *b, size_t n);
+
+	// writes key i of node into out.
+	static void keyAt(const Node *node, size_t i, std::string &out);
+
+	// appends every key of node to keys.
+	static void decode(const Node *node, std::vector<std::string> &keys);
+
+	// the first key of node not less than key (greater than key when upper).
+	static size_t searchNode(const Node *node, std::string_view key, bool upper);
+
+	static bool keyEquals(const Node *node, size_t i, std::string_view key);
+
+	// the shortest string s with left < s <= right.
+	static std::string shortestSeparator(const std::string& left, const std::string& right);
+
+	// the leaf key belongs in.
+	const Leaf* findLeaf(std::string_view key) const;
+
+	// the first key not less than key (greater than key when upper): its leaf and index, or nullptr at the end.
+	const Leaf* seek(std::string_view key, bool upper, size_t &pos) const;
+
+	Leaf* newLeaf();
+	Inner* newInner();
+
+	// frees node's byte area and returns its block, leaving its children alone.
+	void freeNode(Node *node);
+	void freeSubtree(Node *node);
+
+	char* allocateBytes(size_t n);
+	void deallocateBytes(char *bytes, size_t n);
+
+	// grows node's byte area to hold at least needed bytes.
+	void reserveBytes(Node *node, size_t needed);
+
+	// rewrites node to hold keys[first, last), sorted, under their longest
+	// common prefix. node is left unchanged if this throws.
+	void setKeys(Node *node, const std::vector<std::string> &keys, size_t first, size_t last);
+
+	// inserts key at pos of node, which has room for it. A key that does
+	// not share the node's prefix rewrites the node under a shorter one.
+	void insertKey(Node *node, size_t pos, std::string_view key);
+
+	// removes key pos of node; the prefix stays as it is.
+	static void removeKey(Node *node, size_t pos);
+
+	// replaces separator pos of an internal node.
+	void replaceKey(Node *node, size_t pos, const std::string& key);
+
+	// inserts separator sep at pos of an internal node with room for it, with right after it.
+	void insertChild(Inner *node, size_t pos, std::string_view sep, Node *right);
+
+	// removes separator pos of an internal node and the child after it.
+	static void removeChild(Inner *node, size_t pos);
+
+	// copies src's keys into the empty node dst.
+	void copyKeys(Node *dst, const Node *src);
+
+	// copies a subtree, appending its leaves to the chain after prevLeaf.
+	Node* cloneSubtree(const Node *src, Leaf *&prevLeaf);
+
+	// inserts key below node. Returns true if node split, with sep and
+	// right the separator and new right sibling for the parent; added
+	// tells whether key was new.
+	bool insertInto(Node *node, std::string_view key, bool &added, std::string &sep, Node *&right);
+
+	// removes key from below node; returns whether it was there.
+	bool eraseFrom(Node *node, std::string_view key);
+
+	// refills child i of parent after an erase left it under half full.
+	void rebalance(Inner *parent, size_t i);
+
+	static constexpr size_t minElems = Fanout / 2;
+
+	btree_node_pool<Alloc> leafPool;
+	btree_node_pool<Alloc> internalPool;
+	byte_allocator byteAlloc;
+	Node *baseNode;
+	Leaf *firstNode;
+	Leaf *lastNode;
+	size_t btree_size;
+};
+
+/**
+ * Bidirectional iterator over a btree_string_set: a leaf, an index in
+ * it and the key there, decoded; (nullptr, 0) is end().
+ */
+template<typename Tree> class btree_string_iterator{
+
+	typedef typename Tree::Leaf Leaf;
+
+public:
+	const Leaf *pNode;
+	size_t pindex;
+	const Tree *pbtree;
+	std::string key;
+
+	btree_string_iterator(const Leaf *pNode_ = nullptr, size_t pindex_ = 0, const Tree *pbtree_ = nullptr);
+
+	typedef ptrdiff_t difference_type;
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
+
+	bool operator==(const btree_string_iterator& rhs) const;
+	bool operator!=(const btree_string_iterator& rhs) const;
+	reference operator*() const;
+	pointer operator->() const;
+	btree_string_iterator& operator++();
+	btree_string_iterator operator++(int);
+	btree_string_iterator& operator--();
+	btree_string_iterator operator--(int);
+};
+
+//iterator constructor: decode the key it points at
+template<typename Tree>
+btree_string_iterator<Tree>::btree_string_iterator(const Leaf *pNode_, size_t pindex_, const Tree *pbtree_):
+	pNode(pNode_), pindex(pindex_), pbtree(pbtree_){
+
+	if (pNode != nullptr){
+		Tree::keyAt(pNode, pindex, key);
+	}
+}
+
+//== operator overloading
+template<typename Tree>
+bool btree_string_iterator<Tree>::operator==(const btree_string_iterator& rhs) const{
+	return pNode == rhs.pNode && pindex == rhs.pindex && pbtree == rhs.pbtree;
+}
+
+//!= operator overloading
+template<typename Tree>
+bool btree_string_iterator<Tree>::operator!=(const btree_string_iterator& rhs) const{
+	return !operator==(rhs);
+}
+
+//* operator overloading
+template<typename Tree>
+typename btree_string_iterator<Tree>::reference btree_string_iterator<Tree>::operator*() const{
+	return key;
+}
+
+//-> operator overloading
+template<typename Tree>
+typename btree_string_iterator<Tree>::pointer btree_string_iterator<Tree>::operator->() const{
+	return &key;
+}
+
+//++ operator overloading: past a leaf's last key, on to the next leaf
+template<typename Tree>
+btree_string_iterator<Tree>& btree_string_iterator<Tree>::operator++(){
+
+	if (++pindex == pNode->num_element){
+		pNode = pNode->next;
+		pindex = 0;
+		if (pNode == nullptr){
+			return *this;
+		}
+	}
+	Tree::keyAt(pNode, pindex, key);
+	return *this;
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_string_iterator<Tree> btree_string_iterator<Tree>::operator++(int){
+	btree_string_iterator temp_return = *this;
+	operator++();
+	return temp_return;
+}
+
+//-- operator overloading: before a leaf's first key, back to the previous leaf
+template<typename Tree>
+btree_string_iterator<Tree>& btree_string_iterator<Tree>::operator--(){
+
+	if (pNode == nullptr){
+		pNode = pbtree->lastNode;
+		pindex = pNode->num_element - 1;
+	}
+	else if (pindex > 0){
+		--pindex;
+	}
+	else{
+		pNode = pNode->prev;
+		pindex = pNode->num_element - 1;
+	}
+	Tree::keyAt(pNode, pindex, key);
+	return *this;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_string_iterator<Tree> btree_string_iterator<Tree>::operator--(int){
+	btree_string_iterator e_iter = *this;
+	operator--();
+	return e_iter;
+}
+
+/**
+ * Reverse iterator over a btree_string_set. Unlike std::reverse_iterator
+ * it sits on the element it refers to, so *it stays valid as long as the
+ * iterator does; rend() is the forward end().
+ */
+template<typename Tree> class btree_string_reverse_iterator{
+
+	typedef btree_string_iterator<Tree> forward_iterator;
+
+public:
+	forward_iterator current;
+
+	btree_string_reverse_iterator(const forward_iterator& current_ = forward_iterator()): current(current_){}
+
+	typedef ptrdiff_t difference_type;
+	typedef std::bidirectional_iterator_tag iterator_category;
+	typedef typename Tree::value_type value_type;
+	typedef typename Tree::const_reference reference;
+	typedef typename Tree::const_pointer pointer;
+
+	// the forward iterator one past this one's element, as std::reverse_iterator::base() gives.
+	forward_iterator base() const;
+
+	bool operator==(const btree_string_reverse_iterator& rhs) const{ return current == rhs.current; }
+	bool operator!=(const btree_string_reverse_iterator& rhs) const{ return current != rhs.current; }
+	reference operator*() const{ return *current; }
+	pointer operator->() const{ return current.operator->(); }
+	btree_string_reverse_iterator& operator++();
+	btree_string_reverse_iterator operator++(int);
+	btree_string_reverse_iterator& operator--();
+	btree_string_reverse_iterator operator--(int);
+};
+
+//base
+template<typename Tree>
+typename btree_string_reverse_iterator<Tree>::forward_iterator btree_string_reverse_iterator<Tree>::base() const{
+
+	if (current.pNode == nullptr){
+		return current.pbtree->begin();
+	}
+	forward_iterator next = current;
+	return ++next;
+}
+
+//++ operator overloading: from the first element on to rend()
+template<typename Tree>
+btree_string_reverse_iterator<Tree>& btree_string_reverse_iterator<Tree>::operator++(){
+
+	if (current.pindex == 0 && current.pNode->prev == nullptr){
+		current = current.pbtree->end();
+	}
+	else{
+		--current;
+	}
+	return *this;
+}
+
+//++ operator overloading
+template<typename Tree>
+btree_string_reverse_iterator<Tree> btree_string_reverse_iterator<Tree>::operator++(int){
+	btree_string_reverse_iterator temp_return = *this;
+	operator++();
+	return temp_return;
+}
+
+//-- operator overloading: rend() steps back to the first element
+template<typename Tree>
+btree_string_reverse_iterator<Tree>& btree_string_reverse_iterator<Tree>::operator--(){
+
+	if (current.pNode == nullptr){
+		current = current.pbtree->begin();
+	}
+	else{
+		++current;
+	}
+	return *this;
+}
+
+//-- operator overloading
+template<typename Tree>
+btree_string_reverse_iterator<Tree> btree_string_reverse_iterator<Tree>::operator--(int){
+	btree_string_reverse_iterator e_iter = *this;
+	operator--();
+	return e_iter;
+}
+
+//constructor: an empty set has no nodes at all
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>::btree_string_set(const Alloc& alloc)
+	:leafPool(sizeof(Leaf), alloc), internalPool(sizeof(Inner), alloc), byteAlloc(alloc),
+	 baseNode(nullptr), firstNode(nullptr), lastNode(nullptr), btree_size(0){
+}
+
+//range constructor
+template<size_t Fanout, typename Alloc>
+template<typename InputIt>
+btree_string_set<Fanout, Alloc>::btree_string_set(InputIt first, InputIt last, const Alloc& alloc)
+	:btree_string_set(alloc){
+
+	for (; first != last; ++first){
+		insert(*first);
+	}
+}
+
+//copy constructor
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>::btree_string_set(const btree_string_set& original)
+	:leafPool(sizeof(Leaf), original.byteAlloc), internalPool(sizeof(Inner), original.byteAlloc),
+	 byteAlloc(original.byteAlloc), baseNode(nullptr), firstNode(nullptr), lastNode(nullptr), btree_size(0){
+
+	if (original.baseNode != nullptr){
+		Leaf *prevLeaf = nullptr;
+		baseNode = cloneSubtree(original.baseNode, prevLeaf);
+		lastNode = prevLeaf;
+		btree_size = original.btree_size;
+	}
+}
+
+//move constructor
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>::btree_string_set(btree_string_set&& original) noexcept
+	:leafPool(std::move(original.leafPool)), internalPool(std::move(original.internalPool)),
+	 byteAlloc(original.byteAlloc), baseNode(original.baseNode), firstNode(original.firstNode),
+	 lastNode(original.lastNode), btree_size(original.btree_size){
+
+	original.baseNode = nullptr;
+	original.firstNode = nullptr;
+	original.lastNode = nullptr;
+	original.btree_size = 0;
+}
+
+//operator = overloading
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>& btree_string_set<Fanout, Alloc>::operator=(const btree_string_set& rhs){
+
+	if (this != &rhs){
+		btree_string_set copy(rhs);
+		swap(copy);
+	}
+	return *this;
+}
+
+//move operator = overloading
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>& btree_string_set<Fanout, Alloc>::operator=(btree_string_set&& rhs) noexcept{
+
+	if (this != &rhs){
+		swap(rhs);
+	}
+	return *this;
+}
+
+//destructor
+template<size_t Fanout, typename Alloc>
+btree_string_set<Fanout, Alloc>::~btree_string_set(){
+
+	if (baseNode != nullptr){
+		freeSubtree(baseNode);
+	}
+}
+
+//swap
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::swap(btree_string_set& other) noexcept{
+
+	leafPool.swap(other.leafPool);
+	internalPool.swap(other.internalPool);
+	std::swap(byteAlloc, other.byteAlloc);
+	std::swap(baseNode, other.baseNode);
+	std::swap(firstNode, other.firstNode);
+	std::swap(lastNode, other.lastNode);
+	std::swap(btree_size, other.btree_size);
+}
+
+//the shared prefix of a node's keys
+template<size_t Fanout, typename Alloc>
+std::string_view btree_string_set<Fanout, Alloc>::prefixOf(const Node *node){
+	return std::string_view(node->bytes, node->offsets[0]);
+}
+
+//the suffix of key i
+template<size_t Fanout, typename Alloc>
+std::string_view btree_string_set<Fanout, Alloc>::suffixOf(const Node *node, size_t i){
+	return std::string_view(node->bytes + node->offsets[i], node->offsets[i + 1] - node->offsets[i]);
+}
+
+//key head
+template<size_t Fanout, typename Alloc>
+uint32_t btree_string_set<Fanout, Alloc>::headOf(std::string_view suffix){
+
+	uint32_t head = 0;
+	for (size_t i = 0; i < 4; ++i){
+		head = (head << 8) | (i < suffix.size() ? uint32_t(uint8_t(suffix[i])) : 0);
+	}
+	return head;
+}
+
+//byte comparison
+template<size_t Fanout, typename Alloc>
+int btree_string_set<Fanout, Alloc>::compareBytes(const char *a, const char *b, size_t n){
+	return n != 0 ? std::memcmp(a, b, n) : 0;
+}
+
+//decode one key
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::keyAt(const Node *node, size_t i, std::string &out){
+
+	std::string_view prefix = prefixOf(node);
+	std::string_view suffix = suffixOf(node, i);
+	out.assign(prefix.data(), prefix.size());
+	out.append(suffix.data(), suffix.size());
+}
+
+//decode every key of a node
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::decode(const Node *node, std::vector<std::string> &keys){
+
+	for (size_t i = 0; i < node->num_element; ++i){
+		keys.emplace_back();
+		keyAt(node, i, keys.back());
+	}
+}
+
+//in-node search: the prefix is compared once, then a binary search over
+//the suffixes in which the heads settle all but the ties.
+template<size_t Fanout, typename Alloc>
+size_t btree_string_set<Fanout, Alloc>::searchNode(const Node *node, std::string_view key, bool upper){
+
+	size_t n = node->num_element;
+	size_t p = node->offsets[0];
+	int c = compareBytes(key.data(), node->bytes, std::min(p, key.size()));
+	if (c < 0 || (c == 0 && key.size() < p)){
+		return 0;
+	}
+	if (c > 0){
+		return n;
+	}
+	std::string_view rest = key.substr(p);
+	uint32_t head = headOf(rest);
+	size_t lo = 0;
+	size_t hi = n;
+	while (lo < hi){
+		size_t mid = (lo + hi) / 2;
+		int order;
+		if (node->heads[mid] != head){
+			order = node->heads[mid] < head ? -1 : 1;
+		}
+		else{
+			// equal heads: the bytes they both really have are equal already.
+			std::string_view suffix = suffixOf(node, mid);
+			size_t skip = std::min<size_t>(4, std::min(suffix.size(), rest.size()));
+			order = suffix.substr(skip).compare(rest.substr(skip));
+		}
+		if (order < 0 || (upper && order == 0)){
+			lo = mid + 1;
+		}
+		else{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+//key equality
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::keyEquals(const Node *node, size_t i, std::string_view key){
+
+	std::string_view prefix = prefixOf(node);
+	std::string_view suffix = suffixOf(node, i);
+	return key.size() == prefix.size() + suffix.size() &&
+			compareBytes(key.data(), prefix.data(), prefix.size()) == 0 &&
+			compareBytes(key.data() + prefix.size(), suffix.data(), suffix.size()) == 0;
+}
+
+//separator: right cut just past where it first differs from left
+template<size_t Fanout, typename Alloc>
+std::string btree_string_set<Fanout, Alloc>::shortestSeparator(const std::string& left, const std::string& right){
+
+	size_t k = 0;
+	while (k < left.size() && left[k] == right[k]){
+		++k;
+	}
+	return right.substr(0, k + 1);
+}
+
+//descend to the leaf for key
+template<size_t Fanout, typename Alloc>
+const typename btree_string_set<Fanout, Alloc>::Leaf* btree_string_set<Fanout, Alloc>::findLeaf(std::string_view key) const{
+
+	const Node *node = baseNode;
+	while (!node->leaf){
+		node = asInner(node)->children[searchNode(node, key, true)];
+	}
+	return asLeaf(node);
+}
+
+//seek: past the end of its leaf, key's bound is the next leaf's first key,
+//since that leaf starts at a separator greater than key.
+template<size_t Fanout, typename Alloc>
+const typename btree_string_set<Fanout, Alloc>::Leaf* btree_string_set<Fanout, Alloc>::seek(std::string_view key,
+		bool upper, size_t &pos) const{
+
+	pos = 0;
+	if (baseNode == nullptr){
+		return nullptr;
+	}
+	const Leaf *leaf = findLeaf(key);
+	pos = searchNode(leaf, key, upper);
+	if (pos < leaf->num_element){
+		return leaf;
+	}
+	pos = 0;
+	return leaf->next;
+}
+
+//new leaf from the pool
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::Leaf* btree_string_set<Fanout, Alloc>::newLeaf(){
+	return ::new (leafPool.allocate()) Leaf();
+}
+
+//new internal node from the pool
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::Inner* btree_string_set<Fanout, Alloc>::newInner(){
+	return ::new (internalPool.allocate()) Inner();
+}
+
+//give a node's byte area and block back
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::freeNode(Node *node){
+
+	deallocateBytes(node->bytes, node->capacity);
+	if (node->leaf){
+		asLeaf(node)->~Leaf();
+		leafPool.deallocate(node);
+	}
+	else{
+		asInner(node)->~Inner();
+		internalPool.deallocate(node);
+	}
+}
+
+//free a subtree; a partly copied one may have null children
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::freeSubtree(Node *node){
+
+	if (!node->leaf){
+		Inner *inner = asInner(node);
+		for (size_t i = 0; i <= node->num_element; ++i){
+			if (inner->children[i] != nullptr){
+				freeSubtree(inner->children[i]);
+			}
+		}
+	}
+	freeNode(node);
+}
+
+//byte area allocation
+template<size_t Fanout, typename Alloc>
+char* btree_string_set<Fanout, Alloc>::allocateBytes(size_t n){
+
+	if (n > std::numeric_limits<uint32_t>::max()){
+		throw std::length_error("btree_string_set: node keys too long");
+	}
+	return byte_traits::allocate(byteAlloc, n);
+}
+
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::deallocateBytes(char *bytes, size_t n){
+
+	if (bytes != nullptr){
+		byte_traits::deallocate(byteAlloc, bytes, n);
+	}
+}
+
+//grow a byte area by half again, in 16 byte steps
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::reserveBytes(Node *node, size_t needed){
+
+	if (needed <= node->capacity){
+		return;
+	}
+	size_t capacity = (std::max<size_t>(needed, node->capacity + node->capacity / 2) + 15) & ~size_t(15);
+	char *bytes = allocateBytes(capacity);
+	if (node->offsets[node->num_element] != 0){
+		std::memcpy(bytes, node->bytes, node->offsets[node->num_element]);
+	}
+	deallocateBytes(node->bytes, node->capacity);
+	node->bytes = bytes;
+	node->capacity = uint32_t(capacity);
+}
+
+//rewrite a node under the longest prefix its keys share; the first and
+//last key share no less than all of them, the keys being sorted.
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::setKeys(Node *node, const std::vector<std::string> &keys, size_t first, size_t last){
+
+	size_t count = last - first;
+	size_t p = 0;
+	if (count != 0){
+		const std::string &a = keys[first];
+		const std::string &b = keys[last - 1];
+		size_t m = std::min(a.size(), b.size());
+		while (p < m && a[p] == b[p]){
+			++p;
+		}
+	}
+	size_t total = p;
+	for (size_t i = first; i < last; ++i){
+		total += keys[i].size() - p;
+	}
+
+	// a new area when this one is too small, or far too big for what is left.
+	char *bytes = node->bytes;
+	size_t capacity = node->capacity;
+	if (total > capacity || capacity > 2 * total + 64){
+		capacity = (total + total / 8 + 15) & ~size_t(15);
+		bytes = capacity != 0 ? allocateBytes(capacity) : nullptr;
+	}
+
+	// bytes is null when every key is empty, so copy only what is there.
+	if (p != 0){
+		std::memcpy(bytes, keys[first].data(), p);
+	}
+	size_t offset = p;
+	for (size_t i = 0; i < count; ++i){
+		const std::string &key = keys[first + i];
+		node->offsets[i] = uint32_t(offset);
+		node->heads[i] = headOf(std::string_view(key).substr(p));
+		if (key.size() != p){
+			std::memcpy(bytes + offset, key.data() + p, key.size() - p);
+		}
+		offset += key.size() - p;
+	}
+	node->offsets[count] = uint32_t(offset);
+	node->num_element = uint32_t(count);
+	if (bytes != node->bytes){
+		deallocateBytes(node->bytes, node->capacity);
+		node->bytes = bytes;
+		node->capacity = uint32_t(capacity);
+	}
+}
+
+//insert a key: in place when it has the node's prefix, else rewrite the node
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::insertKey(Node *node, size_t pos, std::string_view key){
+
+	size_t n = node->num_element;
+	std::string_view prefix = prefixOf(node);
+	if (n == 0 || key.size() < prefix.size() || compareBytes(key.data(), prefix.data(), prefix.size()) != 0){
+		std::vector<std::string> keys;
+		keys.reserve(n + 1);
+		decode(node, keys);
+		keys.insert(keys.begin() + pos, std::string(key));
+		setKeys(node, keys, 0, n + 1);
+		return;
+	}
+
+	std::string_view rest = key.substr(prefix.size());
+	size_t len = rest.size();
+	reserveBytes(node, node->offsets[n] + len);
+	uint32_t at = node->offsets[pos];
+	if (len != 0){
+		std::memmove(node->bytes + at + len, node->bytes + at, node->offsets[n] - at);
+		std::memcpy(node->bytes + at, rest.data(), len);
+	}
+	for (size_t j = n + 1; j > pos; --j){
+		node->offsets[j] = node->offsets[j - 1] + uint32_t(len);
+	}
+	for (size_t j = n; j > pos; --j){
+		node->heads[j] = node->heads[j - 1];
+	}
+	node->heads[pos] = headOf(rest);
+	node->num_element = uint32_t(n + 1);
+}
+
+//remove a key, closing the gap in the byte area
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::removeKey(Node *node, size_t pos){
+
+	size_t n = node->num_element;
+	uint32_t at = node->offsets[pos];
+	uint32_t len = node->offsets[pos + 1] - at;
+	std::memmove(node->bytes + at, node->bytes + at + len, node->offsets[n] - at - len);
+	for (size_t j = pos; j < n; ++j){
+		node->offsets[j] = node->offsets[j + 1] - len;
+	}
+	for (size_t j = pos; j + 1 < n; ++j){
+		node->heads[j] = node->heads[j + 1];
+	}
+	node->num_element = uint32_t(n - 1);
+}
+
+//replace a separator; it may change the node's prefix, so rewrite the node
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::replaceKey(Node *node, size_t pos, const std::string& key){
+
+	std::vector<std::string> keys;
+	keys.reserve(node->num_element);
+	decode(node, keys);
+	keys[pos] = key;
+	setKeys(node, keys, 0, keys.size());
+}
+
+//open a separator and child slot; the key goes in first, as it may throw
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::insertChild(Inner *node, size_t pos, std::string_view sep, Node *right){
+
+	insertKey(node, pos, sep);
+	for (size_t j = node->num_element; j > pos + 1; --j){
+		node->children[j] = node->children[j - 1];
+	}
+	node->children[pos + 1] = right;
+}
+
+//close a separator and child slot
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::removeChild(Inner *node, size_t pos){
+
+	removeKey(node, pos);
+	for (size_t j = pos + 1; j <= node->num_element; ++j){
+		node->children[j] = node->children[j + 1];
+	}
+	node->children[node->num_element + 1] = nullptr;
+}
+
+//copy a node's keys, with an area no bigger than they need
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::copyKeys(Node *dst, const Node *src){
+
+	size_t n = src->num_element;
+	size_t used = src->offsets[n];
+	if (used != 0){
+		dst->bytes = allocateBytes(used);
+		dst->capacity = uint32_t(used);
+		std::memcpy(dst->bytes, src->bytes, used);
+	}
+	std::copy(src->offsets, src->offsets + n + 1, dst->offsets);
+	std::copy(src->heads, src->heads + n, dst->heads);
+	dst->num_element = uint32_t(n);
+}
+
+//copy a subtree, relinking the leaves in order
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::Node* btree_string_set<Fanout, Alloc>::cloneSubtree(const Node *src, Leaf *&prevLeaf){
+
+	if (src->leaf){
+		Leaf *leaf = newLeaf();
+		try{
+			copyKeys(leaf, src);
+		}
+		catch(...){
+			freeNode(leaf);
+			throw;
+		}
+		leaf->prev = prevLeaf;
+		if (prevLeaf != nullptr){
+			prevLeaf->next = leaf;
+		}
+		else{
+			firstNode = leaf;
+		}
+		prevLeaf = leaf;
+		return leaf;
+	}
+
+	Inner *inner = newInner();
+	try{
+		copyKeys(inner, src);
+		for (size_t i = 0; i <= src->num_element; ++i){
+			inner->children[i] = cloneSubtree(asInner(src)->children[i], prevLeaf);
+		}
+	}
+	catch(...){
+		freeSubtree(inner);
+		throw;
+	}
+	return inner;
+}
+
+// btree_string_set iterators
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::begin() const{
+	return firstNode != nullptr && firstNode->num_element != 0 ? const_iterator(firstNode, 0, this) : end();
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::end() const{
+	return const_iterator(nullptr, 0, this);
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::cbegin() const{
+	return begin();
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::cend() const{
+	return end();
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_reverse_iterator btree_string_set<Fanout, Alloc>::rbegin() const{
+	return lastNode != nullptr ? const_reverse_iterator(const_iterator(lastNode, lastNode->num_element - 1, this)) : rend();
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_reverse_iterator btree_string_set<Fanout, Alloc>::rend() const{
+	return const_reverse_iterator(end());
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_reverse_iterator btree_string_set<Fanout, Alloc>::crbegin() const{
+	return rbegin();
+}
+
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_reverse_iterator btree_string_set<Fanout, Alloc>::crend() const{
+	return rend();
+}
+
+//insert
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::insert(std::string_view key){
+
+	if (baseNode == nullptr){
+		Leaf *leaf = newLeaf();
+		baseNode = firstNode = lastNode = leaf;
+	}
+	bool added;
+	std::string sep;
+	Node *right = nullptr;
+	if (insertInto(baseNode, key, added, sep, right)){
+		// the root split: grow a level.
+		Inner *root = newInner();
+		root->children[0] = baseNode;
+		try{
+			insertChild(root, 0, sep, right);
+		}
+		catch(...){
+			freeNode(root);
+			throw;
+		}
+		baseNode = root;
+	}
+	if (added){
+		++btree_size;
+	}
+	return added;
+}
+
+//insert below a node, splitting it when it is full
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::insertInto(Node *node, std::string_view key, bool &added, std::string &sep, Node *&right){
+
+	size_t n = node->num_element;
+	if (node->leaf){
+		size_t pos = searchNode(node, key, false);
+		if (pos < n && keyEquals(node, pos, key)){
+			added = false;
+			return false;
+		}
+		added = true;
+		if (n < Fanout){
+			insertKey(node, pos, key);
+			return false;
+		}
+
+		std::vector<std::string> keys;
+		keys.reserve(n + 1);
+		decode(node, keys);
+		keys.insert(keys.begin() + pos, std::string(key));
+		// appending to the last leaf, as sorted loads do, leaves it full
+		// rather than half empty for good.
+		Leaf *leaf = asLeaf(node);
+		size_t mid = pos == n && leaf->next == nullptr ? n : (n + 1) / 2;
+		sep = shortestSeparator(keys[mid - 1], keys[mid]);
+		Leaf *sibling = newLeaf();
+		try{
+			setKeys(sibling, keys, mid, n + 1);
+			setKeys(leaf, keys, 0, mid);
+		}
+		catch(...){
+			freeNode(sibling);
+			throw;
+		}
+		sibling->prev = leaf;
+		sibling->next = leaf->next;
+		if (leaf->next != nullptr){
+			leaf->next->prev = sibling;
+		}
+		else{
+			lastNode = sibling;
+		}
+		leaf->next = sibling;
+		right = sibling;
+		return true;
+	}
+
+	Inner *inner = asInner(node);
+	size_t c = searchNode(node, key, true);
+	std::string childSep;
+	Node *childRight = nullptr;
+	if (!insertInto(inner->children[c], key, added, childSep, childRight)){
+		return false;
+	}
+	if (n < Fanout){
+		insertChild(inner, c, childSep, childRight);
+		return false;
+	}
+
+	// full: the middle separator of the Fanout + 1 moves up.
+	std::vector<std::string> keys;
+	keys.reserve(n + 1);
+	decode(node, keys);
+	keys.insert(keys.begin() + c, childSep);
+	std::vector<Node*> children(inner->children, inner->children + n + 1);
+	children.insert(children.begin() + c + 1, childRight);
+	size_t mid = (n + 1) / 2;
+	sep = keys[mid];
+	Inner *sibling = newInner();
+	try{
+		setKeys(sibling, keys, mid + 1, n + 1);
+		setKeys(inner, keys, 0, mid);
+	}
+	catch(...){
+		freeNode(sibling);
+		throw;
+	}
+	std::copy(children.begin() + mid + 1, children.end(), sibling->children);
+	std::copy(children.begin(), children.begin() + mid + 1, inner->children);
+	std::fill(inner->children + mid + 1, inner->children + Fanout + 1, nullptr);
+	right = sibling;
+	return true;
+}
+
+//erase
+template<size_t Fanout, typename Alloc>
+size_t btree_string_set<Fanout, Alloc>::erase(std::string_view key){
+
+	if (baseNode == nullptr || !eraseFrom(baseNode, key)){
+		return 0;
+	}
+	--btree_size;
+	if (!baseNode->leaf && baseNode->num_element == 0){
+		// the root's children merged: drop a level.
+		Node *root = baseNode;
+		baseNode = asInner(root)->children[0];
+		freeNode(root);
+	}
+	else if (baseNode->leaf && baseNode->num_element == 0){
+		freeNode(baseNode);
+		baseNode = firstNode = lastNode = nullptr;
+	}
+	return 1;
+}
+
+//erase below a node, refilling the child it went through if need be
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::eraseFrom(Node *node, std::string_view key){
+
+	if (node->leaf){
+		size_t pos = searchNode(node, key, false);
+		if (pos == node->num_element || !keyEquals(node, pos, key)){
+			return false;
+		}
+		removeKey(node, pos);
+		return true;
+	}
+	Inner *inner = asInner(node);
+	size_t c = searchNode(node, key, true);
+	if (!eraseFrom(inner->children[c], key)){
+		return false;
+	}
+	if (inner->children[c]->num_element < minElems){
+		rebalance(inner, c);
+	}
+	return true;
+}
+
+//rebalance child i with a sibling: merge the two if their keys fit in one
+//node, else share the keys out evenly.
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::rebalance(Inner *parent, size_t i){
+
+	size_t l = i > 0 ? i - 1 : i;
+	Node *left = parent->children[l];
+	Node *right = parent->children[l + 1];
+	std::vector<std::string> keys;
+	keys.reserve(left->num_element + right->num_element + 1);
+	decode(left, keys);
+
+	if (left->leaf){
+		decode(right, keys);
+		size_t total = keys.size();
+		if (total <= Fanout){
+			setKeys(left, keys, 0, total);
+			Leaf *gone = asLeaf(right);
+			asLeaf(left)->next = gone->next;
+			if (gone->next != nullptr){
+				gone->next->prev = asLeaf(left);
+			}
+			else{
+				lastNode = asLeaf(left);
+			}
+			removeChild(parent, l);
+			freeNode(gone);
+			return;
+		}
+		size_t mid = total / 2;
+		setKeys(right, keys, mid, total);
+		setKeys(left, keys, 0, mid);
+		replaceKey(parent, l, shortestSeparator(keys[mid - 1], keys[mid]));
+		return;
+	}
+
+	// internal nodes: the parent's separator comes down between the two.
+	keys.emplace_back();
+	keyAt(parent, l, keys.back());
+	decode(right, keys);
+	std::vector<Node*> children(asInner(left)->children, asInner(left)->children + left->num_element + 1);
+	children.insert(children.end(), asInner(right)->children, asInner(right)->children + right->num_element + 1);
+	size_t total = keys.size();
+	if (total <= Fanout){
+		setKeys(left, keys, 0, total);
+		std::copy(children.begin(), children.end(), asInner(left)->children);
+		removeChild(parent, l);
+		freeNode(right);
+		return;
+	}
+	size_t mid = total / 2;
+	setKeys(right, keys, mid + 1, total);
+	setKeys(left, keys, 0, mid);
+	std::copy(children.begin() + mid + 1, children.end(), asInner(right)->children);
+	std::fill(asInner(right)->children + (total - mid), asInner(right)->children + Fanout + 1, nullptr);
+	std::copy(children.begin(), children.begin() + mid + 1, asInner(left)->children);
+	std::fill(asInner(left)->children + mid + 1, asInner(left)->children + Fanout + 1, nullptr);
+	replaceKey(parent, l, keys[mid]);
+}
+
+//clear
+template<size_t Fanout, typename Alloc>
+void btree_string_set<Fanout, Alloc>::clear(){
+
+	if (baseNode != nullptr){
+		freeSubtree(baseNode);
+	}
+	baseNode = nullptr;
+	firstNode = nullptr;
+	lastNode = nullptr;
+	btree_size = 0;
+}
+
+//find
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::find(std::string_view key) const{
+
+	if (baseNode == nullptr){
+		return end();
+	}
+	const Leaf *leaf = findLeaf(key);
+	size_t pos = searchNode(leaf, key, false);
+	if (pos < leaf->num_element && keyEquals(leaf, pos, key)){
+		return const_iterator(leaf, pos, this);
+	}
+	return end();
+}
+
+//lower bound
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::lower_bound(std::string_view key) const{
+
+	size_t pos;
+	const Leaf *leaf = seek(key, false, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//upper bound
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::const_iterator btree_string_set<Fanout, Alloc>::upper_bound(std::string_view key) const{
+
+	size_t pos;
+	const Leaf *leaf = seek(key, true, pos);
+	return const_iterator(leaf, pos, this);
+}
+
+//equal range
+template<size_t Fanout, typename Alloc>
+std::pair<typename btree_string_set<Fanout, Alloc>::const_iterator, typename btree_string_set<Fanout, Alloc>::const_iterator>
+btree_string_set<Fanout, Alloc>::equal_range(std::string_view key) const{
+
+	const_iterator first = lower_bound(key);
+	const_iterator last = first;
+	if (last.pNode != nullptr && *last == key){
+		++last;
+	}
+	return std::make_pair(first, last);
+}
+
+//count
+template<size_t Fanout, typename Alloc>
+size_t btree_string_set<Fanout, Alloc>::count(std::string_view key) const{
+	return contains(key) ? 1 : 0;
+}
+
+//contains: one descent, nothing decoded
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::contains(std::string_view key) const{
+
+	if (baseNode == nullptr){
+		return false;
+	}
+	const Leaf *leaf = findLeaf(key);
+	size_t pos = searchNode(leaf, key, false);
+	return pos < leaf->num_element && keyEquals(leaf, pos, key);
+}
+
+//range scan along the leaf chain; a leaf's prefix is decoded once
+template<size_t Fanout, typename Alloc>
+template<typename Fn>
+size_t btree_string_set<Fanout, Alloc>::scan(std::string_view lo, std::string_view hi, Fn fn) const{
+
+	size_t visited = 0;
+	if (lo.compare(hi) >= 0){
+		return visited;
+	}
+	size_t i;
+	const Leaf *leaf = seek(lo, false, i);
+	std::string key;
+	while (leaf != nullptr){
+		size_t n = leaf->num_element;
+		size_t end = searchNode(leaf, hi, false);
+		std::string_view prefix = prefixOf(leaf);
+		key.assign(prefix.data(), prefix.size());
+		for (; i < end; ++i){
+			std::string_view suffix = suffixOf(leaf, i);
+			key.resize(prefix.size());
+			key.append(suffix.data(), suffix.size());
+			++visited;
+			if (!btree_scan_visit(fn, key)){
+				return visited;
+			}
+		}
+		if (end < n){
+			break;
+		}
+		leaf = leaf->next;
+		i = 0;
+	}
+	return visited;
+}
+
+//size
+template<size_t Fanout, typename Alloc>
+size_t btree_string_set<Fanout, Alloc>::size() const{
+	return btree_size;
+}
+
+//empty
+template<size_t Fanout, typename Alloc>
+bool btree_string_set<Fanout, Alloc>::empty() const{
+	return btree_size == 0;
+}
+
+//comparator access
+template<size_t Fanout, typename Alloc>
+typename btree_string_set<Fanout, Alloc>::key_compare btree_string_set<Fanout, Alloc>::key_comp() const{
+	return key_compare();
+}
+
+#endif
+//**********************************
@@ -0,0 +1,1244 @@
+/**
+ * Tests for the trees in this repository.
+ *
+ * Each container is put through random inserts and erases next to the
+ * standard container it stands in for, and after every round the two
+ * must hold the same elements in the same order.
+ * On top of that:
+ *  - btree_cow: a snapshot keeps the contents it was taken with, however
+ *    the tree changes afterwards and after the tree itself is gone, and
+ *    reader threads can go through snapshots while the tree is written.
+ *  - btree_durable: a child process writes and dies without closing the
+ *    log, under every sync policy, and a reopen must find what it was
+ *    promised, including a batch that was left to the flusher.  A torn
+ *    record at the end of the log is dropped.
+ *  - btree_disk: the file reopens with the same contents, both read-write
+ *    and mapped, and a corrupt page link is reported, not followed.
+ *  - btree_concurrent, btree_epoch and btree_cow: writers and readers run
+ *    at once and readers check what they see.  These are the tests to run
+ *    under ThreadSanitizer.
+ *
+ * Build and run with, e.g.
+ *     g++ -std=c++17 -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=undefined -pthread -I. btree_test.cpp -o btree_test
+ *     ./btree_test [filter]
+ *     g++ -std=c++17 -O1 -g -fsanitize=thread -pthread -I. btree_test.cpp -o btree_test_tsan
+ *     ./btree_test_tsan concurrent && ./btree_test_tsan epoch && ./btree_test_tsan cow
+ * where filter, when given, runs only the tests whose name contains it.
+ * Failures are reported with their line and make the exit status 1.
+ **/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <iterator>
+#include <numeric>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "btree.h"
+#include "btree_map.h"
+#include "btree_cow.h"
+#include "btree_wal.h"
+#include "btree_disk.h"
+#include "btree_concurrent.h"
+#include "btree_epoch.h"
+#include "btree_string.h"
+#include "btree_packed.h"
+
+// failed checks so far, in all tests.
+static std::atomic<size_t> test_failures(0);
+
+//record a failed check; the test goes on, so one run shows every failure.
+static void check_that(bool ok, const char *what, int line){
+
+	if (!ok){
+		std::cerr << "btree_test.cpp:" << line << ": check failed: " << what << std::endl;
+		++test_failures;
+	}
+}
+
+#define CHECK(cond) check_that((cond), #cond, __LINE__)
+
+// a scratch directory for the file backed trees, removed at exit.
+static std::string test_dir;
+
+//path of a scratch file
+static std::string scratch(const std::string& name){
+
+	return test_dir + "/" + name;
+}
+
+//remove the files a durable tree keeps under path
+static void remove_durable(const std::string& path){
+
+	::unlink((path + ".wal").c_str());
+	::unlink((path + ".snap").c_str());
+}
+
+// bytes counting_allocator has handed out and not had back.
+static long allocated_bytes = 0;
+
+//an allocator that keeps count of the bytes it has out
+template<typename T>
+struct counting_allocator{
+	typedef T value_type;
+
+	counting_allocator(){}
+	template<typename U>
+	counting_allocator(const counting_allocator<U>&){}
+
+	T* allocate(size_t n){
+		allocated_bytes += long(n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T *ptr, size_t n){
+		allocated_bytes -= long(n * sizeof(T));
+		std::allocator<T>().deallocate(ptr, n);
+	}
+
+	template<typename U>
+	bool operator==(const counting_allocator<U>&) const{ return true; }
+	template<typename U>
+	bool operator!=(const counting_allocator<U>&) const{ return false; }
+};
+
+//element equality
+template<typename A, typename B>
+static bool same_element(const A& a, const B& b){
+
+	return a == b;
+}
+
+//a map's element: btree_map hands out a pair of references, std::map a pair
+template<typename A1, typename A2, typename B1, typename B2>
+static bool same_element(const std::pair<A1, A2>& a, const std::pair<B1, B2>& b){
+
+	return a.first == b.first && a.second == b.second;
+}
+
+//same elements in the same order, both ways round
+template<typename Tree, typename Ref>
+static void check_same(const Tree& tree, const Ref& ref){
+
+	auto same = [](const auto& a, const auto& b){ return same_element(a, b); };
+	CHECK(tree.size() == ref.size());
+	CHECK(std::equal(tree.begin(), tree.end(), ref.begin(), ref.end(), same));
+	CHECK(std::equal(tree.rbegin(), tree.rend(), ref.rbegin(), ref.rend(), same));
+}
+
+//lower_bound, upper_bound and count of one key against the reference
+template<typename Tree, typename Ref, typename Key>
+static void check_bounds(const Tree& tree, const Ref& ref, const Key& key){
+
+	typename Tree::const_iterator lb = tree.lower_bound(key), ub = tree.upper_bound(key);
+	typename Ref::const_iterator rlb = ref.lower_bound(key), rub = ref.upper_bound(key);
+	CHECK((lb == tree.end()) == (rlb == ref.end()));
+	CHECK((ub == tree.end()) == (rub == ref.end()));
+	if (lb != tree.end() && rlb != ref.end()){
+		CHECK(*lb == *rlb);
+	}
+	if (ub != tree.end() && rub != ref.end()){
+		CHECK(*ub == *rub);
+	}
+	CHECK(tree.count(key) == ref.count(key));
+}
+
+//scan of [lo, hi) against the reference, whole and stopped after three elements
+template<typename Tree, typename Ref, typename Key>
+static void check_scan(const Tree& tree, const Ref& ref, const Key& lo, const Key& hi){
+
+	std::vector<typename Ref::value_type> seen;
+	size_t n = tree.scan(lo, hi, [&seen](const auto& key){ seen.emplace_back(key); });
+	CHECK(n == seen.size());
+	CHECK(std::equal(seen.begin(), seen.end(), ref.lower_bound(lo), ref.lower_bound(hi)));
+	size_t left = 3;
+	n = tree.scan(lo, hi, [&left](const auto&){ return --left != 0; });
+	CHECK(n == std::min<size_t>(3, seen.size()));
+}
+
+//btree against std::set, at several node widths
+static void test_set(){
+
+	std::mt19937 rng(1);
+	for (size_t width : {3, 4, 7, 40}){
+		btree<int> tree(width);
+		std::set<int> ref;
+		for (int round = 0; round < 4; ++round){
+			for (int i = 0; i < 5000; ++i){
+				int key = int(rng() % 4000);
+				CHECK(tree.insert(key).second == ref.insert(key).second);
+			}
+			for (int i = 0; i < 4000; ++i){
+				int key = int(rng() % 4000);
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+			check_same(tree, ref);
+			for (int i = 0; i < 200; ++i){
+				check_bounds(tree, ref, int(rng() % 4100) - 50);
+			}
+			for (int i = 0; i < 50; ++i){
+				int lo = int(rng() % 4100) - 50;
+				check_scan(tree, ref, lo, lo + int(rng() % 300));
+			}
+		}
+
+		// erase by position and by range, the same on the reference.
+		std::vector<int> sorted(ref.begin(), ref.end());
+		for (size_t i = 0; i < sorted.size(); i += 7){
+			tree.erase(tree.find(sorted[i]));
+			ref.erase(sorted[i]);
+		}
+		int from = *std::next(ref.begin(), ref.size() / 4), to = *std::next(ref.begin(), ref.size() / 2);
+		tree.erase(tree.find(from), tree.find(to));
+		ref.erase(ref.find(from), ref.find(to));
+		check_same(tree, ref);
+	}
+}
+
+//bulk_load and the range constructor, from sorted and from unsorted input
+static void test_bulk_load(){
+
+	std::mt19937 rng(14);
+	for (double fill : {1.0, 0.7, 0.5}){
+		std::vector<int> keys;
+		for (int i = 0; i < 20000; ++i){
+			keys.push_back(int(rng() % 30000));
+		}
+		std::set<int> ref(keys.begin(), keys.end());
+		btree<int> unsorted(keys.begin(), keys.end(), 7, fill);
+		check_same(unsorted, ref);
+		btree<int> tree(5);
+		tree.bulk_load(ref.begin(), ref.end(), fill);
+		check_same(tree, ref);
+
+		// a loaded tree takes further inserts and erases like any other.
+		for (int i = 0; i < 5000; ++i){
+			int key = int(rng() % 30000);
+			if (rng() % 2 != 0){
+				CHECK(tree.insert(key).second == ref.insert(key).second);
+			}
+			else{
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+		}
+		check_same(tree, ref);
+	}
+}
+
+//copies and moves, and the independence of a copy from its original
+static void test_copy(){
+
+	std::mt19937 rng(15);
+	btree<int> tree(4);
+	std::set<int> ref;
+	for (int i = 0; i < 20000; ++i){
+		int key = int(rng() % 10000);
+		tree.insert(key);
+		ref.insert(key);
+	}
+	btree<int> copy(tree);
+	check_same(copy, ref);
+	btree<int> assigned(9);
+	assigned.insert(-5);
+	assigned = tree;
+	check_same(assigned, ref);
+
+	// writes to the copies leave the original alone.
+	for (int key : ref){
+		if (key % 2 != 0){
+			copy.erase(key);
+		}
+	}
+	copy.insert(-1);
+	assigned.clear();
+	check_same(tree, ref);
+
+	btree<int> moved(std::move(copy));
+	CHECK(moved.find(-1) != moved.end() && moved.find(1) == moved.end());
+	btree<int> target(3);
+	target.insert(-7);
+	target = std::move(moved);
+	CHECK(target.find(-1) != target.end() && target.find(-7) == target.end());
+	check_same(tree, ref);
+}
+
+//nodes come from the tree's allocator, and all of it goes back
+static void test_allocator(){
+
+	{
+		typedef btree<int, std::less<int>, 0, counting_allocator<int> > Tree;
+		Tree tree(5);
+		std::set<int> ref;
+		std::mt19937 rng(13);
+		for (int i = 0; i < 20000; ++i){
+			int key = int(rng() % 5000);
+			CHECK(tree.insert(key).second == ref.insert(key).second);
+		}
+		CHECK(allocated_bytes > 0);
+		for (int i = 0; i < 15000; ++i){
+			int key = int(rng() % 5000);
+			CHECK(tree.erase(key) == ref.erase(key));
+		}
+		check_same(tree, ref);
+		Tree copy(tree);
+		check_same(copy, ref);
+		tree.clear();
+		CHECK(tree.begin() == tree.end());
+	}
+	CHECK(allocated_bytes == 0);
+}
+
+//iterators step to the next and the previous element from anywhere
+static void test_iterate(){
+
+	std::mt19937 rng(16);
+	for (size_t width : {3, 8}){
+		btree<int> tree(width);
+		std::set<int> ref;
+		for (int i = 0; i < 10000; ++i){
+			int key = int(rng() % 20000);
+			tree.insert(key);
+			ref.insert(key);
+		}
+		std::vector<int> sorted(ref.begin(), ref.end());
+		for (int i = 0; i < 2000; ++i){
+			size_t at = rng() % sorted.size();
+			btree<int>::iterator it = tree.find(sorted[at]);
+			for (size_t j = at; j < sorted.size() && j < at + 20; ++j, ++it){
+				CHECK(it != tree.end() && *it == sorted[j]);
+			}
+			it = tree.find(sorted[at]);
+			for (size_t j = at; j > 0 && j + 20 > at; --j){
+				--it;
+				CHECK(*it == sorted[j - 1]);
+			}
+		}
+		btree<int>::iterator last = tree.end();
+		--last;
+		CHECK(*last == sorted.back());
+	}
+}
+
+//btree_map against std::map
+static void test_map(){
+
+	std::mt19937 rng(2);
+	for (size_t width : {3, 5, 40}){
+		btree_map<int, int> tree(width);
+		std::map<int, int> ref;
+		for (int round = 0; round < 4; ++round){
+			for (int i = 0; i < 5000; ++i){
+				int key = int(rng() % 3000), value = int(rng() % 1000);
+				switch (rng() % 3){
+				case 0:
+					CHECK(tree.insert(std::make_pair(key, value)).second == ref.insert(std::make_pair(key, value)).second);
+					break;
+				case 1:
+					CHECK(tree.insert_or_assign(key, value).second == ref.insert_or_assign(key, value).second);
+					break;
+				default:
+					tree[key] += value;
+					ref[key] += value;
+					break;
+				}
+			}
+			for (int i = 0; i < 4000; ++i){
+				int key = int(rng() % 3000);
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+			check_same(tree, ref);
+		}
+	}
+}
+
+//btree_multimap against std::multimap: equal keys keep their insertion order
+static void test_multimap(){
+
+	std::mt19937 rng(3);
+	for (size_t width : {3, 6, 40}){
+		btree_multimap<int, int> tree(width);
+		std::multimap<int, int> ref;
+		for (int round = 0; round < 4; ++round){
+			for (int i = 0; i < 5000; ++i){
+				int key = int(rng() % 500), value = i;
+				tree.insert(std::make_pair(key, value));
+				ref.insert(std::make_pair(key, value));
+			}
+			for (int i = 0; i < 300; ++i){
+				int key = int(rng() % 500);
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+			check_same(tree, ref);
+			for (int i = 0; i < 200; ++i){
+				int key = int(rng() % 520) - 10;
+				CHECK(tree.count(key) == ref.count(key));
+			}
+		}
+	}
+}
+
+// calls of three_way_less so far.
+static size_t three_way_calls = 0;
+
+// calls of counting_less so far.
+static size_t less_calls = 0;
+
+//int less than, counting its calls
+struct counting_less{
+	bool operator()(int a, int b) const{
+		++less_calls;
+		return a < b;
+	}
+};
+
+//a three-way comparator over int, the way std::string::compare is one
+struct three_way_less{
+	int operator()(int a, int b) const{
+		++three_way_calls;
+		return (a > b) - (a < b);
+	}
+};
+
+//descending order, a compile-time fanout and a three-way comparator
+static void test_comparator(){
+
+	std::mt19937 rng(17);
+	btree<int, std::greater<int> > down(5);
+	std::set<int, std::greater<int> > downRef;
+	btree<int, std::less<int>, 8> fixed;
+	btree<int, three_way_less> threeWay(6);
+	std::set<int> ref;
+	for (int round = 0; round < 4; ++round){
+		for (int i = 0; i < 5000; ++i){
+			int key = int(rng() % 4000);
+			bool inserted = ref.insert(key).second;
+			CHECK(down.insert(key).second == downRef.insert(key).second);
+			CHECK(fixed.insert(key).second == inserted);
+			CHECK(threeWay.insert(key).second == inserted);
+		}
+		for (int i = 0; i < 4000; ++i){
+			int key = int(rng() % 4000);
+			size_t erased = ref.erase(key);
+			CHECK(down.erase(key) == downRef.erase(key));
+			CHECK(fixed.erase(key) == erased);
+			CHECK(threeWay.erase(key) == erased);
+		}
+		check_same(down, downRef);
+		check_same(fixed, ref);
+		check_same(threeWay, ref);
+		for (int i = 0; i < 200; ++i){
+			int key = int(rng() % 4100) - 50;
+			check_bounds(down, downRef, key);
+			check_bounds(fixed, ref, key);
+			check_bounds(threeWay, ref, key);
+		}
+	}
+
+	// compare() learns both order and equality from a single call.
+	btree_key_compare<three_way_less, int> compare{three_way_less()};
+	three_way_calls = 0;
+	CHECK(compare.compare(1, 2) < 0 && compare.compare(2, 2) == 0 && compare.compare(3, 2) > 0);
+	CHECK(three_way_calls == 3);
+
+	// a search stops probing once a single candidate is left, however wide
+	// the nodes may be: finding the one key of a tree costs just the two
+	// calls that tell whether it matches.
+	btree<int, counting_less, 40> one;
+	one.insert(7);
+	less_calls = 0;
+	CHECK(one.find(7) != one.end());
+	CHECK(less_calls == 2);
+}
+
+//find_batch finds what find does, and insert_sorted inserts what insert does
+static void test_batch(){
+
+	std::mt19937 rng(18);
+	btree<int> tree(6);
+	std::set<int> ref;
+	for (int part = 0; part < 2; ++part){
+		std::vector<int> keys;
+		for (int i = 0; i < 20000; ++i){
+			keys.push_back(int(rng() % 40000));
+		}
+		std::sort(keys.begin(), keys.end());
+		size_t before = ref.size();
+		ref.insert(keys.begin(), keys.end());
+		CHECK(tree.insert_sorted(keys.begin(), keys.end()) == ref.size() - before);
+		check_same(tree, ref);
+	}
+
+	std::vector<int> probes;
+	for (int i = 0; i < 1000; ++i){
+		probes.push_back(int(rng() % 40100) - 50);
+	}
+	std::vector<btree<int>::iterator> found(probes.size());
+	tree.find_batch(probes.data(), probes.size(), found.data());
+	for (size_t i = 0; i < probes.size(); ++i){
+		CHECK(found[i] == tree.find(probes[i]));
+	}
+	std::sort(probes.begin(), probes.end());
+	const btree<int>& view = tree;
+	std::vector<btree<int>::const_iterator> viewed(probes.size());
+	view.find_batch(probes.data(), probes.size(), viewed.data());
+	for (size_t i = 0; i < probes.size(); ++i){
+		CHECK(viewed[i] == view.find(probes[i]));
+	}
+}
+
+//a snapshot loads back into the same contents, and a cut one is refused
+static void test_serialize(){
+
+	std::mt19937 rng(19);
+	btree<int> tree(7);
+	std::set<int> ref;
+	for (int i = 0; i < 20000; ++i){
+		int key = int(rng() % 30000);
+		tree.insert(key);
+		ref.insert(key);
+	}
+	std::stringstream stream;
+	tree.serialize(stream);
+	btree<int> loaded(7);
+	loaded.deserialize(stream);
+	check_same(loaded, ref);
+
+	std::vector<std::byte> buffer(tree.serialized_size());
+	CHECK(tree.serialize(buffer.data(), buffer.size()) == buffer.size());
+	btree<int> copy(7);
+	CHECK(copy.deserialize(buffer.data(), buffer.size()) == buffer.size());
+	check_same(copy, ref);
+
+	// a truncated snapshot throws and leaves the tree as it was.
+	bool reported = false;
+	try{
+		copy.deserialize(buffer.data(), buffer.size() / 2);
+	}
+	catch(const std::runtime_error&){
+		reported = true;
+	}
+	CHECK(reported);
+	check_same(copy, ref);
+}
+
+//rank, select, nth and index_of against positions in the sorted order
+static void test_rank(){
+
+	std::mt19937 rng(20);
+	for (size_t width : {3, 16}){
+		btree<int> tree(width);
+		std::set<int> ref;
+		for (int i = 0; i < 10000; ++i){
+			int key = int(rng() % 20000);
+			tree.insert(key);
+			ref.insert(key);
+		}
+		for (int i = 0; i < 4000; ++i){
+			int key = int(rng() % 20000);
+			CHECK(tree.erase(key) == ref.erase(key));
+		}
+		std::vector<int> sorted(ref.begin(), ref.end());
+		for (int i = 0; i < 2000; ++i){
+			int key = int(rng() % 20100) - 50;
+			size_t rank = size_t(std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin());
+			CHECK(tree.rank(key) == rank);
+			if (rank < sorted.size()){
+				CHECK(tree.select(rank) == sorted[rank]);
+				CHECK(*tree.nth(rank) == sorted[rank]);
+				CHECK(tree.index_of(tree.lower_bound(key)) == rank);
+			}
+		}
+		CHECK(tree.nth(sorted.size()) == tree.end());
+		bool thrown = false;
+		try{
+			tree.select(sorted.size());
+		}
+		catch(const std::out_of_range&){
+			thrown = true;
+		}
+		CHECK(thrown);
+	}
+}
+
+//parallel builds and set operations against the std algorithms
+static void test_parallel(){
+
+	std::mt19937 rng(21);
+	std::vector<int> a, b;
+	for (int i = 0; i < 50000; ++i){
+		a.push_back(int(rng() % 100000));
+	}
+	for (int i = 0; i < 30000; ++i){
+		b.push_back(int(rng() % 100000));
+	}
+	std::set<int> refA(a.begin(), a.end()), refB(b.begin(), b.end());
+	btree<int> tree(16), other(16);
+	tree.bulk_load_parallel(a.begin(), a.end(), 4);
+	other.bulk_load_parallel(b.begin(), b.end(), 3, 0.7);
+	check_same(tree, refA);
+	check_same(other, refB);
+
+	std::vector<int> expected;
+	std::set_union(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+	btree<int> result(tree);
+	result.set_union(other, 4);
+	CHECK(std::equal(result.begin(), result.end(), expected.begin(), expected.end()));
+	btree<int> merged(tree), taken(other);
+	merged.merge(std::move(taken), 4);
+	CHECK(std::equal(merged.begin(), merged.end(), expected.begin(), expected.end()));
+
+	expected.clear();
+	std::set_intersection(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+	result = tree;
+	result.set_intersection(other, 4);
+	CHECK(std::equal(result.begin(), result.end(), expected.begin(), expected.end()));
+
+	expected.clear();
+	std::set_difference(refA.begin(), refA.end(), refB.begin(), refB.end(), std::back_inserter(expected));
+	result = tree;
+	result.set_difference(other, 4);
+	CHECK(std::equal(result.begin(), result.end(), expected.begin(), expected.end()));
+
+	// the parallel walks pass every element in range exactly once.
+	long sum = std::accumulate(refA.begin(), refA.end(), 0L);
+	std::atomic<long> walked(0);
+	CHECK(tree.parallel_for_each([&walked](int key){ walked += key; }, 4) == refA.size());
+	CHECK(walked.load() == sum);
+	long rangeSum = std::accumulate(refA.lower_bound(1000), refA.lower_bound(50000), 0L);
+	walked.store(0);
+	CHECK(tree.parallel_scan(1000, 50000, [&walked](int key){ walked += key; }, 3)
+			== size_t(std::distance(refA.lower_bound(1000), refA.lower_bound(50000))));
+	CHECK(walked.load() == rangeSum);
+	auto fold = [](long acc, int key){ return acc + key; };
+	auto combine = [](long x, long y){ return x + y; };
+	CHECK(tree.parallel_reduce(0L, fold, combine, 4) == sum);
+	CHECK(tree.parallel_reduce(1000, 50000, 0L, fold, combine, 4) == rangeSum);
+}
+
+//btree_cow against std::set, and snapshots against the set they were taken from
+static void test_cow(){
+
+	typedef btree_cow<int, std::less<int>, 4> Tree;
+	std::mt19937 rng(4);
+	std::vector<std::pair<Tree::snapshot_type, std::set<int> > > snapshots;
+	{
+		Tree tree;
+		std::set<int> ref;
+		for (int i = 0; i < 40000; ++i){
+			int key = int(rng() % 5000);
+			if (rng() % 3 != 0){
+				CHECK(tree.insert(key) == ref.insert(key).second);
+			}
+			else{
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+			if (i % 4000 == 0){
+				snapshots.emplace_back(tree.snapshot(), ref);
+			}
+		}
+		check_same(tree, ref);
+		for (int i = 0; i < 200; ++i){
+			check_bounds(tree, ref, int(rng() % 5100) - 50);
+		}
+		for (int i = 0; i < 50; ++i){
+			int lo = int(rng() % 5100) - 50;
+			check_scan(tree, ref, lo, lo + int(rng() % 300));
+		}
+		for (size_t i = 0; i < snapshots.size(); ++i){
+			check_same(snapshots[i].first, snapshots[i].second);
+		}
+		// a copy shares every node with the original until one of them writes.
+		Tree fork(tree);
+		fork.insert(-1);
+		CHECK(!tree.contains(-1) && fork.size() == tree.size() + 1);
+		tree.clear();
+		CHECK(tree.size() == 0 && tree.begin() == tree.end());
+	}
+	for (size_t i = 0; i < snapshots.size(); ++i){
+		check_same(snapshots[i].first, snapshots[i].second);
+	}
+
+	// readers get snapshots from the writer and walk them on their own
+	// threads while it goes on writing; the last holder of a node frees it.
+	// The writer only touches odd keys, and snapshot k was taken when the
+	// tree held the even keys below 2 * k, so a reader knows what it must see.
+	Tree tree;
+	std::vector<Tree::snapshot_type> handed;
+	std::mutex lock;
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 3; ++r){
+		readers.emplace_back([&, r]{
+			std::mt19937 local(unsigned(300 + r));
+			while (!stop.load()){
+				std::unique_lock<std::mutex> hold(lock);
+				if (handed.empty()){
+					continue;
+				}
+				Tree::snapshot_type snapshot(handed[local() % handed.size()]);
+				hold.unlock();
+				int evens = 0, previous = -1;
+				for (int key : snapshot){
+					CHECK(key > previous);
+					previous = key;
+					evens += key % 2 == 0;
+				}
+				CHECK(snapshot.size() >= size_t(evens));
+				CHECK(evens == 0 || snapshot.contains(2 * (evens - 1)));
+				CHECK(!snapshot.contains(2 * evens));
+			}
+		});
+	}
+	for (int i = 0; i < 20000; ++i){
+		int key = int(rng() % 4000) * 2 + 1;
+		if (rng() % 2 != 0){
+			tree.insert(key);
+		}
+		else{
+			tree.erase(key);
+		}
+		if (i % 10 == 0){
+			tree.insert(i / 10 * 2);
+			std::lock_guard<std::mutex> hold(lock);
+			handed.push_back(tree.snapshot());
+			if (handed.size() > 8){
+				handed.erase(handed.begin());
+			}
+		}
+	}
+	stop.store(true);
+	for (size_t r = 0; r < readers.size(); ++r){
+		readers[r].join();
+	}
+}
+
+//btree_string_set against std::set<std::string>, keys sharing long prefixes
+static void test_string_set(){
+
+	std::mt19937_64 rng(5);
+	const char *prefixes[] = {"https://example.com/", "https://example.com/a/", "", "\xff", "a"};
+	auto make = [&]{
+		std::string key = prefixes[rng() % 5];
+		for (size_t n = rng() % 8; n > 0; --n){
+			key += "ab\0z\xff"[rng() % 5];
+		}
+		return key;
+	};
+	btree_string_set<5> tree;
+	std::set<std::string> ref;
+	for (int round = 0; round < 4; ++round){
+		for (int i = 0; i < 4000; ++i){
+			std::string key = make();
+			CHECK(tree.insert(key) == ref.insert(key).second);
+		}
+		for (int i = 0; i < 3000; ++i){
+			std::string key = make();
+			CHECK(tree.erase(key) == ref.erase(key));
+		}
+		check_same(tree, ref);
+		for (int i = 0; i < 200; ++i){
+			std::string key = make();
+			CHECK(tree.contains(key) == (ref.count(key) == 1));
+			btree_string_set<5>::const_iterator lb = tree.lower_bound(key);
+			std::set<std::string>::const_iterator rlb = ref.lower_bound(key);
+			CHECK((lb == tree.end()) == (rlb == ref.end()));
+			if (lb != tree.end() && rlb != ref.end()){
+				CHECK(*lb == *rlb);
+			}
+		}
+		for (int i = 0; i < 50; ++i){
+			std::string lo = make(), hi = make();
+			if (hi < lo){
+				std::swap(lo, hi);
+			}
+			check_scan(tree, ref, lo, hi);
+		}
+	}
+
+	// keys that leave a node with no bytes of its own: empty keys, and keys
+	// that are all equal to the node's shared prefix.
+	btree_string_set<5> bare;
+	for (const char *key : {"", "a", "aa", "aaa", ""}){
+		bare.insert(key);
+	}
+	bare.erase("aa");
+	bare.insert("aa");
+	CHECK(bare.size() == 4 && bare.contains("") && *bare.begin() == "");
+}
+
+//btree_packed_set against std::set, with keys that pack well and keys that do not
+template<typename T>
+static void test_packed_type(unsigned seed){
+
+	std::mt19937_64 rng(seed);
+	auto make = [&]() -> T {
+		switch (rng() % 3){
+		case 0: return T(rng());
+		case 1: return T(rng() % 5000);
+		default: return T(std::numeric_limits<T>::max() - T(rng() % 100));
+		}
+	};
+	btree_packed_set<T, 8, 256> tree;
+	std::set<T> ref;
+	for (int round = 0; round < 4; ++round){
+		for (int i = 0; i < 5000; ++i){
+			T key = make();
+			CHECK(tree.insert(key) == ref.insert(key).second);
+		}
+		for (int i = 0; i < 4000; ++i){
+			T key = make();
+			CHECK(tree.erase(key) == ref.erase(key));
+		}
+		check_same(tree, ref);
+		for (int i = 0; i < 200; ++i){
+			T key = make();
+			CHECK(tree.contains(key) == (ref.count(key) == 1));
+		}
+		for (int i = 0; i < 50; ++i){
+			T lo = make(), hi = make();
+			check_scan(tree, ref, std::min(lo, hi), std::max(lo, hi));
+		}
+	}
+	// dense ascending ids, the case the packing is for.
+	tree.clear();
+	ref.clear();
+	T key = T(0);
+	for (int i = 0; i < 50000 && key < std::numeric_limits<T>::max() - 8; ++i){
+		key = T(key + T(1 + rng() % 7));
+		tree.insert(key);
+		ref.insert(key);
+	}
+	check_same(tree, ref);
+}
+
+//packed sets of a few element types
+static void test_packed_set(){
+
+	test_packed_type<uint64_t>(6);
+	test_packed_type<int64_t>(7);
+	test_packed_type<int32_t>(8);
+	test_packed_type<uint16_t>(9);
+}
+
+//btree_disk against std::set, then reopened read-write and mapped
+static void test_disk(){
+
+	typedef btree_disk<int, std::less<int>, 256> Tree;
+	std::string path = scratch("disk.db");
+	std::mt19937 rng(10);
+	std::set<int> ref;
+	{
+		Tree tree(path, btree_open_readwrite, 8);
+		for (int i = 0; i < 30000; ++i){
+			int key = int(rng() % 20000);
+			CHECK(tree.insert(key).second == ref.insert(key).second);
+			if (i % 3 == 0){
+				key = int(rng() % 20000);
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+		}
+		check_same(tree, ref);
+		for (int i = 0; i < 200; ++i){
+			check_bounds(tree, ref, int(rng() % 21000) - 500);
+		}
+	}
+	{
+		Tree tree(path, btree_open_readwrite, 16);
+		check_same(tree, ref);
+		for (int key = 20000; key < 25000; ++key){
+			tree.insert(key);
+			ref.insert(key);
+		}
+	}
+	{
+		Tree tree(path, btree_open_mapped);
+		CHECK(tree.read_only());
+		check_same(tree, ref);
+		for (int i = 0; i < 200; ++i){
+			check_bounds(tree, ref, int(rng() % 26000));
+		}
+		for (int i = 0; i < 50; ++i){
+			int lo = int(rng() % 26000);
+			check_scan(tree, ref, lo, lo + int(rng() % 2000));
+		}
+	}
+
+	// point the root past the end of the file (the metadata's root field is at byte 24).
+	{
+		int fd = ::open(path.c_str(), O_RDWR);
+		uint64_t root = 1u << 30;
+		CHECK(fd >= 0 && ::pwrite(fd, &root, sizeof(root), 24) == ssize_t(sizeof(root)));
+		::close(fd);
+	}
+	bool reported = false;
+	try{
+		Tree tree(path, btree_open_mapped);
+		tree.count(5);
+	}
+	catch(const std::runtime_error&){
+		reported = true;
+	}
+	CHECK(reported);
+	::unlink(path.c_str());
+}
+
+//a child process that writes count keys under policy, waits idle ms, and dies without closing
+static void crash_after(const std::string& path, btree_sync_policy policy, int count, int idle){
+
+	std::cout.flush();
+	pid_t pid = ::fork();
+	if (pid == 0){
+		btree_wal_options options;
+		options.sync = policy;
+		// leaked on purpose: _exit skips the destructor that would sync.
+		btree_durable<btree<int> > *tree = new btree_durable<btree<int> >(path, options);
+		for (int key = 0; key < count; ++key){
+			tree->insert(key);
+		}
+		if (policy == btree_sync_none){
+			tree->commit();
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(idle));
+		::_exit(0);
+	}
+	int status = 0;
+	CHECK(pid > 0 && ::waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+}
+
+//btree_durable: replay after a crash, checkpoints and a torn tail
+static void test_wal(){
+
+	typedef btree_durable<btree<int> > Tree;
+	std::string path = scratch("wal");
+	std::mt19937 rng(11);
+
+	// against std::set, across reopens and a checkpoint
+	remove_durable(path);
+	std::set<int> ref;
+	{
+		Tree tree(path);
+		for (int i = 0; i < 5000; ++i){
+			int key = int(rng() % 3000);
+			CHECK(tree.insert(key) == ref.insert(key).second);
+			if (i % 4 == 0){
+				key = int(rng() % 3000);
+				CHECK(tree.erase(key) == ref.erase(key));
+			}
+		}
+		check_same(tree.tree(), ref);
+	}
+	{
+		Tree tree(path);
+		check_same(tree.tree(), ref);
+		tree.checkpoint();
+		for (int key = 10000; key < 10100; ++key){
+			tree.insert(key);
+			ref.insert(key);
+		}
+	}
+	{
+		Tree tree(path);
+		check_same(tree.tree(), ref);
+	}
+
+	// every acknowledged insert survives under sync always, and under none after commit.
+	remove_durable(path);
+	crash_after(path, btree_sync_always, 500, 0);
+	{
+		Tree tree(path);
+		CHECK(tree.tree().size() == 500);
+	}
+	remove_durable(path);
+	crash_after(path, btree_sync_none, 500, 0);
+	{
+		Tree tree(path);
+		CHECK(tree.tree().size() == 500);
+	}
+	// batch: a group short of groupOps is synced once it is groupInterval old,
+	// even though nothing else is written after it.
+	for (int count : {1, 3, 300}){
+		remove_durable(path);
+		crash_after(path, btree_sync_batch, count, 100);
+		Tree tree(path);
+		CHECK(tree.tree().size() == size_t(count));
+	}
+
+	// a torn last record is dropped, and the log goes on after the good ones.
+	remove_durable(path);
+	{
+		btree_wal_options options;
+		options.sync = btree_sync_none;
+		Tree tree(path, options);
+		for (int key = 0; key < 100; ++key){
+			tree.insert(key);
+		}
+	}
+	{
+		int fd = ::open((path + ".wal").c_str(), O_RDWR);
+		struct stat st;
+		CHECK(fd >= 0 && ::fstat(fd, &st) == 0 && ::ftruncate(fd, st.st_size - 3) == 0);
+		::close(fd);
+	}
+	{
+		Tree tree(path);
+		CHECK(tree.tree().size() == 99 && tree.tree().count(99) == 0);
+		tree.insert(500);
+	}
+	{
+		Tree tree(path);
+		CHECK(tree.tree().size() == 100 && tree.tree().count(500) == 1);
+	}
+	remove_durable(path);
+}
+
+//btree_concurrent against std::set on one thread, then writers and readers at once
+static void test_concurrent(){
+
+	{
+		btree_concurrent<long, std::less<long>, 4> tree;
+		std::set<long> ref;
+		std::mt19937 rng(12);
+		for (int i = 0; i < 50000; ++i){
+			long key = long(rng() % 5000);
+			if (rng() % 3 != 0){
+				CHECK(tree.insert(key) == ref.insert(key).second);
+			}
+			else{
+				CHECK(tree.erase(key) == (ref.erase(key) == 1));
+			}
+		}
+		CHECK(tree.size() == ref.size());
+		std::vector<long> all;
+		tree.scan(-1, 5001, [&](long key){ all.push_back(key); });
+		CHECK(std::equal(all.begin(), all.end(), ref.begin(), ref.end()));
+		for (int i = 0; i < 50; ++i){
+			long lo = long(rng() % 5100) - 50;
+			check_scan(tree, ref, lo, lo + long(rng() % 300));
+		}
+		for (long key : ref){
+			tree.erase(key);
+		}
+		CHECK(tree.size() == 0 && !tree.contains(*ref.begin()));
+	}
+
+	// an emptied tree shrinks back to one leaf, so filling and emptying it
+	// over and over, a little further up each time, needs no more nodes
+	// than the first few rounds did.
+	{
+		btree_concurrent<long, std::less<long>, 4, counting_allocator<long> > tree;
+		long grown = 0;
+		for (long round = 0; round < 30; ++round){
+			for (long key = round * 500; key < round * 500 + 2000; ++key){
+				tree.insert(key);
+			}
+			for (long key = round * 500; key < round * 500 + 2000; ++key){
+				tree.erase(key);
+			}
+			CHECK(tree.size() == 0);
+			if (round == 3){
+				grown = allocated_bytes;
+			}
+		}
+		CHECK(allocated_bytes <= grown);
+	}
+
+	// each writer owns the keys equal to its number modulo writers, so it can
+	// keep its own reference; the keys ending in 9 are never touched, so
+	// readers know exactly which of them they must see.
+	const long writers = 4, readers = 3, range = 20000;
+	btree_concurrent<long, std::less<long>, 8> tree;
+	for (long i = 0; i < range; i += 2){
+		tree.insert(i * 10 + 9);
+	}
+	std::atomic<bool> stop(false);
+	std::vector<std::thread> threads;
+	for (long w = 0; w < writers; ++w){
+		threads.emplace_back([&, w]{
+			std::mt19937 rng(unsigned(100 + w));
+			std::set<long> mine;
+			for (int i = 0; i < 60000; ++i){
+				long key = (long(rng() % range) * writers + w) * 10;
+				if (rng() % 2 != 0){
+					CHECK(tree.insert(key) == mine.insert(key).second);
+				}
+				else{
+					CHECK(tree.erase(key) == (mine.erase(key) == 1));
+				}
+			}
+			for (long key : mine){
+				CHECK(tree.contains(key));
+				tree.erase(key);
+			}
+		});
+	}
+	for (long r = 0; r < readers; ++r){
+		threads.emplace_back([&, r]{
+			std::mt19937 rng(unsigned(200 + r));
+			while (!stop.load()){
+				long lo = long(rng() % (range * 10)), previous = -1;
+				size_t fixed = 0;
+				tree.scan(lo, lo + 2000, [&](long key){
+					CHECK(key > previous);
+					previous = key;
+					fixed += key % 10 == 9;
+				});
+				size_t expected = 0;
+				for (long key = lo; key < lo + 2000; ++key){
+					expected += key % 10 == 9 && (key / 10) % 2 == 0 && key / 10 < range;
+				}
+				CHECK(fixed == expected);
+				long i = 2 * long(rng() % (range / 2));
+				CHECK(tree.contains(i * 10 + 9));
+			}
+		});
+	}
+	for (long w = 0; w < writers; ++w){
+		threads[w].join();
+	}
+	stop.store(true);
+	for (long r = 0; r < readers; ++r){
+		threads[writers + r].join();
+	}
+	CHECK(tree.size() == size_t(range / 2));
+	CHECK(tree.scan(-1, range * 10, [](long){}) == size_t(range / 2));
+}
+
+//btree_epoch: readers never see a freed object, and short lived threads leave nothing behind
+static void test_epoch(){
+
+	struct Object{
+		long value;
+	};
+	static std::atomic<long> live(0);
+	struct Release{
+		static void object(void*, void *ptr){
+			delete static_cast<Object*>(ptr);
+			--live;
+		}
+	};
+
+	{
+		btree_epoch domain;
+		std::atomic<Object*> current(new Object{0});
+		++live;
+		std::atomic<bool> stop(false);
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; ++r){
+			readers.emplace_back([&]{
+				long last = 0;
+				while (!stop.load()){
+					btree_epoch::guard pin(domain);
+					long value = current.load(std::memory_order_acquire)->value;
+					CHECK(value >= last);
+					last = value;
+				}
+			});
+		}
+		for (long i = 1; i < 100000; ++i){
+			btree_epoch::guard pin(domain);
+			Object *old = current.exchange(new Object{i}, std::memory_order_acq_rel);
+			++live;
+			domain.retire(old, &Release::object, nullptr);
+		}
+		stop.store(true);
+		for (size_t r = 0; r < readers.size(); ++r){
+			readers[r].join();
+		}
+
+		// threads that retire a little and exit hand their records on.
+		std::vector<std::thread> churn;
+		for (int t = 0; t < 4; ++t){
+			churn.emplace_back([&]{
+				for (int k = 0; k < 20; ++k){
+					std::thread worker([&]{
+						for (int i = 0; i < 50; ++i){
+							btree_epoch::guard pin(domain);
+							++live;
+							domain.retire(new Object{i}, &Release::object, nullptr);
+						}
+					});
+					worker.join();
+				}
+			});
+		}
+		for (size_t t = 0; t < churn.size(); ++t){
+			churn[t].join();
+		}
+		// unpinning alone drains what is left.
+		for (int i = 0; i < 1000; ++i){
+			btree_epoch::guard pin(domain);
+		}
+		CHECK(live.load() < 200);
+		delete current.load();
+		--live;
+	}
+	CHECK(live.load() == 0);
+}
+
+struct test_case{
+	const char *name;
+	void (*run)();
+};
+
+int main(int argc, char **argv){
+
+	const test_case tests[] = {
+		{"set", &test_set},
+		{"bulk_load", &test_bulk_load},
+		{"copy", &test_copy},
+		{"allocator", &test_allocator},
+		{"iterate", &test_iterate},
+		{"map", &test_map},
+		{"multimap", &test_multimap},
+		{"comparator", &test_comparator},
+		{"batch", &test_batch},
+		{"serialize", &test_serialize},
+		{"rank", &test_rank},
+		{"parallel", &test_parallel},
+		{"cow", &test_cow},
+		{"string_set", &test_string_set},
+		{"packed_set", &test_packed_set},
+		{"disk", &test_disk},
+		{"wal", &test_wal},
+		{"concurrent", &test_concurrent},
+		{"epoch", &test_epoch},
+	};
+	std::string filter = argc > 1 ? argv[1] : "";
+
+	char dir[] = "/tmp/btree_test.XXXXXX";
+	if (::mkdtemp(dir) == nullptr){
+		std::perror("btree_test: mkdtemp");
+		return 1;
+	}
+	test_dir = dir;
+
+	for (const test_case& test : tests){
+		if (std::string(test.name).find(filter) == std::string::npos){
+			continue;
+		}
+		size_t before = test_failures.load();
+		test.run();
+		std::cout << test.name << ": " << (test_failures.load() == before ? "ok" : "FAILED") << std::endl;
+	}
+	::rmdir(dir);
+	return test_failures.load() == 0 ? 0 : 1;
+}
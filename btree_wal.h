@@ -0,0 +1,740 @@
+/**
+ * Write-ahead logging for btree and btree_map.
+ *
+ * btree_durable keeps a tree in memory and makes its inserts and erases
+ * survive a crash.  Every mutation appends a record to a log file,
+ * and on open the tree is rebuilt from its last snapshot (btree_serialize.h)
+ * plus the records logged after it.  checkpoint() writes a new snapshot
+ * and empties the log.
+ *
+ * The log uses group commit.  A mutation appends its record to a memory
+ * buffer and, depending on the btree_sync_policy, may then wait for it to
+ * reach the disk.  Whoever waits first becomes the leader: it writes the
+ * whole buffer, records from every thread included, and makes it durable
+ * with a single fdatasync.  Threads that append while the leader is busy
+ * form the next group.  So the number of syncs follows the sync rate of
+ * the disk, not the rate of mutations.  Under btree_sync_batch a flusher
+ * thread owned by the log also syncs any record that has waited for
+ * groupInterval, so a burst followed by silence still reaches the disk.
+ *
+ * Records carry a checksum.  Replay stops at the first record that is
+ * incomplete or damaged, which is what a crash in the middle of a write
+ * leaves behind, and cuts the log back to the last good record.
+ **/
+
+#ifndef BTREE_WAL_H
+#define BTREE_WAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "btree_serialize.h"
+#include "btree_page_cache.h"
+
+// when a logged mutation reaches the disk.
+enum btree_sync_policy{
+	btree_sync_always,	// before the mutation returns; concurrent mutations share one sync
+	btree_sync_batch,	// once a group of groupOps records, or groupInterval, has built up
+	btree_sync_none		// on commit(), checkpoint() and close only; a full buffer is written unsynced
+};
+
+struct btree_wal_options{
+	btree_sync_policy sync = btree_sync_batch;
+	// btree_sync_batch: sync once this many records are waiting...
+	size_t groupOps = 256;
+	// ...or once the oldest waiting record is this old.
+	std::chrono::microseconds groupInterval = std::chrono::milliseconds(10);
+	// btree_sync_none: hand the buffer to the OS once it reaches this size.
+	size_t bufferBytes = 1 << 16;
+};
+
+// crc32c of data, bytewise from a table built on first use.
+inline uint32_t btree_crc32c(const void *data, size_t n, uint32_t crc = 0){
+
+	struct Table{
+		uint32_t entry[256];
+		Table(){
+			for (uint32_t i = 0; i < 256; ++i){
+				uint32_t c = i;
+				for (int bit = 0; bit < 8; ++bit){
+					c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+				}
+				entry[i] = c;
+			}
+		}
+	};
+	static const Table table;
+
+	const unsigned char *p = static_cast<const unsigned char*>(data);
+	crc = ~crc;
+	for (size_t i = 0; i < n; ++i){
+		crc = table.entry[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// fsyncs the directory holding path, so a file created or renamed there is durable.
+inline void btree_sync_directory(const std::string& path){
+
+	std::string::size_type slash = path.rfind('/');
+	std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+	int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd < 0){
+		throw std::system_error(errno, std::generic_category(), "btree: cannot open directory " + dir);
+	}
+	int rc = ::fsync(fd);
+	int err = errno;
+	::close(fd);
+	if (rc != 0){
+		throw std::system_error(err, std::generic_category(), "btree: cannot sync directory " + dir);
+	}
+}
+
+/**
+ * The log file: framing, replay and group commit. Records are numbered
+ * from 1 in append order (their LSN). append and the sync calls may be
+ * made from several threads.
+ */
+class btree_wal{
+
+public:
+  /**
+   * Opens the log at path, creating it if it does not exist.
+   * @throws std::system_error on I/O errors, std::runtime_error if the
+   *         file is not a log
+   */
+  btree_wal(const std::string& path, const btree_wal_options& options);
+
+  btree_wal(const btree_wal&) = delete;
+  btree_wal& operator=(const btree_wal&) = delete;
+
+  /**
+   * Stops the flusher, syncs whatever is still buffered (ignoring errors)
+   * and closes the log.
+   */
+  ~btree_wal();
+
+  /**
+   * Calls fn(op, payload, size) for every intact record, in order, and
+   * cuts off a damaged or incomplete tail. Must run before the first append.
+   * @return the number of records replayed.
+   */
+  template<typename Fn>
+  size_t replay(Fn fn);
+
+  /**
+   * Buffers a record.
+   * @return its LSN.
+   */
+  uint64_t append(uint32_t op, const void *payload, size_t size);
+
+  /**
+   * Applies the sync policy to the record lsn just appended: waits for it
+   * to be durable, starts a group sync, or leaves it buffered.
+   */
+  void settle(uint64_t lsn);
+
+  /**
+   * Waits until every record up to lsn is durable, syncing them (and
+   * everything appended with them) if no other thread already is.
+   */
+  void sync(uint64_t lsn);
+
+  /**
+   * sync for every record appended so far.
+   */
+  void sync();
+
+  /**
+   * Empties the log, dropping buffered records too. Only for use once
+   * their effects are durable elsewhere, i.e. in a snapshot.
+   */
+  void reset();
+
+  // fdatasyncs issued so far.
+  uint64_t syncs() const;
+
+private:
+	struct FileHeader{
+		char magic[8];
+		uint32_t formatVersion;
+		uint32_t reserved;
+	};
+
+	struct RecordHeader{
+		uint32_t length;	// payload bytes
+		uint32_t checksum;	// crc32c of op and payload
+		uint32_t op;
+	};
+
+	static constexpr uint32_t currentFormat = 1;
+
+	// hands the buffer to the OS without syncing; needs the lock and no leader at work.
+	void writePending();
+
+	void check() const;
+
+	// btree_sync_batch: syncs whatever has waited groupInterval, until stopping.
+	void flushLoop();
+
+	int fd;
+	btree_wal_options options;
+	mutable std::mutex lock;
+	std::condition_variable synced;
+	std::condition_variable flushWake;	// the flusher: a first record was buffered, or stop
+	std::vector<char> pending;
+	std::chrono::steady_clock::time_point oldestPending;	// when the first record in pending was appended
+	uint64_t appended;	// last LSN appended
+	uint64_t written;	// last LSN handed to the OS
+	uint64_t durable;	// last LSN known to be on disk
+	uint64_t syncCount;
+	bool leading;		// a thread is writing and syncing a group outside the lock
+	bool failed;		// an I/O error left the log behind the tree
+	bool stopping;		// the flusher should exit
+	std::thread flusher;
+};
+
+//open or create the log
+inline btree_wal::btree_wal(const std::string& path, const btree_wal_options& options_)
+	:fd(-1), options(options_), appended(0), written(0), durable(0), syncCount(0), leading(false), failed(false), stopping(false){
+
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0){
+		throw std::system_error(errno, std::generic_category(), "btree: cannot open log " + path);
+	}
+	try{
+		struct stat st;
+		if (::fstat(fd, &st) != 0){
+			throw std::system_error(errno, std::generic_category(), "btree: cannot stat log " + path);
+		}
+		FileHeader header = {};
+		if (st.st_size == 0){
+			std::memcpy(header.magic, "BTREEWAL", sizeof(header.magic));
+			header.formatVersion = currentFormat;
+			btree_write_at(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+			if (::fsync(fd) != 0){
+				throw std::system_error(errno, std::generic_category(), "btree: cannot sync log " + path);
+			}
+			btree_sync_directory(path);
+		}
+		else{
+			btree_read_at(fd, reinterpret_cast<char*>(&header), sizeof(header), 0);
+			if (size_t(st.st_size) < sizeof(header) || std::memcmp(header.magic, "BTREEWAL", sizeof(header.magic)) != 0 ||
+					header.formatVersion != currentFormat){
+				throw std::runtime_error("btree: " + path + " is not a btree log");
+			}
+		}
+	}
+	catch(...){
+		::close(fd);
+		throw;
+	}
+	if (options.sync == btree_sync_batch){
+		flusher = std::thread(&btree_wal::flushLoop, this);
+	}
+}
+
+//destructor
+inline btree_wal::~btree_wal(){
+
+	if (flusher.joinable()){
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		flushWake.notify_one();
+		flusher.join();
+	}
+	try{
+		sync();
+	}
+	catch(...){
+	}
+	::close(fd);
+}
+
+//replay the intact prefix of the log
+template<typename Fn>
+size_t btree_wal::replay(Fn fn){
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0){
+		throw std::system_error(errno, std::generic_category(), "btree: cannot stat log");
+	}
+	std::vector<char> contents(size_t(st.st_size) - sizeof(FileHeader));
+	btree_read_at(fd, contents.data(), contents.size(), sizeof(FileHeader));
+
+	size_t records = 0;
+	size_t offset = 0;
+	while (contents.size() - offset >= sizeof(RecordHeader)){
+		RecordHeader header;
+		std::memcpy(&header, contents.data() + offset, sizeof(header));
+		const char *payload = contents.data() + offset + sizeof(header);
+		if (header.length > contents.size() - offset - sizeof(header)){
+			break;
+		}
+		uint32_t crc = btree_crc32c(&header.op, sizeof(header.op));
+		if (btree_crc32c(payload, header.length, crc) != header.checksum){
+			break;
+		}
+		fn(header.op, payload, size_t(header.length));
+		offset += sizeof(header) + header.length;
+		++records;
+	}
+
+	if (offset != contents.size()){
+		// a torn write from a crash: drop it so new records follow the last good one.
+		if (::ftruncate(fd, off_t(sizeof(FileHeader) + offset)) != 0 || ::fsync(fd) != 0){
+			throw std::system_error(errno, std::generic_category(), "btree: cannot truncate log");
+		}
+	}
+	return records;
+}
+
+//buffer a record
+inline uint64_t btree_wal::append(uint32_t op, const void *payload, size_t size){
+
+	std::lock_guard<std::mutex> guard(lock);
+	check();
+	RecordHeader header;
+	header.length = uint32_t(size);
+	header.op = op;
+	header.checksum = btree_crc32c(payload, size, btree_crc32c(&header.op, sizeof(header.op)));
+	// pending is also empty while a leader writes out the previous group, so
+	// the clock restarts with the first record the next group will carry.
+	if (pending.empty()){
+		oldestPending = std::chrono::steady_clock::now();
+		if (options.sync == btree_sync_batch){
+			flushWake.notify_one();
+		}
+	}
+	const char *bytes = reinterpret_cast<const char*>(&header);
+	pending.insert(pending.end(), bytes, bytes + sizeof(header));
+	pending.insert(pending.end(), static_cast<const char*>(payload), static_cast<const char*>(payload) + size);
+	return ++appended;
+}
+
+//apply the sync policy
+inline void btree_wal::settle(uint64_t lsn){
+
+	switch (options.sync){
+	case btree_sync_always:
+		sync(lsn);
+		return;
+	case btree_sync_batch:{
+		// a full group syncs here; an old one may too, if it beats the flusher.
+		std::unique_lock<std::mutex> guard(lock);
+		bool due = appended - durable >= options.groupOps ||
+				(!pending.empty() && std::chrono::steady_clock::now() - oldestPending >= options.groupInterval);
+		guard.unlock();
+		if (due){
+			sync(lsn);
+		}
+		return;
+	}
+	case btree_sync_none:{
+		std::lock_guard<std::mutex> guard(lock);
+		if (pending.size() >= options.bufferBytes && !leading){
+			writePending();
+		}
+		return;
+	}
+	}
+}
+
+//group commit: the first waiter leads, writing and syncing everything
+//buffered; later waiters either ride along or lead the next group.
+inline void btree_wal::sync(uint64_t lsn){
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (durable < lsn){
+		check();
+		if (leading){
+			synced.wait(guard);
+			continue;
+		}
+		leading = true;
+		std::vector<char> group;
+		group.swap(pending);
+		uint64_t target = appended;
+		guard.unlock();
+		try{
+			btree_write_at(fd, group.data(), group.size(), 0);
+			if (::fdatasync(fd) != 0){
+				throw std::system_error(errno, std::generic_category(), "btree: cannot sync log");
+			}
+		}
+		catch(...){
+			guard.lock();
+			leading = false;
+			failed = true;
+			synced.notify_all();
+			throw;
+		}
+		guard.lock();
+		written = target;
+		durable = target;
+		++syncCount;
+		leading = false;
+		// reuse the group's buffer if nothing new has been buffered meanwhile.
+		if (pending.empty()){
+			group.clear();
+			pending.swap(group);
+		}
+		synced.notify_all();
+	}
+}
+
+//sync everything
+inline void btree_wal::sync(){
+
+	uint64_t lsn;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		lsn = appended;
+	}
+	sync(lsn);
+}
+
+//drop the log's contents
+inline void btree_wal::reset(){
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (leading){
+		synced.wait(guard);
+	}
+	check();
+	pending.clear();
+	if (::ftruncate(fd, off_t(sizeof(FileHeader))) != 0 || ::fsync(fd) != 0){
+		failed = true;
+		throw std::system_error(errno, std::generic_category(), "btree: cannot truncate log");
+	}
+	written = appended;
+	durable = appended;
+	synced.notify_all();
+}
+
+//sync count
+inline uint64_t btree_wal::syncs() const{
+
+	std::lock_guard<std::mutex> guard(lock);
+	return syncCount;
+}
+
+//unsynced write of the buffer
+inline void btree_wal::writePending(){
+
+	try{
+		// O_APPEND: the offset is ignored and records land at the end of the file.
+		btree_write_at(fd, pending.data(), pending.size(), 0);
+	}
+	catch(...){
+		failed = true;
+		throw;
+	}
+	pending.clear();
+	written = appended;
+}
+
+//batch flusher: sleep until the oldest buffered record is groupInterval
+//old, then sync it with everything buffered after it. An I/O error ends
+//the thread; the next mutation reports it.
+inline void btree_wal::flushLoop(){
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (!stopping && !failed){
+		if (pending.empty()){
+			flushWake.wait(guard);
+			continue;
+		}
+		std::chrono::steady_clock::time_point deadline = oldestPending + options.groupInterval;
+		if (std::chrono::steady_clock::now() < deadline){
+			flushWake.wait_until(guard, deadline);
+			continue;
+		}
+		uint64_t target = appended;
+		guard.unlock();
+		try{
+			sync(target);
+		}
+		catch(...){
+		}
+		guard.lock();
+	}
+}
+
+//refuse to go on after an I/O error
+inline void btree_wal::check() const{
+
+	if (failed){
+		throw std::runtime_error("btree: the log failed earlier; reopen to recover");
+	}
+}
+
+/**
+ * A btree or btree_map whose inserts and erases are logged to path + ".wal"
+ * and checkpointed to path + ".snap". Keys and mapped values must be
+ * trivially copyable, and keys unique: replay may apply records that
+ * are already in the snapshot when a crash interrupted a checkpoint, which
+ * is harmless only because unique inserts and erases are idempotent.
+ *
+ * The mutating calls may be made from several threads at once; that is
+ * what lets group commit share syncs. tree() is for readers that are
+ * otherwise kept apart from the writers.
+ */
+template<typename Tree>
+class btree_durable{
+
+ public:
+	typedef Tree tree_type;
+	typedef typename Tree::key_type key_type;
+	typedef typename Tree::mapped_storage mapped_storage;
+
+	static constexpr bool has_mapped = Tree::has_mapped;
+
+	static_assert(!Tree::multi, "btree_durable needs unique keys, so that replaying a record twice is harmless");
+	static_assert(std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<mapped_storage>::value,
+			"btree_durable logs elements as raw bytes, so they must be trivially copyable");
+
+  /**
+   * Opens the tree stored under path: loads the snapshot, if there is
+   * one, into tree and replays the log on top of it.
+   * @param tree an empty tree configured as wanted (width, comparator)
+   * @throws std::system_error on I/O errors, std::runtime_error if the
+   *         files do not hold a tree of this type
+   */
+  btree_durable(const std::string& path, const btree_wal_options& options = btree_wal_options(), Tree tree = Tree());
+
+  btree_durable(const btree_durable&) = delete;
+  btree_durable& operator=(const btree_durable&) = delete;
+
+  /**
+    * Inserts key into a set.
+    * @return true if it was not already present.
+    */
+  bool insert(const key_type& key);
+
+  /**
+    * Maps key to obj in a map, inserting or assigning.
+    * @return true if key was inserted.
+    */
+  bool insert_or_assign(const key_type& key, const mapped_storage& obj);
+
+  /**
+    * @return the number of elements removed (0 or 1).
+    */
+  size_t erase(const key_type& key);
+
+  /**
+    * Makes every mutation made so far durable, whatever the sync policy.
+    */
+  void commit();
+
+  /**
+    * Writes a snapshot of the tree next to the log and then empties the
+    * log, so the next open replays only what follows. Mutations wait
+    * while it runs.
+    */
+  void checkpoint();
+
+  const Tree& tree() const;
+
+  // fdatasyncs of the log so far; with group commit, usually far fewer than mutations.
+  uint64_t syncs() const;
+
+ private:
+	enum Op : uint32_t{ opInsert = 1, opErase = 2 };
+
+	// replays one log record onto the tree.
+	void redo(uint32_t op, const char *payload, size_t size);
+
+	void loadSnapshot();
+
+	std::string snapshotPath;
+	Tree contents;
+	std::mutex lock;
+	btree_wal log;
+};
+
+//load the snapshot, then replay the log onto it
+template<typename Tree>
+btree_durable<Tree>::btree_durable(const std::string& path, const btree_wal_options& options, Tree tree)
+	:snapshotPath(path + ".snap"), contents(std::move(tree)), log(path + ".wal", options){
+
+	loadSnapshot();
+	log.replay([this](uint32_t op, const char *payload, size_t size){
+		redo(op, payload, size);
+	});
+}
+
+//read the snapshot file, if there is one
+template<typename Tree>
+void btree_durable<Tree>::loadSnapshot(){
+
+	int fd = ::open(snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0){
+		if (errno == ENOENT){
+			return;
+		}
+		throw std::system_error(errno, std::generic_category(), "btree: cannot open " + snapshotPath);
+	}
+	try{
+		struct stat st;
+		if (::fstat(fd, &st) != 0){
+			throw std::system_error(errno, std::generic_category(), "btree: cannot stat " + snapshotPath);
+		}
+		std::vector<std::byte> bytes(size_t(st.st_size));
+		btree_read_at(fd, reinterpret_cast<char*>(bytes.data()), bytes.size(), 0);
+		contents.deserialize(bytes.data(), bytes.size());
+	}
+	catch(...){
+		::close(fd);
+		throw;
+	}
+	::close(fd);
+}
+
+//apply a logged mutation
+template<typename Tree>
+void btree_durable<Tree>::redo(uint32_t op, const char *payload, size_t size){
+
+	key_type key;
+	if (op == opErase && size == sizeof(key_type)){
+		std::memcpy(&key, payload, sizeof(key));
+		contents.erase(key);
+		return;
+	}
+	if (op == opInsert && size == sizeof(key_type) + (has_mapped ? sizeof(mapped_storage) : 0)){
+		std::memcpy(&key, payload, sizeof(key));
+		if constexpr (has_mapped){
+			mapped_storage obj;
+			std::memcpy(&obj, payload + sizeof(key), sizeof(obj));
+			contents.insert_or_assign(key, obj);
+		}
+		else{
+			contents.insert(key);
+		}
+		return;
+	}
+	throw std::runtime_error("btree: the log holds records of another tree type");
+}
+
+//logged insert
+template<typename Tree>
+bool btree_durable<Tree>::insert(const key_type& key){
+
+	static_assert(!has_mapped, "btree_durable::insert is for sets; maps use insert_or_assign");
+	uint64_t lsn;
+	bool inserted;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		inserted = contents.insert(key).second;
+		lsn = log.append(opInsert, &key, sizeof(key));
+	}
+	log.settle(lsn);
+	return inserted;
+}
+
+//logged insert or assign
+template<typename Tree>
+bool btree_durable<Tree>::insert_or_assign(const key_type& key, const mapped_storage& obj){
+
+	static_assert(has_mapped, "btree_durable::insert_or_assign is for maps; sets use insert");
+	char payload[sizeof(key_type) + sizeof(mapped_storage)];
+	std::memcpy(payload, &key, sizeof(key));
+	std::memcpy(payload + sizeof(key), &obj, sizeof(obj));
+	uint64_t lsn;
+	bool inserted;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		inserted = contents.insert_or_assign(key, obj).second;
+		lsn = log.append(opInsert, payload, sizeof(payload));
+	}
+	log.settle(lsn);
+	return inserted;
+}
+
+//logged erase
+template<typename Tree>
+size_t btree_durable<Tree>::erase(const key_type& key){
+
+	uint64_t lsn;
+	size_t erased;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		erased = contents.erase(key);
+		lsn = log.append(opErase, &key, sizeof(key));
+	}
+	log.settle(lsn);
+	return erased;
+}
+
+//commit
+template<typename Tree>
+void btree_durable<Tree>::commit(){
+
+	log.sync();
+}
+
+//snapshot to a temporary file, rename it over the old snapshot, then empty the log.
+template<typename Tree>
+void btree_durable<Tree>::checkpoint(){
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<std::byte> bytes(contents.serialized_size());
+	contents.serialize(bytes.data(), bytes.size());
+
+	std::string temp = snapshotPath + ".tmp";
+	int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0){
+		throw std::system_error(errno, std::generic_category(), "btree: cannot create " + temp);
+	}
+	try{
+		btree_write_at(fd, reinterpret_cast<const char*>(bytes.data()), bytes.size(), 0);
+		if (::fsync(fd) != 0){
+			throw std::system_error(errno, std::generic_category(), "btree: cannot sync " + temp);
+		}
+	}
+	catch(...){
+		::close(fd);
+		::unlink(temp.c_str());
+		throw;
+	}
+	::close(fd);
+	if (::rename(temp.c_str(), snapshotPath.c_str()) != 0){
+		throw std::system_error(errno, std::generic_category(), "btree: cannot install " + snapshotPath);
+	}
+	btree_sync_directory(snapshotPath);
+	// a crash before this point replays the whole log onto the new snapshot, which is harmless.
+	log.reset();
+}
+
+//tree access
+template<typename Tree>
+const Tree& btree_durable<Tree>::tree() const{
+	return contents;
+}
+
+//sync count
+template<typename Tree>
+uint64_t btree_durable<Tree>::syncs() const{
+	return log.syncs();
+}
+
+#endif
+//**********************************